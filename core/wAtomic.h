@@ -37,11 +37,29 @@ public:
         mRep.store(v, std::memory_order_relaxed);
     }
 
+    // 顺序一致（seq_cst）读写：写后读不被重排（如先发布自身位置、再检查对方位置的唤醒判断）
+    inline T Load() const {
+        return mRep.load(std::memory_order_seq_cst);
+    }
+
+    inline void Store(T v) {
+        mRep.store(v, std::memory_order_seq_cst);
+    }
+
     // 更改为v并返回原来的值
     inline T Exchange(T v) {
         return mRep.exchange(v, std::memory_order_acq_rel);
     }
 
+    // 加v（减v）并返回原来的值
+    inline T FetchAdd(T v) {
+        return mRep.fetch_add(v, std::memory_order_acq_rel);
+    }
+
+    inline T FetchSub(T v) {
+        return mRep.fetch_sub(v, std::memory_order_acq_rel);
+    }
+
     // 比较被封装的值(weak)与参数expected所指定的值的物理内容是否相等，如果相等，则用v替换原子对象的旧值；如果不相等，则用原子对象的旧值替换expected
     // 
     // 调用该函数之后，如果被该原子对象封装的值与参数 expected 所指定的值不相等，expected 中的内容就是原子对象的旧值。
@@ -70,6 +70,98 @@ struct wChannelReqTerminate_t : public wChannelReqCmd_s {
     wChannelReqTerminate_t() : wChannelReqCmd_s(CHANNEL_REQ_TERMINATE) { }
 };
 
+// 优雅退出进度（worker -> master）
+const uint8_t CHANNEL_REQ_DRAIN = 14;
+struct wChannelReqDrain_t : public wChannelReqCmd_s {
+    int32_t mSlot;
+    int32_t mConn;	// 剩余连接数
+    wChannelReqDrain_t() : wChannelReqCmd_s(CHANNEL_REQ_DRAIN), mSlot(-1), mConn(-1) { }
+
+    inline void set_slot(int32_t slot) {
+        mSlot = slot;
+    }
+    inline void set_conn(int32_t conn) {
+        mConn = conn;
+    }
+    inline int32_t slot() {
+        return mSlot;
+    }
+    inline int32_t conn() {
+        return mConn;
+    }
+};
+
+// 连接迁移指令（master -> 源worker）：向slot迁移至多num个连接
+const uint8_t CHANNEL_REQ_REBALANCE = 15;
+struct wChannelReqRebalance_t : public wChannelReqCmd_s {
+    int32_t mSlot;	// 目标slot
+    int32_t mNum;
+    wChannelReqRebalance_t() : wChannelReqCmd_s(CHANNEL_REQ_REBALANCE), mSlot(-1), mNum(0) { }
+
+    inline void set_slot(int32_t slot) {
+        mSlot = slot;
+    }
+    inline void set_num(int32_t num) {
+        mNum = num;
+    }
+    inline int32_t slot() {
+        return mSlot;
+    }
+    inline int32_t num() {
+        return mNum;
+    }
+};
+
+// 连接迁移（源worker -> 目标worker）：连接描述符随消息以SCM_RIGHTS传递
+// 消息体后依次为接收缓冲未解析数据、发送缓冲未发送数据、业务状态（wTask::SaveState）
+const uint8_t CHANNEL_REQ_MIGRATE = 16;
+struct wChannelReqMigrate_t : public wChannelReqCmd_s {
+    int32_t mSlot;	// 源slot
+    int32_t mFd;
+    uint8_t mProto;	// SockProto
+    uint32_t mRecvLen;
+    uint32_t mSendLen;
+    uint32_t mStateLen;
+    wChannelReqMigrate_t() : wChannelReqCmd_s(CHANNEL_REQ_MIGRATE), mSlot(-1), mFd(-1), mProto(0), mRecvLen(0), mSendLen(0), mStateLen(0) { }
+
+    inline void set_slot(int32_t slot) {
+        mSlot = slot;
+    }
+    inline void set_fd(int32_t fd) {
+        mFd = fd;
+    }
+    inline void set_proto(uint8_t proto) {
+        mProto = proto;
+    }
+    inline void set_recv_len(uint32_t len) {
+        mRecvLen = len;
+    }
+    inline void set_send_len(uint32_t len) {
+        mSendLen = len;
+    }
+    inline void set_state_len(uint32_t len) {
+        mStateLen = len;
+    }
+    inline int32_t slot() {
+        return mSlot;
+    }
+    inline int32_t fd() {
+        return mFd;
+    }
+    inline uint8_t proto() {
+        return mProto;
+    }
+    inline uint32_t recv_len() {
+        return mRecvLen;
+    }
+    inline uint32_t send_len() {
+        return mSendLen;
+    }
+    inline uint32_t state_len() {
+        return mStateLen;
+    }
+};
+
 #pragma pack()
 
 }	// namespace hnet
@@ -0,0 +1,187 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sys/eventfd.h>
+#include "wChannelRing.h"
+#include "wEnv.h"
+#include "wShm.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+wChannelRing::wChannelRing(wEnv* env, uint32_t workers, size_t len) : mEnv(env), mShm(NULL), mBase(NULL), mSlots(0), mGroup(std::max(workers, 1U)),
+mLen(kPageSize), mSelf(kMaxProcess), mNext(0), mEventFD(NULL) {
+	// 新旧两代worker各一组
+	mSlots = std::min(mGroup * 2, kMaxProcess) / mGroup * mGroup;
+	while (mLen < len) {
+		mLen <<= 1;
+	}
+}
+
+wChannelRing::~wChannelRing() {
+	if (mEventFD) {
+		for (uint32_t i = 0; i < mSlots; i++) {
+			if (mEventFD[i] != kFDUnknown) {
+				close(mEventFD[i]);
+			}
+		}
+		HNET_DELETE_VEC(mEventFD);
+	}
+	if (mShm) {
+		mShm->Remove();
+		HNET_DELETE(mShm);
+	}
+}
+
+int wChannelRing::Create() {
+	size_t size = static_cast<size_t>(mSlots) * (mGroup - 1) * (sizeof(RingHead_t) + mLen);
+	if (mEnv->NewShm(soft::GetAcceptPath(), &mShm, size + kPageSize) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Create NewShm() failed", "");
+		return -1;
+	} else if (mShm->CreateShm('c') == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Create CreateShm() failed", "");
+		return -1;
+	}
+
+	char* ptr = reinterpret_cast<char*>(mShm->AllocShm(size + kCacheLine));
+	if (ptr == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Create AllocShm() failed", "");
+		return -1;
+	}
+	mBase = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr) + kCacheLine - 1) & ~(kCacheLine - 1));
+
+	// 即刻标记删除：已映射的进程（含此后fork的worker）全部退出后由系统回收，进程崩溃不遗留共享内存
+	mShm->Destroy();
+
+	for (uint32_t from = 0; from < mSlots; from++) {
+		for (uint32_t to = from / mGroup * mGroup; to < (from / mGroup + 1) * mGroup; to++) {
+			if (to != from) {
+				new (Ring(from, to)) RingHead_t();
+			}
+		}
+	}
+
+	HNET_NEW_VEC(mSlots, int, mEventFD);
+	if (mEventFD == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Create new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	for (uint32_t i = 0; i < mSlots; i++) {
+		mEventFD[i] = eventfd(0, EFD_NONBLOCK | EFD_CLOEXEC);
+		if (mEventFD[i] == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Create eventfd() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+	}
+	return 0;
+}
+
+int wChannelRing::Push(uint32_t to, const char head[], size_t headlen, const char body[], size_t bodylen) {
+	RingHead_t* ring = Ring(mSelf, to);
+	uint64_t tail = ring->mTail.NoBarrierLoad();
+	if (tail + headlen + bodylen - ring->mHead.AcquireLoad() > mLen) {
+		return -1;
+	}
+	CopyIn(ring, tail, head, headlen);
+	if (bodylen > 0) {
+		CopyIn(ring, tail + headlen, body, bodylen);
+	}
+	ring->mTail.Store(tail + headlen + bodylen);
+
+	// 消费者已取完此前全部数据（可能已等待事件）时唤醒
+	if (ring->mHead.Load() == tail) {
+		Notify(to);
+	}
+	return 0;
+}
+
+int wChannelRing::SyncPush(uint32_t to, const char head[], size_t headlen, const char body[], size_t bodylen, uint32_t timeout) {
+	int64_t start = misc::GetTimeofday();
+	while (Push(to, head, headlen, body, bodylen) == -1) {
+		if (misc::GetTimeofday() - start > static_cast<int64_t>(timeout)*1000) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d]", "wChannelRing::SyncPush () failed", "ring full", to);
+			return -1;
+		}
+		usleep(100);
+	}
+	return 0;
+}
+
+size_t wChannelRing::Pop(char buf[], size_t len) {
+	if (mSelf >= mSlots) {
+		return 0;
+	}
+
+	// 先清除eventfd计数，此后生产者的唤醒均保留至下一轮事件循环
+	uint64_t v;
+	if (read(mEventFD[mSelf], &v, sizeof(v)) == -1 && errno != EAGAIN) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Pop read() failed", error::Strerror(errno).c_str());
+	}
+
+	// 仅同组slot向本进程建环
+	size_t n = 0;
+	bool more = false;
+	uint32_t base = mSelf / mGroup * mGroup;
+	for (uint32_t i = 0; i < mGroup && !more; i++) {
+		uint32_t from = base + (mNext + i) % mGroup;
+		if (from == mSelf) {
+			continue;
+		}
+
+		RingHead_t* ring = Ring(from, mSelf);
+		uint64_t head = ring->mHead.NoBarrierLoad(), tail;
+		// 释放位置后重新读取写入位置（与 Push 发布后判空配对，避免唤醒丢失）
+		while (!more && (tail = ring->mTail.Load()) != head) {
+			uint64_t pos = head;
+			while (pos < tail) {
+				char l[sizeof(uint32_t)];
+				CopyOut(ring, pos, l, sizeof(l));
+				size_t framelen = sizeof(uint32_t) + coding::DecodeFixed32(l);
+				if (n + framelen > len) {
+					more = true;
+					mNext = from - base;
+					break;
+				}
+				CopyOut(ring, pos, buf + n, framelen);
+				pos += framelen;
+				n += framelen;
+			}
+			if (pos != head) {
+				head = pos;
+				ring->mHead.Store(head);
+			}
+		}
+	}
+
+	if (more) {
+		Notify(mSelf);
+	}
+	return n;
+}
+
+void wChannelRing::CopyIn(RingHead_t* ring, uint64_t pos, const char buf[], size_t len) {
+	size_t off = static_cast<size_t>(pos & (mLen - 1));
+	size_t first = std::min(len, mLen - off);
+	memcpy(Data(ring) + off, buf, first);
+	memcpy(Data(ring), buf + first, len - first);
+}
+
+void wChannelRing::CopyOut(RingHead_t* ring, uint64_t pos, char buf[], size_t len) {
+	size_t off = static_cast<size_t>(pos & (mLen - 1));
+	size_t first = std::min(len, mLen - off);
+	memcpy(buf, Data(ring) + off, first);
+	memcpy(buf + first, Data(ring), len - first);
+}
+
+void wChannelRing::Notify(uint32_t slot) {
+	uint64_t v = 1;
+	if (write(mEventFD[slot], &v, sizeof(v)) == -1 && errno != EAGAIN) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelRing::Notify write() failed", error::Strerror(errno).c_str());
+	}
+}
+
+}	// namespace hnet
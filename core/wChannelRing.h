@@ -0,0 +1,102 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_CHANNEL_RING_H_
+#define _W_CHANNEL_RING_H_
+
+#include "wCore.h"
+#include "wNoncopyable.h"
+#include "wAtomic.h"
+
+namespace hnet {
+
+// 单环数据区默认长度（KB，配置项 channel_ring）。默认0关闭共享内存通道，按需开启
+// 共享内存总量约 2×N×(N-1)×长度（N为worker数），超过环长度的消息帧经channel socket传递
+const uint32_t	kChannelRingLen = 0;
+
+// SyncWorker环满时最长等待（毫秒）
+const uint32_t	kChannelRingWait = 100;
+
+class wEnv;
+class wShm;
+
+// worker进程间共享内存通道：每对（源slot，目标slot，二者不同）一个单生产者单消费者字节环
+// slot按每N个（worker数）一组，仅同组内建环：平滑重启时新旧两代worker各占一组，跨组消息经channel socket
+// 环中存放完整消息帧（4字节长度 + 数据协议 + 消息体，与channel socket记录一致），目标worker按帧取出后交由channel task解析
+// 生产者仅在环由空变非空（消费者已追上旧写入位置）时写目标worker的eventfd唤醒，持续收发时无系统调用
+// master进程在fork前创建（共享内存即刻标记删除，全部进程退出后由系统回收），worker继承映射与eventfd
+// master与worker间控制消息（含描述符传递）仍经socketpair
+class wChannelRing : private wNoncopyable {
+public:
+    // 环头：读写位置为累计字节数，分处不同缓存行
+    struct RingHead_t {
+        wAtomic<uint64_t> mTail;	// 生产者已发布位置
+        char mPad0[kCacheLine - sizeof(wAtomic<uint64_t>)];
+        wAtomic<uint64_t> mHead;	// 消费者已释放位置
+        char mPad1[kCacheLine - sizeof(wAtomic<uint64_t>)];
+
+        RingHead_t() : mTail(0), mHead(0) { }
+    };
+
+    // workers为worker进程数（每组slot数），len为单环数据区长度（向上取2的幂）
+    wChannelRing(wEnv* env, uint32_t workers, size_t len);
+    ~wChannelRing();
+
+    // master进程创建共享内存及各slot eventfd
+    int Create();
+
+    // worker进程设置自身slot（master进程不设置，不经环发送）
+    inline void Attach(uint32_t slot) { mSelf = slot;}
+
+    // 本进程可经环向to发送（单条帧长度不超过环长度）
+    inline bool Usable(uint32_t to, size_t len) {
+        return mSelf < mSlots && to < mSlots && to != mSelf && to / mGroup == mSelf / mGroup && len <= mLen;
+    }
+
+    // 向to写入一条完整消息帧（head、body两段连续写入，body可为空），空间不足返回-1
+    int Push(uint32_t to, const char head[], size_t headlen, const char body[] = NULL, size_t bodylen = 0);
+
+    // Push的阻塞版本：环满时等待至多timeout毫秒
+    int SyncPush(uint32_t to, const char head[], size_t headlen, const char body[] = NULL, size_t bodylen = 0, uint32_t timeout = kChannelRingWait);
+
+    // 取出发往本进程的消息帧（按帧整体复制，至多len字节），返回复制长度
+    // 因buf不足未取完时自行写eventfd，保证下一轮事件循环继续读取
+    size_t Pop(char buf[], size_t len);
+
+    inline int EventFD(uint32_t slot) { return slot < mSlots ? mEventFD[slot] : kFDUnknown;}
+    inline uint32_t Slots() { return mSlots;}
+
+protected:
+    // 同组内 (from, to) 按组、源、目标（跳过to==from）顺序排列
+    inline RingHead_t* Ring(uint32_t from, uint32_t to) {
+        uint32_t i = from % mGroup, j = to % mGroup;
+        size_t idx = static_cast<size_t>(from / mGroup) * mGroup * (mGroup - 1) + i * (mGroup - 1) + (j < i ? j : j - 1);
+        return reinterpret_cast<RingHead_t*>(mBase + idx * (sizeof(RingHead_t) + mLen));
+    }
+    inline char* Data(RingHead_t* ring) {
+        return reinterpret_cast<char*>(ring + 1);
+    }
+
+    // 环形复制（pos为累计位置）
+    void CopyIn(RingHead_t* ring, uint64_t pos, const char buf[], size_t len);
+    void CopyOut(RingHead_t* ring, uint64_t pos, char buf[], size_t len);
+
+    void Notify(uint32_t slot);
+
+    wEnv* mEnv;
+    wShm* mShm;
+    char* mBase;
+    uint32_t mSlots;	// 参与环通道的slot数（[0, mSlots)，mGroup的整数倍）
+    uint32_t mGroup;
+    size_t mLen;
+    uint32_t mSelf;
+    uint32_t mNext;	// Pop起始源slot组内序号（上轮未取完处，轮转避免饥饿）
+    int* mEventFD;
+};
+
+}	// namespace hnet
+
+#endif
@@ -11,6 +11,7 @@
 #include "wTask.h"
 #include "wChannelSocket.h"
 #include "wChannelCmd.h"
+#include "wChannelRing.h"
 
 namespace hnet {
 
@@ -19,11 +20,18 @@ wChannelSocket::~wChannelSocket() {
 }
 
 int wChannelSocket::Open() {
-    int ret = socketpair(AF_UNIX, SOCK_STREAM, 0, mChannel);
+    // 记录语义：每帧一次sendmsg整体写入，多个进程并发写入同一channel时帧不交错
+    int ret = socketpair(AF_UNIX, SOCK_SEQPACKET, 0, mChannel);
     if (ret == -1) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::Open socketpair() failed", error::Strerror(errno).c_str());
         return -1;
     }
+
+    // 发送缓冲决定单帧最大长度（记录须整体放入发送缓冲），受限于 net.core.wmem_max
+    int sndbuf = static_cast<int>(kPackageSize);
+    if (setsockopt(mChannel[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, sizeof(sndbuf)) == -1) {
+        HNET_DEBUG(soft::GetLogPath(), "%s : %s", "wChannelSocket::Open setsockopt(SO_SNDBUF) failed", error::Strerror(errno).c_str());
+    }
     
     if (fcntl(mChannel[0], F_SETFL, fcntl(mChannel[0], F_GETFL) | O_NONBLOCK) == -1) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::Open fcntl(0,O_NONBLOCK) failed", error::Strerror(errno).c_str());
@@ -44,13 +52,46 @@ int wChannelSocket::Open() {
 int wChannelSocket::Close() {
 	close(mChannel[0]);
 	close(mChannel[1]);
+	for (std::deque<int>::iterator it = mRecvFD.begin(); it != mRecvFD.end(); it++) {
+		close(*it);
+	}
+	mRecvFD.clear();
 	mFD = kFDUnknown;
     return 0;
 }
 
+size_t wChannelSocket::FrameMax() {
+	// 其他worker的channel描述符经 CHANNEL_REQ_OPEN 传入，首次使用时读取
+	if (mFrameMax == 0 && mChannel[0] != kFDUnknown) {
+		int sndbuf = 0;
+		socklen_t optlen = sizeof(sndbuf);
+		if (getsockopt(mChannel[0], SOL_SOCKET, SO_SNDBUF, &sndbuf, &optlen) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::FrameMax getsockopt(SO_SNDBUF) failed", error::Strerror(errno).c_str());
+			return 0;
+		}
+		// 内核返回值含簿记开销（为设置值两倍），取其半
+		mFrameMax = std::min(static_cast<size_t>(sndbuf) / 2, static_cast<size_t>(kChannelFrameMax));
+	}
+	return mFrameMax;
+}
+
+int wChannelSocket::TakeFD() {
+	if (mRecvFD.empty()) {
+		return kFDUnknown;
+	}
+	int fd = mRecvFD.front();
+	mRecvFD.pop_front();
+	return fd;
+}
+
 int wChannelSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
     mRecvTm = soft::TimeUsec();
 
+    if (mRing) {
+        *size = static_cast<ssize_t>(mRing->Pop(buf, len));
+        return 0;
+    }
+
     union {
         struct cmsghdr  cm;
         char space[CMSG_SPACE(sizeof(int32_t))];
@@ -70,45 +111,61 @@ int wChannelSocket::RecvBytes(char buf[], size_t len, ssize_t *size) {
     msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
     msg.msg_controllen = sizeof(cmsg);
 
-    // @TODO
-    // 当recvmsg工作于非阻塞时，要么数据全被接受，要么数据一个也没接受？？？
+    // 每次recvmsg读出一条完整记录（一帧）。缓冲剩余不足以容纳下一记录时不再读取（超出部分会被截断丢弃），留待下次
     int ret = 0;
-    *size = recvmsg(mChannel[1], &msg, 0);
-    if (*size == 0) {   // FIN package // client was closed
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(0) failed", error::Strerror(errno).c_str());
-    } else if (*size == -1) {
-        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(-1) failed", error::Strerror(errno).c_str());
-        } else {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", error::Strerror(errno).c_str());
-            ret = -1;
+    ssize_t recvlen = 0;
+    *size = 0;
+    while (recvlen < static_cast<ssize_t>(len)) {
+        size_t leftlen = len - recvlen;
+        if (leftlen < kChannelFrameMax) {
+            ssize_t next = recv(mChannel[1], NULL, 0, MSG_PEEK | MSG_TRUNC);
+            if (next > 0 && static_cast<size_t>(next) > leftlen) {
+                break;
+            }
+        }
+
+        iov[0].iov_base = reinterpret_cast<char*>(buf + recvlen);
+        iov[0].iov_len = leftlen;
+        msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
+        msg.msg_controllen = sizeof(cmsg);
+        msg.msg_flags = 0;
+
+        *size = recvmsg(mChannel[1], &msg, 0);
+        if (*size == 0) {   // FIN package // client was closed
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg(0) failed", error::Strerror(errno).c_str());
+            break;
+        } else if (*size == -1) {
+            if (errno == EINTR) {
+                continue;
+            } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
+                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", error::Strerror(errno).c_str());
+                ret = -1;
+            }
+            break;
         }
-    } else {
+
+        recvlen += *size;
         if (msg.msg_flags & (MSG_TRUNC|MSG_CTRUNC)) {
-            HNET_DEBUG(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() truncated data", "");
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", "truncated data");
         }
 
-        // 数据协议
-        uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(buf + sizeof(uint32_t)));
-        if (sp == kMpCommand) {
-            struct wCommand *cmd = reinterpret_cast<struct wCommand*>(buf + sizeof(uint32_t) + sizeof(uint8_t));
-            if (cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_OPEN)) {
-                if (cmsg.cm.cmsg_len < static_cast<socklen_t>(CMSG_LEN(sizeof(int32_t)))) {
-                    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", "returned too small ancillary data");
-                    ret = -1;
-                } else if (cmsg.cm.cmsg_level != SOL_SOCKET || cmsg.cm.cmsg_type != SCM_RIGHTS) {
-                    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", "returned invalid ancillary data");
-                    ret = -1;
-                } else {
-                    wChannelReqOpen_t open;
-                    open.ParseFromArray(buf + sizeof(uint32_t) + sizeof(uint8_t), *size - sizeof(uint32_t) - sizeof(uint8_t));
-                    int32_t fd = *(int32_t *) CMSG_DATA(&cmsg.cm);
-                    open.set_fd(fd);
-                    wTask::Assertbuf(buf, reinterpret_cast<char*>(&open), sizeof(open));
-                }
+        // 附属描述符（CHANNEL_REQ_OPEN、CHANNEL_REQ_MIGRATE），由消息处理函数 TakeFD 按序取出
+        struct cmsghdr* cm = CMSG_FIRSTHDR(&msg);
+        if (cm != NULL) {
+            if (cm->cmsg_len < static_cast<socklen_t>(CMSG_LEN(sizeof(int32_t)))) {
+                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", "returned too small ancillary data");
+            } else if (cm->cmsg_level != SOL_SOCKET || cm->cmsg_type != SCM_RIGHTS) {
+                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::RecvBytes recvmsg() failed", "returned invalid ancillary data");
+            } else {
+                mRecvFD.push_back(*reinterpret_cast<int32_t*>(CMSG_DATA(cm)));
             }
         }
     }
+
+    // 已读出记录时返回其总长度，否则保留最后一次recvmsg返回值（0对端关闭，-1暂无数据）
+    if (recvlen > 0) {
+        *size = recvlen;
+    }
     return ret;
 }
 
@@ -121,19 +178,25 @@ int wChannelSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
     } cmsg;
 
     struct msghdr msg;
+    msg.msg_control = NULL;
+    msg.msg_controllen = 0;
 
-    // 数据协议
-    uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(buf + sizeof(uint32_t)));
-    if (sp == kMpProtobuf) {
-        msg.msg_control = NULL;
-        msg.msg_controllen = 0;
-
-    } else if (sp == kMpCommand) {
+    // 数据协议：OPEN、MIGRATE消息帧附带描述符
+    if (len >= sizeof(uint32_t) + sizeof(uint8_t) + sizeof(struct wCommand) && coding::DecodeFixed32(buf) == len - sizeof(uint32_t)) {
+        uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(buf + sizeof(uint32_t)));
         struct wCommand *cmd = reinterpret_cast<struct wCommand*>(buf + sizeof(uint32_t) + sizeof(uint8_t));
-        if (cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_OPEN)) {
+        int32_t fd = kFDUnknown;
+        if (sp == kMpCommand && cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_OPEN)) {
             wChannelReqOpen_t open;
             open.ParseFromArray(buf + sizeof(uint32_t) + sizeof(uint8_t), len - sizeof(uint32_t) - sizeof(uint8_t));
+            fd = open.fd();
+        } else if (sp == kMpCommand && cmd->GetId() == CmdId(CMD_CHANNEL_REQ, CHANNEL_REQ_MIGRATE) && len >= sizeof(uint32_t) + sizeof(uint8_t) + sizeof(wChannelReqMigrate_t)) {
+            wChannelReqMigrate_t migrate;
+            migrate.ParseFromArray(buf + sizeof(uint32_t) + sizeof(uint8_t), sizeof(migrate));
+            fd = migrate.fd();
+        }
 
+        if (fd != kFDUnknown) {
             msg.msg_control = reinterpret_cast<caddr_t>(&cmsg);
             msg.msg_controllen = sizeof(cmsg);
             memset(&cmsg, 0, sizeof(cmsg));
@@ -143,39 +206,34 @@ int wChannelSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
             cmsg.cm.cmsg_len = CMSG_LEN(sizeof(int32_t));
 
             // 文件描述符
-            *(int32_t *) CMSG_DATA(&cmsg.cm) = open.fd();
-        } else {
-            msg.msg_control = NULL;
-            msg.msg_controllen = 0;
+            *(int32_t *) CMSG_DATA(&cmsg.cm) = fd;
         }
     }
     
     // 套接口地址，msg_name指向要发送或是接收信息的套接口地址，仅当是数据包UDP是才需要
     msg.msg_name = NULL;
     msg.msg_namelen = 0;
-    
-    // 实际的数据缓冲区，I/O向量引用。当要同步文件描述符，iov_base 至少一字节
+    msg.msg_flags = 0;
+
+    // 记录语义：整帧写入，或（发送缓冲不足时EAGAIN）一字节也不写入，由调用者整帧排队稍后重发
     struct iovec iov[1];
     iov[0].iov_base = reinterpret_cast<char*>(buf);
     iov[0].iov_len = len;
     msg.msg_iov = iov;
     msg.msg_iovlen = 1;
-    msg.msg_flags = 0;
 
-    // @TODO
-    // 当sendmsg工作于非阻塞时，要么数据全被发送，要么数据一个也没发送？？？
     int ret = 0;
-    *size = sendmsg(mChannel[0], &msg, 0);
-    if (*size >= 0 && (*size - len != 0)) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s[%d]", "wChannelSocket::SendBytes sendmsg() failed", "size:", *size);
-        ret = -1;
-    } else if (*size == -1) {
-        if (errno == EINTR || errno == EAGAIN || errno == EWOULDBLOCK) {
-            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::SendBytes sendmsg() failed", error::Strerror(errno).c_str());
-        } else {
+    while (true) {
+        *size = sendmsg(mChannel[0], &msg, 0);
+        if (*size >= 0) {
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (errno != EAGAIN && errno != EWOULDBLOCK) {
             HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelSocket::SendBytes sendmsg() failed", error::Strerror(errno).c_str());
             ret = -1;
         }
+        break;
     }
     return ret;
 }
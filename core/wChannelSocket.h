@@ -7,15 +7,21 @@
 #ifndef _W_CHANNEL_SOCKET_H_
 #define _W_CHANNEL_SOCKET_H_
 
+#include <deque>
 #include <sys/socket.h>
 #include "wCore.h"
 #include "wSocket.h"
 
 namespace hnet {
 
+// 单帧最大长度上限。接收缓冲剩余不小于该值时无需探测记录长度
+const uint32_t	kChannelFrameMax = kPackageSize/2;
+
+class wChannelRing;
+
 class wChannelSocket : public wSocket {
 public:
-    wChannelSocket(SockType type = kStConnect, SockProto proto = kSpChannel, SockFlag flag = kSfRvsd) : wSocket(type, proto, flag) {
+    wChannelSocket(SockType type = kStConnect, SockProto proto = kSpChannel, SockFlag flag = kSfRvsd) : wSocket(type, proto, flag), mRing(NULL), mFrameMax(0) {
         mChannel[0] = mChannel[1] = kFDUnknown;
     }
     
@@ -30,6 +36,18 @@ public:
         return mChannel[i];
     }
 
+    // 共享内存通道读取端：FD为本worker eventfd，RecvBytes自环中按帧取出其他worker发来的消息
+    inline void SetRing(wChannelRing* ring, int fd) {
+        mRing = ring;
+        mFD = fd;
+    }
+
+    // 单帧最大长度（由写入端发送缓冲长度决定，不超过kChannelFrameMax），超长帧无法整帧写入
+    size_t FrameMax();
+
+    // 取出最早收到的描述符（CHANNEL_REQ_OPEN、CHANNEL_REQ_MIGRATE消息按到达顺序各对应一个），无则返回kFDUnknown
+    int TakeFD();
+
 protected:
     virtual int Bind(const std::string& host, uint16_t port = 0) {
         return 0;
@@ -38,6 +56,15 @@ protected:
     // 0:传递给其他进程，供写入数据
     // 1:当前进程读取其他进程写入0中的数据
     int mChannel[2];
+
+    wChannelRing* mRing;
+
+    // SOCK_SEQPACKET：每帧以一条记录整体写入（或整体未写入），多进程并发写入channel[0]时帧不交错
+    size_t mFrameMax;
+
+    // 已收到尚未取出的描述符。一次RecvBytes可读出多条记录，
+    // 故不按缓冲位置关联，而按到达顺序由消息处理函数取出
+    std::deque<int> mRecvFD;
 };
 
 }   // namespace hnet
@@ -19,12 +19,21 @@ wChannelTask::wChannelTask(wSocket *socket, wMaster *master, int32_t type) : wTa
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_CLOSE, &wChannelTask::ChannelClose, this);
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_QUIT, &wChannelTask::ChannelQuit, this);
 	On(CMD_CHANNEL_REQ, CHANNEL_REQ_TERMINATE, &wChannelTask::ChannelTerminate, this);
+	On(CMD_CHANNEL_REQ, CHANNEL_REQ_REBALANCE, &wChannelTask::ChannelRebalance, this);
+	On(CMD_CHANNEL_REQ, CHANNEL_REQ_MIGRATE, &wChannelTask::ChannelMigrate, this);
 }
 
 int wChannelTask::ChannelOpen(struct Request_t *request) {
 	wChannelReqOpen_t open;
 	open.ParseFromArray(request->mBuf, request->mLen);
 
+	// 随消息传递的描述符
+	open.set_fd(static_cast<wChannelSocket*>(mSocket)->TakeFD());
+	if (open.fd() == kFDUnknown) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelOpen TakeFD() failed", "no descriptor received");
+		return 0;
+	}
+
 	// 更新描述符
 	mMaster->Worker(open.slot())->Pid() = open.pid();
 	mMaster->Worker(open.slot())->ChannelFD(0) = open.fd();
@@ -51,6 +60,7 @@ int wChannelTask::ChannelOpen(struct Request_t *request) {
 			//return -1;
 			exit(0);	// 进程重启
 		}
+		mMaster->Server()->AddChannelSlot(open.slot(), task);
 	}
 	return 0;
 }
@@ -87,6 +97,7 @@ int wChannelTask::ChannelClose(struct Request_t *request) {
 	}
 	mMaster->Worker(cls.slot())->ChannelFD(0) = kFDUnknown;
 	mMaster->Worker(cls.slot())->Pid() = -1;
+	mMaster->Server()->RemoveChannelSlot(cls.slot());
 	return 0;
 }
 
@@ -100,4 +111,46 @@ int wChannelTask::ChannelTerminate(struct Request_t *request) {
 	return 0;
 }
 
+int wChannelTask::ChannelRebalance(struct Request_t *request) {
+	wChannelReqRebalance_t rebalance;
+	rebalance.ParseFromArray(request->mBuf, request->mLen);
+
+	if (rebalance.slot() < 0 || rebalance.slot() >= static_cast<int32_t>(kMaxProcess) || rebalance.num() <= 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelRebalance () failed", "invalid request");
+		return 0;
+	}
+	mMaster->Server()->MigrateTask(static_cast<uint32_t>(rebalance.slot()), static_cast<uint32_t>(rebalance.num()));
+	return 0;
+}
+
+int wChannelTask::ChannelMigrate(struct Request_t *request) {
+	wChannelReqMigrate_t migrate;
+	if (request->mLen < sizeof(migrate)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelMigrate () failed", "message too short");
+		return 0;
+	}
+	migrate.ParseFromArray(request->mBuf, sizeof(migrate));
+
+	int fd = static_cast<wChannelSocket*>(mSocket)->TakeFD();
+	if (fd == kFDUnknown) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelMigrate TakeFD() failed", "no descriptor received");
+		return 0;
+	}
+
+	uint64_t len = static_cast<uint64_t>(migrate.recv_len()) + migrate.send_len() + migrate.state_len();
+	if (request->mLen != sizeof(migrate) + len) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelMigrate () failed", "message length error");
+		close(fd);
+		return 0;
+	}
+
+	const char* recv = request->mBuf + sizeof(migrate);
+	const char* send = recv + migrate.recv_len();
+	const char* state = send + migrate.send_len();
+	if (mMaster->Server()->AdoptTask(fd, migrate.proto(), recv, migrate.recv_len(), send, migrate.send_len(), state, migrate.state_len()) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wChannelTask::ChannelMigrate AdoptTask() failed", "");
+	}
+	return 0;
+}
+
 }	// namespace hnet
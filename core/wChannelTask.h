@@ -24,6 +24,10 @@ public:
     int ChannelQuit(struct Request_t *request);
     int ChannelTerminate(struct Request_t *request);
 
+    // 连接迁移：master指令源worker迁出连接；目标worker接管随消息传递的连接
+    int ChannelRebalance(struct Request_t *request);
+    int ChannelMigrate(struct Request_t *request);
+
 protected:
     wMaster *mMaster;
 };
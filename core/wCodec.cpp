@@ -0,0 +1,111 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wCodec.h"
+#include "wMisc.h"
+#include "wCrc32c.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+int32_t wFixed32Codec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	if (len < sizeof(uint32_t)) {
+		return 0;
+	}
+
+	uint32_t reallen = coding::DecodeFixed32(buf);
+	if (reallen < kMinPackageSize || reallen > kMaxPackageSize) {
+		return -1;
+	} else if (reallen > len - sizeof(uint32_t)) {
+		return 0;
+	}
+	*off = sizeof(uint32_t);
+	*size = reallen;
+	return static_cast<int32_t>(sizeof(uint32_t) + reallen);
+}
+
+void wFixed32Codec::EncodeHead(char buf[], size_t len) {
+	coding::EncodeFixed32(buf, static_cast<uint32_t>(len));
+}
+
+int32_t wVarintCodec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	uint32_t reallen = 0;
+	const char* p = coding::GetVarint32Ptr(buf, buf + len, &reallen);
+	if (p == NULL) {
+		// 超过5字节仍未结束为非法
+		return len >= 5 ? -1 : 0;
+	}
+
+	size_t headlen = static_cast<size_t>(p - buf);
+	if (reallen < kMinPackageSize || reallen > kMaxPackageSize) {
+		return -1;
+	} else if (reallen > len - headlen) {
+		return 0;
+	}
+	*off = headlen;
+	*size = reallen;
+	return static_cast<int32_t>(headlen + reallen);
+}
+
+size_t wVarintCodec::HeadLen(size_t len) {
+	return static_cast<size_t>(coding::VarintLength(len));
+}
+
+void wVarintCodec::EncodeHead(char buf[], size_t len) {
+	coding::EncodeVarint32(buf, static_cast<uint32_t>(len));
+}
+
+int32_t wLineCodec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	size_t n = len < mMaxLen + 2 ? len : mMaxLen + 2;
+	const char* p = reinterpret_cast<const char*>(memchr(buf, kLF, n));
+	if (p == NULL) {
+		return len >= mMaxLen + 2 ? -1 : 0;
+	}
+
+	size_t linelen = static_cast<size_t>(p - buf);
+	*off = 0;
+	*size = static_cast<uint32_t>(linelen > 0 && buf[linelen - 1] == kCR ? linelen - 1 : linelen);
+	if (*size > mMaxLen) {
+		return -1;
+	}
+	return static_cast<int32_t>(linelen + 1);
+}
+
+wCrc32cCodec::~wCrc32cCodec() {
+	HNET_DELETE(mInner);
+}
+
+wCodec* wCrc32cCodec::Release() {
+	wCodec* inner = mInner;
+	mInner = NULL;
+	return inner;
+}
+
+int32_t wCrc32cCodec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	int32_t framelen = mInner->Decode(buf, len, off, size);
+	if (framelen <= 0) {
+		return framelen;
+	} else if (*size < sizeof(uint32_t)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wCrc32cCodec::Decode () failed", "frame too short");
+		return -1;
+	}
+
+	*size -= sizeof(uint32_t);
+	const char* body = buf + *off;
+	uint32_t crc = crc32c::Unmask(coding::DecodeFixed32(body + *size));
+	if (crc != crc32c::Value(body, *size)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wCrc32cCodec::Decode () failed", "crc32c mismatch");
+		return -1;
+	}
+	return framelen;
+}
+
+void wCrc32cCodec::EncodeTail(char body[], size_t len) {
+	coding::EncodeFixed32(body + len, crc32c::Mask(crc32c::Value(body, len)));
+	mInner->EncodeTail(body, len + sizeof(uint32_t));
+}
+
+}	// namespace hnet
@@ -0,0 +1,215 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_CODEC_H_
+#define _W_CODEC_H_
+
+#include <functional>
+#include "wCore.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 消息分帧编解码器（决定接收缓冲中消息边界，以及发送消息的帧头、帧尾）
+// wTask接收缓冲中未处理数据始终连续，Decode直接在缓冲上解析，消息体以指针交由Handlemsg（零拷贝）
+class wCodec : private wNoncopyable {
+public:
+    virtual ~wCodec() { }
+
+    // 解析buf中第一帧消息
+    // 返回 >0  整帧长度（帧头+消息体+帧尾）。*off为消息体相对buf偏移，*size为消息体长度
+    // 返回 0   帧不完整，等待更多数据
+    // 返回 -1  非法帧
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size) = 0;
+
+    // 消息体长度为len时帧头长度
+    virtual size_t HeadLen(size_t len) = 0;
+
+    // 写入帧头（buf至少HeadLen(len)字节）
+    virtual void EncodeHead(char buf[], size_t len) = 0;
+
+    // 帧尾长度
+    virtual size_t TailLen() {
+        return 0;
+    }
+
+    // 写入帧尾。body为消息体起始，帧尾写入 body + len 处
+    virtual void EncodeTail(char body[], size_t len) { }
+
+    // 消息体长度范围
+    virtual size_t MinLen() {
+        return kMinPackageSize;
+    }
+    virtual size_t MaxLen() {
+        return kMaxPackageSize;
+    }
+
+    // 消息体为原始业务数据（不以数据协议字节 kMpCommand 等开头），由 wTask::HandleRaw 处理
+    virtual bool Raw() {
+        return false;
+    }
+
+    virtual const char* Name() = 0;
+};
+
+// 4字节小端长度前缀（默认）：[len][body]
+class wFixed32Codec : public wCodec {
+public:
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len) {
+        return sizeof(uint32_t);
+    }
+
+    virtual void EncodeHead(char buf[], size_t len);
+
+    virtual const char* Name() {
+        return "fixed32";
+    }
+};
+
+// varint长度前缀：[varint len][body]
+class wVarintCodec : public wCodec {
+public:
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len);
+
+    virtual void EncodeHead(char buf[], size_t len);
+
+    virtual const char* Name() {
+        return "varint";
+    }
+};
+
+// 换行分隔：[body]\n（兼容\r\n，消息体不含行尾）
+class wLineCodec : public wCodec {
+public:
+    explicit wLineCodec(size_t maxlen = kMaxPackageSize) : mMaxLen(maxlen) { }
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len) {
+        return 0;
+    }
+
+    virtual void EncodeHead(char buf[], size_t len) { }
+
+    virtual size_t TailLen() {
+        return sizeof(kLF);
+    }
+
+    virtual void EncodeTail(char body[], size_t len) {
+        body[len] = kLF;
+    }
+
+    virtual size_t MinLen() {
+        return 0;
+    }
+    virtual size_t MaxLen() {
+        return mMaxLen;
+    }
+
+    virtual bool Raw() {
+        return true;
+    }
+
+    virtual const char* Name() {
+        return "line";
+    }
+
+protected:
+    size_t mMaxLen;
+};
+
+// 用户自定义分帧（函数语义同wCodec）。消息体视为原始业务数据
+class wUserCodec : public wCodec {
+public:
+    typedef std::function<int32_t(const char buf[], size_t len, size_t* off, uint32_t* size)> DecodeFunc;
+    typedef std::function<size_t(char buf[], size_t len)> EncodeFunc;	// buf为NULL时仅返回帧头长度
+
+    wUserCodec(const DecodeFunc& decode, const EncodeFunc& encode) : mDecode(decode), mEncode(encode) { }
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+        return mDecode(buf, len, off, size);
+    }
+
+    virtual size_t HeadLen(size_t len) {
+        return mEncode ? mEncode(NULL, len) : 0;
+    }
+
+    virtual void EncodeHead(char buf[], size_t len) {
+        if (mEncode) {
+            mEncode(buf, len);
+        }
+    }
+
+    virtual size_t MinLen() {
+        return 0;
+    }
+
+    virtual bool Raw() {
+        return true;
+    }
+
+    virtual const char* Name() {
+        return "user";
+    }
+
+protected:
+    DecodeFunc mDecode;
+    EncodeFunc mEncode;
+};
+
+// 帧完整性校验：在内层codec消息体后追加4字节crc32c掩码（crc32c::Mask），接收时校验并剥离
+// 仅适用长度前缀类codec（消息体为二进制）
+class wCrc32cCodec : public wCodec {
+public:
+    // 接管inner内存
+    explicit wCrc32cCodec(wCodec* inner) : mInner(inner) { }
+    virtual ~wCrc32cCodec();
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len) {
+        return mInner->HeadLen(len + sizeof(uint32_t));
+    }
+
+    virtual void EncodeHead(char buf[], size_t len) {
+        mInner->EncodeHead(buf, len + sizeof(uint32_t));
+    }
+
+    virtual size_t TailLen() {
+        return sizeof(uint32_t) + mInner->TailLen();
+    }
+
+    virtual void EncodeTail(char body[], size_t len);
+
+    virtual size_t MinLen() {
+        return mInner->MinLen() > sizeof(uint32_t) ? mInner->MinLen() - sizeof(uint32_t) : 0;
+    }
+    virtual size_t MaxLen() {
+        return mInner->MaxLen() - sizeof(uint32_t);
+    }
+
+    virtual bool Raw() {
+        return mInner->Raw();
+    }
+
+    virtual const char* Name() {
+        return "crc32c";
+    }
+
+    // 解除包装，返回内层codec（调用者接管内存）
+    wCodec* Release();
+
+protected:
+    wCodec* mInner;
+};
+
+}	// namespace hnet
+
+#endif
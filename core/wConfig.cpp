@@ -31,6 +31,7 @@ wConfig::~wConfig() {
 // ./bin/server -d
 // ./bin/server -h127.0.0.1
 // ./bin/server -h 127.0.0.1
+// ./bin/server -a auto|numa|0,2,4-7
 int wConfig::ParseArgs(int argc, char *argv[]) {
 for (int i = 1; i < argc; i++) {
         const char* p = argv[i];
@@ -161,6 +162,21 @@ for (int i = 1; i < argc; i++) {
                 std::cout << "wConfig::ParseArgs failed, invalid option" << " : " << "option \"-n\" requires workers num" << std::endl;
                 return -1;
 
+            case 'a':
+                if (*p) {
+                    SetStrConf("worker_affinity", p);
+                    goto next;
+                }
+
+                p = argv[++i]; // 多一个空格
+                if (*p) {
+                    SetStrConf("worker_affinity", p);
+                    goto next;
+                }
+                //HNET_ERROR(soft::GetLogPath(), "%s : %s", "wConfig::ParseArgs failed, invalid option", "option \"-a\" requires worker affinity");
+                std::cout << "wConfig::ParseArgs failed, invalid option" << " : " << "option \"-a\" requires worker affinity" << std::endl;
+                return -1;
+
             default:
                 //HNET_ERROR(soft::GetLogPath(), "%s : %s", "wConfig::ParseArgs failed, invalid option", "unknown");
                 std::cout << "wConfig::ParseArgs failed, invalid option" << " : " << "unknown" << std::endl;
@@ -197,6 +213,21 @@ char** wConfig::Environ() {
     return mProcTitle->Environ();
 }
 
+const char* wConfig::Getenv(const char* name) {
+    char** env = Environ();
+    if (env == NULL) {
+        return getenv(name);
+    }
+
+    size_t len = strlen(name);
+    for (; *env; env++) {
+        if (strncmp(*env, name, len) == 0 && (*env)[len] == '=') {
+            return *env + len + 1;
+        }
+    }
+    return NULL;
+}
+
 bool wConfig::SetBoolConf(const std::string& key, bool val, bool force) {
 	if (!force && mConf.find(key) != mConf.end()) {
 		return false;
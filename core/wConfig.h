@@ -24,6 +24,8 @@ public:
 
     char** Argv();
     char** Environ();
+    // 读取环境变量（设置进程标题会覆盖原environ内存，故读取启动时保存的副本）
+    const char* Getenv(const char* name);
     int GetOption(int argc, char *argv[]);
     int InitProcTitle(int argc, char *argv[]);
     int Setproctitle(const char* pretitle, const char* title, bool attach = true);
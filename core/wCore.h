@@ -89,6 +89,8 @@ const uint32_t  kMaxPackageSize = 524284;
 const uint32_t  kMinPackageSize = 3;
 
 const uint32_t  kPageSize = 4096;
+const size_t	kHugePageSize = 2097152;
+const size_t	kCacheLine = 64;
 const bool		kLittleEndian = true;
 
 // 心跳开关及次数
@@ -102,10 +104,20 @@ const int8_t    kProcessJustSpawn = -2;		// 子进程正在重启，该进程创
 const int8_t    kProcessRespawn = -3;     	// 子进程异常退出时，父进程会重新创建它
 const int8_t    kProcessJustRespawn = -4;	// 子进程正在重启，该进程创建之后，再次退出时，父进程会重新创建它
 const int8_t    kProcessDetached = -5;		// 分离进程
+const uint32_t  kQuitTimeout = 30000;		// 优雅退出worker等待已有连接关闭上限（毫秒），配置项 quit_timeout
+const uint32_t  kQuitGrace = 1000;			// 超出优雅退出期限该时长后，master强制杀死worker（毫秒）
+const uint32_t  kDrainTurn = 100;			// 优雅退出worker关闭空闲连接、向master汇报进度间隔（毫秒）
+const uint32_t  kDrainIdleTm = 500;			// 优雅退出时收发缓冲为空且静默该时长的连接视为空闲（毫秒）
 
 // 消息协议
 const int8_t	kMpCommand = 1;
 const int8_t	kMpProtobuf = 2;
+const int8_t	kMpStream = 3;
+
+// 流式消息（突破 kMaxPackageSize 单条消息上限）
+const uint8_t	kStreamFin = 0x01;			// 流最后一个分片
+const uint32_t	kStreamChunkSize = 65536;	// 64k建议分片大小
+const uint32_t	kMaxStreamNum = 64;			// 单连接同时接收的流上限
 
 // 执行用户
 const uid_t     kDeamonUser = 0;
@@ -119,6 +131,24 @@ const gid_t     kDeamonGroup = 0;
 const bool		kAcceptTurn = true;
 const int8_t	kAcceptStuff = 0;	// atmoic
 
+/**
+ * 共享内存实现（配置项 shm_backend，wEnv::NewShm 创建）
+ * 0:sysv（shmget，以文件路径ftok生成key）
+ * 1:memfd（memfd_create，不支持时为/dev/shm下即刻unlink的文件，mmap映射。无名，全部进程解除映射后由系统回收）
+ */
+const int8_t	kShmSysv = 0;
+const int8_t	kShmMemfd = 1;
+
+/**
+ * memfd共享内存大页（配置项 shm_hugepage）
+ * 0:off
+ * 1:transparent（madvise(MADV_HUGEPAGE)，需 /sys/kernel/mm/transparent_hugepage/shmem_enabled 为advise）
+ * 2:explicit（hugetlb大页，需预留 vm.nr_hugepages，长度按kHugePageSize对齐，总是预先分配；大页不足时退回普通页）
+ */
+const int8_t	kShmHugeOff = 0;
+const int8_t	kShmHugeTransparent = 1;
+const int8_t	kShmHugeExplicit = 2;
+
 // 目录
 const char 		kRuntimePath[] = "./";	// 进程运行宿主目录
 const char 		kLogdirPath[] = "./";	// 日志目录
@@ -127,9 +157,13 @@ const char 		kLogdirPath[] = "./";	// 日志目录
 const char		kAcceptFilename[] = "hnet.mtx";
 const char      kLockFilename[] = "hnet.lock";
 const char      kPidFilename[] = "hnet.pid";
+const char      kOldPidSuffix[] = ".oldbin";	// 热升级期间旧master的pid文件后缀
 // 相对 kLogDirPath 目录
 const char      kLogFilename[] = "hnet.log";
 
+// 热升级时旧master向新master传递listen socket描述符的环境变量（"fd;fd;"）
+const char      kListenFdsEnv[] = "HNET_LISTEN_FDS";
+
 const char      kSoftwareName[]   = "HNET";
 const char      kSoftwareVer[]    = "0.0.21";
 
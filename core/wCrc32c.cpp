@@ -7,6 +7,12 @@
 #include "wCrc32c.h"
 #include "wMisc.h"
 
+#if defined(__x86_64__) && defined(__GNUC__)
+#include <nmmintrin.h>
+#include <wmmintrin.h>
+#define HNET_CRC32C_X86 1
+#endif
+
 namespace hnet {
 namespace crc32c {
 
@@ -281,7 +287,8 @@ static inline uint32_t LeLoad32(const uint8_t *p) {
     return coding::DecodeFixed32(reinterpret_cast<const char*>(p));
 }
 
-uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+// 查表实现（可移植）
+static uint32_t ExtendPortable(uint32_t crc, const char* buf, size_t size) {
     const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
     const uint8_t *e = p + size;
     uint32_t l = crc ^ 0xffffffffu;
@@ -322,5 +329,156 @@ uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
     return l ^ 0xffffffffu;
 }
 
+// crc32c多项式（反射）
+static const uint32_t kPoly = 0x82f63b78u;
+
+// 反射表示下 a*b mod P（0x80000000 为 x^0）
+static uint32_t MultModP(uint32_t a, uint32_t b) {
+    uint32_t m = 1u << 31, p = 0;
+    for (;;) {
+        if (a & m) {
+            p ^= b;
+            if ((a & (m - 1)) == 0) {
+                break;
+            }
+        }
+        m >>= 1;
+        b = b & 1 ? (b >> 1) ^ kPoly : b >> 1;
+    }
+    return p;
+}
+
+// x^n mod P
+static uint32_t XpowModP(uint64_t n) {
+    uint32_t p = 1u << 31, x = 1u << 30;  // x^0, x^1
+    while (n) {
+        if (n & 1) {
+            p = MultModP(x, p);
+        }
+        x = MultModP(x, x);
+        n >>= 1;
+    }
+    return p;
+}
+
+#ifdef HNET_CRC32C_X86
+
+// SSE4.2 crc32指令：8字节一步
+__attribute__((target("sse4.2")))
+static uint32_t ExtendSse42(uint32_t crc, const char* buf, size_t size) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
+    const uint8_t *e = p + size;
+    uint64_t l = crc ^ 0xffffffffu;
+
+    while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+    }
+    while (e - p >= 8) {
+        l = _mm_crc32_u64(l, coding::DecodeFixed64(reinterpret_cast<const char*>(p)));
+        p += 8;
+    }
+    while (p != e) {
+        l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+    }
+    return static_cast<uint32_t>(l) ^ 0xffffffffu;
+}
+
+// 三路交错crc32指令（掩盖crc32指令3周期延迟），PCLMULQDQ折叠合并
+// 数据分为 A|B|C 三段各n字节：crc(A|B|C) = crcA*x^(16n) ^ crcB*x^(8n) ^ crcC
+// clmul(c, K) 以反射表示为 c*K*x，再经 crc32(0, v) = v*x^32，故 K = x^(8n*k - 33)
+static const size_t kLongBlock = 8192;
+static const size_t kShortBlock = 256;
+static uint32_t kLongK[2], kShortK[2];
+
+__attribute__((target("sse4.2,pclmul")))
+static inline uint64_t Shift(uint32_t crc, uint32_t k) {
+    __m128i v = _mm_clmulepi64_si128(_mm_cvtsi32_si128(static_cast<int>(crc)), _mm_cvtsi32_si128(static_cast<int>(k)), 0);
+    return static_cast<uint64_t>(_mm_cvtsi128_si64(v));
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static inline const uint8_t* Extend3Way(uint64_t* l, const uint8_t* p, size_t n, const uint32_t k[2]) {
+    uint64_t a = *l, b = 0, c = 0;
+    const uint8_t* pb = p + n;
+    const uint8_t* pc = p + 2*n;
+    for (size_t i = 0; i < n; i += 8) {
+        a = _mm_crc32_u64(a, coding::DecodeFixed64(reinterpret_cast<const char*>(p + i)));
+        b = _mm_crc32_u64(b, coding::DecodeFixed64(reinterpret_cast<const char*>(pb + i)));
+        c = _mm_crc32_u64(c, coding::DecodeFixed64(reinterpret_cast<const char*>(pc + i)));
+    }
+    *l = _mm_crc32_u64(0, Shift(static_cast<uint32_t>(a), k[0]) ^ Shift(static_cast<uint32_t>(b), k[1])) ^ c;
+    return p + 3*n;
+}
+
+__attribute__((target("sse4.2,pclmul")))
+static uint32_t ExtendPclmul(uint32_t crc, const char* buf, size_t size) {
+    const uint8_t *p = reinterpret_cast<const uint8_t *>(buf);
+    const uint8_t *e = p + size;
+    uint64_t l = crc ^ 0xffffffffu;
+
+    while (p != e && (reinterpret_cast<uintptr_t>(p) & 7) != 0) {
+        l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+    }
+    while (static_cast<size_t>(e - p) >= 3*kLongBlock) {
+        p = Extend3Way(&l, p, kLongBlock, kLongK);
+    }
+    while (static_cast<size_t>(e - p) >= 3*kShortBlock) {
+        p = Extend3Way(&l, p, kShortBlock, kShortK);
+    }
+    while (e - p >= 8) {
+        l = _mm_crc32_u64(l, coding::DecodeFixed64(reinterpret_cast<const char*>(p)));
+        p += 8;
+    }
+    while (p != e) {
+        l = _mm_crc32_u8(static_cast<uint32_t>(l), *p++);
+    }
+    return static_cast<uint32_t>(l) ^ 0xffffffffu;
+}
+
+#endif
+
+typedef uint32_t (*ExtendFunc)(uint32_t, const char*, size_t);
+
+// 运行时按CPU特性选择实现
+static ExtendFunc ChooseExtend(const char** name) {
+#ifdef HNET_CRC32C_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("sse4.2")) {
+        if (__builtin_cpu_supports("pclmul")) {
+            kLongK[0] = XpowModP(8*2*kLongBlock - 33);
+            kLongK[1] = XpowModP(8*kLongBlock - 33);
+            kShortK[0] = XpowModP(8*2*kShortBlock - 33);
+            kShortK[1] = XpowModP(8*kShortBlock - 33);
+            *name = "pclmul";
+            return ExtendPclmul;
+        }
+        *name = "sse4.2";
+        return ExtendSse42;
+    }
+#endif
+    *name = "table";
+    return ExtendPortable;
+}
+
+static const char* gExtendName = NULL;
+
+static inline ExtendFunc Dispatch() {
+    static const ExtendFunc func = ChooseExtend(&gExtendName);
+    return func;
+}
+
+uint32_t Extend(uint32_t crc, const char* buf, size_t size) {
+    return Dispatch()(crc, buf, size);
+}
+
+uint32_t ExtendTable(uint32_t crc, const char* buf, size_t size) {
+    return ExtendPortable(crc, buf, size);
+}
+
+const char* Implementation() {
+    Dispatch();
+    return gExtendName;
+}
+
 }  // namespace crc32c
 }  // namespace hnet
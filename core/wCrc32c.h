@@ -16,8 +16,15 @@ namespace crc32c {
 static const uint32_t kMaskDelta = 0xa282ead8ul;
 
 // 返回concat(A, data[0,n-1])的crc32c值，其中字符串A的crc32c值为init_crc
+// 运行时按CPU特性选择实现：PCLMULQDQ三路折叠 > SSE4.2 crc32指令 > 查表
 extern uint32_t Extend(uint32_t init_crc, const char* data, size_t n);
 
+// 查表实现（校验、对比用）
+extern uint32_t ExtendTable(uint32_t init_crc, const char* data, size_t n);
+
+// 当前使用的实现："pclmul"|"sse4.2"|"table"
+extern const char* Implementation();
+
 // 返回data[0,n-1]的crc32c值
 inline uint32_t Value(const char* data, size_t n) {
     return Extend(0, data, n);
@@ -16,6 +16,11 @@
 namespace hnet {
 
 int wDaemon::Start(const std::string& lock_path, const char *prefix) {
+    // 热升级新master由已守护化的旧master执行，无需再次守护化（旧master仍持有锁文件）
+    if (getenv(kListenFdsEnv) != NULL) {
+        return 0;
+    }
+
     if (!lock_path.empty()) {
     	mFilename = lock_path;
     } else {
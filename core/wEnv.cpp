@@ -95,7 +95,11 @@ public:
     }
 
     virtual int NewShm(const std::string& filename, wShm** result, size_t size = kMsgQueueLen) {
-        HNET_NEW(wPosixShm(filename, size), *result);
+        if (mShmBackend == kShmMemfd) {
+            HNET_NEW(wMemfdShm(filename, size, mShmHugePage, mShmPrefault), *result);
+        } else {
+            HNET_NEW(wPosixShm(filename, size), *result);
+        }
         if (!*result) {
             HNET_ERROR(soft::GetLogPath(), "%s : %s", "wPosixEnv::NewShm new() failed", error::Strerror(errno).c_str());
             return -1;
@@ -103,6 +107,12 @@ public:
         return 0;
     }
 
+    virtual void SetShmOption(int8_t backend, int8_t hugepage = kShmHugeOff, bool prefault = false) {
+        mShmBackend = backend;
+        mShmHugePage = hugepage;
+        mShmPrefault = prefault;
+    }
+
     // 创建文件锁
     virtual int LockFile(const std::string& fname, wFileLock** lock) {
         *lock = NULL;
@@ -327,9 +337,14 @@ private:
 
     wPosixLockTable mLocks;
     wMmapLimiter mMmapLimit;
+
+    // 共享内存实现
+    int8_t mShmBackend;
+    int8_t mShmHugePage;
+    bool mShmPrefault;
 };
 
-wPosixEnv::wPosixEnv() : mStartedBgthread(false) {
+wPosixEnv::wPosixEnv() : mStartedBgthread(false), mShmBackend(kShmSysv), mShmHugePage(kShmHugeOff), mShmPrefault(false) {
     PthreadCall("mutex_init", pthread_mutex_init(&mMutex, NULL));
     PthreadCall("cvar_init", pthread_cond_init(&mBgsignal, NULL));
 }
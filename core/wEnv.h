@@ -46,9 +46,12 @@ public:
     // 返回信号量对象
     virtual int NewSem(const std::string& name, wSem** result) = 0;
 
-    // 返回共享内存对象
+    // 返回共享内存对象，实现由 SetShmOption 选择（默认SysV）
     virtual int NewShm(const std::string& filename, wShm** result, size_t size = kMsgQueueLen) = 0;
 
+    // 设置此后 NewShm 创建的共享内存实现（kShmSysv、kShmMemfd）、大页方式（kShmHugeOff等，仅memfd）及是否创建时预先分配物理页
+    virtual void SetShmOption(int8_t backend, int8_t hugepage = kShmHugeOff, bool prefault = false) = 0;
+
     // 锁文件
     virtual int LockFile(const std::string& fname, wFileLock** lock) = 0;
 
@@ -0,0 +1,141 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wFileCache.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+wFileCache::~wFileCache() {
+	for (std::list<File_t*>::iterator it = mLru.begin(); it != mLru.end(); it++) {
+		(*it)->mCached = false;
+		if ((*it)->mRef == 0) {
+			Close(*it);
+		}
+	}
+	mLru.clear();
+	mFiles.clear();
+}
+
+wFileCache::File_t* wFileCache::Acquire(const std::string& path) {
+	int64_t now = soft::TimeUsec();
+	std::unordered_map<std::string, File_t*>::iterator it = mFiles.find(path);
+	if (it != mFiles.end()) {
+		File_t* file = it->second;
+		bool valid = true;
+		if (now - file->mCheckTm > static_cast<int64_t>(mCheckTm)*1000) {
+			// 定时校验：文件被删除、替换或修改后失效
+			struct stat st;
+			valid = stat(path.c_str(), &st) == 0 && st.st_ino == file->mIno && st.st_dev == file->mDev && 
+				st.st_mtime == file->mMtime && static_cast<uint64_t>(st.st_size) == file->mSize;
+			file->mCheckTm = now;
+		}
+		if (valid) {
+			mLru.splice(mLru.begin(), mLru, file->mLru);
+			file->mRef++;
+			return file;
+		}
+		Evict(file);
+	}
+
+	File_t* file = Open(path);
+	if (file == NULL) {
+		return NULL;
+	}
+	file->mCheckTm = now;
+
+	// 淘汰最久未使用项
+	while (mFiles.size() >= mCapacity && !mLru.empty()) {
+		Evict(mLru.back());
+	}
+	if (mCapacity > 0) {
+		mLru.push_front(file);
+		file->mLru = mLru.begin();
+		file->mCached = true;
+		mFiles.insert(std::make_pair(path, file));
+	}
+	file->mRef++;
+	return file;
+}
+
+void wFileCache::Release(File_t* file) {
+	if (--file->mRef == 0 && !file->mCached) {
+		Close(file);
+	}
+}
+
+void wFileCache::ReleaseFile(void* arg) {
+	Default()->Release(reinterpret_cast<File_t*>(arg));
+}
+
+wFileCache::File_t* wFileCache::Open(const std::string& path) {
+	int fd = open(path.c_str(), O_RDONLY | O_CLOEXEC | O_NONBLOCK);
+	if (fd == -1) {
+		return NULL;
+	}
+
+	struct stat st;
+	if (fstat(fd, &st) == -1) {
+		int err = errno;
+		close(fd);
+		errno = err;
+		return NULL;
+	} else if (!S_ISREG(st.st_mode)) {
+		close(fd);
+		errno = S_ISDIR(st.st_mode) ? EISDIR : EACCES;
+		return NULL;
+	}
+
+	File_t* file;
+	HNET_NEW(File_t(), file);
+	if (file == NULL) {
+		close(fd);
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wFileCache::Open new() failed", "");
+		errno = ENOMEM;
+		return NULL;
+	}
+	file->mPath = path;
+	file->mFD = fd;
+	file->mSize = st.st_size;
+	file->mMtime = st.st_mtime;
+	file->mIno = st.st_ino;
+	file->mDev = st.st_dev;
+	file->mRef = 0;
+	file->mCached = false;
+	snprintf(file->mEtag, sizeof(file->mEtag), "\"%lx-%lx\"", static_cast<unsigned long>(st.st_mtime), static_cast<unsigned long>(st.st_size));
+	http::FormatDate(st.st_mtime, file->mLastModified);
+	return file;
+}
+
+void wFileCache::Evict(File_t* file) {
+	if (file->mCached) {
+		mFiles.erase(file->mPath);
+		mLru.erase(file->mLru);
+		file->mCached = false;
+	}
+	if (file->mRef == 0) {
+		Close(file);
+	}
+}
+
+void wFileCache::Close(File_t* file) {
+	close(file->mFD);
+	HNET_DELETE(file);
+}
+
+static pthread_once_t hnet_filecache_once = PTHREAD_ONCE_INIT;
+static wFileCache* hnet_defaultFileCache;
+static void InitDefaultFileCache() {
+    HNET_NEW(wFileCache(), hnet_defaultFileCache);
+}
+
+wFileCache* wFileCache::Default() {
+	pthread_once(&hnet_filecache_once, InitDefaultFileCache);
+	return hnet_defaultFileCache;
+}
+
+}	// namespace hnet
@@ -0,0 +1,69 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_FILE_CACHE_H_
+#define _W_FILE_CACHE_H_
+
+#include <list>
+#include <unordered_map>
+#include "wCore.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+const size_t	kFileCacheNum = 1024;		// 缓存文件描述符上限
+const uint32_t	kFileCacheCheckTm = 1000;	// 缓存项校验间隔（毫秒）
+
+// 只读文件描述符LRU缓存（静态文件服务）
+// 缓存打开的fd及stat元数据、ETag、Last-Modified；缓存项每隔checktm重新stat校验，文件变更（替换、修改）后重新打开
+// 缓存项引用计数：被淘汰或失效时若仍有引用（如sendfile发送中），待最后Release时关闭
+// 非线程安全，每进程一个实例（Default）
+class wFileCache : private wNoncopyable {
+public:
+    struct File_t {
+        std::string mPath;
+        int mFD;
+        uint64_t mSize;
+        time_t mMtime;
+        ino_t mIno;
+        dev_t mDev;
+        int64_t mCheckTm;	// 上次校验时间（微秒）
+        int32_t mRef;
+        bool mCached;	// 在缓存中
+        char mEtag[48];
+        char mLastModified[32];
+        std::list<File_t*>::iterator mLru;
+    };
+
+    explicit wFileCache(size_t capacity = kFileCacheNum, uint32_t checktm = kFileCacheCheckTm) : mCapacity(capacity), mCheckTm(checktm) { }
+    ~wFileCache();
+
+    // 获取文件（引用计数+1），须以Release释放。非普通文件或打开失败返回NULL（errno）
+    File_t* Acquire(const std::string& path);
+    void Release(File_t* file);
+
+    // wTask::SendFile2Buf 释放回调
+    static void ReleaseFile(void* arg);
+
+    static wFileCache* Default();
+
+    inline size_t Size() { return mFiles.size();}
+
+protected:
+    File_t* Open(const std::string& path);
+    // 移出缓存，无引用时关闭
+    void Evict(File_t* file);
+    void Close(File_t* file);
+
+    size_t mCapacity;
+    uint32_t mCheckTm;
+    std::unordered_map<std::string, File_t*> mFiles;
+    std::list<File_t*> mLru;	// 最近使用在前
+};
+
+}	// namespace hnet
+
+#endif
@@ -0,0 +1,464 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttp2.h"
+#include "wMisc.h"
+
+namespace hnet {
+
+namespace {
+
+// 静态表（RFC 7541 附录A）
+const struct { const char* mName; const char* mValue; } kStaticTable[] = {
+	{":authority", ""},
+	{":method", "GET"},
+	{":method", "POST"},
+	{":path", "/"},
+	{":path", "/index.html"},
+	{":scheme", "http"},
+	{":scheme", "https"},
+	{":status", "200"},
+	{":status", "204"},
+	{":status", "206"},
+	{":status", "304"},
+	{":status", "400"},
+	{":status", "404"},
+	{":status", "500"},
+	{"accept-charset", ""},
+	{"accept-encoding", "gzip, deflate"},
+	{"accept-language", ""},
+	{"accept-ranges", ""},
+	{"accept", ""},
+	{"access-control-allow-origin", ""},
+	{"age", ""},
+	{"allow", ""},
+	{"authorization", ""},
+	{"cache-control", ""},
+	{"content-disposition", ""},
+	{"content-encoding", ""},
+	{"content-language", ""},
+	{"content-length", ""},
+	{"content-location", ""},
+	{"content-range", ""},
+	{"content-type", ""},
+	{"cookie", ""},
+	{"date", ""},
+	{"etag", ""},
+	{"expect", ""},
+	{"expires", ""},
+	{"from", ""},
+	{"host", ""},
+	{"if-match", ""},
+	{"if-modified-since", ""},
+	{"if-none-match", ""},
+	{"if-range", ""},
+	{"if-unmodified-since", ""},
+	{"last-modified", ""},
+	{"link", ""},
+	{"location", ""},
+	{"max-forwards", ""},
+	{"proxy-authenticate", ""},
+	{"proxy-authorization", ""},
+	{"range", ""},
+	{"referer", ""},
+	{"refresh", ""},
+	{"retry-after", ""},
+	{"server", ""},
+	{"set-cookie", ""},
+	{"strict-transport-security", ""},
+	{"transfer-encoding", ""},
+	{"user-agent", ""},
+	{"vary", ""},
+	{"via", ""},
+	{"www-authenticate", ""},
+};
+const size_t kStaticNum = sizeof(kStaticTable)/sizeof(kStaticTable[0]);
+
+// Huffman编码表（RFC 7541 附录B）：码字、位数，下标256为EOS
+const struct { uint32_t mCode; uint8_t mBits; } kHuffmanTable[] = {
+	{0x1ff8, 13}, {0x7fffd8, 23}, {0xfffffe2, 28}, {0xfffffe3, 28}, {0xfffffe4, 28}, {0xfffffe5, 28},
+	{0xfffffe6, 28}, {0xfffffe7, 28}, {0xfffffe8, 28}, {0xffffea, 24}, {0x3ffffffc, 30}, {0xfffffe9, 28},
+	{0xfffffea, 28}, {0x3ffffffd, 30}, {0xfffffeb, 28}, {0xfffffec, 28}, {0xfffffed, 28}, {0xfffffee, 28},
+	{0xfffffef, 28}, {0xffffff0, 28}, {0xffffff1, 28}, {0xffffff2, 28}, {0x3ffffffe, 30}, {0xffffff3, 28},
+	{0xffffff4, 28}, {0xffffff5, 28}, {0xffffff6, 28}, {0xffffff7, 28}, {0xffffff8, 28}, {0xffffff9, 28},
+	{0xffffffa, 28}, {0xffffffb, 28}, {0x14, 6}, {0x3f8, 10}, {0x3f9, 10}, {0xffa, 12},
+	{0x1ff9, 13}, {0x15, 6}, {0xf8, 8}, {0x7fa, 11}, {0x3fa, 10}, {0x3fb, 10},
+	{0xf9, 8}, {0x7fb, 11}, {0xfa, 8}, {0x16, 6}, {0x17, 6}, {0x18, 6},
+	{0x0, 5}, {0x1, 5}, {0x2, 5}, {0x19, 6}, {0x1a, 6}, {0x1b, 6},
+	{0x1c, 6}, {0x1d, 6}, {0x1e, 6}, {0x1f, 6}, {0x5c, 7}, {0xfb, 8},
+	{0x7ffc, 15}, {0x20, 6}, {0xffb, 12}, {0x3fc, 10}, {0x1ffa, 13}, {0x21, 6},
+	{0x5d, 7}, {0x5e, 7}, {0x5f, 7}, {0x60, 7}, {0x61, 7}, {0x62, 7},
+	{0x63, 7}, {0x64, 7}, {0x65, 7}, {0x66, 7}, {0x67, 7}, {0x68, 7},
+	{0x69, 7}, {0x6a, 7}, {0x6b, 7}, {0x6c, 7}, {0x6d, 7}, {0x6e, 7},
+	{0x6f, 7}, {0x70, 7}, {0x71, 7}, {0x72, 7}, {0xfc, 8}, {0x73, 7},
+	{0xfd, 8}, {0x1ffb, 13}, {0x7fff0, 19}, {0x1ffc, 13}, {0x3ffc, 14}, {0x22, 6},
+	{0x7ffd, 15}, {0x3, 5}, {0x23, 6}, {0x4, 5}, {0x24, 6}, {0x5, 5},
+	{0x25, 6}, {0x26, 6}, {0x27, 6}, {0x6, 5}, {0x74, 7}, {0x75, 7},
+	{0x28, 6}, {0x29, 6}, {0x2a, 6}, {0x7, 5}, {0x2b, 6}, {0x76, 7},
+	{0x2c, 6}, {0x8, 5}, {0x9, 5}, {0x2d, 6}, {0x77, 7}, {0x78, 7},
+	{0x79, 7}, {0x7a, 7}, {0x7b, 7}, {0x7ffe, 15}, {0x7fc, 11}, {0x3ffd, 14},
+	{0x1ffd, 13}, {0xffffffc, 28}, {0xfffe6, 20}, {0x3fffd2, 22}, {0xfffe7, 20}, {0xfffe8, 20},
+	{0x3fffd3, 22}, {0x3fffd4, 22}, {0x3fffd5, 22}, {0x7fffd9, 23}, {0x3fffd6, 22}, {0x7fffda, 23},
+	{0x7fffdb, 23}, {0x7fffdc, 23}, {0x7fffdd, 23}, {0x7fffde, 23}, {0xffffeb, 24}, {0x7fffdf, 23},
+	{0xffffec, 24}, {0xffffed, 24}, {0x3fffd7, 22}, {0x7fffe0, 23}, {0xffffee, 24}, {0x7fffe1, 23},
+	{0x7fffe2, 23}, {0x7fffe3, 23}, {0x7fffe4, 23}, {0x1fffdc, 21}, {0x3fffd8, 22}, {0x7fffe5, 23},
+	{0x3fffd9, 22}, {0x7fffe6, 23}, {0x7fffe7, 23}, {0xffffef, 24}, {0x3fffda, 22}, {0x1fffdd, 21},
+	{0xfffe9, 20}, {0x3fffdb, 22}, {0x3fffdc, 22}, {0x7fffe8, 23}, {0x7fffe9, 23}, {0x1fffde, 21},
+	{0x7fffea, 23}, {0x3fffdd, 22}, {0x3fffde, 22}, {0xfffff0, 24}, {0x1fffdf, 21}, {0x3fffdf, 22},
+	{0x7fffeb, 23}, {0x7fffec, 23}, {0x1fffe0, 21}, {0x1fffe1, 21}, {0x3fffe0, 22}, {0x1fffe2, 21},
+	{0x7fffed, 23}, {0x3fffe1, 22}, {0x7fffee, 23}, {0x7fffef, 23}, {0xfffea, 20}, {0x3fffe2, 22},
+	{0x3fffe3, 22}, {0x3fffe4, 22}, {0x7ffff0, 23}, {0x3fffe5, 22}, {0x3fffe6, 22}, {0x7ffff1, 23},
+	{0x3ffffe0, 26}, {0x3ffffe1, 26}, {0xfffeb, 20}, {0x7fff1, 19}, {0x3fffe7, 22}, {0x7ffff2, 23},
+	{0x3fffe8, 22}, {0x1ffffec, 25}, {0x3ffffe2, 26}, {0x3ffffe3, 26}, {0x3ffffe4, 26}, {0x7ffffde, 27},
+	{0x7ffffdf, 27}, {0x3ffffe5, 26}, {0xfffff1, 24}, {0x1ffffed, 25}, {0x7fff2, 19}, {0x1fffe3, 21},
+	{0x3ffffe6, 26}, {0x7ffffe0, 27}, {0x7ffffe1, 27}, {0x3ffffe7, 26}, {0x7ffffe2, 27}, {0xfffff2, 24},
+	{0x1fffe4, 21}, {0x1fffe5, 21}, {0x3ffffe8, 26}, {0x3ffffe9, 26}, {0xffffffd, 28}, {0x7ffffe3, 27},
+	{0x7ffffe4, 27}, {0x7ffffe5, 27}, {0xfffec, 20}, {0xfffff3, 24}, {0xfffed, 20}, {0x1fffe6, 21},
+	{0x3fffe9, 22}, {0x1fffe7, 21}, {0x1fffe8, 21}, {0x7ffff3, 23}, {0x3fffea, 22}, {0x3fffeb, 22},
+	{0x1ffffee, 25}, {0x1ffffef, 25}, {0xfffff4, 24}, {0xfffff5, 24}, {0x3ffffea, 26}, {0x7ffff4, 23},
+	{0x3ffffeb, 26}, {0x7ffffe6, 27}, {0x3ffffec, 26}, {0x3ffffed, 26}, {0x7ffffe7, 27}, {0x7ffffe8, 27},
+	{0x7ffffe9, 27}, {0x7ffffea, 27}, {0x7ffffeb, 27}, {0xffffffe, 28}, {0x7ffffec, 27}, {0x7ffffed, 27},
+	{0x7ffffee, 27}, {0x7ffffef, 27}, {0x7fffff0, 27}, {0x3ffffee, 26}, {0x3fffffff, 30},
+};
+
+// Huffman解码树：子节点 >0 为内部节点下标，<0 为叶子（符号为 -value-1）
+struct HuffmanTree_t {
+	int16_t mNode[256][2];
+
+	HuffmanTree_t() {
+		memset(mNode, 0, sizeof(mNode));
+		int16_t num = 1;
+		for (int sym = 0; sym < 257; sym++) {
+			int16_t cur = 0;
+			for (int i = kHuffmanTable[sym].mBits - 1; i > 0; i--) {
+				int bit = (kHuffmanTable[sym].mCode >> i) & 1;
+				if (mNode[cur][bit] == 0) {
+					mNode[cur][bit] = num++;
+				}
+				cur = mNode[cur][bit];
+			}
+			mNode[cur][kHuffmanTable[sym].mCode & 1] = static_cast<int16_t>(-sym - 1);
+		}
+	}
+};
+
+const HuffmanTree_t& HuffmanTree() {
+	static const HuffmanTree_t tree;
+	return tree;
+}
+
+// 各条目占用大小（RFC 7541 4.1）
+inline size_t EntrySize(const std::string& name, const std::string& value) {
+	return name.size() + value.size() + 32;
+}
+
+}	// namespace anonymous
+
+int wHpack::DecodeInt(const uint8_t** p, const uint8_t* e, int n, uint64_t* value) {
+	if (*p >= e) {
+		return -1;
+	}
+	uint64_t max = (1u << n) - 1;
+	uint64_t v = **p & max;
+	(*p)++;
+	if (v < max) {
+		*value = v;
+		return 0;
+	}
+	for (int shift = 0; *p < e && shift <= 28; shift += 7) {
+		uint8_t b = **p;
+		(*p)++;
+		v += static_cast<uint64_t>(b & 0x7f) << shift;
+		if ((b & 0x80) == 0) {
+			*value = v;
+			return 0;
+		}
+	}
+	return -1;
+}
+
+void wHpack::EncodeInt(std::string* dst, uint8_t flag, int n, uint64_t value) {
+	uint64_t max = (1u << n) - 1;
+	if (value < max) {
+		dst->push_back(static_cast<char>(flag | value));
+		return;
+	}
+	dst->push_back(static_cast<char>(flag | max));
+	for (value -= max; value >= 0x80; value >>= 7) {
+		dst->push_back(static_cast<char>((value & 0x7f) | 0x80));
+	}
+	dst->push_back(static_cast<char>(value));
+}
+
+int wHpack::DecodeString(const uint8_t** p, const uint8_t* e, std::string* str) {
+	if (*p >= e) {
+		return -1;
+	}
+	bool huffman = (**p & 0x80) != 0;
+	uint64_t len;
+	if (DecodeInt(p, e, 7, &len) == -1 || len > static_cast<uint64_t>(e - *p)) {
+		return -1;
+	}
+	const uint8_t* s = *p;
+	*p += len;
+	if (huffman) {
+		return HuffmanDecode(s, static_cast<size_t>(len), str);
+	}
+	str->assign(reinterpret_cast<const char*>(s), static_cast<size_t>(len));
+	return 0;
+}
+
+int wHpack::HuffmanDecode(const uint8_t* p, size_t len, std::string* str) {
+	const HuffmanTree_t& tree = HuffmanTree();
+	str->clear();
+	str->reserve(len*8/5);
+
+	int16_t cur = 0;
+	int depth = 0;	// 当前未完成码字位数
+	bool ones = true;	// 未完成码字全为1（填充须为EOS前缀）
+	for (size_t i = 0; i < len; i++) {
+		for (int b = 7; b >= 0; b--) {
+			int bit = (p[i] >> b) & 1;
+			int16_t next = tree.mNode[cur][bit];
+			ones = ones && bit == 1;
+			depth++;
+			if (next > 0) {
+				cur = next;
+				continue;
+			} else if (next == 0 || next == -257) {
+				return -1;	// 非法码字，或EOS出现在字符串中
+			}
+			str->push_back(static_cast<char>(-next - 1));
+			cur = 0;
+			depth = 0;
+			ones = true;
+		}
+	}
+	return depth <= 7 && ones ? 0 : -1;
+}
+
+int wHpack::Lookup(uint64_t index, std::string* name, std::string* value) {
+	if (index == 0) {
+		return -1;
+	} else if (index <= kStaticNum) {
+		name->assign(kStaticTable[index - 1].mName);
+		if (value != NULL) {
+			value->assign(kStaticTable[index - 1].mValue);
+		}
+		return 0;
+	} else if (index - kStaticNum <= mTable.size()) {
+		const Entry_t& entry = mTable[static_cast<size_t>(index - kStaticNum - 1)];
+		name->assign(entry.mName);
+		if (value != NULL) {
+			value->assign(entry.mValue);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+void wHpack::Insert(const std::string& name, const std::string& value) {
+	size_t size = EntrySize(name, value);
+	while (!mTable.empty() && mSize + size > mMaxSize) {
+		Evict();
+	}
+	if (size > mMaxSize) {
+		// 大于表容量的条目清空动态表（RFC 7541 4.4）
+		return;
+	}
+	Entry_t entry;
+	entry.mName = name;
+	entry.mValue = value;
+	mTable.push_front(entry);
+	mSize += size;
+}
+
+void wHpack::Evict() {
+	mSize -= EntrySize(mTable.back().mName, mTable.back().mValue);
+	mTable.pop_back();
+}
+
+int wHpack::Decode(const char buf[], size_t len, Headers* headers) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	const uint8_t* e = p + len;
+	bool first = true;	// 表大小更新须位于header块开头
+	while (p < e) {
+		uint8_t b = *p;
+		uint64_t index;
+		std::string name, value;
+		if (b & 0x80) {
+			// 索引header
+			if (DecodeInt(&p, e, 7, &index) == -1 || Lookup(index, &name, &value) == -1) {
+				return -1;
+			}
+			headers->push_back(std::make_pair(name, value));
+		} else if ((b & 0xe0) == 0x20) {
+			// 动态表大小更新
+			if (!first || DecodeInt(&p, e, 5, &index) == -1 || index > mLimit) {
+				return -1;
+			}
+			mMaxSize = static_cast<size_t>(index);
+			while (!mTable.empty() && mSize > mMaxSize) {
+				Evict();
+			}
+			continue;
+		} else {
+			// 字面量：增量索引（01）、不索引（0000）、永不索引（0001）
+			bool incremental = (b & 0xc0) == 0x40;
+			if (DecodeInt(&p, e, incremental ? 6 : 4, &index) == -1) {
+				return -1;
+			}
+			if (index == 0) {
+				if (DecodeString(&p, e, &name) == -1) {
+					return -1;
+				}
+			} else if (Lookup(index, &name, NULL) == -1) {
+				return -1;
+			}
+			if (DecodeString(&p, e, &value) == -1) {
+				return -1;
+			}
+			if (incremental) {
+				Insert(name, value);
+			}
+			headers->push_back(std::make_pair(name, value));
+		}
+		first = false;
+	}
+	return 0;
+}
+
+void wHpack::Encode(std::string* dst, const wSlice& name, const wSlice& value) {
+	// 静态表中完全匹配的条目以索引编码，否则以（静态表名称索引的）不索引字面量编码
+	size_t nameidx = 0;
+	for (size_t i = 0; i < kStaticNum; i++) {
+		if (name == wSlice(kStaticTable[i].mName)) {
+			if (value == wSlice(kStaticTable[i].mValue)) {
+				EncodeInt(dst, 0x80, 7, i + 1);
+				return;
+			} else if (nameidx == 0) {
+				nameidx = i + 1;
+			}
+		}
+	}
+	EncodeInt(dst, 0x00, 4, nameidx);
+	if (nameidx == 0) {
+		EncodeInt(dst, 0x00, 7, name.size());
+		dst->append(name.data(), name.size());
+	}
+	EncodeInt(dst, 0x00, 7, value.size());
+	dst->append(value.data(), value.size());
+}
+
+void wHpack::EncodeStatus(std::string* dst, int code) {
+	char status[4];
+	snprintf(status, sizeof(status), "%03d", code);
+	Encode(dst, ":status", status);
+}
+
+int32_t wHttp2Codec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	if (mPreface) {
+		// 连接前言单独成段
+		size_t n = len < kHttp2PrefaceLen ? len : kHttp2PrefaceLen;
+		if (memcmp(buf, kHttp2Preface, n) != 0) {
+			return -1;
+		} else if (n < kHttp2PrefaceLen) {
+			return 0;
+		}
+		mPreface = false;
+		*off = 0;
+		*size = static_cast<uint32_t>(kHttp2PrefaceLen);
+		return static_cast<int32_t>(kHttp2PrefaceLen);
+	}
+
+	if (len < kHttp2FrameHead) {
+		return 0;
+	}
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	uint32_t framelen = (static_cast<uint32_t>(p[0]) << 16) | (static_cast<uint32_t>(p[1]) << 8) | p[2];
+	if (framelen > kHttp2FrameSize) {
+		return -1;
+	} else if (kHttp2FrameHead + framelen > len) {
+		return 0;
+	}
+	*off = 0;
+	*size = static_cast<uint32_t>(kHttp2FrameHead + framelen);
+	return static_cast<int32_t>(kHttp2FrameHead + framelen);
+}
+
+Http2Conn_t::~Http2Conn_t() {
+	while (!mStreams.empty()) {
+		Remove(mStreams.begin()->first);
+	}
+}
+
+Http2Stream_t* Http2Conn_t::Find(uint32_t id) {
+	std::map<uint32_t, Http2Stream_t*>::iterator it = mStreams.find(id);
+	return it != mStreams.end() ? it->second : NULL;
+}
+
+void Http2Conn_t::Remove(uint32_t id) {
+	std::map<uint32_t, Http2Stream_t*>::iterator it = mStreams.find(id);
+	if (it == mStreams.end()) {
+		return;
+	}
+	Http2Stream_t* stream = it->second;
+	if (stream->mFile != NULL) {
+		wFileCache::Default()->Release(stream->mFile);
+	}
+	if (mCur == stream) {
+		mCur = NULL;
+	}
+	mStreams.erase(it);
+	HNET_DELETE(stream);
+}
+
+namespace http2 {
+
+void EncodeHead(char buf[], uint32_t len, uint8_t type, uint8_t flags, uint32_t id) {
+	buf[0] = static_cast<char>((len >> 16) & 0xff);
+	buf[1] = static_cast<char>((len >> 8) & 0xff);
+	buf[2] = static_cast<char>(len & 0xff);
+	buf[3] = static_cast<char>(type);
+	buf[4] = static_cast<char>(flags);
+	EncodeBig32(buf + 5, id & 0x7fffffff);
+}
+
+bool Base64UrlDecode(const wSlice& src, std::string* dst) {
+	dst->clear();
+	uint32_t acc = 0;
+	int bits = 0;
+	for (size_t i = 0; i < src.size(); i++) {
+		char c = src[i];
+		int v;
+		if (c >= 'A' && c <= 'Z') {
+			v = c - 'A';
+		} else if (c >= 'a' && c <= 'z') {
+			v = c - 'a' + 26;
+		} else if (c >= '0' && c <= '9') {
+			v = c - '0' + 52;
+		} else if (c == '-' || c == '+') {
+			v = 62;
+		} else if (c == '_' || c == '/') {
+			v = 63;
+		} else if (c == '=') {
+			break;
+		} else {
+			return false;
+		}
+		acc = (acc << 6) | static_cast<uint32_t>(v);
+		bits += 6;
+		if (bits >= 8) {
+			bits -= 8;
+			dst->push_back(static_cast<char>((acc >> bits) & 0xff));
+		}
+	}
+	return true;
+}
+
+}	// namespace http2
+
+}	// namespace hnet
@@ -0,0 +1,201 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP2_H_
+#define _W_HTTP2_H_
+
+#include <map>
+#include <deque>
+#include <vector>
+#include <functional>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+#include "wCodec.h"
+#include "wFileCache.h"
+
+namespace hnet {
+
+// 客户端连接前言
+const char		kHttp2Preface[]		= "PRI * HTTP/2.0\r\n\r\nSM\r\n\r\n";
+const size_t	kHttp2PrefaceLen	= sizeof(kHttp2Preface) - 1;
+
+const size_t	kHttp2FrameHead		= 9;		// 帧头长度
+const uint32_t	kHttp2FrameSize		= 16384;	// 默认（本端接收）最大帧长度
+const int32_t	kHttp2Window		= 65535;	// 默认初始流量窗口
+const int32_t	kHttp2MaxWindow		= 0x7fffffff;
+const int32_t	kHttp2ConnWindow	= 16 << 20;	// 本端连接接收窗口
+const uint32_t	kHttp2TableSize		= 4096;		// HPACK动态表大小
+const uint32_t	kHttp2MaxStreams	= 256;		// 默认单连接最大并发流，配置项 http2_max_streams
+const size_t	kHttp2OutSize		= 65536;	// 单流待发送分块响应数据上限
+const size_t	kHttp2BlockMax		= 4*kMaxPackageSize;	// 单个header块累计上限。header块须完整解码以保持HPACK动态表同步，超出为连接错误
+
+// 帧类型
+enum {
+	kHttp2Data = 0, kHttp2Headers, kHttp2Priority, kHttp2RstStream, kHttp2Settings,
+	kHttp2PushPromise, kHttp2Ping, kHttp2Goaway, kHttp2WindowUpdate, kHttp2Continuation
+};
+
+// 帧标志
+const uint8_t	kHttp2FlagEndStream		= 0x1;
+const uint8_t	kHttp2FlagAck			= 0x1;
+const uint8_t	kHttp2FlagEndHeaders	= 0x4;
+const uint8_t	kHttp2FlagPadded		= 0x8;
+const uint8_t	kHttp2FlagPriority		= 0x20;
+
+// 设置项
+enum {
+	kHttp2SetTableSize = 1, kHttp2SetEnablePush, kHttp2SetMaxStreams, kHttp2SetInitialWindow, kHttp2SetMaxFrameSize, kHttp2SetMaxHeaderList
+};
+
+// 错误码
+enum {
+	kHttp2NoError = 0, kHttp2ProtocolError, kHttp2InternalError, kHttp2FlowControlError, kHttp2SettingsTimeout, kHttp2StreamClosed,
+	kHttp2FrameSizeError, kHttp2RefusedStream, kHttp2Cancel, kHttp2CompressionError, kHttp2ConnectError, kHttp2EnhanceYourCalm
+};
+
+// HPACK头部压缩（RFC 7541）
+// 解码支持静态表、动态表（含表大小更新）及Huffman编码字符串
+// 编码仅使用静态表索引及不索引字面量（不占用对端动态表，不做Huffman编码）
+class wHpack : private wNoncopyable {
+public:
+    typedef std::vector<std::pair<std::string, std::string> > Headers;
+
+    wHpack() : mSize(0), mMaxSize(kHttp2TableSize), mLimit(kHttp2TableSize) { }
+
+    // 解码完整header块，结果追加至headers。返回-1为压缩错误（连接须关闭）
+    int Decode(const char buf[], size_t len, Headers* headers);
+
+    // 编码一个header至dst（name须为小写）
+    static void Encode(std::string* dst, const wSlice& name, const wSlice& value);
+    static void EncodeStatus(std::string* dst, int code);
+
+protected:
+    struct Entry_t {
+        std::string mName;
+        std::string mValue;
+    };
+
+    // 前缀整数（n位前缀）
+    static int DecodeInt(const uint8_t** p, const uint8_t* e, int n, uint64_t* value);
+    static void EncodeInt(std::string* dst, uint8_t flag, int n, uint64_t value);
+    static int DecodeString(const uint8_t** p, const uint8_t* e, std::string* str);
+    static int HuffmanDecode(const uint8_t* p, size_t len, std::string* str);
+
+    // 静态表、动态表索引（从1开始）
+    int Lookup(uint64_t index, std::string* name, std::string* value);
+    void Insert(const std::string& name, const std::string& value);
+    void Evict();
+
+    std::deque<Entry_t> mTable;	// 动态表，新条目在前
+    size_t mSize;
+    size_t mMaxSize;	// 当前动态表大小上限（表大小更新指令）
+    size_t mLimit;		// 本端设置的上限（SETTINGS_HEADER_TABLE_SIZE）
+};
+
+// HTTP/2帧分帧：[24位长度][类型][标志][流id][载荷]，Handlemsg收到整帧（含帧头）
+class wHttp2Codec : public wCodec {
+public:
+    explicit wHttp2Codec(bool preface = false) : mPreface(preface) { }
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len) {
+        return 0;
+    }
+
+    virtual void EncodeHead(char buf[], size_t len) { }
+
+    virtual size_t MinLen() {
+        return 0;
+    }
+
+    virtual const char* Name() {
+        return "http2";
+    }
+
+protected:
+    bool mPreface;	// 等待客户端连接前言（h2c升级后）
+};
+
+// HTTP/2流
+struct Http2Stream_t {
+    uint32_t mId;
+    int32_t mSendWindow;	// 对端授予的发送窗口
+    int32_t mRecvWindow;	// 本端接收窗口
+    wHpack::Headers mHeaders;
+    std::string mBody;		// 请求body
+    bool mRemoteEnd;	// 对端已结束（END_STREAM）
+    bool mTrailer;		// 正接收trailer
+
+    // 响应数据（受流量控制）：mOut自mOutOff起待发送，之后依次为文件内容、分块写函数数据
+    std::string mOut;
+    size_t mOutOff;
+    bool mOutEnd;	// 响应数据已全部写入mOut（待发送完毕后结束流）
+    bool mEnded;	// 已发送END_STREAM
+    wFileCache::File_t* mFile;
+    uint64_t mFileOff;
+    uint64_t mFileLen;
+    std::function<int()> mChunk;
+
+    Http2Stream_t(uint32_t id, int32_t sendwin) : mId(id), mSendWindow(sendwin), mRecvWindow(kHttp2Window), mRemoteEnd(false), mTrailer(false),
+    mOutOff(0), mOutEnd(false), mEnded(false), mFile(NULL), mFileOff(0), mFileLen(0) { }
+
+    inline size_t OutLen() { return mOut.size() - mOutOff;}
+};
+
+// HTTP/2连接状态
+struct Http2Conn_t {
+    wHpack mHpack;
+    std::map<uint32_t, Http2Stream_t*> mStreams;
+    uint32_t mLastStream;	// 已接收最大流id
+    uint32_t mContinuation;	// 等待CONTINUATION的流id，0无
+    std::string mBlock;		// header块片段（HEADERS、CONTINUATION）
+    uint8_t mBlockFlags;	// header块所在HEADERS帧标志
+    uint32_t mBlockReset;	// header块解码后以该错误码重置所属流（流错误），0无
+    int64_t mSendWindow;	// 连接发送窗口
+    int32_t mRecvWindow;	// 连接接收窗口
+    int32_t mInitWindow;	// 对端SETTINGS_INITIAL_WINDOW_SIZE
+    uint32_t mFrameSize;	// 对端SETTINGS_MAX_FRAME_SIZE
+    uint32_t mMaxStreams;
+    bool mGoaway;	// 已收到GOAWAY
+    bool mPreface;	// 等待客户端连接前言（h2c升级后）
+    Http2Stream_t* mCur;	// 正在处理（路由、分块写函数）的流
+    std::string mReq;	// 当前流的HTTP/1.1形式请求（供 wHttpParser 解析）
+
+    Http2Conn_t() : mLastStream(0), mContinuation(0), mBlockFlags(0), mBlockReset(0), mSendWindow(kHttp2Window), mRecvWindow(kHttp2Window), mInitWindow(kHttp2Window),
+    mFrameSize(kHttp2FrameSize), mMaxStreams(kHttp2MaxStreams), mGoaway(false), mPreface(false), mCur(NULL) { }
+    ~Http2Conn_t();
+
+    Http2Stream_t* Find(uint32_t id);
+    void Remove(uint32_t id);
+};
+
+namespace http2 {
+
+// 写入帧头（9字节）
+void EncodeHead(char buf[], uint32_t len, uint8_t type, uint8_t flags, uint32_t id);
+
+inline void EncodeBig32(char buf[], uint32_t value) {
+	buf[0] = static_cast<char>((value >> 24) & 0xff);
+	buf[1] = static_cast<char>((value >> 16) & 0xff);
+	buf[2] = static_cast<char>((value >> 8) & 0xff);
+	buf[3] = static_cast<char>(value & 0xff);
+}
+
+inline uint32_t DecodeBig32(const char buf[]) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	return (static_cast<uint32_t>(p[0]) << 24) | (static_cast<uint32_t>(p[1]) << 16) | (static_cast<uint32_t>(p[2]) << 8) | p[3];
+}
+
+// base64url解码（HTTP2-Settings），失败返回false
+bool Base64UrlDecode(const wSlice& src, std::string* dst);
+
+}	// namespace http2
+
+}	// namespace hnet
+
+#endif
@@ -0,0 +1,136 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sys/socket.h>
+#include "wHttpClientTask.h"
+#include "wSocket.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+wHttpClientTask::~wHttpClientTask() {
+	// 在途请求已由 wMultiClient::HttpClose 回调或重新排队，此处仅释放析构时残留
+	for (std::deque<HttpCall_t*>::iterator it = mInflight.begin(); it != mInflight.end(); it++) {
+		HNET_DELETE(*it);
+	}
+}
+
+int wHttpClientTask::TaskRecv(ssize_t *size) {
+	int ret = wTask::TaskRecv(size);
+	if (ret == -1 && mErr == 0) {
+		if (*size == 0) {
+			// 对端关闭：结束以连接关闭分帧的响应
+			mClose = true;
+			if (!mInflight.empty() && mParser.Eof()) {
+				Complete();
+			}
+			mErr = ECONNRESET;
+		} else {
+			mErr = errno != 0 ? errno : ECONNRESET;
+		}
+	}
+	return ret;
+}
+
+int wHttpClientTask::Handlemsg(char buf[], uint32_t len) {
+	if (mInflight.empty()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClientTask::Handlemsg () failed", "unexpected response");
+		mErr = EPROTO;
+		return -1;
+	}
+
+	wHttpParser::Part part = mParser.GetPart();
+	if (part == wHttpParser::kPartRequest || part == wHttpParser::kPartHead) {
+		if (mParser.Status()/100 == 1) {
+			// 忽略1xx临时响应
+			return 0;
+		}
+		mRes.mCode = mParser.Status();
+		mRes.mReason = mParser.Reason().ToString();
+		mRes.mHeader.clear();
+		mRes.mBody.clear();
+		for (uint32_t i = 0; i < mParser.HeaderNum(); i++) {
+			mRes.mHeader[mParser.HeaderName(i).ToString()] = mParser.HeaderValue(i).ToString();
+		}
+		mClose = !mParser.KeepAlive();
+	}
+
+	if (part != wHttpParser::kPartHead) {
+		wSlice body = mParser.Body();
+		if (mRes.mBody.size() + body.size() > kHttpClientMaxBody) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClientTask::Handlemsg () failed", "response body too large");
+			mErr = EMSGSIZE;
+			return -1;
+		}
+		mRes.mBody.append(body.data(), body.size());
+	}
+
+	if (part == wHttpParser::kPartRequest || part == wHttpParser::kPartEnd) {
+		return Complete();
+	}
+	return 0;
+}
+
+int wHttpClientTask::Complete() {
+	HttpCall_t* call = mInflight.front();
+	mInflight.pop_front();
+	if (mInflight.empty()) {
+		mIdleTm = soft::TimeUsec();
+	} else {
+		mParser.SkipBody(mInflight.front()->mHead);
+	}
+
+	if (call->mCallback) {
+		call->mCallback(0, &mRes);
+	}
+	HNET_DELETE(call);
+
+	if (mClose) {
+		// 响应要求关闭连接，其后流水线请求由连接池重试
+		mErr = ECONNRESET;
+		return -1;
+	}
+	return Client()->HttpDispatch(mPool);
+}
+
+int wHttpClientTask::Request(HttpCall_t* call) {
+	if (Append2Buf(call->mReq.data(), call->mReq.size()) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClientTask::Request Append2Buf() failed", "");
+		return -1;
+	}
+	if (mInflight.empty()) {
+		mParser.SkipBody(call->mHead);
+	}
+	mInflight.push_back(call);
+	return Output();
+}
+
+bool wHttpClientTask::Acceptable(HttpCall_t* call, size_t depth) {
+	if (mClose || mErr != 0 || mInflight.size() >= depth || kPackageSize - SendLen() < call->mReq.size()) {
+		return false;
+	}
+	// 非幂等请求不参与流水线
+	return mInflight.empty() || (call->mIdempotent && mInflight.back()->mIdempotent);
+}
+
+int wHttpClientTask::Connected() {
+	int err = 0;
+	socklen_t len = sizeof(err);
+	if (getsockopt(mSocket->FD(), SOL_SOCKET, SO_ERROR, reinterpret_cast<void*>(&err), &len) == -1) {
+		err = errno;
+	}
+	if (err != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpClientTask::Connected connect() failed", error::Strerror(err).c_str());
+		mErr = err;
+		return -1;
+	}
+	mConnecting = false;
+	mSocket->SS() = kSsConnected;
+	return 0;
+}
+
+}	// namespace hnet
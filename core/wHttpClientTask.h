@@ -0,0 +1,90 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_CLIENT_TASK_H_
+#define _W_HTTP_CLIENT_TASK_H_
+
+#include <deque>
+#include <vector>
+#include "wCore.h"
+#include "wTask.h"
+#include "wHttpParser.h"
+#include "wHttpTask.h"
+
+namespace hnet {
+
+// 异步HTTP请求
+struct HttpCall_t {
+    std::string mReq;	// 序列化请求（请求行、header、body）
+    HttpCallback mCallback;
+    uint64_t mDeadline;	// 截止时间（微秒）
+    bool mHead;		// HEAD请求（响应无body）
+    bool mIdempotent;	// 幂等请求（可流水线发送、连接失效时重试）
+    bool mRetried;	// 已重试
+
+    HttpCall_t() : mDeadline(0), mHead(false), mIdempotent(false), mRetried(false) { }
+};
+
+class wHttpClientTask;
+
+// host:port 长连接池
+struct HttpPool_t {
+    std::string mHost;
+    uint16_t mPort;
+    std::vector<wHttpClientTask*> mConn;
+    std::deque<HttpCall_t*> mWait;	// 等待连接的请求
+};
+
+// 连接池中的HTTP客户端连接：请求按序写入发送缓冲，响应按序匹配在途请求（流水线）
+// 非阻塞连接建立前请求即可写入发送缓冲，连接建立后发出
+class wHttpClientTask : public wTask {
+public:
+    wHttpClientTask(wSocket *socket, HttpPool_t* pool) : wTask(socket, kClientHttpType), mParser(true), mPool(pool),
+    mConnecting(false), mClose(false), mErr(0), mIdleTm(soft::TimeUsec()) {
+        wCodec* codec;
+        HNET_NEW(wHttpCodec(&mParser), codec);
+        SetCodec(codec);
+    }
+    virtual ~wHttpClientTask();
+
+    // 连接关闭时结束以连接关闭分帧的响应
+    virtual int TaskRecv(ssize_t *size);
+
+    virtual int Handlemsg(char buf[], uint32_t len);
+
+    // 写入请求并加入在途队列
+    int Request(HttpCall_t* call);
+
+    // 可否立即（或流水线）发送请求
+    bool Acceptable(HttpCall_t* call, size_t depth);
+
+    // 非阻塞连接完成（可写事件）
+    int Connected();
+
+    inline std::deque<HttpCall_t*>& Inflight() { return mInflight;}
+    inline HttpPool_t* Pool() { return mPool;}
+    inline bool& Connecting() { return mConnecting;}
+    inline bool Closing() { return mClose;}
+    inline int& Err() { return mErr;}
+    inline uint64_t IdleTm() { return mIdleTm;}
+
+protected:
+    // 完成队首请求
+    int Complete();
+
+    wHttpParser mParser;
+    HttpPool_t* mPool;
+    std::deque<HttpCall_t*> mInflight;
+    HttpResponse_t mRes;	// 接收中的响应
+    bool mConnecting;
+    bool mClose;	// 响应要求关闭连接
+    int mErr;	// 连接错误（errno）
+    uint64_t mIdleTm;	// 在途请求清空时间（微秒）
+};
+
+}	// namespace hnet
+
+#endif
@@ -0,0 +1,455 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttpParser.h"
+#include "wMisc.h"
+
+namespace hnet {
+
+namespace {
+
+inline bool IsSpace(char c) {
+	return c == ' ' || c == '\t';
+}
+
+inline bool EqualNoCase(const wSlice& a, const char* b, size_t n) {
+	return a.size() == n && scan::CaseEqual(a.data(), b, n);
+}
+
+}	// namespace anonymous
+
+bool wHttpParser::HasToken(const wSlice& value, const char* token) {
+	size_t n = strlen(token);
+	const char* p = value.data();
+	const char* e = p + value.size();
+	while (p < e) {
+		while (p < e && (IsSpace(*p) || *p == ',')) {
+			p++;
+		}
+		const char* s = p;
+		while (p < e && *p != ',') {
+			p++;
+		}
+		const char* t = p;
+		while (t > s && IsSpace(*(t - 1))) {
+			t--;
+		}
+		if (static_cast<size_t>(t - s) == n && scan::CaseEqual(s, token, n)) {
+			return true;
+		}
+	}
+	return false;
+}
+
+void wHttpParser::Reset() {
+	mBase = NULL;
+	mState = kStart;
+	mPart = kPartNone;
+	mPos = mScan = 0;
+	memset(&mMethod, 0, sizeof(mMethod));
+	memset(&mUrl, 0, sizeof(mUrl));
+	memset(&mPath, 0, sizeof(mPath));
+	memset(&mQuery, 0, sizeof(mQuery));
+	memset(&mVersion, 0, sizeof(mVersion));
+	memset(&mBody, 0, sizeof(mBody));
+	memset(&mReason, 0, sizeof(mReason));
+	mMinor = 1;
+	mStatus = 0;
+	mMethodId = -1;
+	mHeaderNum = 0;
+	mHeadLen = 0;
+	mContentLength = 0;
+	mConnection = 0;
+	mLength = false;
+	mChunked = false;
+	mChunkLeft = 0;
+	mUntilClose = false;
+}
+
+int32_t wHttpParser::Parse(const char buf[], size_t len) {
+	if (mState == kDone) {
+		Reset();
+	}
+	mBase = buf;
+	if (mState >= kChunkSize) {
+		return ParseChunk(buf, len);
+	}
+
+	while (mState != kDone) {
+		if (mState == kBody) {
+			if (mHeadLen + mContentLength > len) {
+				return 0;
+			}
+			SetSpan(&mBody, mHeadLen, static_cast<size_t>(mContentLength));
+			mState = kDone;
+			break;
+		}
+
+		// 逐行解析：从上次扫描位置继续查找换行
+		size_t n = len < kMaxPackageSize ? len : kMaxPackageSize;
+		const char* lf = NULL;
+		if (mScan < n) {
+			lf = reinterpret_cast<const char*>(memchr(buf + mScan, kLF, n - mScan));
+		}
+		if (lf == NULL) {
+			mScan = n;
+			return len >= kMaxPackageSize ? -1 : 0;
+		}
+
+		size_t next = static_cast<size_t>(lf - buf) + 1;
+		size_t end = next - 1;
+		if (end > mPos && buf[end - 1] == kCR) {
+			end--;
+		}
+
+		int ret = 0;
+		if (mState == kStart) {
+			// 忽略请求前空行
+			if (end == mPos) {
+				mPos = mScan = next;
+				continue;
+			}
+			mState = kLine;
+		}
+
+		if (mState == kLine) {
+			ret = ParseLine(buf, end);
+			mState = kHeader;
+		} else if (mState == kHeader) {
+			if (end == mPos) {
+				// header结束
+				mHeadLen = next;
+				if (mResponse && (mSkipBody || mStatus/100 == 1 || mStatus == 204 || mStatus == 304)) {
+					mContentLength = 0;
+					mChunked = false;
+				} else if (mResponse && !mChunked && (!mLength || mContentLength > kMaxPackageSize - mHeadLen)) {
+					// 连接关闭分帧，或超出接收缓冲的长度分帧响应体：按片解析
+					mUntilClose = !mLength;
+					mChunkLeft = mLength ? mContentLength : UINT64_MAX;
+					mState = kChunkData;
+					mPos = next;
+					return Emit(kPartHead);
+				} else if (!mResponse && mLength && (mContentLength > kMaxPackageSize - mHeadLen || mContentLength > mStreamLen)) {
+					// 超出接收缓冲（或StreamLen）的长度分帧请求体：按片解析
+					mChunkLeft = mContentLength;
+					mState = kChunkData;
+					mPos = next;
+					return Emit(kPartHead);
+				}
+				if (mChunked) {
+					// 请求头单独成段，请求体按片解析
+					mState = kChunkSize;
+					mPos = next;
+					return Emit(kPartHead);
+				}
+				mState = kBody;
+			} else {
+				ret = ParseHeader(buf, end);
+			}
+		}
+		if (ret == -1) {
+			return -1;
+		}
+		mPos = mScan = next;
+	}
+
+	if (mHeadLen + mContentLength > kMaxPackageSize) {
+		return -1;
+	}
+	mPart = kPartRequest;
+	return static_cast<int32_t>(mHeadLen + mContentLength);
+}
+
+int32_t wHttpParser::ParseChunk(const char buf[], size_t len) {
+	while (true) {
+		if (mState == kChunkData) {
+			// 数据片：已到达部分即返回，单块可大于接收缓冲
+			size_t n = len - mPos;
+			if (n > mChunkLeft) {
+				n = static_cast<size_t>(mChunkLeft);
+			}
+			if (n == 0) {
+				return 0;
+			}
+			SetSpan(&mBody, mPos, n);
+			mPos += n;
+			mChunkLeft -= n;
+			if (mChunkLeft == 0 && !mChunked) {
+				// 长度分帧响应体最后一片
+				mState = kDone;
+				return Emit(kPartEnd);
+			} else if (mChunkLeft == 0) {
+				mState = kChunkEnd;
+			}
+			return Emit(kPartBody);
+		}
+
+		// 块大小行、块尾CRLF、trailer逐行解析
+		size_t n = len < kMaxPackageSize ? len : kMaxPackageSize;
+		const char* lf = NULL;
+		if (mScan < n) {
+			lf = reinterpret_cast<const char*>(memchr(buf + mScan, kLF, n - mScan));
+		}
+		if (lf == NULL) {
+			mScan = n;
+			return len >= kMaxPackageSize ? -1 : 0;
+		}
+
+		size_t next = static_cast<size_t>(lf - buf) + 1;
+		size_t end = next - 1;
+		if (end > mPos && buf[end - 1] == kCR) {
+			end--;
+		}
+
+		if (mState == kChunkEnd) {
+			if (end != mPos) {
+				return -1;
+			}
+			mState = kChunkSize;
+		} else if (mState == kChunkSize) {
+			if (ParseChunkSize(buf, end) == -1) {
+				return -1;
+			}
+			mState = mChunkLeft > 0 ? kChunkData : kTrailer;
+		} else if (mState == kTrailer) {
+			// 忽略trailer，空行结束请求
+			if (end == mPos) {
+				mPos = next;
+				mState = kDone;
+				memset(&mBody, 0, sizeof(mBody));
+				return Emit(kPartEnd);
+			}
+		}
+		mPos = mScan = next;
+	}
+}
+
+int wHttpParser::ParseChunkSize(const char buf[], size_t end) {
+	// 十六进制块大小，忽略块扩展（;name=value）
+	uint64_t size = 0;
+	size_t p = mPos;
+	for (; p < end; p++) {
+		char c = buf[p];
+		int v;
+		if (c >= '0' && c <= '9') {
+			v = c - '0';
+		} else if (c >= 'a' && c <= 'f') {
+			v = c - 'a' + 10;
+		} else if (c >= 'A' && c <= 'F') {
+			v = c - 'A' + 10;
+		} else {
+			break;
+		}
+		if (size >> 56) {
+			return -1;
+		}
+		size = (size << 4) | v;
+	}
+	if (p == mPos || (p < end && buf[p] != ';' && !IsSpace(buf[p]))) {
+		return -1;
+	}
+	mChunkLeft = size;
+	return 0;
+}
+
+bool wHttpParser::Eof() {
+	if (mUntilClose && mState == kChunkData) {
+		mState = kDone;
+		mPart = kPartEnd;
+		memset(&mBody, 0, sizeof(mBody));
+		return true;
+	}
+	return false;
+}
+
+int wHttpParser::ParseStatus(const char buf[], size_t end) {
+	// 协议版本 HTTP/1.x
+	size_t p = mPos;
+	if (end - p < 12 || memcmp(buf + p, "HTTP/1.", 7) != 0 || (buf[p + 7] != '0' && buf[p + 7] != '1') || buf[p + 8] != ' ') {
+		return -1;
+	}
+	SetSpan(&mVersion, p, 8);
+	mMinor = buf[p + 7] - '0';
+
+	// 三位状态码
+	p += 9;
+	int status = 0;
+	for (size_t i = 0; i < 3; i++, p++) {
+		if (buf[p] < '0' || buf[p] > '9') {
+			return -1;
+		}
+		status = status*10 + (buf[p] - '0');
+	}
+	if (status < 100 || (p < end && buf[p] != ' ')) {
+		return -1;
+	}
+	mStatus = status;
+
+	// 原因短语（可为空）
+	if (p < end) {
+		p++;
+	}
+	SetSpan(&mReason, p, end - p);
+	return 0;
+}
+
+int wHttpParser::ParseLine(const char buf[], size_t end) {
+	if (mResponse) {
+		return ParseStatus(buf, end);
+	}
+
+	// 请求方法
+	const char* sp = reinterpret_cast<const char*>(memchr(buf + mPos, ' ', end - mPos));
+	size_t p = sp ? static_cast<size_t>(sp - buf) : end;
+	if (p == mPos || p == end) {
+		return -1;
+	}
+	SetSpan(&mMethod, mPos, p - mPos);
+	for (size_t i = 0; i < sizeof(kMethod)/sizeof(kMethod[0]); i++) {
+		if (mMethod.mLen == strlen(kMethod[i]) && memcmp(buf + mPos, kMethod[i], mMethod.mLen) == 0) {
+			mMethodId = static_cast<int>(i);
+			break;
+		}
+	}
+
+	// 请求URI：一次扫描定位路径结束（'?'或' '），查询串存在时再定位URI结束
+	size_t u = ++p;
+	const char* q = scan::FindAny(buf + u, end - u, " ?", 2);
+	if (q != NULL && *q == '?') {
+		sp = reinterpret_cast<const char*>(memchr(q, ' ', buf + end - q));
+	} else {
+		sp = q;
+		q = NULL;
+	}
+	p = sp ? static_cast<size_t>(sp - buf) : end;
+	if (p == u || p == end) {
+		return -1;
+	}
+	SetSpan(&mUrl, u, p - u);
+
+	if (q != NULL) {
+		size_t qoff = static_cast<size_t>(q - buf);
+		SetSpan(&mPath, u, qoff - u);
+		SetSpan(&mQuery, qoff + 1, p - qoff - 1);
+	} else {
+		SetSpan(&mPath, u, p - u);
+	}
+
+	// 协议版本 HTTP/1.x
+	size_t v = ++p;
+	if (end - v != 8 || memcmp(buf + v, "HTTP/1.", 7) != 0 || (buf[v + 7] != '0' && buf[v + 7] != '1')) {
+		return -1;
+	}
+	SetSpan(&mVersion, v, end - v);
+	mMinor = buf[v + 7] - '0';
+	return 0;
+}
+
+int wHttpParser::ParseHeader(const char buf[], size_t end) {
+	if (mHeaderNum >= kMaxHttpHeaders) {
+		return -1;
+	}
+
+	const char* colon = reinterpret_cast<const char*>(memchr(buf + mPos, ':', end - mPos));
+	if (colon == NULL || colon == buf + mPos) {
+		return -1;
+	}
+
+	size_t c = static_cast<size_t>(colon - buf);
+	size_t ne = c;
+	while (ne > mPos && IsSpace(buf[ne - 1])) {
+		ne--;
+	}
+	size_t vs = c + 1, ve = end;
+	while (vs < ve && IsSpace(buf[vs])) {
+		vs++;
+	}
+	while (ve > vs && IsSpace(buf[ve - 1])) {
+		ve--;
+	}
+
+	Field_t* f = &mHeaders[mHeaderNum++];
+	SetSpan(&f->mName, mPos, ne - mPos);
+	SetSpan(&f->mValue, vs, ve - vs);
+
+	// 影响分帧、连接的header即时处理
+	wSlice name(buf + mPos, ne - mPos), value(buf + vs, ve - vs);
+	if (EqualNoCase(name, "Content-Length", 14)) {
+		if (value.empty() || mChunked) {
+			return -1;
+		}
+		uint64_t l = 0;
+		for (size_t i = 0; i < value.size(); i++) {
+			// 请求体、响应体均可按片解析，长度不受接收缓冲限制
+			if (value[i] < '0' || value[i] > '9' || l > (UINT64_MAX - 9)/10) {
+				return -1;
+			}
+			l = l*10 + (value[i] - '0');
+		}
+		// 重复且值不一致的Content-Length为非法请求（防止请求走私）
+		if (mLength && l != mContentLength) {
+			return -1;
+		}
+		mContentLength = l;
+		mLength = true;
+	} else if (EqualNoCase(name, "Transfer-Encoding", 17)) {
+		// 仅支持chunked；与Content-Length同时出现为非法请求（防止请求走私）
+		if (!EqualNoCase(value, "chunked", 7) || mLength || mChunked) {
+			return -1;
+		}
+		mChunked = true;
+	} else if (EqualNoCase(name, "Connection", 10)) {
+		if (HasToken(value, "close")) {
+			mConnection = -1;
+		} else if (HasToken(value, "keep-alive")) {
+			mConnection = 1;
+		}
+	}
+	return 0;
+}
+
+bool wHttpParser::KeepAlive() {
+	if (mConnection != 0) {
+		return mConnection > 0;
+	}
+	return mMinor >= 1;
+}
+
+bool wHttpParser::Header(const wSlice& name, wSlice* value) {
+	for (uint32_t i = 0; i < mHeaderNum; i++) {
+		if (mHeaders[i].mName.mLen == name.size() && scan::CaseEqual(mBase + mHeaders[i].mName.mOff, name.data(), name.size())) {
+			*value = Slice(mHeaders[i].mValue);
+			return true;
+		}
+	}
+	return false;
+}
+
+bool wHttpParser::FindParam(const wSlice& str, const wSlice& key, wSlice* value) {
+	const char* p = str.data();
+	const char* e = p + str.size();
+	while (p < e) {
+		// 键以'='或'&'结束，仅'='时再定位值结束
+		const char* kend = scan::FindAny(p, e - p, "=&", 2);
+		const char* eq = NULL;
+		const char* ke = kend;
+		if (kend == NULL) {
+			kend = ke = e;
+		} else if (*kend == '=') {
+			eq = kend;
+			ke = reinterpret_cast<const char*>(memchr(eq, '&', e - eq));
+			ke = ke ? ke : e;
+		}
+		if (static_cast<size_t>(kend - p) == key.size() && memcmp(p, key.data(), key.size()) == 0) {
+			*value = eq ? wSlice(eq + 1, ke - eq - 1) : wSlice();
+			return true;
+		}
+		p = ke + 1;
+	}
+	return false;
+}
+
+}	// namespace hnet
@@ -0,0 +1,167 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_PARSER_H_
+#define _W_HTTP_PARSER_H_
+
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+const char  kMethod[][8]	= {"GET", "POST", "PUT", "DELETE", "HEAD", "PATCH", "OPTIONS"};
+
+// 请求方法在 kMethod 中下标（MethodId），须与 kMethod 顺序一致
+enum {
+	kMethodGet = 0, kMethodPost, kMethodPut, kMethodDelete, kMethodHead, kMethodPatch, kMethodOptions
+};
+
+// 单请求最多header数
+const uint32_t	kMaxHttpHeaders = 64;
+
+// HTTP/1.x 请求增量解析器（状态机）
+// 每次 Parse 从上次位置继续，不重复扫描；请求行、header、body仅记录相对请求起始的偏移，
+// 访问器以 wSlice 形式返回缓冲视图，解码（百分号、数字）在访问时按需进行。解析过程无堆内存分配
+// 分块请求体（Transfer-Encoding: chunked）及超出接收缓冲（或 StreamLen）的Content-Length请求体按片返回：
+// 请求头、各数据片、结束各为一段（见 Part），请求体无需整体缓冲
+// 响应模式（客户端）解析状态行，响应体以Content-Length、chunked或连接关闭分帧；超出接收缓冲的长度分帧、
+// 连接关闭分帧响应体同样按片返回
+class wHttpParser : private wNoncopyable {
+public:
+    enum State { kStart = 0, kLine, kHeader, kBody, kChunkSize, kChunkData, kChunkEnd, kTrailer, kDone };
+
+    // Parse返回的数据段
+    enum Part {
+        kPartNone = 0,
+        kPartRequest,	// 完整请求（Content-Length请求体）
+        kPartHead,		// 分块（按片）请求的请求头
+        kPartBody,		// 分块（按片）请求体数据片（Body()）
+        kPartEnd		// 分块（按片）请求体结束（长度、连接关闭分帧的按片请求体、响应体中可含最后一个数据片）
+    };
+
+    explicit wHttpParser(bool response = false) : mResponse(response), mSkipBody(false), mStreamLen(kMaxPackageSize) { Reset(); }
+
+    void Reset();
+
+    // 解析[buf, buf+len)，buf须为当前数据段起始（缓冲移动后偏移仍有效）
+    // 返回 >0  数据段长度（普通请求为整条请求长度，含body）
+    // 返回 0   数据段不完整
+    // 返回 -1  非法请求
+    int32_t Parse(const char buf[], size_t len);
+
+    inline State GetState() { return mState;}
+    inline Part GetPart() { return mPart;}
+    inline bool Done() { return mState == kDone;}
+    inline bool HeadDone() { return mState >= kBody;}
+    inline bool Chunked() { return mChunked;}
+
+    // 响应模式：对应请求为HEAD时响应无body（Reset不清除）
+    inline void SkipBody(bool skip) { mSkipBody = skip;}
+
+    // 请求模式：Content-Length超过len的请求体按片返回（默认仅超出接收缓冲时，Reset不清除）
+    inline void StreamLen(uint64_t len) { mStreamLen = len;}
+
+    // 响应模式：连接关闭。以连接关闭分帧的响应体就此结束时返回true
+    bool Eof();
+
+    // 以下访问器须在请求头解析完成后调用，返回视图指向 Parse 时的缓冲
+    // 分块请求中，请求行、header视图仅在 kPartHead 段有效；Body()为当前数据片
+    inline wSlice Method() { return Slice(mMethod);}
+    inline wSlice Url() { return Slice(mUrl);}
+    inline wSlice Path() { return Slice(mPath);}
+    inline wSlice Query() { return Slice(mQuery);}	// 不含'?'
+    inline wSlice Version() { return Slice(mVersion);}
+    inline wSlice Body() { return Slice(mBody);}
+    inline int VersionMinor() { return mMinor;}
+    inline int Status() { return mStatus;}	// 响应状态码
+    inline wSlice Reason() { return Slice(mReason);}	// 响应原因短语
+    inline uint64_t ContentLength() { return mContentLength;}
+    inline size_t HeadLen() { return mHeadLen;}
+
+    // 请求方法在 kMethod 中下标，未知为-1
+    inline int MethodId() { return mMethodId;}
+
+    // 长连接：HTTP/1.1默认开启（Connection: close关闭），HTTP/1.0默认关闭（Connection: keep-alive开启）
+    bool KeepAlive();
+
+    // header（名称不区分大小写），不存在返回false
+    bool Header(const wSlice& name, wSlice* value);
+    inline uint32_t HeaderNum() { return mHeaderNum;}
+    inline wSlice HeaderName(uint32_t i) { return Slice(mHeaders[i].mName);}
+    inline wSlice HeaderValue(uint32_t i) { return Slice(mHeaders[i].mValue);}
+
+    // 在 a=1&b=2 形式的串中查找key，返回未解码的值
+    static bool FindParam(const wSlice& str, const wSlice& key, wSlice* value);
+
+    // 在逗号分隔的token列表中查找token（不区分大小写）
+    static bool HasToken(const wSlice& value, const char* token);
+
+protected:
+    struct Span_t {
+        uint32_t mOff;
+        uint32_t mLen;
+    };
+    struct Field_t {
+        Span_t mName;
+        Span_t mValue;
+    };
+
+    inline wSlice Slice(const Span_t& s) { return wSlice(mBase + s.mOff, s.mLen);}
+    inline void SetSpan(Span_t* s, size_t off, size_t len) {
+        s->mOff = static_cast<uint32_t>(off);
+        s->mLen = static_cast<uint32_t>(len);
+    }
+
+    int ParseLine(const char buf[], size_t end);
+    int ParseStatus(const char buf[], size_t end);
+    int ParseHeader(const char buf[], size_t end);
+    int32_t ParseChunk(const char buf[], size_t len);
+    int ParseChunkSize(const char buf[], size_t end);
+
+    // 返回已解析的数据段，下一数据段从缓冲新起始处解析
+    inline int32_t Emit(Part part) {
+        int32_t ret = static_cast<int32_t>(mPos);
+        mPart = part;
+        mPos = mScan = 0;
+        return ret;
+    }
+
+    bool mResponse;
+    bool mSkipBody;
+    uint64_t mStreamLen;
+    const char* mBase;
+    State mState;
+    Part mPart;
+    size_t mPos;	// 下一待解析行起始
+    size_t mScan;	// 已扫描（无换行）位置
+
+    Span_t mMethod;
+    Span_t mUrl;
+    Span_t mPath;
+    Span_t mQuery;
+    Span_t mVersion;
+    Span_t mBody;
+    Span_t mReason;
+    int mMinor;
+    int mStatus;
+    int mMethodId;
+
+    Field_t mHeaders[kMaxHttpHeaders];
+    uint32_t mHeaderNum;
+
+    size_t mHeadLen;
+    uint64_t mContentLength;
+    int8_t mConnection;	// -1 close，0 未指定，1 keep-alive
+    bool mLength;	// 含Content-Length
+    bool mChunked;	// Transfer-Encoding: chunked
+    uint64_t mChunkLeft;	// 当前块剩余长度
+    bool mUntilClose;	// 响应体以连接关闭分帧
+};
+
+}	// namespace hnet
+
+#endif
@@ -0,0 +1,21 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttpRouter.h"
+
+namespace hnet {
+
+bool RouteParams_t::Get(const wSlice& key, wSlice* value) const {
+	for (uint32_t i = 0; i < mNum; i++) {
+		if (mKey[i] == key) {
+			*value = mValue[i];
+			return true;
+		}
+	}
+	return false;
+}
+
+}	// namespace hnet
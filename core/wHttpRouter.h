@@ -0,0 +1,284 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_ROUTER_H_
+#define _W_HTTP_ROUTER_H_
+
+#include <vector>
+#include <functional>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+#include "wHttpParser.h"
+
+namespace hnet {
+
+// 单条路由最多路径参数数
+const uint32_t	kMaxRouteParams = 16;
+
+// 路径参数（视图指向注册路径及请求缓冲，无拷贝）
+struct RouteParams_t {
+	wSlice mKey[kMaxRouteParams];
+	wSlice mValue[kMaxRouteParams];
+	uint32_t mNum;
+
+	RouteParams_t() : mNum(0) { }
+
+	// 不存在返回false
+	bool Get(const wSlice& key, wSlice* value) const;
+};
+
+// HTTP路由器：每个请求方法一棵压缩前缀树（radix tree）
+// 路径支持静态片段、:name 参数（匹配一个路径段）、*name 通配（匹配剩余路径，须位于末尾），如 /user/:id/files/*path
+// 匹配优先级：静态 > 参数 > 通配。匹配过程无堆内存分配
+template<typename FUNC>
+class wHttpRouter : private wNoncopyable {
+public:
+    wHttpRouter() {
+        for (size_t i = 0; i < kMethodNum; i++) {
+            mRoot[i] = NULL;
+        }
+    }
+    ~wHttpRouter() {
+        for (size_t i = 0; i < kMethodNum; i++) {
+            Free(mRoot[i]);
+        }
+    }
+
+    // 注册路由，同一路径重复注册时覆盖。方法未知或路径非法返回-1
+    int Add(const wSlice& method, const wSlice& path, const FUNC& func);
+
+    // 匹配路由，未匹配返回NULL
+    FUNC* Match(int method, const wSlice& path, RouteParams_t* params);
+
+    // 路径在其他方法中可匹配时返回允许的方法列表（405 Allow）
+    bool Allowed(const wSlice& path, std::string* allow);
+
+    inline bool Empty() { return mHandle.empty();}
+
+protected:
+    static const size_t kMethodNum = sizeof(kMethod)/sizeof(kMethod[0]);
+
+    struct Node_t {
+        std::string mPrefix;	// 静态片段
+        std::string mIndices;	// 静态子节点首字符
+        std::vector<Node_t*> mChildren;
+        Node_t* mParam;	// :name子节点
+        Node_t* mWild;	// *name子节点
+        std::string mName;	// 参数名
+        int mHandle;	// mHandle下标，-1无
+
+        Node_t() : mParam(NULL), mWild(NULL), mHandle(-1) { }
+    };
+
+    Node_t* Insert(Node_t* root, const char* path, size_t len);
+    int Find(Node_t* n, const char* path, size_t len, RouteParams_t* params);
+    void Free(Node_t* n);
+
+    Node_t* mRoot[kMethodNum];
+    std::vector<FUNC> mHandle;
+};
+
+template<typename FUNC>
+int wHttpRouter<FUNC>::Add(const wSlice& method, const wSlice& path, const FUNC& func) {
+    size_t m = 0;
+    while (m < kMethodNum && !(method.size() == strlen(kMethod[m]) && memcmp(method.data(), kMethod[m], method.size()) == 0)) {
+        m++;
+    }
+    if (m == kMethodNum || path.empty() || path[0] != '/') {
+        return -1;
+    }
+
+    if (mRoot[m] == NULL) {
+        HNET_NEW(Node_t(), mRoot[m]);
+        if (mRoot[m] == NULL) {
+            return -1;
+        }
+    }
+    Node_t* n = Insert(mRoot[m], path.data(), path.size());
+    if (n == NULL) {
+        return -1;
+    }
+    if (n->mHandle >= 0) {
+        mHandle[n->mHandle] = func;
+    } else {
+        n->mHandle = static_cast<int>(mHandle.size());
+        mHandle.push_back(func);
+    }
+    return 0;
+}
+
+template<typename FUNC>
+typename wHttpRouter<FUNC>::Node_t* wHttpRouter<FUNC>::Insert(Node_t* n, const char* path, size_t len) {
+    while (len > 0) {
+        if (*path == ':' || *path == '*') {
+            // 参数名至'/'（通配至末尾）
+            const char* e = *path == ':' ? reinterpret_cast<const char*>(memchr(path, '/', len)) : NULL;
+            size_t namelen = (e ? static_cast<size_t>(e - path) : len) - 1;
+            if (namelen == 0 || (*path == '*' && memchr(path + 1, '/', namelen) != NULL)) {
+                return NULL;
+            }
+
+            Node_t** child = *path == ':' ? &n->mParam : &n->mWild;
+            if (*child == NULL) {
+                HNET_NEW(Node_t(), *child);
+                if (*child == NULL) {
+                    return NULL;
+                }
+                (*child)->mName.assign(path + 1, namelen);
+            } else if ((*child)->mName.size() != namelen || memcmp((*child)->mName.data(), path + 1, namelen) != 0) {
+                // 同一位置参数名冲突
+                return NULL;
+            }
+            n = *child;
+            path += namelen + 1;
+            len -= namelen + 1;
+            continue;
+        }
+
+        // 静态片段至下一参数
+        size_t k = 0;
+        while (k < len && path[k] != ':' && path[k] != '*') {
+            k++;
+        }
+
+        size_t i = n->mIndices.find(*path);
+        if (i == std::string::npos) {
+            Node_t* child;
+            HNET_NEW(Node_t(), child);
+            if (child == NULL) {
+                return NULL;
+            }
+            child->mPrefix.assign(path, k);
+            n->mIndices.push_back(*path);
+            n->mChildren.push_back(child);
+            n = child;
+            path += k;
+            len -= k;
+            continue;
+        }
+
+        // 公共前缀
+        Node_t* child = n->mChildren[i];
+        size_t c = 0;
+        while (c < k && c < child->mPrefix.size() && child->mPrefix[c] == path[c]) {
+            c++;
+        }
+        if (c < child->mPrefix.size()) {
+            // 分裂子节点
+            Node_t* mid;
+            HNET_NEW(Node_t(), mid);
+            if (mid == NULL) {
+                return NULL;
+            }
+            mid->mPrefix = child->mPrefix.substr(0, c);
+            child->mPrefix.erase(0, c);
+            mid->mIndices.push_back(child->mPrefix[0]);
+            mid->mChildren.push_back(child);
+            n->mChildren[i] = mid;
+            child = mid;
+        }
+        n = child;
+        path += c;
+        len -= c;
+    }
+    return n;
+}
+
+template<typename FUNC>
+FUNC* wHttpRouter<FUNC>::Match(int method, const wSlice& path, RouteParams_t* params) {
+    if (method < 0 || static_cast<size_t>(method) >= kMethodNum || mRoot[method] == NULL) {
+        return NULL;
+    }
+    params->mNum = 0;
+    int h = Find(mRoot[method], path.data(), path.size(), params);
+    return h >= 0 ? &mHandle[h] : NULL;
+}
+
+template<typename FUNC>
+int wHttpRouter<FUNC>::Find(Node_t* n, const char* path, size_t len, RouteParams_t* params) {
+    // 本节点静态片段
+    size_t plen = n->mPrefix.size();
+    if (len < plen || memcmp(path, n->mPrefix.data(), plen) != 0) {
+        return -1;
+    }
+    path += plen;
+    len -= plen;
+    if (len == 0 && n->mHandle >= 0) {
+        return n->mHandle;
+    }
+
+    uint32_t num = params->mNum;
+    if (len > 0) {
+        // 静态子节点
+        size_t i = n->mIndices.find(*path);
+        if (i != std::string::npos) {
+            int h = Find(n->mChildren[i], path, len, params);
+            if (h >= 0) {
+                return h;
+            }
+            params->mNum = num;
+        }
+
+        // 参数子节点：匹配一个非空路径段
+        if (n->mParam != NULL && num < kMaxRouteParams) {
+            const char* e = reinterpret_cast<const char*>(memchr(path, '/', len));
+            size_t seg = e ? static_cast<size_t>(e - path) : len;
+            if (seg > 0) {
+                params->mKey[num] = n->mParam->mName;
+                params->mValue[num] = wSlice(path, seg);
+                params->mNum = num + 1;
+                int h = Find(n->mParam, path + seg, len - seg, params);
+                if (h >= 0) {
+                    return h;
+                }
+                params->mNum = num;
+            }
+        }
+    }
+
+    // 通配子节点：匹配剩余路径（可为空）
+    if (n->mWild != NULL && n->mWild->mHandle >= 0 && num < kMaxRouteParams) {
+        params->mKey[num] = n->mWild->mName;
+        params->mValue[num] = wSlice(path, len);
+        params->mNum = num + 1;
+        return n->mWild->mHandle;
+    }
+    return -1;
+}
+
+template<typename FUNC>
+bool wHttpRouter<FUNC>::Allowed(const wSlice& path, std::string* allow) {
+    RouteParams_t params;
+    allow->clear();
+    for (size_t i = 0; i < kMethodNum; i++) {
+        if (mRoot[i] != NULL && Find(mRoot[i], path.data(), path.size(), &params) >= 0) {
+            if (!allow->empty()) {
+                allow->append(", ");
+            }
+            allow->append(kMethod[i]);
+        }
+        params.mNum = 0;
+    }
+    return !allow->empty();
+}
+
+template<typename FUNC>
+void wHttpRouter<FUNC>::Free(Node_t* n) {
+    if (n == NULL) {
+        return;
+    }
+    for (size_t i = 0; i < n->mChildren.size(); i++) {
+        Free(n->mChildren[i]);
+    }
+    Free(n->mParam);
+    Free(n->mWild);
+    HNET_DELETE(n);
+}
+
+}	// namespace hnet
+
+#endif
@@ -4,338 +4,780 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <strings.h>
+#include <ctype.h>
 #include <algorithm>
 #include <vector>
 #include "wHttpTask.h"
+#include "wHttpWriter.h"
 #include "wMisc.h"
 #include "wLogger.h"
+#include "wEnv.h"
+#include "wFile.h"
 
 namespace hnet {
 
-int wHttpTask::TaskRecv(ssize_t *size) {
-	const char *buffend = mRecvBuff + kPackageSize;
-
-	// 循环队列
-	if (mRecvLen < kPackageSize && mRecvLen == 0) {
-		mRecvRead = mRecvWrite = mRecvBuff;
-	} else if (mRecvLen < kPackageSize && mRecvRead != mRecvBuff && mRecvWrite == buffend) {
-		mRecvWrite = mRecvBuff;
-	}
-	*size = 0;
-
-	// len >= 0 正向剩余
-	// len < 0 分段，中间剩余
-	ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-	size_t leftlen = len >= 0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-
-	if (mRecvLen < kPackageSize) {
-		if (len >= 0 && leftlen <= 10*sizeof(kProtocol[0])) {
-			// 队列太过靠后，重新调整
-			memmove(mRecvBuff, mRecvRead, len);
-			mRecvRead = mRecvBuff;
-			mRecvWrite= mRecvBuff + len;
-			len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-			leftlen = len>=0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-		}
-
-		if (leftlen > 0) {
-			// socket接受数据
-			int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
-            if (ret == -1 || (ret == 0 && *size < 0)) {
-                return ret;
-            }
+namespace {
+
+// 单区间Range（bytes=a-b、bytes=a-、bytes=-n）
+// 返回 1 有效，0 忽略（语法错误或多区间），-1 不可满足
+int ParseRange(const wSlice& range, uint64_t size, uint64_t* off, uint64_t* len) {
+	const char* p = range.data();
+	const char* e = p + range.size();
+	if (range.size() < 6 || memcmp(p, "bytes=", 6) != 0 || memchr(p, ',', range.size()) != NULL) {
+		return 0;
+	}
+	p += 6;
 
-			mRecvLen += *size;
-			mRecvWrite += *size;
+	uint64_t first = 0, last = 0;
+	bool hasfirst = false, haslast = false;
+	for (; p < e && *p >= '0' && *p <= '9'; p++, hasfirst = true) {
+		if (first > (UINT64_MAX - 9)/10) {
+			return 0;
 		}
+		first = first*10 + (*p - '0');
+	}
+	if (p == e || *p != '-') {
+		return 0;
+	}
+	for (p++; p < e && *p >= '0' && *p <= '9'; p++, haslast = true) {
+		if (last > (UINT64_MAX - 9)/10) {
+			return 0;
+		}
+		last = last*10 + (*p - '0');
+	}
+	if (p != e || (!hasfirst && !haslast)) {
+		return 0;
 	}
 
-	// 消息解析
-    auto handleFunc = [this] (char* buf, uint32_t len, char* nextbuf) -> int {
-        int ret = this->Handlemsg(buf, len);
+	if (!hasfirst) {
+		// 末尾n字节
+		if (last == 0 || size == 0) {
+			return -1;
+		}
+		*off = last >= size ? 0 : size - last;
+		*len = size - *off;
+		return 1;
+	} else if (haslast && last < first) {
+		return 0;
+	} else if (first >= size) {
+		return -1;
+	}
+	*off = first;
+	*len = (haslast && last < size ? last + 1 : size) - first;
+	return 1;
+}
 
-        this->mRecvRead = nextbuf;
-        this->mRecvLen -= len;
-        return ret;
-    };
+// h2c升级响应
+const char kUpgradeH2c[] = "HTTP/1.1 101 Switching Protocols\r\nConnection: Upgrade\r\nUpgrade: h2c\r\n\r\n";
 
-    int ret = 0;
-	while (mRecvLen > strlen(kProtocol[0]) + strlen(kMethod[0]) + strlen(kCRLF)) {
-		// 循环队列
-		if (mRecvRead == buffend && mRecvWrite != mRecvBuff) {
-			mRecvRead = mRecvBuff;
-		}
-		ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-		
-		uint32_t reallen = 0;
-		if (len > 0) {
-			// 消息字符在正向缓冲中
-			if (misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0) {
-				// GET请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, len), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [GET] recv a part of message");
-					ret = 0;
-					break;
-				}
+// 100-continue临时响应
+const char kContinue[] = "HTTP/1.1 100 Continue\r\n\r\n";
 
-				reallen = pos + strlen(kEndl);
-			} else if (misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0) {
-				// POST请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, len), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+// 请求解析失败响应（随后关闭连接）
+const char kBadRequest[] = "HTTP/1.1 400 Bad Request\r\nContent-Length: 0\r\nConnection: close\r\n\r\n";
 
-				int32_t pos1 = misc::Strpos(std::string(mRecvRead, 0, len), kHeader[0]);
-				if (pos1 == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] header error(has no Content-Length)");
-					ret = -1;
-					break;
-				}
+// WebSocket升级响应header（Sec-WebSocket-Accept值待续写）
+const char kUpgradeWs[] = "Upgrade: websocket\r\nConnection: Upgrade\r\nSec-WebSocket-Accept: ";
 
-				int32_t contentLength = atoi(mRecvRead + pos1 + strlen(kHeader[0]) + strlen(kColon));
-				if (pos + strlen(kEndl) + contentLength > kMaxPackageSize) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] header error(Content-Length out range)");
-					ret = -1;
-					break;
-				} else if (pos + strlen(kEndl) + contentLength > static_cast<uint32_t>(len)) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+// 预渲染header行的值（去除名称及CRLF）
+template<size_t N>
+inline wSlice LineValue(const char (&line)[N]) {
+	const char* value = strchr(line, ':') + 2;
+	return wSlice(value, line + N - 3 - value);
+}
 
-				reallen = pos + strlen(kEndl) + contentLength;
-			} else {
-				// 未知请求
-				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", ">0 method error");
-				ret = -1;
-				break;
+// HTTP/2 header须为小写名称，名称、值不含CR、LF、NUL（转换为HTTP/1.1请求时防止注入）
+bool ValidField(const std::string& name, const std::string& value) {
+	if (name.empty()) {
+		return false;
+	}
+	for (size_t i = name[0] == ':' ? 1 : 0; i < name.size(); i++) {
+		char c = name[i];
+		if (c <= ' ' || c == ':' || (c >= 'A' && c <= 'Z') || c == 0x7f) {
+			return false;
+		}
+	}
+	return value.find_first_of("\r\n", 0, 3) == std::string::npos;
+}
+
+}	// namespace anonymous
+
+int32_t wHttpCodec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	if (mProbe && mParser->GetState() == wHttpParser::kStart) {
+		// HTTP/2连接前言
+		size_t n = len < kHttp2PrefaceLen ? len : kHttp2PrefaceLen;
+		if (memcmp(buf, kHttp2Preface, n) == 0) {
+			if (n < kHttp2PrefaceLen) {
+				return 0;
 			}
+			mProbe = false;
+			*off = 0;
+			*size = static_cast<uint32_t>(kHttp2PrefaceLen);
+			return static_cast<int32_t>(kHttp2PrefaceLen);
+		}
+	}
 
-			ret = handleFunc(mRecvRead, reallen, mRecvRead + reallen);
-            if (ret == -1) {
-                break;
-            }
-		} else {
-			leftlen = buffend - mRecvRead;
-			if ((leftlen >= strlen(kMethod[0]) && misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0) ||
-				(leftlen == 0 && misc::Strcmp(std::string(mRecvBuff, 0, strlen(kMethod[0])), kMethod[0], strlen(kMethod[0])) == 0)) {
-				// GET请求
-				int32_t pos = misc::Strpos(std::string(mRecvRead, 0, leftlen), kEndl);
-				if (pos == -1) {
-					memset(mTempBuff, 0, sizeof(mTempBuff));
-					memcpy(mTempBuff, mRecvRead, leftlen);
-					memcpy(mTempBuff + leftlen, mRecvBuff, mRecvLen - leftlen);
-					pos = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kEndl);
-					if (pos == -1) {
-						HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [GET] recv a part of message");
-						ret = 0;
-						break;
-					}
+	int32_t ret = mParser->Parse(buf, len);
+	if (ret == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpCodec::Decode () failed", "request invalid");
+		mInvalid = true;
+		return -1;
+	} else if (ret > 0) {
+		mProbe = false;
+		*off = 0;
+		*size = static_cast<uint32_t>(ret);
+	}
+	return ret;
+}
 
-					reallen = leftlen + pos + strlen(kEndl);
-				} else {
-					reallen = pos + strlen(kEndl);
-				}
+int wHttpTask::TaskRecv(ssize_t *size) {
+	int ret = wTask::TaskRecv(size);
+	wHttpCodec* codec = dynamic_cast<wHttpCodec*>(mCodec);
+	if (ret == -1 && mH2 == NULL && mWs == NULL && codec != NULL && codec->Invalid()) {
+		// 排在已缓冲的流水线响应之后，连接随即关闭
+		ssize_t n;
+		if (Append2Buf(kBadRequest, strlen(kBadRequest)) == 0) {
+			wTask::TaskSend(&n);
+		}
+	}
+	return ret;
+}
 
-				if (reallen <= leftlen) {
-					ret = handleFunc(mRecvRead, reallen, mRecvRead + reallen);
-				} else {
-					ret = handleFunc(mTempBuff, reallen, mRecvBuff + reallen - leftlen);
-				}
+int wHttpTask::Handlemsg(char buf[], uint32_t len) {
+	if (WebSocket()) {
+		return WsFrame(buf, len);
+	} else if (mH2 != NULL) {
+		bool pending = SendPending();
+		if (H2Frame(buf, len) == -1 || H2Pump() == -1) {
+			return -1;
+		}
+		return pending || !SendPending() ? 0 : Output();
+	} else if (len == kHttp2PrefaceLen && memcmp(buf, kHttp2Preface, len) == 0) {
+		// h2c（prior-knowledge）
+		bool pending = SendPending();
+		if (H2Start(false) == -1) {
+			return -1;
+		}
+		return pending ? 0 : Output();
+	}
 
-	            if (ret == -1) {
-	                break;
-	            }
-			} else if ((leftlen >= strlen(kMethod[1]) && misc::Strcmp(std::string(mRecvRead, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0) || 
-				(leftlen == 0 && misc::Strcmp(std::string(mRecvBuff, 0, strlen(kMethod[1])), kMethod[1], strlen(kMethod[1])) == 0)) {
-				// POST请求
-				memset(mTempBuff, 0, sizeof(mTempBuff));
-				memcpy(mTempBuff, mRecvRead, leftlen);
-				memcpy(mTempBuff + leftlen, mRecvBuff, mRecvLen - leftlen);
-
-				int32_t pos = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kEndl);
-				if (pos == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+	switch (mParser.GetPart()) {
+	case wHttpParser::kPartBody:
+		return HandleBody(mParser.Body(), false) == -1 ? -1 : 0;
 
-				int32_t pos1 = misc::Strpos(std::string(mTempBuff, 0, mRecvLen), kHeader[0]);
-				if (pos1 == -1) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] header error(has no Content-Length)");
-					ret = -1;
-					break;
-				}
-				int32_t contentLength = atoi(mTempBuff + pos1 + strlen(kHeader[0]) + strlen(kColon));
-				if (pos + strlen(kEndl) + contentLength > kMaxPackageSize) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] header error(Content-Length out range)");
-					ret = -1;
-					break;
-				} else if (pos + strlen(kEndl) + contentLength > static_cast<uint32_t>(mRecvLen)) {
-					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 [POST] recv a part of message");
-					ret = 0;
-					break;
-				}
+	case wHttpParser::kPartEnd: {
+		// 长度分帧的按片请求体中，结束段含最后一个数据片
+		int ret = HandleBody(mParser.Body(), true);
+		if (ret != 0) {
+			return ret == -1 ? -1 : 0;
+		}
+		return AsyncResponse();
+	}
 
-				reallen = pos + strlen(kEndl) + contentLength;
-				if (reallen <= leftlen) {
-					ret = handleFunc(mTempBuff, reallen, mRecvRead + reallen);
-				} else {
-					ret = handleFunc(mTempBuff, reallen, mRecvBuff + reallen - leftlen);
-				}
-	            if (ret == -1) {
-	                break;
-	            }
-			} else {
-				// 未知请求
-				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::TaskRecv () failed", "<=0 method error");
-				ret = -1;
-				break;
+	default:
+		break;
+	}
+
+	NewRequest();
+	LoadConf();
+	if (mMaxBody > 0 && mParser.ContentLength() > mMaxBody) {
+		// 请求体超限：不接收请求体，响应后关闭连接
+		ResponseSet(kHeader[3], "close");
+		Error("", "413");
+		return AsyncResponse();
+	}
+
+	std::string settings;
+	if (H2Upgrade(&settings)) {
+		// h2c升级：101响应后切换为HTTP/2，本请求作为流1以HTTP/2响应
+		bool pending = SendPending();
+		if (Append2Buf(kUpgradeH2c, strlen(kUpgradeH2c)) == -1 || H2Start(true) == -1) {
+			return -1;
+		}
+		int code = H2Settings(settings.data(), static_cast<uint32_t>(settings.size()));
+		if (code != 0) {
+			if (H2Goaway(code) == -1) {
+				return -1;
+			}
+		} else {
+			Http2Stream_t* stream;
+			HNET_NEW(Http2Stream_t(1, mH2->mInitWindow), stream);
+			if (stream == NULL) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::Handlemsg new() failed", error::Strerror(errno).c_str());
+				return -1;
+			}
+			stream->mRemoteEnd = true;
+			mH2->mStreams.insert(std::make_pair(stream->mId, stream));
+			mH2->mLastStream = stream->mId;
+			if (H2Serve(stream, buf, len) == -1 || H2Pump() == -1) {
+				return -1;
 			}
 		}
+		return pending ? 0 : Output();
 	}
-	return ret;
+
+	Dispatch(buf, len);
+	if (mWs != NULL) {
+		// 握手成功且处理函数未改写响应状态时切换为WebSocket
+		if (mCode == 200) {
+			return WsStart();
+		}
+		WsRelease();
+		mEventWs = nullptr;
+	}
+	if (mParser.GetPart() == wHttpParser::kPartHead) {
+		// 按片请求体：接收完毕后响应
+		return BodyStart();
+	} else if (HandleBody(mParser.Body(), true) == -1) {
+		return -1;
+	}
+	return AsyncResponse();
 }
 
-int wHttpTask::Handlemsg(char buf[], uint32_t len) {
-	mReq.clear(); mRes.clear(); mGet.clear(); mPost.clear();
+int wHttpTask::BodyStart() {
+	if (mCode >= 400) {
+		// 处理函数已拒绝请求：不再接收请求体，立即响应并关闭连接
+		mEventBody = nullptr;
+		CloseBody(false);
+		ResponseSet(kHeader[3], "close");
+		return AsyncResponse();
+	}
+
+	wSlice expect;
+	if (mParser.VersionMinor() == 1 && mParser.Header("Expect", &expect) && wHttpParser::HasToken(expect, "100-continue")) {
+		// 客户端等待100响应后再发送请求体
+		bool pending = SendPending();
+		if (Append2Buf(kContinue, strlen(kContinue)) == -1) {
+			return -1;
+		}
+		return pending ? 0 : Output();
+	}
+	return 0;
+}
+
+int wHttpTask::HandleBody(const wSlice& data, bool fin) {
+	mBodyLen += data.size();
+	if (mH2 == NULL && mMaxBody > 0 && mBodyLen > mMaxBody) {
+		// 分块请求体超限：立即响应并关闭连接
+		mEventBody = nullptr;
+		CloseBody(false);
+		ResponseSet(kHeader[3], "close");
+		Error("", "413");
+		return AsyncResponse() == -1 ? -1 : 1;
+	}
+
+	wSlice body = data;
+	if (!mBodyPath.empty()) {
+		// 写入文件，写入失败后丢弃后续数据（响应500）
+		if (mBodyFile != NULL && !data.empty() && mBodyFile->Append(data) == -1) {
+			CloseBody(false);
+			Error("", "500");
+		}
+		if (!fin) {
+			return 0;
+		} else if (mBodyFile == NULL || CloseBody(true) == -1) {
+			Error("", "500");
+			mEventBody = nullptr;
+			return 0;
+		}
+		body = wSlice();
+	}
+
+	int ret = 0;
+	if (mEventBody) {
+		ret = mEventBody(body, fin);
+		if (fin) {
+			mEventBody = nullptr;
+		}
+	}
+	return ret == -1 ? -1 : 0;
+}
+
+int wHttpTask::SaveBody(const std::string& path) {
+	CloseBody(false);
+	mBodyPath = path;
+	if (wEnv::Default()->NewWritableFile(path, &mBodyFile) == -1 || mBodyFile == NULL) {
+		mBodyFile = NULL;
+		Error("", "500");
+		return -1;
+	}
+	return 0;
+}
+
+int wHttpTask::CloseBody(bool done) {
+	int ret = 0;
+	if (mBodyFile != NULL) {
+		if (done) {
+			ret = mBodyFile->Close();
+		}
+		HNET_DELETE(mBodyFile);
+		if (!done || ret != 0) {
+			// 请求体不完整
+			wEnv::Default()->DeleteFile(mBodyPath);
+		}
+	}
+	return ret == 0 ? 0 : -1;
+}
+
+void wHttpTask::Dispatch(char buf[], uint32_t len) {
+	wSlice path = mParser.Path();
+	for (std::vector<std::pair<std::string, std::string> >::iterator it = mStatic.begin(); it != mStatic.end(); it++) {
+		if (path.startsWith(it->first)) {
+			path.removePrefix(it->first.size());
+			ServeStatic(it->second, path);
+			return;
+		}
+	}
 
-	ParseRequest(buf, len);
-	std::string cmd = QueryGet(kCmd[0]);
-	std::string para = QueryGet(kCmd[1]);
-	if (!cmd.empty() && !para.empty()) {
+	// 路径路由
+	mParams.mNum = 0;
+	if (!mRouter.Empty()) {
+		std::function<int(struct Request_t *argv)>* func = mRouter.Match(mParser.MethodId(), path, &mParams);
+		if (func != NULL) {
+			struct Request_t request(buf, len);
+			if ((*func)(&request) == -1) {
+				// 处理函数失败：丢弃已写入的响应体
+				mBody.clear();
+				Error("", "500");
+			}
+			return;
+		}
+	}
+
+	wSlice cmd, para;
+	if (wHttpParser::FindParam(mParser.Query(), kCmd[0], &cmd) && wHttpParser::FindParam(mParser.Query(), kCmd[1], &para) && !cmd.empty() && !para.empty()) {
+		// 参数后紧随'&'或' '，atoi可直接作用于缓冲
 		struct Request_t request(buf, len);
-		if (mEventCmd(CmdId(atoi(cmd.c_str()), atoi(para.c_str())), &request) == false) {
-			ResponseSet(kHeader[3], "close");
+		if (mEventCmd(CmdId(atoi(cmd.data()), atoi(para.data())), &request) == false) {
 			Error("Not Found(cmd,para illegal)", "404");
 		}
+	} else if (!mRouter.Empty()) {
+		std::string allow;
+		if (mRouter.Allowed(path, &allow)) {
+			ResponseSet("Allow", allow);
+			Error("", "405");
+		} else {
+			Error("", "404");
+		}
 	} else {
-		ResponseSet(kHeader[3], "close");
 		Error("Bad Request(cmd,para must)", "400");
 	}
-	return AsyncResponse();
 }
 
-int wHttpTask::ParseRequest(char buf[], uint32_t len) {
-	std::vector<std::string> req = misc::SplitString(std::string(buf, 0, len), kCRLF);
-	if (!req.empty()) {	// 请求行
-		std::vector<std::string> line = misc::SplitString(req.front(), " ");
-		if (line.size() == 3) {
-			mReq.insert(std::make_pair(kLine[0], line[0]));
-			mReq.insert(std::make_pair(kLine[1], line[1]));
-			mReq.insert(std::make_pair(kLine[2], line[2]));
-			// 请求参数
-			std::vector<std::string> line1 = misc::SplitString(line[1], "?");
-			if (line1.size() == 1) {
-				mReq.insert(std::make_pair(kLine[3], line1[0]));
-			} else if (line1.size() > 1) {
-				mReq.insert(std::make_pair(kLine[3], line1[0]));
-				mReq.insert(std::make_pair(kLine[4], "?"+line1.back()));
-				mReq.insert(std::make_pair(kLine[5], line1.back()));
-				// get
-				std::vector<std::string> line2 = misc::SplitString(mReq[kLine[5]], "&");
-				if (!line2.empty()) {
-					for (std::vector<std::string>::iterator it2 = line2.begin(); it2 != line2.end(); it2++) {
-						std::vector<std::string> v = misc::SplitString(*it2, "=");
-						if (v.size() == 2) {
-							mGet[v[0]] = v[1];
-						} else if (v.size() == 1) {
-							mGet[v[0]] = "";
-						}
-					}
-				}
-			}
+wSlice wHttpTask::Param(const wSlice& key) {
+	wSlice value;
+	mParams.Get(key, &value);
+	return value;
+}
+
+std::string wHttpTask::ParamGet(const std::string& key) {
+	std::string value;
+	wSlice raw;
+	if (mParams.Get(key, &raw)) {
+		http::UrlDecode(raw, &value);
+	}
+	return value;
+}
+
+bool wHttpTask::HoldRecv() {
+	if (WebSocket()) {
+		return mClose || SendLen() > kPackageSize/2 || SendFileNum() >= kWsMaxQueue;
+	}
+	// 分块响应已开始（请求已接收完毕）时，后续请求待其结束后处理
+	return mClose || (mChunking && mParser.Done()) || SendLen() > kPackageSize/2 || SendFileNum() >= kMaxPipelineFiles;
+}
+
+int wHttpTask::TaskWritable() {
+	if (wTask::TaskWritable() == -1) {
+		return -1;
+	} else if (mH2 != NULL) {
+		// 续发各流响应数据；对端GOAWAY后流全部结束时关闭连接
+		if (H2Pump() == -1) {
+			return -1;
+		} else if (!SendPending() && (mClose || (mH2->mGoaway && mH2->mStreams.empty()))) {
+			return -1;
+		}
+		return mRecvLen > 0 ? HandleRecv() : 0;
+	} else if (mChunking && mParser.Done()) {
+		// 续写分块响应，响应结束且发送完毕后再处理后续请求
+		if (HandleChunk() == -1) {
+			return -1;
+		} else if (mChunking || SendPending()) {
+			return 0;
 		}
-		req.erase(req.begin());
 	}
 
-	int8_t p = 0;
-	for (std::vector<std::string>::iterator it = req.begin(); it != req.end(); it++) {	// header + 参数
-		if (it->size() == 0) {	// header与body分隔
-			p = 1;
-			continue;
+	if (mClose) {
+		return -1;
+	} else if (mRecvLen > 0) {
+		return HandleRecv();
+	}
+	return 0;
+}
+
+int wHttpTask::HandleChunk() {
+	int ret = mEventChunk ? mEventChunk() : EndChunk();
+	if (!mChunking) {
+		mEventChunk = nullptr;
+	}
+	return ret;
+}
+
+size_t wHttpTask::ChunkLeft() {
+	if (mH2 != NULL) {
+		// 写入当前流待发送数据，由 H2Pump 分帧发送
+		Http2Stream_t* stream = mH2->mCur;
+		return stream != NULL && stream->OutLen() < kHttp2OutSize ? kHttp2OutSize - stream->OutLen() : 0;
+	}
+
+	// 块大小（十六进制）+ CRLF + 数据 + CRLF，并预留结束块
+	const size_t chunklen = 2*sizeof(uint32_t) + 2*strlen(kCRLF) + strlen(kChunkEnd);
+	size_t left = kPackageSize - SendLen();
+	if (mChunkRaw) {
+		return left;
+	}
+	return left > chunklen ? left - chunklen : 0;
+}
+
+int wHttpTask::WriteChunk(const char buf[], size_t len) {
+	if (mH2 != NULL) {
+		Http2Stream_t* stream = mH2->mCur;
+		if (stream == NULL || !stream->mChunk || stream->mOutEnd || len > ChunkLeft()) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WriteChunk () failed", "not chunking or left buffer not enough");
+			return -1;
 		}
-		if (p == 0) {
-			std::vector<std::string> header = misc::SplitString(*it, kColon);
-			if (header.size() == 2) {
-				mReq.insert(std::make_pair(header[0], header[1]));
-			}
-		} else {
-			mReq.insert(std::make_pair(kLine[6], *it));
-			// POST数据
-			std::vector<std::string> line2 = misc::SplitString(mReq[kLine[6]], "&");
-			if (!line2.empty()) {
-				for (std::vector<std::string>::iterator it2 = line2.begin(); it2 != line2.end(); it2++) {
-					std::vector<std::string> v = misc::SplitString(*it2, "=");
-					if (v.size() == 2) {
-						mPost[v[0]] = v[1];
-					} else if (v.size() == 1) {
-						mPost[v[0]] = "";
-					}
-				}
-			}
+		stream->mOut.append(buf, len);
+		return 0;
+	} else if (!mChunking || len > ChunkLeft()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WriteChunk () failed", "not chunking or left buffer not enough");
+		return -1;
+	} else if (len == 0) {
+		return 0;
+	} else if (mChunkRaw) {
+		return Append2Buf(buf, len);
+	}
+
+	char head[2*sizeof(uint32_t) + 2];
+	int headlen = snprintf(head, sizeof(head), "%zx\r\n", len);
+	char* dst = PrepareBuf(headlen + len + strlen(kCRLF));
+	if (dst == NULL) {
+		return -1;
+	}
+	memcpy(dst, head, headlen);
+	memcpy(dst + headlen, buf, len);
+	memcpy(dst + headlen + len, kCRLF, strlen(kCRLF));
+	CommitBuf(headlen + len + strlen(kCRLF));
+	return 0;
+}
+
+int wHttpTask::EndChunk() {
+	if (mH2 != NULL) {
+		if (mH2->mCur != NULL) {
+			mH2->mCur->mOutEnd = true;
+		}
+		return 0;
+	} else if (!mChunking) {
+		return 0;
+	} else if (!mChunkRaw && Append2Buf(kChunkEnd, strlen(kChunkEnd)) == -1) {
+		return -1;
+	}
+	mChunking = false;
+	return 0;
+}
+
+bool wHttpTask::IdleOut(uint64_t now) {
+	if (mKeepAliveTimeout <= 0 || SendPending() || WebSocket()) {
+		return false;
+	}
+	uint64_t last = std::max(Socket()->RecvTm(), Socket()->SendTm());
+	return now > last && now - last > static_cast<uint64_t>(mKeepAliveTimeout)*1000000;
+}
+
+int wHttpTask::Drain() {
+	if (WebSocket()) {
+		return WsClose(kWsCloseGoingAway);
+	} else if (mH2 != NULL) {
+		if (mClose) {
+			return 0;
 		}
+		bool pending = SendPending();
+		if (H2Goaway(kHttp2NoError) == -1) {
+			return -1;
+		}
+		return pending ? 0 : Output();
+	}
+	return 0;
+}
+
+bool wHttpTask::Idle(uint64_t now) {
+	if (SendPending() || mRecvLen > 0 || WebSocket()) {
+		return false;
+	} else if (mH2 != NULL) {
+		return mH2->mStreams.empty();
+	}
+	wHttpParser::Part part = mParser.GetPart();
+	return !mChunking && part != wHttpParser::kPartHead && part != wHttpParser::kPartBody;
+}
+
+int wHttpTask::SaveState(std::string* state) {
+	if (mH2 != NULL || mWs != NULL || mChunking || mFile != NULL || mBodyFile != NULL) {
+		return -1;
+	}
+	wHttpParser::Part part = mParser.GetPart();
+	if (part == wHttpParser::kPartHead || part == wHttpParser::kPartBody) {
+		return -1;
+	}
+
+	wHttpCodec* codec = dynamic_cast<wHttpCodec*>(Codec());
+	char buf[sizeof(uint32_t) + sizeof(uint8_t)*2];
+	coding::EncodeFixed32(buf, static_cast<uint32_t>(mRequests));
+	coding::EncodeFixed8(buf + sizeof(uint32_t), static_cast<uint8_t>(mClose));
+	coding::EncodeFixed8(buf + sizeof(uint32_t) + sizeof(uint8_t), static_cast<uint8_t>(codec != NULL && codec->Probe()));
+	state->append(buf, sizeof(buf));
+	return 0;
+}
+
+int wHttpTask::LoadState(const char state[], size_t len) {
+	if (len != sizeof(uint32_t) + sizeof(uint8_t)*2) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::LoadState () failed", "state length error");
+		return -1;
+	}
+	mRequests = static_cast<int>(coding::DecodeFixed32(state));
+	mClose = coding::DecodeFixed8(state + sizeof(uint32_t)) != 0;
+
+	wHttpCodec* codec = dynamic_cast<wHttpCodec*>(Codec());
+	if (codec != NULL) {
+		codec->Probe() = coding::DecodeFixed8(state + sizeof(uint32_t) + sizeof(uint8_t)) != 0;
 	}
 	return 0;
 }
 
+void wHttpTask::LoadConf() {
+	if (!mKeepAliveConf) {
+		mKeepAliveConf = true;
+		wConfig* config = Config();
+		if (config) {
+			config->GetConf("http_keepalive_requests", &mMaxRequests);
+			config->GetConf("http_keepalive_timeout", &mKeepAliveTimeout);
+			int maxbody = 0;
+			if (config->GetConf("http_max_body", &maxbody) && maxbody >= 0) {
+				mMaxBody = static_cast<uint64_t>(maxbody) << 20;
+			}
+		}
+	}
+}
+
+void wHttpTask::KeepAlive() {
+	LoadConf();
+
+	std::string* conn = Headers().Find(kHeader[3]);
+	if (mChunking && mParser.VersionMinor() == 0) {
+		// HTTP/1.0不支持分块，以关闭连接结束响应
+		mChunkRaw = true;
+		if (conn != NULL) {
+			Headers().Erase(kHeader[3]);
+			conn = NULL;
+		}
+		mClose = true;
+	} else if (conn != NULL) {
+		mClose = strcasecmp(conn->c_str(), "keep-alive") != 0;
+	} else {
+		mClose = !mParser.KeepAlive() || (mMaxRequests > 0 && mRequests >= mMaxRequests);
+	}
+
+	// worker优雅退出：响应后关闭连接
+	if (mDrain && !mClose) {
+		if (conn != NULL) {
+			Headers().Erase(kHeader[3]);
+		}
+		mClose = true;
+	}
+}
+
+void wHttpTask::NewRequest() {
+	mReq.clear(); mRes.Clear(); mResMap.clear();
+	mReqBuilt = false;
+	mCode = 200;
+	mReason.clear();
+	mBody.clear();
+	mRequests++;
+	mEventBody = nullptr;
+	mEventChunk = nullptr;
+	mEventWs = nullptr;
+	mChunking = mChunkRaw = false;
+	ReleaseFile();
+	CloseBody(false);
+	mBodyPath.clear();
+	mBodyLen = 0;
+}
+
+std::string wHttpTask::QueryGet(const std::string& key) {
+	std::string value;
+	wSlice raw;
+	if (wHttpParser::FindParam(mParser.Query(), key, &raw)) {
+		http::UrlDecode(raw, &value);
+	}
+	return value;
+}
+
+std::string wHttpTask::FormGet(const std::string& key) {
+	std::string value;
+	wSlice raw;
+	if (wHttpParser::FindParam(mParser.Body(), key, &raw)) {
+		http::UrlDecode(raw, &value);
+	}
+	return value;
+}
+
+std::string wHttpTask::RequestGet(const std::string& key) {
+	wSlice value;
+	if (mParser.Header(key, &value)) {
+		return value.ToString();
+	}
+	return Req()[key];
+}
+
+std::map<std::string, std::string>& wHttpTask::Res() {
+	for (wHttpHeaders::iterator it = mRes.begin(); it != mRes.end(); it++) {
+		mResMap[it->first] = it->second;
+	}
+	mRes.Clear();
+	return mResMap;
+}
+
+void wHttpTask::MergeRes() {
+	for (std::map<std::string, std::string>::iterator it = mResMap.begin(); it != mResMap.end(); it++) {
+		mRes.Set(it->first, it->second);
+	}
+	mResMap.clear();
+}
+
+std::map<std::string, std::string>& wHttpTask::Req() {
+	// 分块请求的请求头视图仅在请求头段有效
+	wHttpParser::Part part = mParser.GetPart();
+	if (mReqBuilt || !mParser.HeadDone() || part == wHttpParser::kPartBody || part == wHttpParser::kPartEnd) {
+		return mReq;
+	}
+	mReqBuilt = true;
+
+	mReq.insert(std::make_pair(kLine[0], mParser.Method().ToString()));
+	mReq.insert(std::make_pair(kLine[1], mParser.Url().ToString()));
+	mReq.insert(std::make_pair(kLine[2], mParser.Version().ToString()));
+	mReq.insert(std::make_pair(kLine[3], mParser.Path().ToString()));
+	if (!mParser.Query().empty()) {
+		mReq.insert(std::make_pair(kLine[4], "?" + mParser.Query().ToString()));
+		mReq.insert(std::make_pair(kLine[5], mParser.Query().ToString()));
+	}
+	if (!mParser.Body().empty()) {
+		mReq.insert(std::make_pair(kLine[6], mParser.Body().ToString()));
+	}
+	for (uint32_t i = 0; i < mParser.HeaderNum(); i++) {
+		mReq.insert(std::make_pair(mParser.HeaderName(i).ToString(), mParser.HeaderValue(i).ToString()));
+	}
+	return mReq;
+}
+
 int wHttpTask::AsyncResponse() {
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    ssize_t len = 0;
-    std::string tmp;
+    // 长连接
+    KeepAlive();
 
-    // 填写默认头
-    FillResponse();
+    // 自定义header覆盖的默认header
+    enum { kSetContentType = 1, kSetPoweredBy = 2, kSetCacheControl = 4, kSetPragma = 8, kSetConnection = 16, kSetKeepAlive = 32 };
+    const struct { int mFlag; const char* mName; } defaults[] = {
+    	{kSetContentType, kHeader[1]}, {kSetPoweredBy, kHeader[4]}, {kSetCacheControl, kHeader[5]}, 
+    	{kSetPragma, kHeader[6]}, {kSetConnection, kHeader[3]}, {kSetKeepAlive, kHeader[7]}
+    };
+    int set = 0;
+    size_t len = wHttpWriter::kMaxHeadLen + wHttpWriter::PoweredByLen() + mReason.size();
+    for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+    	for (size_t i = 0; i < sizeof(defaults)/sizeof(defaults[0]); i++) {
+    		if (strcasecmp(it->first.c_str(), defaults[i].mName) == 0) {
+    			set |= defaults[i].mFlag;
+    			break;
+    		}
+    	}
+    	len += it->first.size() + it->second.size() + 4;
+    }
 
-    // 响应行
-    memset(mTempBuff, 0, sizeof(mTempBuff));
-    tmp = mRes[kLine[2]] + " " + mRes[kLine[7]] + " " + mRes[kLine[8]] + kCRLF;
-	memcpy(mTempBuff, tmp.c_str(), tmp.size());
-	len = tmp.size();
+	// 响应body（分块响应由 ChunkedResponse 写函数续写，HEAD请求无body）
+	bool head = mParser.HeadDone() && mParser.MethodId() == kMethodHead;
+	size_t bodylen = mChunking || head ? 0 : mBody.size();
+	len += bodylen;
 
-	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
+	// 响应头、body直接写入发送缓冲。流水线请求的响应按序追加，发送缓冲非空时写事件已注册
+	bool pending = SendPending();
+	char* buf = PrepareBuf(len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::AsyncResponse PrepareBuf() failed", "left buffer not enough");
+		return -1;
+	}
+
+	wHttpWriter writer(buf);
+	writer.Status(mCode, mReason);
+	writer.Date();
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		// 消息长度由框架决定
+		if (strcasecmp(it->first.c_str(), kHeader[0]) == 0 || strcasecmp(it->first.c_str(), kHeader[14]) == 0) {
 			continue;
 		}
-		tmp = it->first + kColon + it->second + kCRLF;
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
+		writer.Header(it->first, it->second);
 	}
-	tmp = kCRLF;
-	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-	len += tmp.size();
-	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
+	if (!(set & kSetContentType)) {
+		writer.Line(kLineContentType);
 	}
+	if (!(set & kSetPoweredBy)) {
+		writer.PoweredBy();
+	}
+	if (!(set & (kSetCacheControl | kSetPragma))) {
+		writer.Line(kLineNoCache);
+		writer.Line(kLinePragma);
+	} else if (!(set & kSetCacheControl)) {
+		writer.Line(kLineNoCache);
+	}
+	if (!(set & kSetConnection)) {
+		if (mClose) {
+			writer.Line(kLineClose);
+		} else {
+			writer.Line(kLineKeepAlive);
+			if (!(set & kSetKeepAlive)) {
+				writer.Append("Keep-Alive: timeout=", 20);
+				writer.Number(static_cast<uint64_t>(mKeepAliveTimeout));
+				if (mMaxRequests > 0) {
+					writer.Append(", max=", 6);
+					writer.Number(static_cast<uint64_t>(mMaxRequests - mRequests));
+				}
+				writer.Append(kCRLF, 2);
+			}
+		}
+	}
+	if (mChunking) {
+		if (!mChunkRaw) {
+			writer.Line(kLineChunked);
+		}
+	} else if (mFile != NULL) {
+		writer.Header(kHeader[0], mFileLen);
+	} else if (mCode != 304 && mCode != 204 && mCode >= 200) {
+		writer.Header(kHeader[0], static_cast<uint64_t>(mBody.size()));
+	}
+	writer.End();
+	if (bodylen > 0) {
+		writer.Append(mBody.data(), bodylen);
+	}
+	CommitBuf(writer.Len());
 
-	// 异步缓冲
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len)) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	memcpy(mSendWrite, mTempBuff, len);
-    	mSendWrite += len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendBuff, mTempBuff + leftlen, len - leftlen);
-    	mSendWrite = mSendBuff + len - leftlen;
-    } else {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::ParseResponse () failed", "left buffer not enough");
-    	return -1;
-    }
-    mSendLen += len;
+	// 异步缓冲。流水线请求的响应按序追加，发送缓冲非空时写事件已注册
+	if (mFile != NULL && !head) {
+		// 文件内容排在响应头之后零拷贝发送，发送完毕释放
+		SendFile2Buf(mFile->mFD, static_cast<off_t>(mFileOff), static_cast<size_t>(mFileLen), &wFileCache::ReleaseFile, mFile);
+		mFile = NULL;
+	}
+	ReleaseFile();
+	if (mChunking && HandleChunk() == -1) {
+		return -1;
+	}
 
-	return Output();
+	return pending ? 0 : Output();
 }
 
 int wHttpTask::SyncResponse(char buf[], ssize_t* size, uint32_t timeout) {
@@ -373,16 +815,18 @@ int wHttpTask::SyncResponse(char buf[], ssize_t* size, uint32_t timeout) {
             continue;
         }
 
-        if (misc::Strcmp(std::string(mTempBuff, 0, strlen(kProtocol[0])), kProtocol[0], strlen(kProtocol[0])) == 0) {	// HTTP/1.1
-       		pos = misc::Strpos(std::string(mTempBuff, 0, recvlen), kEndl);
-       		if (pos == -1) {
+        if (memcmp(mTempBuff, kProtocol[0], strlen(kProtocol[0])) == 0) {	// HTTP/1.1
+       		const char* end = scan::FindHeadEnd(mTempBuff, recvlen);
+       		if (end == NULL) {
 	            continue;
        		}
+       		pos = static_cast<int32_t>(end - mTempBuff);
 
-	   		pos1 = misc::Strpos(std::string(mTempBuff, 0, recvlen), kHeader[0]);	// Content-Length
-	   		if (pos1 == -1) {
+	   		const char* cl = reinterpret_cast<const char*>(memmem(mTempBuff, pos, kHeader[0], strlen(kHeader[0])));	// Content-Length
+	   		if (cl == NULL) {
 	   			continue;
 	   		}
+	   		pos1 = static_cast<int32_t>(cl - mTempBuff);
 
 	   		len = atoi(mTempBuff + pos1 + strlen(kHeader[0]) + strlen(kColon));
 	   		if (pos + strlen(kEndl) + len > kMaxPackageSize) {
@@ -416,24 +860,21 @@ int wHttpTask::SyncResponse(char buf[], ssize_t* size, uint32_t timeout) {
 }
 
 int wHttpTask::AsyncRequest() {
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
     ssize_t len = 0;
     std::string tmp;
 
     // 填写默认头
-    FillResponse();
+    FillRequest();
     
     // 请求行
     memset(mTempBuff, 0, sizeof(mTempBuff));
-    tmp = mRes[kLine[0]] + " " + mRes[kLine[1]] + " " + mRes[kLine[2]] + kCRLF;
+    tmp = Headers().Get(kLine[0]) + " " + Headers().Get(kLine[1]) + " " + Headers().Get(kLine[2]) + kCRLF;
 	memcpy(mTempBuff, tmp.c_str(), tmp.size());
 	len = tmp.size();
 
 	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		if (it->first == kLine[0] || it->first == kLine[1] || it->first == kLine[2]) {
 			continue;
 		}
 		tmp = it->first + kColon + it->second + kCRLF;
@@ -444,28 +885,17 @@ int wHttpTask::AsyncRequest() {
 	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
 	len += tmp.size();
 	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
+	// 请求body
+	if (!mBody.empty()) {
+		memcpy(mTempBuff + len, mBody.data(), mBody.size());
+		len += mBody.size();
 	}
 
 	// 异步缓冲
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len)) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	memcpy(mSendWrite, mTempBuff, len);
-    	mSendWrite += len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendBuff, mTempBuff + leftlen, len - leftlen);
-    	mSendWrite = mSendBuff + len - leftlen;
-    } else {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::AsyncRequest () failed", "left buffer not enough");
-    	return -1;
-    }
-    mSendLen += len;
+	if (Append2Buf(mTempBuff, len) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::AsyncRequest Append2Buf() failed", "");
+		return -1;
+	}
 
     return Output();
 }
@@ -475,16 +905,16 @@ int wHttpTask::SyncRequest(ssize_t* size) {
     std::string tmp;
 
     // 填写默认头
-    FillResponse();
+    FillRequest();
     
     // 请求行
-    tmp = mRes[kLine[0]] + " " + mRes[kLine[1]] + " " + mRes[kLine[2]] + kCRLF;
+    tmp = Headers().Get(kLine[0]) + " " + Headers().Get(kLine[1]) + " " + Headers().Get(kLine[2]) + kCRLF;
 	memcpy(mTempBuff, tmp.c_str(), tmp.size());
 	len = tmp.size();
 
 	// header
-	for (std::map<std::string, std::string>::iterator it = mRes.begin(); it != mRes.end(); it++) {
-		if (it->first == kLine[2] || it->first == kLine[7] || it->first == kLine[8] || it->first == kLine[9]) {
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		if (it->first == kLine[0] || it->first == kLine[1] || it->first == kLine[2]) {
 			continue;
 		}
 		tmp = it->first + kColon + it->second + kCRLF;
@@ -495,96 +925,1042 @@ int wHttpTask::SyncRequest(ssize_t* size) {
 	memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
 	len += tmp.size();
 	
-	// 响应body
-	if (!mRes[kLine[9]].empty()) {
-		tmp = mRes[kLine[9]];
-		memcpy(mTempBuff + len, tmp.c_str(), tmp.size());
-		len += tmp.size();
+	// 请求body
+	if (!mBody.empty()) {
+		memcpy(mTempBuff + len, mBody.data(), mBody.size());
+		len += mBody.size();
 	}
 	return mSocket->SendBytes(mTempBuff, len, size);
 }
 
-void wHttpTask::FillResponse() {
-	if (mRes[kHeader[3]].empty() && !mReq[kHeader[3]].empty()) {	// keep-alive
-		ResponseSet(kHeader[3], mReq[kHeader[3]]);
-		ResponseSet(kHeader[7], "timeout=30, max=120");
-	} else if (mRes[kHeader[3]].empty()) {
+void wHttpTask::FillRequest() {
+	if (Headers().Get(kHeader[3]).empty()) {	// Connection
 		ResponseSet(kHeader[3], "close");
 	}
-    if (mRes[kLine[2]].empty()) {	// HTTP/1.1
+    if (Headers().Get(kLine[2]).empty()) {	// HTTP/1.1
     	ResponseSet(kLine[2], kProtocol[0]);
     }
-    if (mRes[kLine[7]].empty()) {	// code
-    	ResponseSet(kLine[7], "200");
-    }
-    if (mRes[kLine[8]].empty()) {	// status
-    	ResponseSet(kLine[8], "Ok");
-    }
-	if (!mRes[kLine[9]].empty()) {	// Content-Length
-		ResponseSet(kHeader[0], logging::NumberToString(static_cast<uint64_t>(mRes[kLine[9]].size())));
-	} else {
-		ResponseSet(kHeader[0], "0");
-	}
-	if (mRes[kHeader[1]].empty()) {	// Content-Type
+	ResponseSet(kHeader[0], logging::NumberToString(static_cast<uint64_t>(mBody.size())));	// Content-Length
+	if (Headers().Get(kHeader[1]).empty()) {	// Content-Type
 		ResponseSet(kHeader[1], "text/html; charset=UTF-8");
 	}
-	if (mRes[kHeader[4]].empty()) {	// X-Powered-By
+	if (Headers().Get(kHeader[4]).empty()) {	// X-Powered-By
 		ResponseSet(kHeader[4], soft::GetSoftName() + "/" + soft::GetSoftVer());
 	}
-	if (mRes[kHeader[5]].empty()) {	// Cache-Control
-		ResponseSet(kHeader[5], "no-store, no-cache, must-revalidate");
-	}
-	if (mRes[kHeader[6]].empty()) {	// Pragma
-		ResponseSet(kHeader[6], "no-cache");
-	}
 	return;
 }
 
+void wHttpTask::ResponseSet(const std::string& key, const std::string& value) {
+	if (key == kLine[7]) {	// Code
+		mCode = atoi(value.c_str());
+	} else if (key == kLine[8]) {	// Status
+		mReason = value;
+	} else if (key == kLine[9]) {	// Body
+		mBody = value;
+	} else {
+		Headers().Set(key, value);
+	}
+}
+
 void wHttpTask::Error(const std::string& status, const std::string& code) {
 	if (!code.empty()) {
-		if (status.empty()) {
-			const std::string s = http::Status(code);
-			if (s.empty()) {
-				ResponseSet(kLine[7], "500");
-				ResponseSet(kLine[8], http::Status("500"));
+		int c = atoi(code.c_str());
+		if (status.empty() && http::Status(c) == NULL) {
+			mCode = 500;
+			mReason.clear();
+		} else {
+			mCode = c;
+			mReason = status;
+		}
+	}
+}
+
+void wHttpTask::Write(const wSlice& body) {
+	mBody.assign(body.data(), body.size());
+}
+
+void wHttpTask::Static(const std::string& prefix, const std::string& root) {
+	mStatic.push_back(std::make_pair(prefix, root));
+}
+
+void wHttpTask::ServeStatic(const std::string& root, const wSlice& path) {
+	int method = mParser.MethodId();
+	if (method != kMethodGet && method != kMethodHead) {
+		ResponseSet("Allow", "GET, HEAD");
+		Error("", "405");
+		return;
+	}
+
+	// 解码后拒绝上级目录、空字符
+	std::string name;
+	if (!http::UrlDecode(path, &name) || name.find('\0') != std::string::npos || ("/" + name + "/").find("/../") != std::string::npos) {
+		Error("", "400");
+		return;
+	}
+	if (name.empty() || name[name.size() - 1] == '/') {
+		name += "index.html";
+	}
+	if (name[0] != '/') {
+		name = "/" + name;
+	}
+	WriteFile(root + name);
+}
+
+int wHttpTask::WriteFile(const std::string& path) {
+	ReleaseFile();
+
+	wFileCache::File_t* file = wFileCache::Default()->Acquire(path);
+	if (file == NULL) {
+		Error("", errno == EACCES ? "403" : "404");
+		return -1;
+	}
+	ResponseSet(kHeader[1], http::MimeType(path));
+	ResponseSet(kHeader[5], "no-cache");
+	ResponseSet("ETag", file->mEtag);
+	ResponseSet("Last-Modified", file->mLastModified);
+	ResponseSet("Accept-Ranges", "bytes");
+
+	// 条件请求：If-None-Match优先于If-Modified-Since
+	wSlice value;
+	bool modified = true;
+	if (mParser.Header("If-None-Match", &value)) {
+		modified = !(value == wSlice("*") || memmem(value.data(), value.size(), file->mEtag, strlen(file->mEtag)) != NULL);
+	} else if (mParser.Header("If-Modified-Since", &value)) {
+		time_t since = http::ParseDate(value);
+		modified = since == -1 || file->mMtime > since;
+	}
+	if (!modified) {
+		wFileCache::Default()->Release(file);
+		Error("", "304");
+		return 0;
+	}
+
+	mFile = file;
+	mFileOff = 0;
+	mFileLen = file->mSize;
+
+	// 单区间Range（If-Range与ETag或Last-Modified一致时有效）
+	wSlice ifrange;
+	if (mParser.Header("Range", &value) && (!mParser.Header("If-Range", &ifrange) || ifrange == wSlice(file->mEtag) || ifrange == wSlice(file->mLastModified))) {
+		uint64_t off = 0, len = 0;
+		int ret = ParseRange(value, file->mSize, &off, &len);
+		if (ret > 0) {
+			char range[64];
+			snprintf(range, sizeof(range), "bytes %llu-%llu/%llu", static_cast<unsigned long long>(off), static_cast<unsigned long long>(off + len - 1), static_cast<unsigned long long>(file->mSize));
+			ResponseSet("Content-Range", range);
+			Error("", "206");
+			mFileOff = off;
+			mFileLen = len;
+		} else if (ret < 0) {
+			ResponseSet("Content-Range", "bytes */" + logging::NumberToString(file->mSize));
+			Error("", "416");
+			ReleaseFile();
+		}
+	}
+	return 0;
+}
+
+void wHttpTask::ReleaseFile() {
+	if (mFile != NULL) {
+		wFileCache::Default()->Release(mFile);
+		mFile = NULL;
+	}
+}
+
+bool wHttpTask::H2Upgrade(std::string* settings) {
+	wSlice upgrade, connection, value;
+	if (mParser.GetPart() != wHttpParser::kPartRequest || mParser.VersionMinor() != 1 || !mParser.Body().empty()) {
+		return false;
+	} else if (!mParser.Header("Upgrade", &upgrade) || !wHttpParser::HasToken(upgrade, "h2c")) {
+		return false;
+	} else if (!mParser.Header(kHeader[3], &connection) || !wHttpParser::HasToken(connection, "Upgrade") || !wHttpParser::HasToken(connection, "HTTP2-Settings")) {
+		return false;
+	}
+	return mParser.Header("HTTP2-Settings", &value) && http2::Base64UrlDecode(value, settings);
+}
+
+int wHttpTask::H2Start(bool upgrade) {
+	wCodec* codec;
+	HNET_NEW(wHttp2Codec(upgrade), codec);
+	HNET_NEW(Http2Conn_t(), mH2);
+	if (codec == NULL || mH2 == NULL) {
+		HNET_DELETE(codec);
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Start new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	SetCodec(codec);
+	mH2->mPreface = upgrade;
+
+	int streams = 0;
+	wConfig* config = Config();
+	if (config && config->GetConf("http2_max_streams", &streams) && streams > 0) {
+		mH2->mMaxStreams = static_cast<uint32_t>(streams);
+	}
+
+	// 本端SETTINGS（最大并发流），连接接收窗口扩大至 kHttp2ConnWindow
+	char payload[6];
+	payload[0] = 0;
+	payload[1] = static_cast<char>(kHttp2SetMaxStreams);
+	http2::EncodeBig32(payload + 2, mH2->mMaxStreams);
+	if (H2Write(kHttp2Settings, 0, 0, payload, sizeof(payload)) == -1 || H2Window(0, kHttp2ConnWindow - kHttp2Window) == -1) {
+		return -1;
+	}
+	mH2->mRecvWindow = kHttp2ConnWindow;
+	return 0;
+}
+
+int wHttpTask::H2Frame(char buf[], uint32_t len) {
+	if (mH2->mPreface) {
+		// h2c升级后的客户端连接前言
+		mH2->mPreface = false;
+		return 0;
+	}
+
+	uint8_t type = static_cast<uint8_t>(buf[3]);
+	uint8_t flags = static_cast<uint8_t>(buf[4]);
+	uint32_t id = http2::DecodeBig32(buf + 5) & 0x7fffffff;
+	uint32_t framelen = len - static_cast<uint32_t>(kHttp2FrameHead);
+	char* payload = buf + kHttp2FrameHead;
+	uint32_t plen = framelen;
+
+	if (mH2->mContinuation != 0 && (type != kHttp2Continuation || id != mH2->mContinuation)) {
+		return H2Goaway(kHttp2ProtocolError);
+	} else if ((type == kHttp2Data || type == kHttp2Headers) && (flags & kHttp2FlagPadded)) {
+		// 去除填充
+		if (plen == 0 || static_cast<uint8_t>(payload[0]) >= plen) {
+			return H2Goaway(kHttp2ProtocolError);
+		}
+		plen -= 1 + static_cast<uint8_t>(payload[0]);
+		payload++;
+	}
+
+	switch (type) {
+	case kHttp2Data: {
+		if (id == 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		}
+
+		// 连接接收窗口（含填充）消耗过半时补充
+		mH2->mRecvWindow -= static_cast<int32_t>(framelen);
+		if (mH2->mRecvWindow < 0) {
+			return H2Goaway(kHttp2FlowControlError);
+		} else if (mH2->mRecvWindow < kHttp2ConnWindow/2) {
+			if (H2Window(0, kHttp2ConnWindow - mH2->mRecvWindow) == -1) {
+				return -1;
+			}
+			mH2->mRecvWindow = kHttp2ConnWindow;
+		}
+
+		Http2Stream_t* stream = mH2->Find(id);
+		if (stream == NULL) {
+			// 已重置的流忽略
+			return id > mH2->mLastStream ? H2Goaway(kHttp2ProtocolError) : 0;
+		} else if (stream->mRemoteEnd) {
+			return H2Reset(id, kHttp2StreamClosed);
+		}
+		stream->mRecvWindow -= static_cast<int32_t>(framelen);
+		if (stream->mRecvWindow < 0) {
+			return H2Reset(id, kHttp2FlowControlError);
+		} else if (stream->mBody.size() + plen > kMaxPackageSize) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Frame () failed", "request body too large");
+			return H2Reset(id, kHttp2Cancel);
+		}
+		stream->mBody.append(payload, plen);
+
+		if (flags & kHttp2FlagEndStream) {
+			stream->mRemoteEnd = true;
+			return H2Dispatch(stream);
+		} else if (stream->mRecvWindow < kHttp2Window/2) {
+			if (H2Window(id, kHttp2Window - stream->mRecvWindow) == -1) {
+				return -1;
+			}
+			stream->mRecvWindow = kHttp2Window;
+		}
+		return 0;
+	}
+
+	case kHttp2Headers: {
+		if (id == 0 || (id & 1) == 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		} else if (flags & kHttp2FlagPriority) {
+			if (plen < 5) {
+				return H2Goaway(kHttp2FrameSizeError);
 			}
-			ResponseSet(kLine[7], code);
-			ResponseSet(kLine[8], s);
+			payload += 5;
+			plen -= 5;
+		}
+
+		// 单流错误仅重置该流，header块仍须解码（保持HPACK动态表同步）
+		Http2Stream_t* stream = mH2->Find(id);
+		mH2->mBlockReset = kHttp2NoError;
+		if (stream != NULL) {
+			// trailer须结束流
+			if (stream->mRemoteEnd) {
+				mH2->mBlockReset = kHttp2StreamClosed;
+			} else if (!(flags & kHttp2FlagEndStream)) {
+				mH2->mBlockReset = kHttp2ProtocolError;
+			}
+			stream->mTrailer = true;
+		} else if (id <= mH2->mLastStream) {
+			mH2->mBlockReset = kHttp2StreamClosed;
 		} else {
-			ResponseSet(kLine[7], code);
-			ResponseSet(kLine[8], status);
+			// 超出并发上限的流仍须解码header块（保持HPACK动态表同步），解码后拒绝
+			mH2->mLastStream = id;
+			if (!mClose && mH2->mStreams.size() < mH2->mMaxStreams) {
+				HNET_NEW(Http2Stream_t(id, mH2->mInitWindow), stream);
+				if (stream == NULL) {
+					HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Frame new() failed", error::Strerror(errno).c_str());
+					return -1;
+				}
+				mH2->mStreams.insert(std::make_pair(id, stream));
+			}
+		}
+
+		mH2->mBlock.assign(payload, plen);
+		mH2->mBlockFlags = flags;
+		if (flags & kHttp2FlagEndHeaders) {
+			return H2Headers(id);
+		}
+		mH2->mContinuation = id;
+		return 0;
+	}
+
+	case kHttp2Continuation:
+		if (mH2->mContinuation == 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		} else if (mH2->mBlock.size() + plen > kHttp2BlockMax) {
+			return H2Goaway(kHttp2EnhanceYourCalm);
+		}
+		mH2->mBlock.append(payload, plen);
+		if (flags & kHttp2FlagEndHeaders) {
+			mH2->mContinuation = 0;
+			return H2Headers(id);
+		}
+		return 0;
+
+	case kHttp2Priority:
+		if (id == 0) {
+			return H2Goaway(kHttp2ProtocolError);
 		}
+		return plen == 5 ? 0 : H2Reset(id, kHttp2FrameSizeError);
+
+	case kHttp2RstStream:
+		if (id == 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		} else if (plen != 4) {
+			return H2Goaway(kHttp2FrameSizeError);
+		}
+		mH2->Remove(id);
+		return 0;
+
+	case kHttp2Settings: {
+		if (id != 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		} else if (flags & kHttp2FlagAck) {
+			return plen == 0 ? 0 : H2Goaway(kHttp2FrameSizeError);
+		}
+		int code = H2Settings(payload, plen);
+		if (code != 0) {
+			return H2Goaway(code);
+		}
+		return H2Write(kHttp2Settings, kHttp2FlagAck, 0, NULL, 0);
+	}
+
+	case kHttp2PushPromise:
+		// 客户端不得推送
+		return H2Goaway(kHttp2ProtocolError);
+
+	case kHttp2Ping:
+		if (id != 0) {
+			return H2Goaway(kHttp2ProtocolError);
+		} else if (plen != 8) {
+			return H2Goaway(kHttp2FrameSizeError);
+		}
+		return flags & kHttp2FlagAck ? 0 : H2Write(kHttp2Ping, kHttp2FlagAck, 0, payload, plen);
+
+	case kHttp2Goaway:
+		if (id != 0 || plen < 8) {
+			return H2Goaway(kHttp2ProtocolError);
+		}
+		mH2->mGoaway = true;
+		return 0;
+
+	case kHttp2WindowUpdate: {
+		if (plen != 4) {
+			return H2Goaway(kHttp2FrameSizeError);
+		}
+		uint32_t inc = http2::DecodeBig32(payload) & 0x7fffffff;
+		if (id == 0) {
+			if (inc == 0) {
+				return H2Goaway(kHttp2ProtocolError);
+			} else if (mH2->mSendWindow + inc > kHttp2MaxWindow) {
+				return H2Goaway(kHttp2FlowControlError);
+			}
+			mH2->mSendWindow += inc;
+			return 0;
+		}
+
+		Http2Stream_t* stream = mH2->Find(id);
+		if (stream == NULL) {
+			return 0;
+		} else if (inc == 0) {
+			return H2Reset(id, kHttp2ProtocolError);
+		} else if (static_cast<int64_t>(stream->mSendWindow) + inc > kHttp2MaxWindow) {
+			return H2Reset(id, kHttp2FlowControlError);
+		}
+		stream->mSendWindow += static_cast<int32_t>(inc);
+		return 0;
+	}
+
+	default:
+		// 未知帧类型忽略
+		return 0;
 	}
 }
 
-void wHttpTask::Write(const std::string& body) {
-	ResponseSet(kLine[9], body);
+int wHttpTask::H2Settings(const char buf[], uint32_t len) {
+	if (len % 6 != 0) {
+		return kHttp2FrameSizeError;
+	}
+	for (uint32_t i = 0; i < len; i += 6) {
+		uint16_t key = static_cast<uint16_t>((static_cast<uint8_t>(buf[i]) << 8) | static_cast<uint8_t>(buf[i + 1]));
+		uint32_t value = http2::DecodeBig32(buf + i + 2);
+		switch (key) {
+		case kHttp2SetEnablePush:
+			if (value > 1) {
+				return kHttp2ProtocolError;
+			}
+			break;
+
+		case kHttp2SetInitialWindow: {
+			if (value > static_cast<uint32_t>(kHttp2MaxWindow)) {
+				return kHttp2FlowControlError;
+			}
+			// 初始窗口变化量作用于所有流
+			int64_t delta = static_cast<int64_t>(value) - mH2->mInitWindow;
+			for (std::map<uint32_t, Http2Stream_t*>::iterator it = mH2->mStreams.begin(); it != mH2->mStreams.end(); it++) {
+				int64_t window = it->second->mSendWindow + delta;
+				if (window > kHttp2MaxWindow) {
+					return kHttp2FlowControlError;
+				}
+				it->second->mSendWindow = static_cast<int32_t>(window);
+			}
+			mH2->mInitWindow = static_cast<int32_t>(value);
+			break;
+		}
+
+		case kHttp2SetMaxFrameSize:
+			if (value < kHttp2FrameSize || value > 0xffffff) {
+				return kHttp2ProtocolError;
+			}
+			mH2->mFrameSize = value;
+			break;
+
+		default:
+			// 其余设置不影响本端（响应头不使用对端动态表）
+			break;
+		}
+	}
+	return 0;
+}
+
+int wHttpTask::H2Headers(uint32_t id) {
+	wHpack::Headers headers;
+	size_t size = mH2->mBlock.size();
+	int ret = mH2->mHpack.Decode(mH2->mBlock.data(), size, &headers);
+	mH2->mBlock.clear();
+	if (ret == -1) {
+		return H2Goaway(kHttp2CompressionError);
+	} else if (mH2->mBlockReset != kHttp2NoError) {
+		return H2Reset(id, mH2->mBlockReset);
+	}
+
+	Http2Stream_t* stream = mH2->Find(id);
+	if (stream == NULL) {
+		return H2Reset(id, kHttp2RefusedStream);
+	} else if (size > kMaxPackageSize) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Headers () failed", "request header too large");
+		return H2Reset(id, kHttp2Cancel);
+	} else if (!stream->mTrailer) {
+		stream->mHeaders.swap(headers);
+	}
+	if (mH2->mBlockFlags & kHttp2FlagEndStream) {
+		stream->mRemoteEnd = true;
+		return H2Dispatch(stream);
+	}
+	return 0;
+}
+
+int wHttpTask::H2Dispatch(Http2Stream_t* stream) {
+	const wHpack::Headers& headers = stream->mHeaders;
+	std::string method, path, authority, cookie;
+	for (size_t i = 0; i < headers.size(); i++) {
+		if (!ValidField(headers[i].first, headers[i].second)) {
+			return H2Reset(stream->mId, kHttp2ProtocolError);
+		} else if (headers[i].first == ":method") {
+			method = headers[i].second;
+		} else if (headers[i].first == ":path") {
+			path = headers[i].second;
+		} else if (headers[i].first == ":authority") {
+			authority = headers[i].second;
+		}
+	}
+	if (method.empty() || path.empty()) {
+		return H2Reset(stream->mId, kHttp2ProtocolError);
+	}
+
+	// 转换为HTTP/1.1请求（多个cookie合并为一行），经 wHttpParser 解析后与HTTP/1.1请求同样路由
+	std::string& req = mH2->mReq;
+	req.clear();
+	req.append(method).append(" ").append(path).append(" ").append(kProtocol[0]).append(kCRLF);
+	if (!authority.empty()) {
+		req.append(kHeader[2]).append(kColon).append(authority).append(kCRLF);
+	}
+	for (size_t i = 0; i < headers.size(); i++) {
+		const std::string& name = headers[i].first;
+		if (name[0] == ':' || name == "content-length" || name == "transfer-encoding" || name == "connection" || (name == "host" && !authority.empty())) {
+			continue;
+		} else if (name == "cookie") {
+			cookie.append(cookie.empty() ? "" : "; ").append(headers[i].second);
+			continue;
+		}
+		req.append(name).append(kColon).append(headers[i].second).append(kCRLF);
+	}
+	if (!cookie.empty()) {
+		req.append("Cookie").append(kColon).append(cookie).append(kCRLF);
+	}
+	if (!stream->mBody.empty()) {
+		req.append(kHeader[0]).append(kColon).append(logging::NumberToString(static_cast<uint64_t>(stream->mBody.size()))).append(kCRLF);
+	}
+	req.append(kCRLF).append(stream->mBody);
+	std::string().swap(stream->mBody);
+	wHpack::Headers().swap(stream->mHeaders);
+
+	// 请求体已整体接收，不按片解析
+	mParser.Reset();
+	mParser.StreamLen(kMaxPackageSize);
+	if (mParser.Parse(&req[0], req.size()) != static_cast<int32_t>(req.size())) {
+		return H2Reset(stream->mId, kHttp2ProtocolError);
+	}
+	NewRequest();
+	return H2Serve(stream, &req[0], static_cast<uint32_t>(req.size()));
+}
+
+int wHttpTask::H2Serve(Http2Stream_t* stream, char buf[], uint32_t len) {
+	mH2->mCur = stream;
+	Dispatch(buf, len);
+	if (HandleBody(mParser.Body(), true) == -1) {
+		mEventChunk = nullptr;
+		mChunking = false;
+		ReleaseFile();
+		return H2Reset(stream->mId, kHttp2InternalError);
+	}
+	int ret = H2Response(stream);
+	mH2->mCur = NULL;
+	return ret;
+}
+
+int wHttpTask::H2Response(Http2Stream_t* stream) {
+	// 自定义header覆盖的默认header
+	enum { kSetContentType = 1, kSetPoweredBy = 2, kSetCacheControl = 4, kSetPragma = 8 };
+	const struct { int mFlag; const char* mName; } defaults[] = {
+		{kSetContentType, "content-type"}, {kSetPoweredBy, "x-powered-by"}, {kSetCacheControl, "cache-control"}, {kSetPragma, "pragma"}
+	};
+
+	std::string block;
+	wHpack::EncodeStatus(&block, mCode);
+	char date[http::kHttpDateLen + 1];
+	time_t now = soft::TimeUnix();
+	wHpack::Encode(&block, "date", wSlice(date, http::FormatDate(now > 0 ? now : time(NULL), date)));
+
+	int set = 0;
+	std::string name;
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		// 名称小写；消息长度由框架决定，不发送连接相关header
+		name = it->first;
+		std::transform(name.begin(), name.end(), name.begin(), ::tolower);
+		if (name == "content-length" || name == "transfer-encoding" || name == "connection" || name == "keep-alive" || name == "upgrade" || name == "proxy-connection") {
+			continue;
+		}
+		for (size_t i = 0; i < sizeof(defaults)/sizeof(defaults[0]); i++) {
+			if (name == defaults[i].mName) {
+				set |= defaults[i].mFlag;
+				break;
+			}
+		}
+		wHpack::Encode(&block, name, it->second);
+	}
+	if (!(set & kSetContentType)) {
+		wHpack::Encode(&block, "content-type", LineValue(kLineContentType));
+	}
+	if (!(set & kSetPoweredBy)) {
+		wHpack::Encode(&block, "x-powered-by", wHttpWriter::PoweredByValue());
+	}
+	if (!(set & (kSetCacheControl | kSetPragma))) {
+		wHpack::Encode(&block, "cache-control", LineValue(kLineNoCache));
+		wHpack::Encode(&block, "pragma", LineValue(kLinePragma));
+	} else if (!(set & kSetCacheControl)) {
+		wHpack::Encode(&block, "cache-control", LineValue(kLineNoCache));
+	}
+	if (mChunking) {
+		// 分块响应以END_STREAM结束，无content-length
+	} else if (mFile != NULL) {
+		wHpack::Encode(&block, "content-length", logging::NumberToString(mFileLen));
+	} else if (mCode != 304 && mCode != 204 && mCode >= 200) {
+		wHpack::Encode(&block, "content-length", logging::NumberToString(static_cast<uint64_t>(mBody.size())));
+	}
+
+	// 响应头：超出对端最大帧长度时以CONTINUATION续写（其间不得插入其他帧）
+	bool head = mParser.MethodId() == kMethodHead;
+	bool end = head || (!mChunking && mFile == NULL && mBody.empty());
+	uint8_t type = kHttp2Headers;
+	uint8_t flags = end ? kHttp2FlagEndStream : 0;
+	size_t off = 0;
+	do {
+		size_t n = std::min(block.size() - off, static_cast<size_t>(mH2->mFrameSize));
+		if (off + n == block.size()) {
+			flags |= kHttp2FlagEndHeaders;
+		}
+		if (H2Write(type, flags, stream->mId, block.data() + off, static_cast<uint32_t>(n)) == -1) {
+			return -1;
+		}
+		off += n;
+		type = kHttp2Continuation;
+		flags = 0;
+	} while (off < block.size());
+
+	// 响应body移交流，由 H2Pump 依流量窗口发送
+	if (end) {
+		mEventChunk = nullptr;
+		mChunking = false;
+		ReleaseFile();
+		mH2->Remove(stream->mId);
+	} else if (mChunking) {
+		stream->mChunk.swap(mEventChunk);
+		mEventChunk = nullptr;
+		mChunking = false;
+	} else if (mFile != NULL) {
+		stream->mFile = mFile;
+		stream->mFileOff = mFileOff;
+		stream->mFileLen = mFileLen;
+		stream->mOutEnd = true;
+		mFile = NULL;
+	} else {
+		stream->mOut.swap(mBody);
+		stream->mOutEnd = true;
+	}
+	return 0;
+}
+
+int wHttpTask::H2Pump() {
+	if (mH2->mPreface) {
+		// h2c升级：收到客户端连接前言后再发送响应数据（部分客户端仅缓冲101后少量数据）
+		return 0;
+	}
+
+	// 各流轮转，每轮至多一帧；分块写函数仅在本流待发送数据耗尽时回调
+	bool progress = true;
+	while (progress) {
+		progress = false;
+		for (std::map<uint32_t, Http2Stream_t*>::iterator it = mH2->mStreams.begin(); it != mH2->mStreams.end(); ) {
+			Http2Stream_t* stream = (it++)->second;
+			if (!stream->mRemoteEnd) {
+				continue;
+			} else if (stream->OutLen() == 0 && stream->mChunk && !stream->mOutEnd) {
+				stream->mOut.clear();
+				stream->mOutOff = 0;
+				mH2->mCur = stream;
+				int ret = stream->mChunk();
+				mH2->mCur = NULL;
+				if (ret == -1) {
+					if (H2Reset(stream->mId, kHttp2InternalError) == -1) {
+						return -1;
+					}
+					continue;
+				}
+			}
+
+			// 受流、连接发送窗口，对端最大帧长度及发送缓冲剩余空间限制
+			size_t room = kPackageSize - SendLen();
+			if (room <= kHttp2FrameHead) {
+				return 0;
+			}
+			int64_t window = std::min(static_cast<int64_t>(stream->mSendWindow), mH2->mSendWindow);
+			size_t n = window > 0 ? static_cast<size_t>(window) : 0;
+			n = std::min(n, std::min(static_cast<size_t>(mH2->mFrameSize), room - kHttp2FrameHead));
+
+			bool end = false;
+			if (stream->OutLen() > 0) {
+				n = std::min(n, stream->OutLen());
+				if (n == 0) {
+					continue;
+				}
+				end = stream->mOutEnd && n == stream->OutLen();
+				if (H2Write(kHttp2Data, end ? kHttp2FlagEndStream : 0, stream->mId, stream->mOut.data() + stream->mOutOff, static_cast<uint32_t>(n)) == -1) {
+					return -1;
+				}
+				stream->mOutOff += n;
+			} else if (stream->mFileLen > 0) {
+				// 文件内容：帧头写入发送缓冲，载荷以sendfile零拷贝发送
+				n = static_cast<size_t>(std::min(static_cast<uint64_t>(n), stream->mFileLen));
+				if (n == 0 || SendFileNum() >= kMaxPipelineFiles) {
+					continue;
+				}
+				end = n == stream->mFileLen;
+				char* buf = PrepareBuf(kHttp2FrameHead);
+				http2::EncodeHead(buf, static_cast<uint32_t>(n), kHttp2Data, end ? kHttp2FlagEndStream : 0, stream->mId);
+				CommitBuf(kHttp2FrameHead);
+				stream->mFile->mRef++;
+				SendFile2Buf(stream->mFile->mFD, static_cast<off_t>(stream->mFileOff), n, &wFileCache::ReleaseFile, stream->mFile);
+				stream->mFileOff += n;
+				stream->mFileLen -= n;
+			} else if (stream->mOutEnd) {
+				// 空DATA帧结束流
+				n = 0;
+				end = true;
+				if (H2Write(kHttp2Data, kHttp2FlagEndStream, stream->mId, NULL, 0) == -1) {
+					return -1;
+				}
+			} else {
+				continue;
+			}
+
+			stream->mSendWindow -= static_cast<int32_t>(n);
+			mH2->mSendWindow -= n;
+			progress = true;
+			if (end) {
+				mH2->Remove(stream->mId);
+			}
+		}
+	}
+	return 0;
+}
+
+int wHttpTask::H2Write(uint8_t type, uint8_t flags, uint32_t id, const char payload[], uint32_t len) {
+	char* buf = PrepareBuf(kHttp2FrameHead + len);
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Write PrepareBuf() failed", "left buffer not enough");
+		return -1;
+	}
+	http2::EncodeHead(buf, len, type, flags, id);
+	if (len > 0) {
+		memcpy(buf + kHttp2FrameHead, payload, len);
+	}
+	CommitBuf(kHttp2FrameHead + len);
+	return 0;
+}
+
+int wHttpTask::H2Window(uint32_t id, uint32_t inc) {
+	char payload[4];
+	http2::EncodeBig32(payload, inc);
+	return H2Write(kHttp2WindowUpdate, 0, id, payload, sizeof(payload));
+}
+
+int wHttpTask::H2Reset(uint32_t id, uint32_t code) {
+	char payload[4];
+	http2::EncodeBig32(payload, code);
+	mH2->Remove(id);
+	return H2Write(kHttp2RstStream, 0, id, payload, sizeof(payload));
+}
+
+int wHttpTask::H2Goaway(uint32_t code) {
+	if (code != kHttp2NoError) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::H2Goaway () connection error", logging::NumberToString(static_cast<uint64_t>(code)).c_str());
+	}
+	char payload[8];
+	http2::EncodeBig32(payload, mH2->mLastStream);
+	http2::EncodeBig32(payload + 4, code);
+	mClose = true;
+	return H2Write(kHttp2Goaway, 0, 0, payload, sizeof(payload));
+}
+
+bool wHttpTask::HeartbeatTurn() {
+	return WebSocket();
+}
+
+int wHttpTask::HeartbeatSend() {
+	if (!WebSocket()) {
+		return wTask::HeartbeatSend();
+	}
+	mHeartbeat++;
+	return mWs->mClosing ? 0 : WsSend(wSlice(), kWsPing);
+}
+
+int wHttpTask::WsHandshake() {
+	wSlice upgrade, connection, version, key;
+	if (mH2 != NULL || mParser.GetPart() != wHttpParser::kPartRequest || mParser.MethodId() != kMethodGet || mParser.VersionMinor() != 1 || !mParser.Body().empty()) {
+		Error("", "400");
+		return -1;
+	} else if (!mParser.Header("Upgrade", &upgrade) || !wHttpParser::HasToken(upgrade, "websocket")) {
+		Error("", "400");
+		return -1;
+	} else if (!mParser.Header(kHeader[3], &connection) || !wHttpParser::HasToken(connection, "Upgrade")) {
+		Error("", "400");
+		return -1;
+	} else if (!mParser.Header("Sec-WebSocket-Version", &version) || version != "13") {
+		ResponseSet("Sec-WebSocket-Version", "13");
+		Error("", "426");
+		return -1;
+	} else if (!mParser.Header("Sec-WebSocket-Key", &key) || key.size() != 24) {	// 16字节随机数的base64
+		Error("", "400");
+		return -1;
+	}
+
+	if (mWs == NULL) {
+		HNET_NEW(WsConn_t(), mWs);
+		if (mWs == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsHandshake new() failed", error::Strerror(errno).c_str());
+			Error("", "500");
+			return -1;
+		}
+	}
+	mWs->mAccept = ws::AcceptKey(key);
+	return 0;
+}
+
+int wHttpTask::WsStart() {
+	wCodec* codec;
+	HNET_NEW(wWsCodec(), codec);
+	if (codec == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsStart new() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+
+	size_t len = wHttpWriter::kMaxHeadLen + wHttpWriter::PoweredByLen() + mWs->mAccept.size();
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		len += it->first.size() + it->second.size() + 4;
+	}
+	bool pending = SendPending();
+	char* buf = PrepareBuf(len);
+	if (buf == NULL) {
+		HNET_DELETE(codec);
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsStart PrepareBuf() failed", "left buffer not enough");
+		return -1;
+	}
+
+	wHttpWriter writer(buf);
+	writer.Status(101);
+	writer.Date();
+	writer.Append(kUpgradeWs, strlen(kUpgradeWs));
+	writer.Append(mWs->mAccept.data(), mWs->mAccept.size());
+	writer.Append(kCRLF, 2);
+	for (wHttpHeaders::iterator it = Headers().begin(); it != Headers().end(); it++) {
+		// 升级相关header由框架决定
+		if (strcasecmp(it->first.c_str(), kHeader[0]) == 0 || strcasecmp(it->first.c_str(), kHeader[3]) == 0 || 
+			strcasecmp(it->first.c_str(), kHeader[14]) == 0 || strcasecmp(it->first.c_str(), "Upgrade") == 0) {
+			continue;
+		}
+		writer.Header(it->first, it->second);
+	}
+	writer.PoweredBy();
+	writer.End();
+	CommitBuf(writer.Len());
+
+	// 接收缓冲中101后的数据以WebSocket分帧解析
+	SetCodec(codec);
+	mWs->mOpen = true;
+	mWs->mAccept.clear();
+	mClose = false;
+	HeartbeatReset();
+	return pending ? 0 : Output();
+}
+
+int wHttpTask::WsFrame(char buf[], uint32_t len) {
+	wWsCodec* codec = static_cast<wWsCodec*>(mCodec);
+	uint8_t opcode = codec->Opcode();
+	ws::Mask(buf, len, codec->Key());
+	HeartbeatReset();
+
+	switch (opcode) {
+	case kWsPing:
+		return WsSend(wSlice(buf, len), kWsPong);
+
+	case kWsPong:
+		return 0;
+
+	case kWsClose:
+		// 校验后回送对端状态码，发送完毕后关闭连接
+		if (len == 1 || (len >= 2 && !ws::ValidCloseCode(static_cast<uint16_t>((static_cast<uint8_t>(buf[0]) << 8) | static_cast<uint8_t>(buf[1]))))) {
+			return WsClose(kWsCloseProtocol);
+		} else if (len > 2 && !ws::ValidUtf8(buf + 2, len - 2)) {
+			return WsClose(kWsCloseInvalid);
+		} else if (!mWs->mClosing && WsSend(wSlice(buf, len >= 2 ? 2 : 0), kWsClose) == -1) {
+			return -1;
+		}
+		mWs->mClosing = true;
+		mClose = true;
+		return 0;
+
+	case kWsCont:
+		// 分片消息续片
+		if (mWs->mOpcode == kWsCont) {
+			return WsClose(kWsCloseProtocol);
+		} else if (mWs->mMsg.size() + len > codec->MaxLen()) {
+			return WsClose(kWsCloseTooBig);
+		}
+		mWs->mMsg.append(buf, len);
+		if (codec->Fin()) {
+			std::string msg;
+			msg.swap(mWs->mMsg);
+			bool binary = mWs->mOpcode == kWsBinary;
+			mWs->mOpcode = kWsCont;
+			if (!binary && !ws::ValidUtf8(msg.data(), msg.size())) {
+				return WsClose(kWsCloseInvalid);
+			}
+			return mEventWs ? mEventWs(msg, binary) : 0;
+		}
+		return 0;
+
+	default:
+		if (mWs->mOpcode != kWsCont) {
+			// 分片消息未结束时收到新消息
+			return WsClose(kWsCloseProtocol);
+		} else if (!codec->Fin()) {
+			mWs->mOpcode = opcode;
+			mWs->mMsg.assign(buf, len);
+			return 0;
+		}
+		// 未分片消息直接引用接收缓冲，文本消息须为UTF-8
+		if (opcode == kWsText && !ws::ValidUtf8(buf, len)) {
+			return WsClose(kWsCloseInvalid);
+		}
+		return mEventWs ? mEventWs(wSlice(buf, len), opcode == kWsBinary) : 0;
+	}
+}
+
+int wHttpTask::WsSend(const wSlice& data, uint8_t opcode, bool fin) {
+	if (!WebSocket() || mWs->mClosing) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsSend () failed", "not websocket or closing");
+		return -1;
+	}
+
+	bool pending = SendPending();
+	size_t headlen = ws::HeadLen(data.size());
+	char* buf = PrepareBuf(headlen + data.size());
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsSend PrepareBuf() failed", "left buffer not enough");
+		return -1;
+	}
+	ws::EncodeHead(buf, opcode, fin, data.size());
+	memcpy(buf + headlen, data.data(), data.size());
+	CommitBuf(headlen + data.size());
+	return pending ? 0 : Output();
+}
+
+int wHttpTask::WsClose(uint16_t code, const wSlice& reason) {
+	if (!WebSocket()) {
+		return -1;
+	} else if (mWs->mClosing) {
+		return 0;
+	}
+
+	char payload[kWsMaxControl];
+	size_t len = reason.size() < kWsMaxControl - 2 ? reason.size() : kWsMaxControl - 2;
+	payload[0] = static_cast<char>((code >> 8) & 0xff);
+	payload[1] = static_cast<char>(code & 0xff);
+	memcpy(payload + 2, reason.data(), len);
+	int ret = WsSend(wSlice(payload, len + 2), kWsClose);
+	mWs->mClosing = true;
+	mClose = true;
+	return ret;
+}
+
+int wHttpTask::WsPush(const char frame[], size_t len, wWsHub::Frame_t* shared) {
+	if (!WebSocket() || mWs->mClosing || SendLen() > kPackageSize/2 || SendFileNum() >= kWsMaxQueue) {
+		return -1;
+	}
+
+	bool pending = SendPending();
+	if (shared == NULL) {
+		char* buf = PrepareBuf(len);
+		if (buf == NULL) {
+			return -1;
+		}
+		memcpy(buf, frame, len);
+		CommitBuf(len);
+	} else {
+		shared->mRef++;
+		SendData2Buf(frame, len, &wWsHub::ReleaseFrame, shared);
+	}
+	return pending ? 0 : Output();
+}
+
+int wHttpTask::WsSubscribe(const std::string& topic) {
+	if (mWs == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::WsSubscribe () failed", "not websocket");
+		return -1;
+	} else if (std::find(mWs->mTopics.begin(), mWs->mTopics.end(), topic) == mWs->mTopics.end()) {
+		mWs->mTopics.push_back(topic);
+		wWsHub::Default()->Subscribe(topic, this);
+	}
+	return 0;
+}
+
+void wHttpTask::WsUnsubscribe(const std::string& topic) {
+	if (mWs != NULL) {
+		std::vector<std::string>::iterator it = std::find(mWs->mTopics.begin(), mWs->mTopics.end(), topic);
+		if (it != mWs->mTopics.end()) {
+			mWs->mTopics.erase(it);
+			wWsHub::Default()->Unsubscribe(topic, this);
+		}
+	}
+}
+
+void wHttpTask::WsRelease() {
+	if (mWs != NULL) {
+		for (std::vector<std::string>::iterator it = mWs->mTopics.begin(); it != mWs->mTopics.end(); it++) {
+			wWsHub::Default()->Unsubscribe(*it, this);
+		}
+		HNET_DELETE(mWs);
+	}
 }
 
 int wHttpTask::HttpGet(const std::string& url, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout) {
-	ResponseSet(kLine[0], kMethod[0]);
+	return SyncHttp(kMethod[0], url, header, "", res, timeout);
+}
+
+int wHttpTask::HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout) {
+	std::string body;
+	for (std::map<std::string, std::string>::const_iterator it = data.begin(); it != data.end(); it++) {
+		if (!body.empty()) {
+			body += "&";
+		}
+		body += http::UrlEncode(it->first) + "=" + http::UrlEncode(it->second);
+	}
+
+	std::map<std::string, std::string> h(header);
+	if (h.find(kHeader[1]) == h.end()) {	// Content-Type
+		h.insert(std::make_pair(kHeader[1], "application/x-www-form-urlencoded"));
+	}
+	return SyncHttp(kMethod[1], url, h, body, res, timeout);
+}
+
+int wHttpTask::SyncHttp(const std::string& method, const std::string& url, const std::map<std::string, std::string>& header, const std::string& body, std::string& res, uint32_t timeout) {
+	mRes.Clear();
+	mResMap.clear();
+	mBody = body;
+	ResponseSet(kLine[0], method);
 	ResponseSet(kLine[1], url);
-    ResponseSet(kHeader[2], Socket()->Host() + ":" + logging::NumberToString(static_cast<uint64_t>(Socket()->Port())));
+	ResponseSet(kHeader[2], Socket()->Host() + ":" + logging::NumberToString(static_cast<uint64_t>(Socket()->Port())));
+	for (std::map<std::string, std::string>::const_iterator it = header.begin(); it != header.end(); it++) {
+		ResponseSet(it->first, it->second);
+	}
 
     ssize_t size;
     int ret = SyncRequest(&size);
     if (ret == -1) {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::HttpGet SyncRequest() failed", "");
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SyncHttp SyncRequest() failed", "");
     	return -1;
     }
     memset(mTempBuff, 0, sizeof(mTempBuff));
     
     ret = SyncResponse(mTempBuff, &size, timeout);
     if (ret == -1) {
-    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::HttpGet SyncResponse() failed", "");
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wHttpTask::SyncHttp SyncResponse() failed", "");
     	return ret;
     }
     res = mTempBuff;
     return 0;
 }
 
-int wHttpTask::HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout) {
-    return 0;
-}
-
 }	// namespace hnet
@@ -8,51 +8,276 @@
 #define _W_HTTP_TASK_H_
 
 #include <map>
+#include <vector>
+#include <functional>
 #include "wCore.h"
 #include "wCommand.h"
 #include "wTask.h"
+#include "wHttpParser.h"
+#include "wHttpWriter.h"
+#include "wFileCache.h"
+#include "wHttpRouter.h"
+#include "wHttp2.h"
+#include "wWebSocket.h"
 
 namespace hnet {
 
 const char	kCmd[][8]		= {"cmd", "para"};
 const char	kProtocol[][16]	= {"HTTP/1.1", "http://"};
 const char	kLine[][16]		= {"Method", "Url", "Schema", "PathInfo", "QueryString", "Get", "Post", "Code", "Status", "Body"};
-const char  kMethod[][8]	= {"GET", "POST", "PUT", "DELETE", "HEAD", "PATCH"};
-const char  kHeader[][32]	= {"Content-Length", "Content-Type", "Host", "Connection", "X-Powered-By", "Cache-Control", "Pragma", "Keep-Alive", "User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Accept-Charset", "Referer"};
+const char  kHeader[][32]	= {"Content-Length", "Content-Type", "Host", "Connection", "X-Powered-By", "Cache-Control", "Pragma", "Keep-Alive", "User-Agent", "Accept", "Accept-Encoding", "Accept-Language", "Accept-Charset", "Referer", "Transfer-Encoding"};
 const char	kColon[]		= ": ";
 const char	kEndl[]			= "\r\n\r\n";
+const char	kChunkEnd[]		= "0\r\n\r\n";
+
+// 长连接默认：单连接最大请求数、空闲超时（秒）。配置项 http_keepalive_requests、http_keepalive_timeout
+const int	kKeepAliveRequests	= 1000;
+const int	kKeepAliveTimeout	= 30;
+
+// 请求体上限（MB，0不限）。配置项 http_max_body
+const int	kHttpMaxBody	= 64;
+
+// 流水线请求中待发送文件片段上限（超出时暂停解析后续请求）
+const size_t	kMaxPipelineFiles	= 16;
 
 class wSocket;
+class wWritableFile;
+
+// HTTP/1.1请求分帧：由 wHttpParser 增量解析（请求头以空行结束，请求体长度由Content-Length指定）
+// 连接首个请求前识别HTTP/2连接前言（h2c prior-knowledge），前言单独成帧
+class wHttpCodec : public wCodec {
+public:
+    explicit wHttpCodec(wHttpParser* parser) : mParser(parser), mProbe(true), mInvalid(false) { }
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    virtual size_t HeadLen(size_t len) {
+        return 0;
+    }
+
+    virtual void EncodeHead(char buf[], size_t len) { }
+
+    virtual size_t MinLen() {
+        return 0;
+    }
+
+    virtual const char* Name() {
+        return "http";
+    }
+
+    inline bool& Probe() { return mProbe;}
+    inline bool Invalid() { return mInvalid;}
+
+protected:
+    wHttpParser* mParser;
+    bool mProbe;	// 尚未收到首个请求
+    bool mInvalid;	// 请求解析失败（格式错误、Content-Length冲突等）
+};
 
 class wHttpTask : public wTask {
 public:
-    wHttpTask(wSocket *socket, int32_t type = 0) : wTask(socket, type) { }
-    virtual ~wHttpTask() { }
+    wHttpTask(wSocket *socket, int32_t type = 0) : wTask(socket, type), mReqBuilt(false), mCode(200), mKeepAliveConf(false), 
+    mMaxRequests(kKeepAliveRequests), mKeepAliveTimeout(kKeepAliveTimeout), mRequests(0), mClose(false), mChunking(false), mChunkRaw(false), mFile(NULL), mFileOff(0), mFileLen(0), mBodyFile(NULL), mBodyLen(0), mMaxBody(static_cast<uint64_t>(kHttpMaxBody) << 20), mH2(NULL), mWs(NULL) {
+        wCodec* codec;
+        HNET_NEW(wHttpCodec(&mParser), codec);
+        SetCodec(codec);
+    }
+    virtual ~wHttpTask() {
+        ReleaseFile();
+        CloseBody(false);
+        HNET_DELETE(mH2);
+        WsRelease();
+    }
 
-    virtual int TaskRecv(ssize_t *size);
     virtual int Handlemsg(char buf[], uint32_t len);
 
-    inline std::map<std::string, std::string>& Req() { return mReq;}
-    inline std::map<std::string, std::string>& Res() { return mRes;}
+    // 请求解析失败时尽力回复400后关闭连接
+    virtual int TaskRecv(ssize_t *size);
+
+    // 长连接：响应积压或连接待关闭时暂停解析流水线请求
+    virtual bool HoldRecv();
+    // 响应发送完毕：待关闭连接返回-1；否则继续处理已接收的流水线请求
+    virtual int TaskWritable();
+    // 空闲超时（WebSocket连接由心跳检测）
+    virtual bool IdleOut(uint64_t now);
+    // worker优雅退出：HTTP/1.1响应后关闭连接，HTTP/2发送GOAWAY，WebSocket发送关闭帧（1001）
+    virtual int Drain();
+    // 请求之间（HTTP/2无活动流）且无待发送数据
+    virtual bool Idle(uint64_t now);
+    // 连接迁移：仅迁移请求之间的HTTP/1.x连接（可含已接收的流水线请求、未发送的响应），状态为已处理请求数及关闭标记
+    // HTTP/2（HPACK动态表、流状态）、WebSocket（消息回调于握手路由中绑定）连接不迁移
+    virtual int SaveState(std::string* state);
+    virtual int LoadState(const char state[], size_t len);
+    // WebSocket连接参与服务端心跳检测：心跳为ping帧，收到任意帧（含pong）重置
+    virtual bool HeartbeatTurn();
+    virtual int HeartbeatSend();
+
+    // 请求解析结果（wSlice视图，无拷贝）
+    inline wHttpParser& Parser() { return mParser;}
+
+    // 请求键值表（首次调用时构建，兼容旧接口）
+    std::map<std::string, std::string>& Req();
+    // 响应header表（兼容旧接口）：调用时自定义header移入该表，响应写出前并回 Headers
+    std::map<std::string, std::string>& Res();
+    // 自定义响应header（按设置顺序写出）
+    inline wHttpHeaders& Headers() {
+        if (!mResMap.empty()) {
+            MergeRes();
+        }
+        return mRes;
+    }
     
-    inline std::string Url() { return kProtocol[1] + RequestGet(kHeader[2]) + mReq[kLine[1]];}
-    inline std::string Method() { return mReq[kLine[0]];}
-    inline std::string Pathinfo() { return mReq[kLine[3]];}
-    inline std::string QueryString() { return mReq[kLine[4]];}
-    inline std::string QueryGet(const std::string& key) { return mGet[key];}
-    inline std::string FormGet(const std::string& key) { return mPost[key];}
-    inline std::string RequestGet(const std::string& key) { return mReq[key];}
-
-    void ResponseSet(const std::string& key, const std::string& value) { mRes[key] = value;}
+    inline std::string Url() { return kProtocol[1] + RequestGet(kHeader[2]) + mParser.Url().ToString();}
+    inline std::string Method() { return mParser.Method().ToString();}
+    inline std::string Pathinfo() { return mParser.Path().ToString();}
+    inline std::string QueryString() { return mParser.Query().empty() ? "" : "?" + mParser.Query().ToString();}
+    std::string QueryGet(const std::string& key);
+    std::string FormGet(const std::string& key);
+    std::string RequestGet(const std::string& key);
+
+    // 设置响应header（Code、Status、Body分别设置状态码、原因短语、响应body）
+    // 未设置的Content-Type、X-Powered-By、Cache-Control、Pragma、Connection以预渲染默认值写出，Content-Length由框架计算
+    void ResponseSet(const std::string& key, const std::string& value);
+    // 状态码、原因短语（status为空时使用标准原因短语）
     void Error(const std::string& status, const std::string& code);
-    void Write(const std::string& body);
+    void Write(const wSlice& body);
+
+    // 请求体处理函数（于路由处理函数中注册）：请求体按到达顺序分片回调，fin为最后一片
+    // 接收缓冲可容纳（且未超出 StreamBody 阈值）的Content-Length请求体一次回调（fin=true）；
+    // 其余请求体（分块、大Content-Length）于请求头到达后即路由，逐片回调，不整体缓冲，接收完毕后发送响应
+    // 请求体超出配置项 http_max_body 时响应413并关闭连接。返回-1关闭连接
+    template<typename T = wHttpTask>
+    void OnBody(int (T::*func)(const wSlice& data, bool fin), T* target) {
+    	mEventBody = std::bind(func, target, std::placeholders::_1, std::placeholders::_2);
+    }
+    std::function<int(const wSlice& data, bool fin)> mEventBody;
+
+    // 请求体写入文件（于路由处理函数中调用）：请求体到达即经 wEnv 写入path（覆盖），内存占用与请求体大小无关
+    // 接收完毕后关闭文件；若注册了 OnBody，仅于结束时回调一次（data为空）。写入失败响应500，未接收完毕时删除文件
+    int SaveBody(const std::string& path);
+
+    // 按片接收请求体的阈值（于构造函数中调用）：Content-Length超过len的请求体按片回调（默认仅超出接收缓冲时）
+    inline void StreamBody(uint64_t len) { mParser.StreamLen(len);}
+
+    // 分块响应（于路由或请求体处理函数中调用）：响应头以 Transfer-Encoding: chunked 发送（不含Content-Length），
+    // 随后及每次发送缓冲清空时回调func，func以 WriteChunk 写入不超过 ChunkLeft() 的数据片，完毕后调用 EndChunk
+    // 单响应内存占用以发送缓冲为界。暂无数据时func可直接返回，稍后自行 WriteChunk 并 Output
+    // HTTP/1.0请求直接发送数据，发送完毕后关闭连接
+    // HTTP/2流中func仅在本流窗口、发送缓冲可用时回调，须于回调内 WriteChunk、EndChunk
+    template<typename T = wHttpTask>
+    void ChunkedResponse(int (T::*func)(), T* target) {
+    	mChunking = true;
+    	mEventChunk = std::bind(func, target);
+    }
+    std::function<int()> mEventChunk;
+
+    // 路径路由：method为kMethod中请求方法，path可含 :name 参数段、末尾 *name 通配段（如 /user/:id、/files/*path）
+    // 优先于cmd、para路由（作为兼容回退），次于静态文件目录。路径已注册而方法未注册时响应405
+    // 处理函数返回-1时响应500（已写入的响应体丢弃）
+    template<typename T = wHttpTask>
+    int Route(const std::string& method, const std::string& path, int (T::*func)(struct Request_t *argv), T* target) {
+    	return mRouter.Add(method, path, std::bind(func, target, std::placeholders::_1));
+    }
+    // 当前请求路径参数（未解码视图），不存在返回空
+    wSlice Param(const wSlice& key);
+    // 当前请求路径参数（百分号解码）
+    std::string ParamGet(const std::string& key);
+
+    // 静态文件目录：路径前缀为prefix的GET、HEAD请求映射至root目录下文件（优先于cmd、para路由），
+    // 以'/'结尾的路径映射至index.html
+    void Static(const std::string& prefix, const std::string& root);
+
+    // 以文件响应（于路由处理函数中调用）：sendfile自页缓存零拷贝发送，文件描述符经 wFileCache 缓存
+    // 支持ETag、Last-Modified条件请求（304）及单区间Range（206、416）。文件不存在返回-1（响应404）
+    int WriteFile(const std::string& path);
+
+    // 当前可写入的最大分块长度
+    size_t ChunkLeft();
+    int WriteChunk(const char buf[], size_t len);
+    int EndChunk();
+    inline bool Chunking() { return mChunking;}
+
+    // 连接已切换为HTTP/2（h2c）。各流请求转换为HTTP/1.1形式后经 Parser() 访问，路由、处理函数与HTTP/1.1一致
+    inline bool Http2() { return mH2 != NULL;}
+
+    // WebSocket升级（于GET路由处理函数中调用，RFC 6455）：校验握手请求，失败响应400（版本不符426）并返回-1
+    // 处理函数返回后发送101响应（可以 ResponseSet 附加 Sec-WebSocket-Protocol 等header），连接切换为WebSocket
+    // 此后每条完整消息（分片已重组）回调func，binary区分二进制、文本消息；func返回-1关闭连接
+    // HTTP/2流不支持升级
+    template<typename T = wHttpTask>
+    int WsUpgrade(int (T::*func)(const wSlice& data, bool binary), T* target) {
+    	if (WsHandshake() == -1) {
+    		return -1;
+    	}
+    	mEventWs = std::bind(func, target, std::placeholders::_1, std::placeholders::_2);
+    	return 0;
+    }
+    std::function<int(const wSlice& data, bool binary)> mEventWs;
+
+    // 连接已切换为WebSocket
+    inline bool WebSocket() { return mWs != NULL && mWs->mOpen;}
+
+    // 发送一帧（单帧不超过发送缓冲剩余空间；大消息以fin=false分片，后续分片opcode为kWsCont）
+    int WsSend(const wSlice& data, uint8_t opcode = kWsText, bool fin = true);
+    // 发送关闭帧，发送完毕后关闭连接
+    int WsClose(uint16_t code = kWsCloseNormal, const wSlice& reason = wSlice());
+
+    // 订阅主题，经 wWsHub::Default()->Broadcast 接收广播（握手处理函数中即可订阅）。连接关闭时自动退订
+    int WsSubscribe(const std::string& topic);
+    void WsUnsubscribe(const std::string& topic);
 
     virtual int HttpGet(const std::string& url, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
     virtual int HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, std::string& res, uint32_t timeout = 30);
 
 protected:
+	// Res() 兼容表并入自定义header表（同名覆盖）
+	void MergeRes();
+
+	wHttpParser mParser;
+	bool mReqBuilt;
 	std::map<std::string, std::string> mReq;
-	std::map<std::string, std::string> mRes;
+	wHttpHeaders mRes;	// 自定义响应header（请求间复用）
+	std::map<std::string, std::string> mResMap;	// Res() 兼容表，仅调用 Res() 后使用
+	int mCode;	// 响应状态码
+	std::string mReason;	// 自定义原因短语
+	std::string mBody;	// 响应body
+
+	// 长连接
+	bool mKeepAliveConf;	// 已读取配置
+	int mMaxRequests;
+	int mKeepAliveTimeout;
+	int mRequests;	// 已处理请求数
+	bool mClose;	// 当前响应发送完毕后关闭连接
+
+	// 分块响应
+	bool mChunking;	// 分块响应未结束
+	bool mChunkRaw;	// HTTP/1.0不分块
+
+	// 路径路由
+	wHttpRouter<std::function<int(struct Request_t *argv)> > mRouter;
+	RouteParams_t mParams;
+
+	// 静态文件
+	std::vector<std::pair<std::string, std::string> > mStatic;	// 路径前缀、目录
+	wFileCache::File_t* mFile;	// 待发送文件
+	uint64_t mFileOff;
+	uint64_t mFileLen;
+
+	// 请求体
+	wWritableFile* mBodyFile;	// SaveBody 写入文件
+	std::string mBodyPath;
+	uint64_t mBodyLen;	// 已接收请求体长度
+	uint64_t mMaxBody;	// 请求体上限（0不限）
+
+	// HTTP/2连接状态（h2c），HTTP/1.1连接为NULL
+	Http2Conn_t* mH2;
+
+	// WebSocket连接状态，HTTP连接为NULL
+	WsConn_t* mWs;
+
+	// 广播写入一帧（frame为编码后的完整帧，shared非NULL时共享引用）。未升级或发送积压返回-1
+	friend class wWsHub;
+	int WsPush(const char frame[], size_t len, wWsHub::Frame_t* shared);
 
 private:
     int AsyncRequest();  // 异步接受请求
@@ -67,12 +292,70 @@ private:
     // size > 0  接受字符
     int SyncResponse(char buf[], ssize_t* size, uint32_t timeout = 30);  // 同步接受响应
 
-	int ParseRequest(char buf[], uint32_t len);
-    int ParseResponse(char buf[], uint32_t len);
-    void FillResponse();
+    // 同步请求（阻塞，异步请求见 wMultiClient::HttpRequest）
+    int SyncHttp(const std::string& method, const std::string& url, const std::map<std::string, std::string>& header, const std::string& body, std::string& res, uint32_t timeout);
+
+    // 填写请求默认头（客户端）
+    void FillRequest();
+
+    // 请求路由（静态文件目录、路径路由、cmd、para）
+    void Dispatch(char buf[], uint32_t len);
+
+    // 回调分块响应写函数
+    int HandleChunk();
+
+    // 静态文件目录请求
+    void ServeStatic(const std::string& root, const wSlice& path);
+    void ReleaseFile();
+
+    // 读取配置（首次请求时）
+    void LoadConf();
+
+    // 依据请求及连接状态决定响应后是否关闭连接
+    void KeepAlive();
+
+    // 按片请求体的请求头已路由：已拒绝时立即响应，否则按需发送100 Continue
+    int BodyStart();
+    // 请求体数据片（写入文件或回调 OnBody），返回-1关闭连接，1已响应（请求体超限）
+    int HandleBody(const wSlice& data, bool fin);
+    // 关闭请求体文件，done为false（未接收完毕）时删除
+    int CloseBody(bool done);
+
+    // 重置请求、响应状态
+    void NewRequest();
+
+    // h2c升级请求（Upgrade: h2c、HTTP2-Settings，无请求体），settings为解码后的SETTINGS载荷
+    bool H2Upgrade(std::string* settings);
+
+    // 切换为HTTP/2：发送本端SETTINGS及连接窗口。upgrade为h2c升级（待接收连接前言）
+    int H2Start(bool upgrade);
+    int H2Frame(char buf[], uint32_t len);
+    // 应用对端设置，返回0或连接错误码
+    int H2Settings(const char buf[], uint32_t len);
+    // header块接收完毕：解码后按流错误重置或更新流header
+    int H2Headers(uint32_t id);
+
+    // 流请求接收完毕：转换为HTTP/1.1请求后路由，响应头写入发送缓冲，响应body待 H2Pump 发送
+    int H2Dispatch(Http2Stream_t* stream);
+    int H2Serve(Http2Stream_t* stream, char buf[], uint32_t len);
+    int H2Response(Http2Stream_t* stream);
+
+    // 在流量窗口、发送缓冲允许范围内轮转发送各流DATA帧
+    int H2Pump();
+
+    int H2Write(uint8_t type, uint8_t flags, uint32_t id, const char payload[], uint32_t len);
+    int H2Window(uint32_t id, uint32_t inc);
+    int H2Reset(uint32_t id, uint32_t code);
+    // 连接错误：发送GOAWAY，发送完毕后关闭连接
+    int H2Goaway(uint32_t code);
 
-	std::map<std::string, std::string> mGet;
-	std::map<std::string, std::string> mPost;
+    // 校验WebSocket握手请求
+    int WsHandshake();
+    // 发送101响应，切换为WebSocket
+    int WsStart();
+    int WsFrame(char buf[], uint32_t len);
+    // 退订全部主题并释放连接状态
+    void WsRelease();
 };
 
 }	// namespace hnet
@@ -0,0 +1,173 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wHttpWriter.h"
+#include "wMisc.h"
+
+namespace hnet {
+
+namespace {
+
+const int kMaxStatusCode = 600;
+
+// 标准状态行表（首次使用时渲染）
+class StatusTable {
+public:
+    StatusTable() {
+        for (int code = 100; code < kMaxStatusCode; code++) {
+            const char* reason = http::Status(code);
+            if (reason != NULL) {
+                mLine[code] = std::string(kProtocol) + " " + logging::NumberToString(static_cast<uint64_t>(code)) + " " + reason + kCRLF;
+            }
+        }
+    }
+
+    inline const std::string& Line(int code) {
+        return mLine[code];
+    }
+
+    static StatusTable* Default() {
+        static StatusTable table;
+        return &table;
+    }
+
+private:
+    static const char kProtocol[];
+    std::string mLine[kMaxStatusCode];
+};
+
+const char StatusTable::kProtocol[] = "HTTP/1.1";
+
+// Date、X-Powered-By行缓存（进程内单线程使用）
+char hnet_dateLine[64];
+size_t hnet_dateLen = 0;
+time_t hnet_dateTime = -1;
+
+std::string hnet_poweredBy;
+
+const std::string& PoweredByLine() {
+    if (hnet_poweredBy.empty()) {
+        hnet_poweredBy = "X-Powered-By: " + soft::GetSoftName() + "/" + soft::GetSoftVer() + kCRLF;
+    }
+    return hnet_poweredBy;
+}
+
+}	// namespace anonymous
+
+void wHttpWriter::Status(int code, const wSlice& reason) {
+    if (reason.empty() && code > 0 && code < kMaxStatusCode && !StatusTable::Default()->Line(code).empty()) {
+        const std::string& line = StatusTable::Default()->Line(code);
+        Append(line.data(), line.size());
+        return;
+    }
+    Append("HTTP/1.1 ", 9);
+    Number(static_cast<uint64_t>(code));
+    Append(" ", 1);
+    Append(reason.data(), reason.size());
+    Append(kCRLF, 2);
+}
+
+void wHttpWriter::Date() {
+    time_t now = soft::TimeUnix();
+    if (now <= 0) {
+        now = time(NULL);
+    }
+    if (now != hnet_dateTime) {
+        memcpy(hnet_dateLine, "Date: ", 6);
+        size_t len = 6 + http::FormatDate(now, hnet_dateLine + 6);
+        memcpy(hnet_dateLine + len, kCRLF, 2);
+        hnet_dateLen = len + 2;
+        hnet_dateTime = now;
+    }
+    Append(hnet_dateLine, hnet_dateLen);
+}
+
+void wHttpWriter::PoweredBy() {
+    const std::string& line = PoweredByLine();
+    Append(line.data(), line.size());
+}
+
+size_t wHttpWriter::PoweredByLen() {
+    return PoweredByLine().size();
+}
+
+wSlice wHttpWriter::PoweredByValue() {
+    const std::string& line = PoweredByLine();
+    return wSlice(line.data() + 14, line.size() - 16);	// 去除"X-Powered-By: "及CRLF
+}
+
+void wHttpWriter::Header(const wSlice& name, const wSlice& value) {
+    Append(name.data(), name.size());
+    Append(": ", 2);
+    Append(value.data(), value.size());
+    Append(kCRLF, 2);
+}
+
+void wHttpWriter::Header(const wSlice& name, uint64_t value) {
+    Append(name.data(), name.size());
+    Append(": ", 2);
+    Number(value);
+    Append(kCRLF, 2);
+}
+
+void wHttpWriter::Number(uint64_t v) {
+    char tmp[20];
+    size_t n = 0;
+    do {
+        tmp[n++] = static_cast<char>('0' + v % 10);
+        v /= 10;
+    } while (v > 0);
+    while (n > 0) {
+        mBuf[mLen++] = tmp[--n];
+    }
+}
+
+void wHttpHeaders::Set(const wSlice& name, const wSlice& value) {
+	int32_t i = Index(name);
+	if (i != -1) {
+		mField[i].second.assign(value.data(), value.size());
+		return;
+	} else if (mNum >= mField.size()) {
+		mField.resize(mNum + 1);
+	}
+	mField[mNum].first.assign(name.data(), name.size());
+	mField[mNum].second.assign(value.data(), value.size());
+	mNum++;
+}
+
+int32_t wHttpHeaders::Index(const wSlice& name) {
+	for (uint32_t i = 0; i < mNum; i++) {
+		if (mField[i].first.size() == name.size() && strncasecmp(mField[i].first.data(), name.data(), name.size()) == 0) {
+			return static_cast<int32_t>(i);
+		}
+	}
+	return -1;
+}
+
+std::string* wHttpHeaders::Find(const wSlice& name) {
+	int32_t i = Index(name);
+	return i != -1 ? &mField[i].second : NULL;
+}
+
+const std::string& wHttpHeaders::Get(const wSlice& name) {
+	static const std::string empty;
+	int32_t i = Index(name);
+	return i != -1 ? mField[i].second : empty;
+}
+
+void wHttpHeaders::Erase(const wSlice& name) {
+	int32_t i = Index(name);
+	if (i == -1) {
+		return;
+	}
+	// 逐个交换后移，保留字符串容量
+	for (uint32_t j = static_cast<uint32_t>(i); j + 1 < mNum; j++) {
+		mField[j].swap(mField[j + 1]);
+	}
+	mNum--;
+}
+
+}	// namespace hnet
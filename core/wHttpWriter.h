@@ -0,0 +1,116 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_HTTP_WRITER_H_
+#define _W_HTTP_WRITER_H_
+
+#include <vector>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+
+namespace hnet {
+
+// 预渲染的默认header行
+const char	kLineContentType[]	= "Content-Type: text/html; charset=UTF-8\r\n";
+const char	kLineNoCache[]		= "Cache-Control: no-store, no-cache, must-revalidate\r\n";
+const char	kLinePragma[]		= "Pragma: no-cache\r\n";
+const char	kLineClose[]		= "Connection: close\r\n";
+const char	kLineKeepAlive[]	= "Connection: keep-alive\r\n";
+const char	kLineChunked[]		= "Transfer-Encoding: chunked\r\n";
+
+// 自定义header表预置字段数（超出时扩容）
+const uint32_t	kHttpHeaderMax = 32;
+
+// HTTP响应头写入器：直接写入调用者缓冲（如发送缓冲），调用者须预留足够空间
+// 标准状态行、默认header为预渲染模板，Date行每秒格式化一次，数字原地格式化。写入过程无堆内存分配
+class wHttpWriter : private wNoncopyable {
+public:
+    // 状态行、Date及默认header最大长度（不含自定义header、原因短语、X-Powered-By、body）
+    static const size_t kMaxHeadLen = 512;
+
+    explicit wHttpWriter(char buf[]) : mBuf(buf), mLen(0) { }
+
+    // 状态行。reason为空时使用标准状态行
+    void Status(int code, const wSlice& reason = wSlice());
+
+    // Date: 当前时间（同一秒内复用）
+    void Date();
+
+    // X-Powered-By: 软件名/版本
+    void PoweredBy();
+
+    void Header(const wSlice& name, const wSlice& value);
+    void Header(const wSlice& name, uint64_t value);
+
+    // 预渲染header行（含CRLF）
+    template<size_t N>
+    inline void Line(const char (&line)[N]) {
+        Append(line, N - 1);
+    }
+
+    // 空行结束header
+    inline void End() {
+        Append(kCRLF, 2);
+    }
+
+    inline void Append(const char* s, size_t n) {
+        memcpy(mBuf + mLen, s, n);
+        mLen += n;
+    }
+
+    void Number(uint64_t v);
+
+    inline size_t Len() { return mLen;}
+
+    // X-Powered-By行长度
+    static size_t PoweredByLen();
+    // X-Powered-By值（软件名/版本）
+    static wSlice PoweredByValue();
+
+protected:
+    char* mBuf;
+    size_t mLen;
+};
+
+// 自定义header表：字段数组（预置 kHttpHeaderMax 个，超出时扩容），按设置顺序写出，同名（不区分大小写）覆盖
+// 请求间仅重置计数，字段及其字符串保留容量复用，稳定运行后设置header无堆内存分配
+class wHttpHeaders : private wNoncopyable {
+public:
+    typedef std::pair<std::string, std::string> Field_t;
+    typedef Field_t* iterator;
+
+    wHttpHeaders() : mField(kHttpHeaderMax), mNum(0) { }
+
+    // 设置（已存在则覆盖）
+    void Set(const wSlice& name, const wSlice& value);
+
+    // 查找值，不存在返回NULL
+    std::string* Find(const wSlice& name);
+
+    // 值，不存在返回空串
+    const std::string& Get(const wSlice& name);
+
+    // 删除（其后字段保持顺序）
+    void Erase(const wSlice& name);
+
+    inline void Clear() { mNum = 0;}
+    inline uint32_t Size() { return mNum;}
+    inline bool Empty() { return mNum == 0;}
+
+    inline iterator begin() { return &mField[0];}
+    inline iterator end() { return &mField[0] + mNum;}
+
+protected:
+    int32_t Index(const wSlice& name);
+
+    std::vector<Field_t> mField;	// 前mNum个有效
+    uint32_t mNum;
+};
+
+}	// namespace hnet
+
+#endif
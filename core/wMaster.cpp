@@ -12,15 +12,21 @@
 #include "wSigSet.h"
 #include "wSignal.h"
 #include "wWorker.h"
+#include "wShm.h"
 #include "wTask.h"
 #include "wChannelCmd.h"
+#include "wChannelRing.h"
+#include "wShmHash.h"
+#include "wShmSlab.h"
 
 namespace hnet {
 
 wMaster::wMaster(const std::string& title, wServer* server) : mPid(getpid()), mTitle(title), mSlot(kMaxProcess), mDelay(0), mSigio(0),
-mLive(1), mServer(server), mWorker(NULL), mEnv(wEnv::Default()) {
+mLive(1), mNewBinary(0), mLoadShm(NULL), mLoad(NULL), mRebalance(0), mRebalanceThreshold(kRebalanceThreshold), mRebalanceTm(0), 
+mServer(server), mWorker(NULL), mEnv(wEnv::Default()), mRing(NULL), mHash(NULL), mSlabShm(NULL), mSlab(NULL) {
 	assert(mServer != NULL);
 	mPidPath = soft::GetPidPath();
+	mReport[0] = mReport[1] = kFDUnknown;
 	memset(mWorkerPool, 0, sizeof(mWorkerPool));
 	mNcpu = sysconf(_SC_NPROCESSORS_ONLN); // CPU核数
 	mWorkerNum = mNcpu; // worker默认数量
@@ -31,6 +37,22 @@ wMaster::~wMaster() {
     for (uint32_t i = 0; i < kMaxProcess; ++i) {
 		HNET_DELETE(mWorkerPool[i]);
     }
+    HNET_DELETE(mRing);
+    HNET_DELETE(mHash);
+    HNET_DELETE(mSlab);
+    if (mSlabShm) {
+    	mSlabShm->Remove();
+    	HNET_DELETE(mSlabShm);
+    }
+    if (mLoadShm) {
+    	mLoadShm->Remove();
+    	HNET_DELETE(mLoadShm);
+    }
+    for (int i = 0; i < 2; i++) {
+    	if (mReport[i] != kFDUnknown) {
+    		close(mReport[i]);
+    	}
+    }
 }
 
 int wMaster::PrepareStart() {
@@ -55,6 +77,26 @@ int wMaster::PrepareStart() {
     	mWorkerNum = worker;
     }
 
+    ret = InitAffinity();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::PrepareStart InitAffinity() failed", "");
+    	return ret;
+    }
+
+    // 共享内存实现（此后经 wEnv::NewShm 创建的共享内存均生效）
+    std::string backend, hugepage;
+    bool prefault = false;
+    mServer->Config()->GetConf("shm_backend", &backend);
+    mServer->Config()->GetConf("shm_hugepage", &hugepage);
+    mServer->Config()->GetConf("shm_prefault", &prefault);
+    int8_t huge = kShmHugeOff;
+    if (hugepage == "transparent") {
+    	huge = kShmHugeTransparent;
+    } else if (hugepage == "explicit") {
+    	huge = kShmHugeExplicit;
+    }
+    mEnv->SetShmOption(backend == "memfd" ? kShmMemfd : kShmSysv, huge, prefault);
+
     // 进程标题
     ret = mServer->Config()->Setproctitle(kMasterTitle, mTitle.c_str());
     if (ret == -1) {
@@ -90,6 +132,18 @@ int wMaster::SingleStart() {
         return ret;
     }
     
+    ret = InitShmHash();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::SingleStart InitShmHash() failed", "");
+    	return ret;
+    }
+
+    ret = InitShmSlab();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::SingleStart InitShmSlab() failed", "");
+    	return ret;
+    }
+
     ret = Run();
     if (ret == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::SingleStart Run() failed", "");
@@ -133,6 +187,7 @@ int wMaster::MasterStart() {
     ss.AddSet(SIGTERM);	// 优雅退出
     ss.AddSet(SIGHUP);	// 重新读取配置
     ss.AddSet(SIGUSR1);	// 重启服务
+    ss.AddSet(SIGUSR2);	// 热升级
     ret = ss.Procmask();
     if (ret == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart Procmask() failed", "");
@@ -146,6 +201,36 @@ int wMaster::MasterStart() {
     	return ret;
     }
 
+    ret = InitChannelRing();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart InitChannelRing() failed", "");
+    	return ret;
+    }
+
+    ret = InitReport();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart InitReport() failed", "");
+    	return ret;
+    }
+
+    ret = InitLoad();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart InitLoad() failed", "");
+    	return ret;
+    }
+
+    ret = InitShmHash();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart InitShmHash() failed", "");
+    	return ret;
+    }
+
+    ret = InitShmSlab();
+    if (ret == -1) {
+    	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::MasterStart InitShmSlab() failed", "");
+    	return ret;
+    }
+
     // 初始化进程表
 	for (uint32_t i = 0; i < kMaxProcess; i++) {
 		if (NewWorker(i, &mWorkerPool[i]) == -1) {
@@ -167,6 +252,11 @@ int wMaster::MasterStart() {
     	return ret;
     }
 
+    // 热升级启动，由新worker接管listen socket
+    if (mServer->Config()->Getenv(kListenFdsEnv) != NULL) {
+    	QuitOldBinary();
+    }
+
     // 主进程监听信号
     while (true) {
     	soft::TimeUpdate();
@@ -176,6 +266,309 @@ int wMaster::MasterStart() {
     return 0;
 }
 
+int wMaster::InitChannelRing() {
+	int len = kChannelRingLen;
+	mServer->Config()->GetConf("channel_ring", &len);
+	if (mWorkerNum <= 1 || len <= 0) {
+		return 0;
+	}
+
+	HNET_NEW(wChannelRing(mEnv, mWorkerNum, static_cast<size_t>(len) << 10), mRing);
+	if (mRing == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitChannelRing new() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (mRing->Create() == -1) {
+		// 共享内存不可用（如系统限制）时退回socketpair通道
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitChannelRing Create() failed", "fallback to channel socket");
+		HNET_DELETE(mRing);
+	}
+	return 0;
+}
+
+int wMaster::InitReport() {
+	if (socketpair(AF_UNIX, SOCK_DGRAM, 0, mReport) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitReport socketpair() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+
+	for (int i = 0; i < 2; i++) {
+		if (fcntl(mReport[i], F_SETFL, fcntl(mReport[i], F_GETFL) | O_NONBLOCK) == -1 || fcntl(mReport[i], F_SETFD, FD_CLOEXEC) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitReport fcntl() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+	}
+
+	// 可读时向master发送SIGIO
+	if (fcntl(mReport[1], F_SETOWN, mPid) == -1 || fcntl(mReport[1], F_SETFL, fcntl(mReport[1], F_GETFL) | O_ASYNC) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitReport fcntl(O_ASYNC) failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	return 0;
+}
+
+int wMaster::InitLoad() {
+	if (mWorkerNum <= 1) {
+		return 0;
+	}
+
+	int interval = 0, threshold = 0;
+	if (mServer->Config()->GetConf("rebalance_interval", &interval) && interval > 0) {
+		mRebalance = static_cast<uint32_t>(interval);
+	}
+	if (mServer->Config()->GetConf("rebalance_threshold", &threshold) && threshold > 0) {
+		mRebalanceThreshold = static_cast<uint32_t>(threshold);
+	}
+
+	size_t size = sizeof(WorkerLoad_t) * kMaxProcess;
+	if (mEnv->NewShm(soft::GetAcceptPath(), &mLoadShm, size + kCacheLine) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitLoad NewShm() failed", "");
+		return -1;
+	} else if (mLoadShm->CreateShm('l') == -1) {
+		// 共享内存不可用时不迁移连接
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitLoad CreateShm() failed", "rebalance disabled");
+		HNET_DELETE(mLoadShm);
+		mRebalance = 0;
+		return 0;
+	}
+
+	char* ptr = reinterpret_cast<char*>(mLoadShm->AllocShm(size + kCacheLine));
+	if (ptr == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitLoad AllocShm() failed", "");
+		return -1;
+	}
+	mLoad = reinterpret_cast<WorkerLoad_t*>((reinterpret_cast<uintptr_t>(ptr) + kCacheLine - 1) & ~(kCacheLine - 1));
+
+	// 即刻标记删除，全部进程退出后由系统回收
+	mLoadShm->Destroy();
+
+	for (uint32_t i = 0; i < kMaxProcess; i++) {
+		new (&mLoad[i]) WorkerLoad_t();
+	}
+	return 0;
+}
+
+int wMaster::InitShmHash() {
+	int entries = 0, vallen = kShmHashValue;
+	mServer->Config()->GetConf("shm_hash", &entries);
+	mServer->Config()->GetConf("shm_hash_value", &vallen);
+	if (entries <= 0) {
+		return 0;
+	} else if (vallen <= 0) {
+		vallen = kShmHashValue;
+	}
+
+	HNET_NEW(wShmHash(mEnv, static_cast<uint32_t>(entries), static_cast<uint32_t>(vallen)), mHash);
+	if (mHash == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmHash new() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (mHash->Create() == -1) {
+		// 共享内存不可用（如系统限制）时不启用，Hash() 返回NULL
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmHash Create() failed", "shm hash disabled");
+		HNET_DELETE(mHash);
+	}
+	return 0;
+}
+
+int wMaster::InitShmSlab() {
+	int len = 0;
+	mServer->Config()->GetConf("shm_slab", &len);
+	if (len <= 0) {
+		return 0;
+	}
+
+	size_t size = static_cast<size_t>(len) << 10;
+	if (mEnv->NewShm(soft::GetAcceptPath(), &mSlabShm, size + kPageSize) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmSlab NewShm() failed", "");
+		return -1;
+	} else if (mSlabShm->CreateShm('s') == -1) {
+		// 共享内存不可用（如系统限制）时不启用，Slab() 返回NULL
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmSlab CreateShm() failed", "shm slab disabled");
+		HNET_DELETE(mSlabShm);
+		return 0;
+	}
+
+	void* ptr = mSlabShm->AllocShm(size);
+	if (ptr == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmSlab AllocShm() failed", "");
+		return -1;
+	}
+
+	// 即刻标记删除，全部进程退出后由系统回收
+	mSlabShm->Destroy();
+
+	HNET_NEW(wShmSlab, mSlab);
+	if (mSlab == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmSlab new() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (mSlab->Init(ptr, size) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitShmSlab Init() failed", "shm slab disabled");
+		HNET_DELETE(mSlab);
+	}
+	return 0;
+}
+
+int wMaster::Rebalance() {
+	if (mLoad == NULL) {
+		return 0;
+	}
+
+	// 存活、未退出、负载表项有效的worker中连接数最多、最少者
+	int32_t max = -1, min = -1;
+	uint32_t maxconn = 0, minconn = 0;
+	uint64_t now = soft::TimeUsec();
+	for (uint32_t i = 0; i < kMaxProcess; i++) {
+		wWorker* worker = mWorkerPool[i];
+		if (worker == NULL || worker->mPid == -1 || worker->mExited || worker->mExiting || worker->mDetached || worker->ChannelFD(0) == kFDUnknown) {
+			continue;
+		}
+		uint64_t tm = mLoad[i].mTm.Load();
+		if (mLoad[i].mPid.Load() != worker->mPid || tm + static_cast<uint64_t>(kLoadExpire) * 1000 < now) {
+			continue;
+		}
+
+		uint32_t conn = mLoad[i].mConn.Load();
+		if (max == -1 || conn > maxconn) {
+			max = i;
+			maxconn = conn;
+		}
+		if (min == -1 || conn < minconn) {
+			min = i;
+			minconn = conn;
+		}
+	}
+	if (max == -1 || max == min || maxconn - minconn <= mRebalanceThreshold) {
+		return 0;
+	}
+
+	wChannelReqRebalance_t rebalance;
+	rebalance.set_pid(mPid);
+	rebalance.set_slot(min);
+	rebalance.set_num(std::min((maxconn - minconn) / 2, kMigrateBatch));
+	if (mServer->SyncWorker(reinterpret_cast<char*>(&rebalance), sizeof(rebalance), max) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::Rebalance SyncWorker() failed", "");
+		return -1;
+	}
+
+	std::string str = "wMaster::Rebalance, worker(" + logging::NumberToString(mWorkerPool[max]->mPid) + ") -> worker(" + logging::NumberToString(mWorkerPool[min]->mPid) + ")";
+	HNET_DEBUG(soft::GetLogPath(), "%s : %s", str.c_str(), (logging::NumberToString(rebalance.num()) + " connections").c_str());
+	return 0;
+}
+
+int wMaster::RecvDrain() {
+	wChannelReqDrain_t drain;
+	while (true) {
+		ssize_t size = recv(mReport[1], reinterpret_cast<char*>(&drain), sizeof(drain), 0);
+		if (size == -1) {
+			if (errno == EINTR) {
+				continue;
+			} else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+				break;
+			}
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::RecvDrain recv() failed", error::Strerror(errno).c_str());
+			return -1;
+		} else if (size != sizeof(drain) || drain.GetCmd() != CMD_CHANNEL_REQ || drain.GetPara() != CHANNEL_REQ_DRAIN) {
+			continue;
+		}
+
+		// 忽略已回收进程的汇报
+		if (drain.slot() < 0 || drain.slot() >= static_cast<int32_t>(kMaxProcess) || mWorkerPool[drain.slot()]->mPid != drain.pid()) {
+			continue;
+		}
+		mWorkerPool[drain.slot()]->mDrainConn = drain.conn();
+
+		std::string str = "wMaster::RecvDrain, worker(" + logging::NumberToString(drain.pid()) + ") draining";
+		HNET_DEBUG(soft::GetLogPath(), "%s : %s", str.c_str(), (logging::NumberToString(drain.conn()) + " connections left").c_str());
+	}
+	return 0;
+}
+
+int wMaster::CheckDrain() {
+	int num = 0;
+	uint64_t now = soft::TimeUsec();
+	uint64_t deadline = (static_cast<uint64_t>(mServer->mQuitTimeout) + kQuitGrace) * 1000;
+	for (uint32_t i = 0; i < kMaxProcess; i++) {
+		if (mWorkerPool[i] == NULL || mWorkerPool[i]->mPid == -1 || mWorkerPool[i]->mExited || mWorkerPool[i]->mQuitTm == 0) {
+			continue;
+		}
+
+		if (now - mWorkerPool[i]->mQuitTm < deadline) {
+			num++;
+			continue;
+		}
+
+		std::string str = "wMaster::CheckDrain, worker(" + logging::NumberToString(mWorkerPool[i]->mPid) + ") drain timeout";
+		if (mWorkerPool[i]->mDrainConn >= 0) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", str.c_str(), (logging::NumberToString(static_cast<uint64_t>(mWorkerPool[i]->mDrainConn)) + " connections left").c_str());
+		} else {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", str.c_str(), "no drain report");
+		}
+		if (kill(mWorkerPool[i]->mPid, SIGKILL) == -1 && errno == ESRCH) {
+			mWorkerPool[i]->mExited = 1;
+			hnet_reap = 1;
+		}
+		mWorkerPool[i]->mQuitTm = 0;
+	}
+	return num;
+}
+
+int wMaster::InitAffinity() {
+	std::string affinity;
+	if (!mServer->Config()->GetConf("worker_affinity", &affinity) || affinity.empty() || affinity == "off") {
+		return 0;
+	}
+
+	mCpuList.clear();
+	mCpuNode.clear();
+	if (affinity == "auto" || affinity == "numa") {
+		std::vector<int> allowed;
+		if (misc::GetAffinityCpus(&allowed) == -1 || allowed.empty()) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::InitAffinity GetAffinityCpus() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+
+		std::map<int, std::vector<int> > nodes;
+		if (affinity == "numa" && misc::GetNodeCpus(&nodes) == 0) {
+			// 各节点可运行CPU，按节点轮转取出：相邻slot交替分布于各节点
+			std::vector<std::vector<int> > cpus;
+			std::vector<int> ids;
+			for (std::map<int, std::vector<int> >::iterator it = nodes.begin(); it != nodes.end(); it++) {
+				std::vector<int> local;
+				for (std::vector<int>::iterator c = it->second.begin(); c != it->second.end(); c++) {
+					if (std::find(allowed.begin(), allowed.end(), *c) != allowed.end()) {
+						local.push_back(*c);
+					}
+				}
+				if (!local.empty()) {
+					cpus.push_back(local);
+					ids.push_back(it->first);
+				}
+			}
+			bool more = true;
+			for (size_t n = 0; more; n++) {
+				more = false;
+				for (size_t i = 0; i < cpus.size(); i++) {
+					if (n < cpus[i].size()) {
+						mCpuList.push_back(cpus[i][n]);
+						mCpuNode.push_back(ids[i]);
+						more = true;
+					}
+				}
+			}
+		}
+		if (mCpuList.empty()) {
+			mCpuList = allowed;
+			mCpuNode.assign(allowed.size(), -1);
+		}
+	} else if (misc::ParseCpuList(affinity, &mCpuList) == -1 || mCpuList.empty()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[%s]", "wMaster::InitAffinity ParseCpuList() failed", "invalid cpu list", affinity.c_str());
+		mCpuList.clear();
+		return -1;
+	} else {
+		mCpuNode.assign(mCpuList.size(), -1);
+	}
+	return 0;
+}
+
 int wMaster::NewWorker(uint32_t slot, wWorker** ptr) {
     HNET_NEW(wWorker(mTitle, slot, this), *ptr);
     if (!*ptr) {
@@ -225,6 +618,12 @@ int wMaster::SpawnWorker(int64_t type) {
 	// 当前进程
 	mWorker = mWorkerPool[mSlot];
 
+	// 绑定CPU（重启worker沿用slot对应CPU）
+	if (!mCpuList.empty()) {
+		mWorker->mCpu = mCpuList[mSlot % mCpuList.size()];
+		mWorker->mNode = mCpuNode[mSlot % mCpuNode.size()];
+	}
+
 	// 打开进程间channel通道
 	int ret = mWorker->Channel()->Open();
 	if (ret == -1) {
@@ -262,7 +661,10 @@ int wMaster::SpawnWorker(int64_t type) {
 
     // 主进程master
     mWorker->mPid = pid;
+    mServer->AddChannelSlot(mSlot);
     mWorker->mExited = 0;
+    mWorker->mQuitTm = 0;
+    mWorker->mDrainConn = -1;
     mWorker->mTimeline = soft::TimeUnix();
     
 	if (type >= 0) {
@@ -340,12 +742,52 @@ int wMaster::HandleSignal() {
 			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::HandleSignal setitimer() failed", error::Strerror(errno).c_str());
 			return -1;
 		}
+	} else if (CheckDrain() > 0) {
+		// 有worker正在优雅退出，定时唤醒检查退出期限
+		hnet_sigalrm = 0;
+
+		struct itimerval itv;
+		itv.it_interval.tv_sec = 0;
+		itv.it_interval.tv_usec = 0;
+		itv.it_value.tv_sec = kQuitGrace / 1000;
+		itv.it_value.tv_usec = (kQuitGrace % 1000) * 1000;
+		if (setitimer(ITIMER_REAL, &itv, NULL) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::HandleSignal setitimer() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+	} else if (mRebalance > 0 && !hnet_quit && !hnet_terminate) {
+		// 定时迁移连接（优雅退出期间暂停）
+		hnet_sigalrm = 0;
+
+		uint64_t now = soft::TimeUsec();
+		uint64_t interval = static_cast<uint64_t>(mRebalance) * 1000;
+		if (now - mRebalanceTm >= interval) {
+			Rebalance();
+			mRebalanceTm = now;
+		}
+
+		uint64_t left = mRebalanceTm + interval - now;
+		struct itimerval itv;
+		itv.it_interval.tv_sec = 0;
+		itv.it_interval.tv_usec = 0;
+		itv.it_value.tv_sec = left / 1000000;
+		itv.it_value.tv_usec = left % 1000000;
+		if (setitimer(ITIMER_REAL, &itv, NULL) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::HandleSignal setitimer() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
 	}
 
 	// 阻塞方式等待信号量，定时器控制超时
 	wSigSet ss;
 	ss.EmptySet();
 	ss.Suspend();
+
+	// SIGIO（worker汇报优雅退出进度）
+	if (hnet_sigio) {
+		hnet_sigio = 0;
+		RecvDrain();
+	}
 	
 	// SIGCHLD
 	if (hnet_reap) {
@@ -359,8 +801,11 @@ int wMaster::HandleSignal() {
 	if (!mLive && (hnet_terminate || hnet_quit)) {
 	    ProcessExit();
 	    if (mServer) {
-		    mServer->CleanListenSock();
-		    mServer->DeleteAcceptFile();
+	    	// listen socket、惊群锁已移交热升级新master
+		    mServer->CleanListenSock(mNewBinary == 0);
+		    if (mNewBinary == 0) {
+		    	mServer->DeleteAcceptFile();
+		    }
 	    }
 	    DeletePidFile();
 	    exit(0);
@@ -396,6 +841,24 @@ int wMaster::HandleSignal() {
 		return 0;
 	}
 	
+	// SIGUSR2
+	if (hnet_changebinary) {
+		hnet_changebinary = 0;
+
+		if (mNewBinary > 0) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::HandleSignal ExecNewBinary() failed", "new binary process is already running");
+			return 0;
+		}
+		if (hnet_terminate || hnet_quit) {
+			return 0;
+		}
+		int ret = ExecNewBinary();
+		if (ret == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::HandleSignal ExecNewBinary() failed", "");
+		}
+		return ret;
+	}
+
 	// SIGHUP
 	if (hnet_reconfigure) {
 		hnet_reconfigure = 0;
@@ -464,6 +927,7 @@ int wMaster::ReapChildren() {
 			}
 
 			mWorkerPool[i]->mPid = -1;
+			mServer->RemoveChannelSlot(i);
 
 		} else if (mWorkerPool[i]->mExiting || !mWorkerPool[i]->mDetached) {
 			// 进程正在退出，且不为分离进程，则总认为有存活进程
@@ -522,6 +986,12 @@ void wMaster::SignalWorker(int signo) {
         if (signo != SIGUSR1) {
         	mWorkerPool[i]->mExiting = 1;
         }
+
+        // 优雅退出期限自首次通知起计
+        if (signo == SIGQUIT && mWorkerPool[i]->mQuitTm == 0) {
+        	mWorkerPool[i]->mQuitTm = soft::TimeUsec();
+        	mWorkerPool[i]->mDrainConn = -1;
+        }
     }
 }
 
@@ -534,6 +1004,92 @@ int wMaster::DeletePidFile() {
 	return mEnv->DeleteFile(mPidPath);
 }
 
+int wMaster::ExecNewBinary() {
+	// 可执行文件路径（原文件已被新文件替换时，链接目标带" (deleted)"后缀）
+	char path[PATH_MAX];
+	ssize_t len = readlink("/proc/self/exe", path, sizeof(path) - 1);
+	if (len <= 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::ExecNewBinary readlink() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	path[len] = '\0';
+	const char deleted[] = " (deleted)";
+	size_t dlen = sizeof(deleted) - 1;
+	if (static_cast<size_t>(len) > dlen && strcmp(path + len - dlen, deleted) == 0) {
+		path[len - dlen] = '\0';
+	}
+
+	// 传递listen socket描述符（execve后保持打开）
+	std::string env = std::string(kListenFdsEnv) + "=";
+	for (std::vector<wSocket*>::iterator it = mServer->mListenSock.begin(); it != mServer->mListenSock.end(); it++) {
+		int fd = static_cast<int>((*it)->FD());
+		int flags = fcntl(fd, F_GETFD);
+		if (flags == -1 || fcntl(fd, F_SETFD, flags & ~FD_CLOEXEC) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::ExecNewBinary fcntl() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+		env += logging::NumberToString(fd) + ";";
+	}
+
+	std::vector<char*> envp;
+	size_t n = strlen(kListenFdsEnv);
+	for (char** e = mServer->Config()->Environ(); e && *e; e++) {
+		if (strncmp(*e, kListenFdsEnv, n) == 0 && (*e)[n] == '=') {
+			continue;
+		}
+		envp.push_back(*e);
+	}
+	envp.push_back(const_cast<char*>(env.c_str()));
+	envp.push_back(NULL);
+
+	// 新master创建自己的pid文件
+	std::string oldpath = mPidPath + kOldPidSuffix;
+	if (mEnv->RenameFile(mPidPath, oldpath) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::ExecNewBinary RenameFile() failed", "");
+		return -1;
+	}
+
+	pid_t pid = fork();
+	if (pid == 0) {
+		// 恢复信号屏蔽字（execve继承）
+		wSigSet ss;
+		ss.EmptySet();
+		ss.Procmask(SIG_SETMASK);
+
+		execve(path, mServer->Config()->Argv(), &envp[0]);
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::ExecNewBinary execve() failed", error::Strerror(errno).c_str());
+		exit(2);
+	} else if (pid == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::ExecNewBinary fork() failed", error::Strerror(errno).c_str());
+		mEnv->RenameFile(oldpath, mPidPath);
+		return -1;
+	}
+
+	mNewBinary = pid;
+	mPidPath = oldpath;
+	return 0;
+}
+
+int wMaster::QuitOldBinary() {
+	std::string str;
+	if (ReadFileToString(mEnv, mPidPath + kOldPidSuffix, &str) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::QuitOldBinary ReadFileToString() failed", "");
+		return -1;
+	}
+
+	uint64_t pid = 0;
+	if (!logging::DecimalStringToNumber(str, &pid) || pid <= 1 || static_cast<pid_t>(pid) == mPid) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::QuitOldBinary () failed", "invalid old pid");
+		return -1;
+	}
+
+	if (kill(static_cast<pid_t>(pid), SIGQUIT) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::QuitOldBinary kill() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	return 0;
+}
+
 int wMaster::SignalProcess(const std::string& signal) {
 	std::string str;
 	if (ReadFileToString(mEnv, mPidPath, &str) != 0) {
@@ -588,6 +1144,17 @@ void wMaster::WorkerExitStat() {
         }
 		
         one = 1;
+
+        // 热升级新master退出（execve失败、启动失败），恢复pid文件
+        if (pid == mNewBinary) {
+        	mNewBinary = 0;
+        	std::string pidpath = soft::GetPidPath();
+        	mEnv->RenameFile(mPidPath, pidpath);
+        	mPidPath = pidpath;
+        	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMaster::WorkerExitStat () failed", "new binary process exited");
+        	continue;
+        }
+
 		uint32_t i;
 		for (i = 0; i < kMaxProcess; ++i) {
 			if (mWorkerPool[i]->mPid == pid) {	// 设置退出状态
@@ -13,13 +13,36 @@
 #include "wCore.h"
 #include "wNoncopyable.h"
 #include "wEnv.h"
+#include "wAtomic.h"
 
 namespace hnet {
 
 const char  kMasterTitle[] = " - master process";
 
+// 连接迁移：最忙与最闲worker连接数差超出该值时迁移（配置项 rebalance_threshold），单次至多迁移 kMigrateBatch 个
+const uint32_t	kRebalanceThreshold = 16;
+const uint32_t	kMigrateBatch = 64;
+
+// 负载表中超过该时长（毫秒）未更新的worker（阻塞、尚未启动）不参与迁移
+const uint32_t	kLoadExpire = 1000;
+
 class wServer;
 class wWorker;
+class wChannelRing;
+class wShmHash;
+class wShmSlab;
+class wShm;
+
+// worker负载（共享内存负载表项，各worker每 kLoadTurn 毫秒写入自身slot，master读取），各项独占缓存行
+struct WorkerLoad_t {
+    wAtomic<int32_t> mPid;
+    wAtomic<uint32_t> mConn;	// 已建立连接数
+    wAtomic<uint32_t> mScore;	// 负载评分（连接数、待发送连接数、事件循环延迟），各worker据此让出accept锁
+    wAtomic<uint64_t> mTm;	// 最近更新时间 微妙
+    char mPad[kCacheLine - sizeof(wAtomic<int32_t>) - sizeof(wAtomic<uint32_t>)*2 - sizeof(wAtomic<uint64_t>)];
+
+    WorkerLoad_t() : mPid(-1), mConn(0), mScore(0), mTm(0) { }
+};
 
 class wMaster : private wNoncopyable {
 public:
@@ -59,6 +82,18 @@ public:
     inline pid_t& Pid() { return mPid;}
     inline std::string& Title() { return mTitle;}
 
+    // worker间共享内存通道（未启用为NULL）
+    inline wChannelRing* Ring() { return mRing;}
+
+    // worker间共享哈希表（未启用为NULL）
+    inline wShmHash* Hash() { return mHash;}
+
+    // worker间共享内存slab分配器（未启用为NULL）
+    inline wShmSlab* Slab() { return mSlab;}
+
+    // 共享内存负载表中slot项（未启用为NULL）
+    inline WorkerLoad_t* Load(uint32_t slot) { return mLoad != NULL && slot < kMaxProcess ? &mLoad[slot] : NULL;}
+
     template<typename T = wServer*>
     inline T Server() { return reinterpret_cast<T>(mServer);}
 
@@ -80,6 +115,16 @@ protected:
     // 创建一个worker进程
     int SpawnWorker(int64_t type);
     
+    // 创建worker间共享内存通道（fork前）。slot数为worker数2倍（重载时新旧worker并存），环长度由配置项 channel_ring（KB）指定
+    int InitChannelRing();
+
+    // worker绑定CPU策略（配置项 worker_affinity，命令行 -a）：
+    // auto  各worker依次绑定本进程可运行的一个CPU
+    // numa  同auto，但相邻slot交替分布于各NUMA节点，并优先自所在节点分配内存
+    // CPU列表（如 "0,2,4-7"）  各worker依次绑定列表中一个CPU
+    // worker数多于CPU时循环复用。未配置不绑定
+    int InitAffinity();
+
     // 注册信号回调
     // 可覆盖全局变量hnet_signals，实现自定义信号处理
     int InitSignals();
@@ -90,6 +135,33 @@ protected:
 
     int CreatePidFile();
     int DeletePidFile();
+
+    // worker优雅退出进度汇报channel（数据报socketpair，可读时SIGIO通知master）
+    int InitReport();
+
+    // 创建worker负载表（fork前，共享内存）。配置项 rebalance_interval（毫秒，0关闭）开启连接迁移
+    int InitLoad();
+
+    // 创建worker间共享哈希表（fork前）。配置项 shm_hash（槽数，0关闭）、shm_hash_value（值最大长度）
+    int InitShmHash();
+
+    // 创建worker间共享内存slab分配器（fork前）。配置项 shm_slab（KB，0关闭）
+    int InitShmSlab();
+
+    // 连接迁移：依据负载表，指令最忙worker向最闲worker迁移连接（使二者连接数趋于相等）
+    int Rebalance();
+
+    // 读取worker汇报的剩余连接数
+    int RecvDrain();
+
+    // 强制杀死超出优雅退出期限（quit_timeout + kQuitGrace）的worker，返回仍在优雅退出的worker数
+    int CheckDrain();
+
+    // 热升级（SIGUSR2）：pid文件改名为*.oldbin，fork并execve新的可执行文件，经环境变量kListenFdsEnv传递listen socket
+    int ExecNewBinary();
+
+    // 热升级新master：worker启动后通知旧master（SIGQUIT）停止accept，待旧worker已有连接关闭后退出
+    int QuitOldBinary();
     
     // 给所有worker进程发送信号
     void SignalWorker(int signo);
@@ -108,13 +180,40 @@ protected:
     uint32_t mWorkerNum;
     wWorker* mWorkerPool[kMaxProcess];
 
+    // 按slot循环分配的CPU及其NUMA节点（-1未知）
+    std::vector<int> mCpuList;
+    std::vector<int> mCpuNode;
+
     int32_t mDelay;
     int32_t mSigio;
     int32_t mLive;
 
+    // 热升级新master进程id（0未升级）
+    pid_t mNewBinary;
+
+    // worker优雅退出进度汇报channel
+    // 0:worker写入
+    // 1:master读取
+    int mReport[2];
+
+    // worker负载表
+    wShm* mLoadShm;
+    WorkerLoad_t* mLoad;
+
+    // 连接迁移周期、阈值，最近一次检查时间 微妙
+    uint32_t mRebalance;
+    uint32_t mRebalanceThreshold;
+    uint64_t mRebalanceTm;
+
     wServer* mServer;
     wWorker* mWorker;	// 当前worker进程
     wEnv* mEnv;
+    wChannelRing* mRing;
+    wShmHash* mHash;
+
+    // 共享内存slab分配器
+    wShm* mSlabShm;
+    wShmSlab* mSlab;
 };
 
 }	// namespace hnet
@@ -4,11 +4,17 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <strings.h>
 #include <algorithm>
 #include "wMisc.h"
 #include "wAtomic.h"
 #include "wLogger.h"
 
+#if defined(__x86_64__) || (defined(__i386__) && defined(__SSE2__))
+#define HNET_SCAN_X86
+#include <immintrin.h>
+#endif
+
 namespace hnet {
 namespace coding {
 
@@ -67,6 +73,42 @@ void PutFixed64(std::string* dst, uint64_t value) {
     dst->append(buf, sizeof(buf));
 }
 
+char* EncodeVarint32(char* dst, uint32_t v) {
+    static const int B = 128;
+    unsigned char* ptr = reinterpret_cast<unsigned char*>(dst);
+    while (v >= static_cast<uint32_t>(B)) {
+        *(ptr++) = v | B;
+        v >>= 7;
+    }
+    *(ptr++) = static_cast<unsigned char>(v);
+    return reinterpret_cast<char*>(ptr);
+}
+
+int VarintLength(uint64_t v) {
+    int len = 1;
+    while (v >= 128) {
+        v >>= 7;
+        len++;
+    }
+    return len;
+}
+
+const char* GetVarint32PtrFallback(const char* p, const char* limit, uint32_t* value) {
+    uint32_t result = 0;
+    for (uint32_t shift = 0; shift <= 28 && p < limit; shift += 7) {
+        uint32_t byte = *(reinterpret_cast<const unsigned char*>(p));
+        p++;
+        if (byte & 128) {
+            result |= ((byte & 127) << shift);
+        } else {
+            result |= (byte << shift);
+            *value = result;
+            return p;
+        }
+    }
+    return NULL;
+}
+
 }	// namespace coding
 
 namespace logging {
@@ -258,6 +300,88 @@ int GetIpList(std::vector<unsigned int>& iplist) {
     return -1;
 }
 
+int ParseCpuList(const std::string& str, std::vector<int>* cpus) {
+    std::vector<std::string> items = SplitString(str, ",");
+    for (std::vector<std::string>::iterator it = items.begin(); it != items.end(); it++) {
+        const char* p = it->c_str();
+        while (isspace(*p)) {
+            p++;
+        }
+        if (*p == '\0') {
+            continue;
+        }
+
+        char* end;
+        long first = strtol(p, &end, 10), last;
+        if (end == p || first < 0) {
+            return -1;
+        } else if (*end == '-') {
+            p = end + 1;
+            last = strtol(p, &end, 10);
+            if (end == p || last < first) {
+                return -1;
+            }
+        } else {
+            last = first;
+        }
+        while (isspace(*end)) {
+            end++;
+        }
+        if (*end != '\0' || last >= CPU_SETSIZE) {
+            return -1;
+        }
+        for (long cpu = first; cpu <= last; cpu++) {
+            cpus->push_back(static_cast<int>(cpu));
+        }
+    }
+    return 0;
+}
+
+int GetAffinityCpus(std::vector<int>* cpus) {
+    cpu_set_t set;
+    CPU_ZERO(&set);
+    if (sched_getaffinity(0, sizeof(set), &set) == -1) {
+        return -1;
+    }
+    for (int cpu = 0; cpu < CPU_SETSIZE; cpu++) {
+        if (CPU_ISSET(cpu, &set)) {
+            cpus->push_back(cpu);
+        }
+    }
+    return 0;
+}
+
+int GetNodeCpus(std::map<int, std::vector<int> >* nodes) {
+    char buf[1024];
+    FILE* fp = fopen("/sys/devices/system/node/online", "r");
+    if (fp == NULL) {
+        return -1;
+    }
+    std::vector<int> online;
+    bool ok = fgets(buf, sizeof(buf), fp) != NULL && ParseCpuList(buf, &online) == 0;
+    fclose(fp);
+    if (!ok) {
+        return -1;
+    }
+
+    for (std::vector<int>::iterator it = online.begin(); it != online.end(); it++) {
+        char path[128];
+        snprintf(path, sizeof(path), "/sys/devices/system/node/node%d/cpulist", *it);
+        if ((fp = fopen(path, "r")) == NULL) {
+            return -1;
+        }
+        std::vector<int> cpus;
+        ok = fgets(buf, sizeof(buf), fp) != NULL && ParseCpuList(buf, &cpus) == 0;
+        fclose(fp);
+        if (!ok) {
+            return -1;
+        } else if (!cpus.empty()) {	// 无CPU节点（仅内存）忽略
+            (*nodes)[*it] = cpus;
+        }
+    }
+    return nodes->empty() ? -1 : 0;
+}
+
 unsigned int GetIpByIF(const char* ifname) {
     unsigned int ip = 0;
     ssize_t fd = socket(AF_INET, SOCK_DGRAM, 0);
@@ -339,6 +463,367 @@ int SetBinPath(std::string bin_path, std::string self) {
 
 }	// namespace misc
 
+namespace scan {
+
+namespace {
+
+inline char Lower(char c) {
+    return (c >= 'A' && c <= 'Z') ? static_cast<char>(c | 0x20) : c;
+}
+
+// 标量实现，亦用于向量内核尾部
+const char* FindCrlfScalar(const char* p, size_t n) {
+    const char* e = p + n;
+    while (e - p >= 2) {
+        const char* r = reinterpret_cast<const char*>(memchr(p, '\r', e - p - 1));
+        if (r == NULL) {
+            return NULL;
+        } else if (r[1] == '\n') {
+            return r;
+        }
+        p = r + 1;
+    }
+    return NULL;
+}
+
+const char* FindHeadEndScalar(const char* p, size_t n) {
+    const char* e = p + n;
+    while (e - p >= 4) {
+        const char* r = reinterpret_cast<const char*>(memchr(p, '\r', e - p - 3));
+        if (r == NULL) {
+            return NULL;
+        } else if (memcmp(r, "\r\n\r\n", 4) == 0) {
+            return r;
+        }
+        p = r + 1;
+    }
+    return NULL;
+}
+
+const char* FindAnyScalar(const char* p, size_t n, const char* set, size_t setlen) {
+    for (size_t i = 0; i < n; i++) {
+        if (memchr(set, p[i], setlen) != NULL) {
+            return p + i;
+        }
+    }
+    return NULL;
+}
+
+// 十六进制字符值，非法返回-1
+inline int HexValue(char c) {
+    if (c >= '0' && c <= '9') {
+        return c - '0';
+    }
+    c = Lower(c);
+    return (c >= 'a' && c <= 'f') ? c - 'a' + 10 : -1;
+}
+
+// s处"%XY"解码后字节，截断或非十六进制返回-1
+inline int DecodeEscape(const char* s, const char* e) {
+    if (e - s < 3) {
+        return -1;
+    }
+    int high = HexValue(s[1]), low = HexValue(s[2]);
+    return (high | low) < 0 ? -1 : (high << 4 | low);
+}
+
+ssize_t PercentDecodeScalar(const char* p, size_t n, char dst[]) {
+    const char* e = p + n;
+    char* d = dst;
+    while (p < e) {
+        if (*p == '+') {
+            *d++ = ' ';
+            p++;
+        } else if (*p == '%') {
+            int c = DecodeEscape(p, e);
+            if (c == -1) {
+                return -1;
+            }
+            *d++ = static_cast<char>(c);
+            p += 3;
+        } else {
+            *d++ = *p++;
+        }
+    }
+    return d - dst;
+}
+
+bool CaseEqualScalar(const char* a, const char* b, size_t n) {
+    for (size_t i = 0; i < n; i++) {
+        if (a[i] != b[i] && Lower(a[i]) != Lower(b[i])) {
+            return false;
+        }
+    }
+    return true;
+}
+
+#ifdef HNET_SCAN_X86
+
+// SSE2（x86_64基线指令集），每次16字节
+const char* FindCrlfSse2(const char* p, size_t n) {
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 17 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i b = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1));
+        int m = _mm_movemask_epi8(_mm_and_si128(_mm_cmpeq_epi8(a, cr), _mm_cmpeq_epi8(b, lf)));
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindCrlfScalar(p + i, n - i);
+}
+
+const char* FindHeadEndSse2(const char* p, size_t n) {
+    const __m128i cr = _mm_set1_epi8('\r'), lf = _mm_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 19 <= n; i += 16) {
+        __m128i a = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i)), cr);
+        __m128i b = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 1)), lf);
+        __m128i c = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 2)), cr);
+        __m128i d = _mm_cmpeq_epi8(_mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i + 3)), lf);
+        int m = _mm_movemask_epi8(_mm_and_si128(_mm_and_si128(a, b), _mm_and_si128(c, d)));
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindHeadEndScalar(p + i, n - i);
+}
+
+const char* FindAnySse2(const char* p, size_t n, const char* set, size_t setlen) {
+    __m128i s[kScanMaxSet];
+    for (size_t k = 0; k < setlen; k++) {
+        s[k] = _mm_set1_epi8(set[k]);
+    }
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p + i));
+        __m128i eq = _mm_cmpeq_epi8(a, s[0]);
+        for (size_t k = 1; k < setlen; k++) {
+            eq = _mm_or_si128(eq, _mm_cmpeq_epi8(a, s[k]));
+        }
+        int m = _mm_movemask_epi8(eq);
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindAnyScalar(p + i, n - i, set, setlen);
+}
+
+// 整块'+'换为空格后写出，块内有'%'时写出至首个'%'并解码该转义，其后自转义末尾续扫
+// 输出不长于输入，整块写出不越过dst第n字节
+ssize_t PercentDecodeSse2(const char* p, size_t n, char dst[]) {
+    const __m128i pct = _mm_set1_epi8('%'), plus = _mm_set1_epi8('+'), flip = _mm_set1_epi8('+' ^ ' ');
+    const char* e = p + n;
+    char* d = dst;
+    while (e - p >= 16) {
+        __m128i a = _mm_loadu_si128(reinterpret_cast<const __m128i*>(p));
+        a = _mm_xor_si128(a, _mm_and_si128(_mm_cmpeq_epi8(a, plus), flip));
+        _mm_storeu_si128(reinterpret_cast<__m128i*>(d), a);
+        int m = _mm_movemask_epi8(_mm_cmpeq_epi8(a, pct));
+        if (m == 0) {
+            p += 16;
+            d += 16;
+            continue;
+        }
+        int k = __builtin_ctz(m);
+        int c = DecodeEscape(p + k, e);
+        if (c == -1) {
+            return -1;
+        }
+        d[k] = static_cast<char>(c);
+        d += k + 1;
+        p += k + 3;
+    }
+    ssize_t r = PercentDecodeScalar(p, e - p, d);
+    return r == -1 ? -1 : (d - dst) + r;
+}
+
+// 'A'-'Z'字节置0x20位（有符号比较，非ASCII字节为负数不受影响）
+inline __m128i Lower16(__m128i v) {
+    __m128i upper = _mm_and_si128(_mm_cmpgt_epi8(v, _mm_set1_epi8('A' - 1)), _mm_cmplt_epi8(v, _mm_set1_epi8('Z' + 1)));
+    return _mm_or_si128(v, _mm_and_si128(upper, _mm_set1_epi8(0x20)));
+}
+
+bool CaseEqualSse2(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 16 <= n; i += 16) {
+        __m128i x = Lower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(a + i)));
+        __m128i y = Lower16(_mm_loadu_si128(reinterpret_cast<const __m128i*>(b + i)));
+        if (_mm_movemask_epi8(_mm_cmpeq_epi8(x, y)) != 0xffff) {
+            return false;
+        }
+    }
+    return CaseEqualScalar(a + i, b + i, n - i);
+}
+
+// AVX2，每次32字节（target属性编译，运行时检测CPU支持后启用）
+__attribute__((target("avx2")))
+const char* FindCrlfAvx2(const char* p, size_t n) {
+    const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 33 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1));
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_cmpeq_epi8(a, cr), _mm256_cmpeq_epi8(b, lf))));
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindCrlfSse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+const char* FindHeadEndAvx2(const char* p, size_t n) {
+    const __m256i cr = _mm256_set1_epi8('\r'), lf = _mm256_set1_epi8('\n');
+    size_t i = 0;
+    for (; i + 35 <= n; i += 32) {
+        __m256i a = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i)), cr);
+        __m256i b = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 1)), lf);
+        __m256i c = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 2)), cr);
+        __m256i d = _mm256_cmpeq_epi8(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i + 3)), lf);
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_and_si256(_mm256_and_si256(a, b), _mm256_and_si256(c, d))));
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindHeadEndSse2(p + i, n - i);
+}
+
+__attribute__((target("avx2")))
+const char* FindAnyAvx2(const char* p, size_t n, const char* set, size_t setlen) {
+    __m256i s[kScanMaxSet];
+    for (size_t k = 0; k < setlen; k++) {
+        s[k] = _mm256_set1_epi8(set[k]);
+    }
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p + i));
+        __m256i eq = _mm256_cmpeq_epi8(a, s[0]);
+        for (size_t k = 1; k < setlen; k++) {
+            eq = _mm256_or_si256(eq, _mm256_cmpeq_epi8(a, s[k]));
+        }
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(eq));
+        if (m != 0) {
+            return p + i + __builtin_ctz(m);
+        }
+    }
+    return FindAnySse2(p + i, n - i, set, setlen);
+}
+
+__attribute__((target("avx2")))
+ssize_t PercentDecodeAvx2(const char* p, size_t n, char dst[]) {
+    const __m256i pct = _mm256_set1_epi8('%'), plus = _mm256_set1_epi8('+'), flip = _mm256_set1_epi8('+' ^ ' ');
+    const char* e = p + n;
+    char* d = dst;
+    while (e - p >= 32) {
+        __m256i a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(p));
+        a = _mm256_xor_si256(a, _mm256_and_si256(_mm256_cmpeq_epi8(a, plus), flip));
+        _mm256_storeu_si256(reinterpret_cast<__m256i*>(d), a);
+        uint32_t m = static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(a, pct)));
+        if (m == 0) {
+            p += 32;
+            d += 32;
+            continue;
+        }
+        int k = __builtin_ctz(m);
+        int c = DecodeEscape(p + k, e);
+        if (c == -1) {
+            return -1;
+        }
+        d[k] = static_cast<char>(c);
+        d += k + 1;
+        p += k + 3;
+    }
+    ssize_t r = PercentDecodeSse2(p, e - p, d);
+    return r == -1 ? -1 : (d - dst) + r;
+}
+
+__attribute__((target("avx2")))
+inline __m256i Lower32(__m256i v) {
+    __m256i upper = _mm256_and_si256(_mm256_cmpgt_epi8(v, _mm256_set1_epi8('A' - 1)), _mm256_cmpgt_epi8(_mm256_set1_epi8('Z' + 1), v));
+    return _mm256_or_si256(v, _mm256_and_si256(upper, _mm256_set1_epi8(0x20)));
+}
+
+__attribute__((target("avx2")))
+bool CaseEqualAvx2(const char* a, const char* b, size_t n) {
+    size_t i = 0;
+    for (; i + 32 <= n; i += 32) {
+        __m256i x = Lower32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(a + i)));
+        __m256i y = Lower32(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(b + i)));
+        if (static_cast<uint32_t>(_mm256_movemask_epi8(_mm256_cmpeq_epi8(x, y))) != 0xffffffffu) {
+            return false;
+        }
+    }
+    return CaseEqualSse2(a + i, b + i, n - i);
+}
+
+#endif
+
+// 进程内按CPU选定的内核
+struct Kernel_t {
+    const char* (*mFindCrlf)(const char* p, size_t n);
+    const char* (*mFindHeadEnd)(const char* p, size_t n);
+    const char* (*mFindAny)(const char* p, size_t n, const char* set, size_t setlen);
+    bool (*mCaseEqual)(const char* a, const char* b, size_t n);
+    ssize_t (*mPercentDecode)(const char* p, size_t n, char dst[]);
+    const char* mIsa;
+};
+
+Kernel_t hnet_scanKernel = {FindCrlfScalar, FindHeadEndScalar, FindAnyScalar, CaseEqualScalar, PercentDecodeScalar, "scalar"};
+pthread_once_t hnet_scan_once = PTHREAD_ONCE_INIT;
+
+void InitScanKernel() {
+#ifdef HNET_SCAN_X86
+    __builtin_cpu_init();
+    if (__builtin_cpu_supports("avx2")) {
+        Kernel_t k = {FindCrlfAvx2, FindHeadEndAvx2, FindAnyAvx2, CaseEqualAvx2, PercentDecodeAvx2, "avx2"};
+        hnet_scanKernel = k;
+    } else {
+        Kernel_t k = {FindCrlfSse2, FindHeadEndSse2, FindAnySse2, CaseEqualSse2, PercentDecodeSse2, "sse2"};
+        hnet_scanKernel = k;
+    }
+#endif
+}
+
+inline const Kernel_t& Kernel() {
+    pthread_once(&hnet_scan_once, InitScanKernel);
+    return hnet_scanKernel;
+}
+
+}	// namespace anonymous
+
+const char* FindCrlf(const char* p, size_t n) {
+    return n < 16 ? FindCrlfScalar(p, n) : Kernel().mFindCrlf(p, n);
+}
+
+const char* FindHeadEnd(const char* p, size_t n) {
+    return n < 16 ? FindHeadEndScalar(p, n) : Kernel().mFindHeadEnd(p, n);
+}
+
+const char* FindAny(const char* p, size_t n, const char* set, size_t setlen) {
+    if (setlen == 0) {
+        return NULL;
+    } else if (n < 16 || setlen > kScanMaxSet) {
+        return FindAnyScalar(p, n, set, setlen);
+    }
+    return Kernel().mFindAny(p, n, set, setlen);
+}
+
+bool CaseEqual(const char* a, const char* b, size_t n) {
+    return n < 16 ? CaseEqualScalar(a, b, n) : Kernel().mCaseEqual(a, b, n);
+}
+
+ssize_t PercentDecode(const char* p, size_t n, char dst[]) {
+    return n < 16 ? PercentDecodeScalar(p, n, dst) : Kernel().mPercentDecode(p, n, dst);
+}
+
+const char* Isa() {
+    return Kernel().mIsa;
+}
+
+}	// namespace scan
+
 namespace error {
 
 const int32_t kSysNerr = 132;
@@ -401,8 +886,9 @@ static struct StatusCode_t statusCodes[] = {
     {"413", "Request Entity Too Large"},
     {"414", "Request-url Too Long"},
     {"415", "Unsupported Media Type"},
-    {"416", ""},
+    {"416", "Requested Range Not Satisfiable"},
     {"417", "Expectation Failed"},
+    {"426", "Upgrade Required"},
 
     {"500", "Internal Server Error"},
     {"501", "Not Implemented"},
@@ -426,20 +912,82 @@ const std::string& Status(const std::string& code) {
     return gStatusCode[code];
 }
 
-static unsigned char toHex(unsigned char x) {
-    return  x > 9 ? x + 55 : x + 48;
+const char* Status(int code) {
+    for (int i = 0; strlen(statusCodes[i].code); i++) {
+        if (atoi(statusCodes[i].code) == code) {
+            return statusCodes[i].status;
+        }
+    }
+    return NULL;
 }
 
-static unsigned char fromHex(unsigned char x) {
-    unsigned char y;
-    if (x >= 'A' && x <= 'Z') {
-        y = x - 'A' + 10;
-    } else if (x >= 'a' && x <= 'z') {
-        y = x - 'a' + 10;
-    } else {
-        y = x - '0';
+size_t FormatDate(time_t t, char buf[]) {
+    struct tm tm;
+    gmtime_r(&t, &tm);
+    return strftime(buf, kHttpDateLen + 1, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+}
+
+time_t ParseDate(const wSlice& str) {
+    if (str.size() != kHttpDateLen) {
+        return -1;
     }
-    return y;
+    char buf[kHttpDateLen + 1];
+    memcpy(buf, str.data(), kHttpDateLen);
+    buf[kHttpDateLen] = '\0';
+
+    struct tm tm;
+    memset(&tm, 0, sizeof(tm));
+    const char* end = strptime(buf, "%a, %d %b %Y %H:%M:%S GMT", &tm);
+    if (end == NULL || *end != '\0') {
+        return -1;
+    }
+    return timegm(&tm);
+}
+
+static const struct MimeType_t {
+    const char  ext[8];
+    const char  type[32];
+} mimeTypes[] = {
+    {"html", "text/html; charset=UTF-8"},
+    {"htm", "text/html; charset=UTF-8"},
+    {"css", "text/css"},
+    {"js", "application/javascript"},
+    {"json", "application/json"},
+    {"xml", "text/xml"},
+    {"txt", "text/plain; charset=UTF-8"},
+    {"png", "image/png"},
+    {"jpg", "image/jpeg"},
+    {"jpeg", "image/jpeg"},
+    {"gif", "image/gif"},
+    {"svg", "image/svg+xml"},
+    {"ico", "image/x-icon"},
+    {"webp", "image/webp"},
+    {"woff", "font/woff"},
+    {"woff2", "font/woff2"},
+    {"pdf", "application/pdf"},
+    {"zip", "application/zip"},
+    {"mp4", "video/mp4"},
+    {"", ""}
+};
+
+const char* MimeType(const wSlice& path) {
+    const char* p = path.data() + path.size();
+    while (p > path.data() && *(p - 1) != '.' && *(p - 1) != '/') {
+        p--;
+    }
+    if (p > path.data() && *(p - 1) == '.') {
+        size_t n = path.data() + path.size() - p;
+        for (int i = 0; strlen(mimeTypes[i].ext); i++) {
+            if (strlen(mimeTypes[i].ext) == n && strncasecmp(mimeTypes[i].ext, p, n) == 0) {
+                return mimeTypes[i].type;
+            }
+        }
+    }
+    return "application/octet-stream";
+}
+
+static unsigned char toHex(unsigned char x) {
+    return  x > 9 ? x + 55 : x + 48;
 }
 
 std::string UrlEncode(const std::string& str) {
@@ -463,25 +1011,25 @@ std::string UrlEncode(const std::string& str) {
 }
 
 std::string UrlDecode(const std::string& str) {
-    std::string strTemp = "";
-    size_t length = str.length();
-    for (size_t i = 0; i < length; i++) {
-        if (str[i] == '+') {
-            strTemp += ' ';
-        } else if (str[i] == '%') {
-            if (i+2 >= length) {
-                return "";
-            }
-            unsigned char high = fromHex(static_cast<unsigned char>(str[++i]));
-            unsigned char low = fromHex(static_cast<unsigned char>(str[++i]));
-            strTemp += high*16 + low;
-        } else {
-            strTemp += str[i];
-        }
+    std::string strTemp;
+    if (!UrlDecode(wSlice(str), &strTemp)) {
+        return "";
     }
     return strTemp;
 }
 
+bool UrlDecode(const wSlice& str, std::string* dst) {
+    size_t size = dst->size();
+    dst->resize(size + str.size());
+    ssize_t len = scan::PercentDecode(str.data(), str.size(), &(*dst)[0] + size);
+    if (len == -1) {
+        dst->resize(size);
+        return false;
+    }
+    dst->resize(size + len);
+    return true;
+}
+
 }   // namespace http
 
 namespace soft {
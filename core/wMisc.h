@@ -30,6 +30,26 @@ void EncodeFixed64(char* dst, uint64_t value);
 void PutFixed32(std::string* dst, uint32_t value);
 void PutFixed64(std::string* dst, uint64_t value);
 
+// varint编码，返回dst写入结束位置（最多5字节）
+char* EncodeVarint32(char* dst, uint32_t value);
+
+// varint编码长度
+int VarintLength(uint64_t value);
+
+// 解析[p,limit)中varint，返回解析后位置，不完整或非法返回NULL
+const char* GetVarint32PtrFallback(const char* p, const char* limit, uint32_t* value);
+
+inline const char* GetVarint32Ptr(const char* p, const char* limit, uint32_t* value) {
+    if (p < limit) {
+        uint32_t result = *(reinterpret_cast<const unsigned char*>(p));
+        if ((result & 128) == 0) {
+            *value = result;
+            return p + 1;
+        }
+    }
+    return GetVarint32PtrFallback(p, limit, value);
+}
+
 inline uint8_t DecodeFixed8(const char* ptr) {
     if (kLittleEndian) {
         uint8_t result;
@@ -129,6 +149,15 @@ int FastUnixSec2Tm(time_t unix_sec, struct tm* tm, int time_zone = 8);
 int GetIpList(std::vector<unsigned int>& iplist);
 unsigned int GetIpByIF(const char* ifname);
 
+// 解析CPU列表（如 "0,2,4-7"，同 /sys/devices/system/node/node0/cpulist 格式），非法返回-1
+int ParseCpuList(const std::string& str, std::vector<int>* cpus);
+
+// 本进程可运行的CPU（sched_getaffinity，受cpuset限制）
+int GetAffinityCpus(std::vector<int>* cpus);
+
+// NUMA节点及其CPU（/sys/devices/system/node），不支持返回-1
+int GetNodeCpus(std::map<int, std::vector<int> >* nodes);
+
 // 切换进程工作目录
 // 行成功则返回0, 失败返回-1, errno 为错误代码
 int SetBinPath(std::string bin_path = "", std::string self = "/proc/self/exe");
@@ -169,6 +198,32 @@ inline u_char* AlignPtr(char* p, char* a) {
 
 }   // namespace misc
 
+// 协议解析字节扫描内核：运行时按CPU选择AVX2、SSE2实现（非x86平台为标量实现），短数据直接标量处理
+namespace scan {
+
+// FindAny字符集最大长度
+const size_t kScanMaxSet = 16;
+
+// 首个"\r\n"起始位置，不存在返回NULL
+const char* FindCrlf(const char* p, size_t n);
+
+// 首个"\r\n\r\n"起始位置（header结束），不存在返回NULL
+const char* FindHeadEnd(const char* p, size_t n);
+
+// 首个属于字符集set的字节位置，不存在返回NULL（setlen超过kScanMaxSet时为标量扫描）
+const char* FindAny(const char* p, size_t n, const char* set, size_t setlen);
+
+// ASCII不区分大小写比较n字节是否相同（header名称、token比较）
+bool CaseEqual(const char* a, const char* b, size_t n);
+
+// URL解码（'+'为空格，"%XY"为字节）至dst（至少n字节），返回解码后长度，转义截断或非十六进制返回-1
+ssize_t PercentDecode(const char* p, size_t n, char dst[]);
+
+// 当前内核指令集："avx2"、"sse2"或"scalar"
+const char* Isa();
+
+}   // namespace scan
+
 namespace error {
 
 // 初始化系统错误字符
@@ -190,9 +245,25 @@ void StatusCodeInit();
 
 const std::string& Status(const std::string& code);
 
+// 标准原因短语，未知状态码返回NULL
+const char* Status(int code);
+
 std::string UrlEncode(const std::string& str);
 std::string UrlDecode(const std::string& str);
 
+// 以 scan::PercentDecode 解码追加至dst，非法编码返回false（dst不变）
+bool UrlDecode(const wSlice& str, std::string* dst);
+
+// HTTP日期（RFC1123，如 Sun, 06 Nov 1994 08:49:37 GMT），buf至少kHttpDateLen+1字节，返回长度
+const size_t kHttpDateLen = 29;
+size_t FormatDate(time_t t, char buf[]);
+
+// 解析HTTP日期，非法返回-1
+time_t ParseDate(const wSlice& str);
+
+// 依据文件扩展名返回Content-Type
+const char* MimeType(const wSlice& path);
+
 }   // namespace http
 
 namespace soft {
@@ -5,6 +5,8 @@
  */
 
 #include <algorithm>
+#include <strings.h>
+#include <arpa/inet.h>
 #include "wMultiClient.h"
 #include "wEnv.h"
 #include "wTcpSocket.h"
@@ -12,17 +14,20 @@
 #include "wTcpTask.h"
 #include "wUnixTask.h"
 #include "wHttpTask.h"
+#include "wHttpClientTask.h"
 
 namespace hnet {
 
 wMultiClient::wMultiClient(wConfig* config, wServer* server, bool join) : wThread(join), mTick(0),
-mHeartbeatTurn(kHeartbeatTurn),mEpollFD(kFDUnknown), mTimeout(10), mConfig(config), mServer(server) {
+mHeartbeatTurn(kHeartbeatTurn),mEpollFD(kFDUnknown), mTimeout(10), mHttpConns(kHttpClientConns), mHttpPipeline(kHttpClientPipeline), 
+mHttpIdle(kHttpClientIdle), mConfig(config), mServer(server) {
 	assert(mConfig != NULL);
     mLatestTm = soft::TimeUsec();
     mHeartbeatTimer = wTimer(kKeepAliveTm);
 }
 
 wMultiClient::~wMultiClient() {
+    CleanHttp();
     CleanTask();
 }
 
@@ -148,6 +153,16 @@ int wMultiClient::DisConnect(wTask* task) {
 int wMultiClient::PrepareStart() {
     soft::TimeUpdate();
 
+    mConfig->GetConf("http_client_connections", &mHttpConns);
+    mConfig->GetConf("http_client_pipeline", &mHttpPipeline);
+    mConfig->GetConf("http_client_idle", &mHttpIdle);
+    if (mHttpConns < 1) {
+        mHttpConns = 1;
+    }
+    if (mHttpPipeline < 1) {
+        mHttpPipeline = 1;
+    }
+
     int ret = InitEpoll();
     if (ret == -1) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::PrepareStart InitEpoll() failed", "");
@@ -225,7 +240,9 @@ int wMultiClient::Recv() {
     for (int i = 0; i < ret && evt[i].data.ptr; i++) {
         wTask* task = reinterpret_cast<wTask*>(evt[i].data.ptr);
 
-        if (task->Socket()->FD() == kFDUnknown || evt[i].events & (EPOLLERR|EPOLLPRI)) {
+        if (task->Type() == kClientHttpType) {
+            HttpEvent(static_cast<wHttpClientTask*>(task), evt[i].events);
+        } else if (task->Socket()->FD() == kFDUnknown || evt[i].events & (EPOLLERR|EPOLLPRI)) {
             task->Socket()->SS() = kSsUnconnect;
             RemoveTask(task, NULL, false);
         } else if (task->Socket()->ST() == kStConnect && task->Socket()->SS() == kSsConnected) {
@@ -236,7 +253,7 @@ int wMultiClient::Recv() {
                     RemoveTask(task, NULL, false);
                 }
             } else if (evt[i].events & EPOLLOUT) {
-                if (task->SendLen() == 0) { // 清除写事件
+                if (!task->SendPending()) { // 清除写事件
                     AddTask(task, EPOLLIN, EPOLL_CTL_MOD, false);
                 } else {
                     // 套接口准备好了写入操作
@@ -405,6 +422,9 @@ void wMultiClient::CheckTick() {
     if (mHeartbeatTurn && mHeartbeatTimer.CheckTimer(mTick/1000)) {
         CheckHeartBeat();
     }
+    if (!mHttpPool.empty()) {
+        CheckHttp();
+    }
 }
 
 void wMultiClient::CheckHeartBeat() {
@@ -433,4 +453,337 @@ void wMultiClient::CheckHeartBeat() {
     }
 }
 
+int wMultiClient::HttpRequest(const std::string& method, const std::string& url, const std::map<std::string, std::string>& header, 
+    const std::string& body, const HttpCallback& callback, uint32_t timeout) {
+    // http://host[:port][/path][?query]
+    const size_t plen = strlen(kProtocol[1]);
+    if (method.empty() || url.compare(0, plen, kProtocol[1]) != 0) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpRequest () failed", "url illegal");
+        return -1;
+    }
+    size_t pos = url.find_first_of("/?", plen);
+    std::string hostport = url.substr(plen, pos == std::string::npos ? std::string::npos : pos - plen);
+    std::string path = pos == std::string::npos ? "/" : url.substr(pos);
+    if (path[0] == '?') {
+        path.insert(0, "/");
+    }
+
+    std::string host = hostport;
+    uint16_t port = 80;
+    size_t colon = hostport.find(':');
+    if (colon != std::string::npos) {
+        host = hostport.substr(0, colon);
+        port = static_cast<uint16_t>(atoi(hostport.c_str() + colon + 1));
+    }
+    struct in_addr addr;
+    if (port == 0 || inet_pton(AF_INET, host.c_str(), &addr) != 1) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpRequest () failed", "host must be ip address");
+        return -1;
+    }
+
+    HttpCall_t* call;
+    HNET_NEW(HttpCall_t(), call);
+    if (!call) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpRequest new() failed", error::Strerror(errno).c_str());
+        return -1;
+    }
+
+    // 请求行、header（Content-Length由框架计算），序列化一次
+    std::string& req = call->mReq;
+    req.reserve(256 + body.size());
+    req.append(method).append(" ").append(path).append(" ").append(kProtocol[0]).append(kCRLF);
+    bool hashost = false;
+    for (std::map<std::string, std::string>::const_iterator it = header.begin(); it != header.end(); it++) {
+        if (strcasecmp(it->first.c_str(), kHeader[0]) == 0 || strcasecmp(it->first.c_str(), kHeader[14]) == 0) {
+            continue;
+        } else if (strcasecmp(it->first.c_str(), kHeader[2]) == 0) {
+            hashost = true;
+        }
+        req.append(it->first).append(kColon).append(it->second).append(kCRLF);
+    }
+    if (!hashost) {
+        req.append(kHeader[2]).append(kColon).append(hostport).append(kCRLF);
+    }
+    if (!body.empty() || method == "POST" || method == "PUT" || method == "PATCH") {
+        req.append(kHeader[0]).append(kColon).append(logging::NumberToString(static_cast<uint64_t>(body.size()))).append(kCRLF);
+    }
+    req.append(kCRLF).append(body);
+    if (req.size() > kPackageSize) {
+        HNET_DELETE(call);
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpRequest () failed", "request too large");
+        return -1;
+    }
+
+    call->mCallback = callback;
+    call->mDeadline = soft::TimeUsec() + static_cast<uint64_t>(timeout)*1000;
+    call->mHead = method == "HEAD";
+    call->mIdempotent = method == "GET" || method == "HEAD" || method == "PUT" || method == "DELETE" || method == "OPTIONS";
+
+    std::map<std::string, HttpPool_t*>::iterator it = mHttpPool.find(hostport);
+    if (it == mHttpPool.end()) {
+        HttpPool_t* pool;
+        HNET_NEW(HttpPool_t(), pool);
+        if (!pool) {
+            HNET_DELETE(call);
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpRequest new() failed", error::Strerror(errno).c_str());
+            return -1;
+        }
+        pool->mHost = host;
+        pool->mPort = port;
+        it = mHttpPool.insert(std::make_pair(hostport, pool)).first;
+    }
+    it->second->mWait.push_back(call);
+    return HttpDispatch(it->second);
+}
+
+int wMultiClient::HttpGet(const std::string& url, const std::map<std::string, std::string>& header, const HttpCallback& callback, uint32_t timeout) {
+    return HttpRequest(kMethod[0], url, header, "", callback, timeout);
+}
+
+int wMultiClient::HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, 
+    const HttpCallback& callback, uint32_t timeout) {
+    std::string body;
+    for (std::map<std::string, std::string>::const_iterator it = data.begin(); it != data.end(); it++) {
+        if (!body.empty()) {
+            body += "&";
+        }
+        body += http::UrlEncode(it->first) + "=" + http::UrlEncode(it->second);
+    }
+
+    std::map<std::string, std::string> h(header);
+    if (h.find(kHeader[1]) == h.end()) {	// Content-Type
+        h.insert(std::make_pair(kHeader[1], "application/x-www-form-urlencoded"));
+    }
+    return HttpRequest(kMethod[1], url, h, body, callback, timeout);
+}
+
+int wMultiClient::HttpDispatch(HttpPool_t* pool) {
+    while (!pool->mWait.empty()) {
+        HttpCall_t* call = pool->mWait.front();
+        wHttpClientTask* task = NULL;
+
+        // 空闲连接
+        for (std::vector<wHttpClientTask*>::iterator it = pool->mConn.begin(); it != pool->mConn.end(); it++) {
+            if ((*it)->Inflight().empty() && (*it)->Acceptable(call, 1)) {
+                task = *it;
+                break;
+            }
+        }
+
+        // 新建连接
+        if (task == NULL && pool->mConn.size() < static_cast<size_t>(mHttpConns) && HttpConnect(pool, &task) == -1) {
+            int err = errno != 0 ? errno : ECONNREFUSED;
+            pool->mWait.pop_front();
+            if (call->mCallback) {
+                call->mCallback(err, NULL);
+            }
+            HNET_DELETE(call);
+            continue;
+        }
+
+        // 流水线：在途请求最少的连接
+        if (task == NULL) {
+            for (std::vector<wHttpClientTask*>::iterator it = pool->mConn.begin(); it != pool->mConn.end(); it++) {
+                if ((*it)->Acceptable(call, static_cast<size_t>(mHttpPipeline)) && (task == NULL || (*it)->Inflight().size() < task->Inflight().size())) {
+                    task = *it;
+                }
+            }
+        }
+        if (task == NULL) {
+            break;
+        }
+
+        pool->mWait.pop_front();
+        if (task->Request(call) == -1) {
+            if (call->mCallback) {
+                call->mCallback(ENOBUFS, NULL);
+            }
+            HNET_DELETE(call);
+        }
+    }
+    return 0;
+}
+
+int wMultiClient::HttpConnect(HttpPool_t* pool, wHttpClientTask** ptr) {
+    wSocket *socket = NULL;
+    HNET_NEW(wTcpSocket(kStConnect, kSpHttp), socket);
+    if (!socket) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpConnect new() failed", error::Strerror(errno).c_str());
+        return -1;
+    }
+
+    int err = 0;
+    if (socket->Open() == -1 || socket->SetNonblock() == -1) {
+        err = errno;
+        HNET_DELETE(socket);
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpConnect Open() failed", "");
+        errno = err;
+        return -1;
+    }
+
+    // 非阻塞连接，EINPROGRESS时待可写事件完成
+    int ret = socket->Connect(pool->mHost, pool->mPort, 0);
+    if (ret == -1 && errno != EINPROGRESS) {
+        err = errno;
+        HNET_DELETE(socket);
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpConnect Connect() failed", error::Strerror(err).c_str());
+        errno = err;
+        return -1;
+    }
+    socket->SS() = ret == -1 ? kSsUnconnect : kSsConnected;
+
+    wHttpClientTask* task = NULL;
+    HNET_NEW(wHttpClientTask(socket, pool), task);
+    if (!task) {
+        err = errno;
+        HNET_DELETE(socket);
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMultiClient::HttpConnect new() failed", error::Strerror(err).c_str());
+        errno = err;
+        return -1;
+    }
+    task->Connecting() = ret == -1;
+
+    if (AddTask(task, EPOLLIN | EPOLLOUT, EPOLL_CTL_ADD, false) == -1) {
+        err = errno;
+        HNET_DELETE(task);
+        errno = err;
+        return -1;
+    }
+    pool->mConn.push_back(task);
+    *ptr = task;
+    return 0;
+}
+
+void wMultiClient::HttpEvent(wHttpClientTask* task, uint32_t events) {
+    if (events & EPOLLERR) {
+        task->Connected();
+        if (task->Err() == 0) {
+            task->Err() = ECONNRESET;
+        }
+        HttpClose(task);
+        return;
+    } else if (task->Connecting()) {
+        if (!(events & (EPOLLOUT | EPOLLHUP))) {
+            return;
+        } else if (task->Connected() == -1) {
+            HttpClose(task);
+            return;
+        }
+    }
+
+    ssize_t size;
+    if (events & (EPOLLIN | EPOLLHUP)) {
+        if (task->TaskRecv(&size) == -1) {
+            HttpClose(task);
+            return;
+        }
+    }
+    if (events & EPOLLOUT) {
+        if (!task->SendPending()) { // 清除写事件
+            AddTask(task, EPOLLIN, EPOLL_CTL_MOD, false);
+        } else if (task->TaskSend(&size) == -1) {
+            if (task->Err() == 0) {
+                task->Err() = ECONNRESET;
+            }
+            HttpClose(task);
+        }
+    }
+}
+
+void wMultiClient::HttpClose(wHttpClientTask* task) {
+    HttpPool_t* pool = task->Pool();
+    int err = task->Err() != 0 ? task->Err() : ECONNRESET;
+    uint64_t now = soft::TimeUsec();
+
+    // 未响应的幂等请求重试一次（连接可能已被服务端空闲关闭），按原顺序排在等待队列前
+    std::vector<HttpCall_t*> failed;
+    std::deque<HttpCall_t*>& inflight = task->Inflight();
+    for (std::deque<HttpCall_t*>::reverse_iterator it = inflight.rbegin(); it != inflight.rend(); it++) {
+        if ((*it)->mIdempotent && !(*it)->mRetried && (*it)->mDeadline > now) {
+            (*it)->mRetried = true;
+            pool->mWait.push_front(*it);
+        } else {
+            failed.push_back(*it);
+        }
+    }
+    inflight.clear();
+
+    RemoveTask(task, NULL, false);
+    std::vector<wHttpClientTask*>::iterator it = std::find(pool->mConn.begin(), pool->mConn.end(), task);
+    if (it != pool->mConn.end()) {
+        pool->mConn.erase(it);
+    }
+    HNET_DELETE(task);
+
+    for (std::vector<HttpCall_t*>::reverse_iterator it = failed.rbegin(); it != failed.rend(); it++) {
+        if ((*it)->mCallback) {
+            (*it)->mCallback((*it)->mDeadline > now ? err : ETIMEDOUT, NULL);
+        }
+        HNET_DELETE(*it);
+    }
+    HttpDispatch(pool);
+}
+
+void wMultiClient::CheckHttp() {
+    uint64_t now = soft::TimeUsec();
+    std::vector<HttpCall_t*> expired;
+    std::vector<wHttpClientTask*> closing;
+    for (std::map<std::string, HttpPool_t*>::iterator it = mHttpPool.begin(); it != mHttpPool.end(); it++) {
+        HttpPool_t* pool = it->second;
+
+        // 等待连接的请求超时
+        std::deque<HttpCall_t*>::iterator wit = pool->mWait.begin();
+        while (wit != pool->mWait.end()) {
+            if ((*wit)->mDeadline <= now) {
+                expired.push_back(*wit);
+                wit = pool->mWait.erase(wit);
+            } else {
+                wit++;
+            }
+        }
+
+        // 在途请求超时（响应顺序已无法保证，关闭连接），空闲连接超时
+        for (std::vector<wHttpClientTask*>::iterator cit = pool->mConn.begin(); cit != pool->mConn.end(); cit++) {
+            std::deque<HttpCall_t*>& inflight = (*cit)->Inflight();
+            if (inflight.empty()) {
+                if (!(*cit)->Connecting() && now - (*cit)->IdleTm() > static_cast<uint64_t>(mHttpIdle)*1000000) {
+                    closing.push_back(*cit);
+                }
+                continue;
+            }
+            for (std::deque<HttpCall_t*>::iterator iit = inflight.begin(); iit != inflight.end(); iit++) {
+                if ((*iit)->mDeadline <= now) {
+                    (*cit)->Err() = ECONNABORTED;
+                    closing.push_back(*cit);
+                    break;
+                }
+            }
+        }
+    }
+
+    for (std::vector<wHttpClientTask*>::iterator it = closing.begin(); it != closing.end(); it++) {
+        HttpClose(*it);
+    }
+    for (std::vector<HttpCall_t*>::iterator it = expired.begin(); it != expired.end(); it++) {
+        if ((*it)->mCallback) {
+            (*it)->mCallback(ETIMEDOUT, NULL);
+        }
+        HNET_DELETE(*it);
+    }
+}
+
+void wMultiClient::CleanHttp() {
+    for (std::map<std::string, HttpPool_t*>::iterator it = mHttpPool.begin(); it != mHttpPool.end(); it++) {
+        HttpPool_t* pool = it->second;
+        for (std::vector<wHttpClientTask*>::iterator cit = pool->mConn.begin(); cit != pool->mConn.end(); cit++) {
+            HNET_DELETE(*cit);
+        }
+        for (std::deque<HttpCall_t*>::iterator wit = pool->mWait.begin(); wit != pool->mWait.end(); wit++) {
+            HNET_DELETE(*wit);
+        }
+        HNET_DELETE(pool);
+    }
+    mHttpPool.clear();
+}
+
 }   // namespace hnet
@@ -9,6 +9,8 @@
 
 #include <algorithm>
 #include <vector>
+#include <map>
+#include <functional>
 #include <sys/epoll.h>
 #include "wCore.h"
 #include "wNoncopyable.h"
@@ -29,7 +31,33 @@ namespace hnet {
 const int kClientNumShardBits = 4;
 const int kClientNumShard = 1 << kClientNumShardBits;
 
+// 异步HTTP客户端连接池任务类型（不加入 mTaskPool）
+const int kClientHttpType = kClientNumShard;
+
+// 异步HTTP客户端默认：每host连接数、单连接流水线深度、空闲连接保持（秒）、请求超时（毫秒）、响应body上限
+// 配置项 http_client_connections、http_client_pipeline、http_client_idle
+const int		kHttpClientConns	= 8;
+const int		kHttpClientPipeline	= 4;
+const int		kHttpClientIdle		= 20;
+const uint32_t	kHttpClientTimeout	= 30000;
+const size_t	kHttpClientMaxBody	= 64 << 20;
+
+// 异步HTTP响应
+struct HttpResponse_t {
+    int mCode;
+    std::string mReason;
+    std::map<std::string, std::string> mHeader;
+    std::string mBody;
+
+    HttpResponse_t() : mCode(0) { }
+};
+
+// 异步HTTP回调：err为0时res为响应，否则为errno（ETIMEDOUT、ECONNREFUSED、ECONNRESET、EPROTO等），res为NULL
+typedef std::function<void(int err, HttpResponse_t* res)> HttpCallback;
+
 class wTask;
+class wHttpClientTask;
+struct HttpPool_t;
 
 // 多类型客户端（类型为0-15）
 // 多用于与服务端长连，守护监听服务端消息
@@ -59,6 +87,19 @@ public:
     int Send(wTask *task, const google::protobuf::Message* msg);
 #endif
 
+    // 异步HTTP请求（须于事件循环线程中调用，不阻塞）：按 host:port 复用长连接池，连接非阻塞建立，
+    // 幂等请求可在同一连接上流水线发送；响应、出错或超时（timeout毫秒）时回调callback
+    // url形如 http://127.0.0.1:8080/path?query（主机须为IP地址，不做阻塞的域名解析）。参数非法返回-1（不回调）
+    int HttpRequest(const std::string& method, const std::string& url, const std::map<std::string, std::string>& header, 
+        const std::string& body, const HttpCallback& callback, uint32_t timeout = kHttpClientTimeout);
+    int HttpGet(const std::string& url, const std::map<std::string, std::string>& header, const HttpCallback& callback, uint32_t timeout = kHttpClientTimeout);
+    // data以 application/x-www-form-urlencoded 编码为请求body
+    int HttpPost(const std::string& url, const std::map<std::string, std::string>& data, const std::map<std::string, std::string>& header, 
+        const HttpCallback& callback, uint32_t timeout = kHttpClientTimeout);
+
+    // 连接池调度等待中的请求（空闲连接优先，其次新建连接，最后流水线发送）
+    int HttpDispatch(HttpPool_t* pool);
+
     int PrepareStart();
     int Start();
     
@@ -94,6 +135,15 @@ protected:
     int InitEpoll();
 
     int RemoveTask(wTask* task, std::vector<wTask*>::iterator* iter = NULL, bool delpool = true);
+
+    // 异步HTTP连接池
+    int HttpConnect(HttpPool_t* pool, wHttpClientTask** ptr);
+    void HttpEvent(wHttpClientTask* task, uint32_t events);
+    // 关闭连接：未响应的幂等请求重试一次，其余回调失败
+    void HttpClose(wHttpClientTask* task);
+    // 请求超时、空闲连接检测
+    void CheckHttp();
+    void CleanHttp();
     int CleanTask();
     
     int AddToTaskPool(wTask *task);
@@ -115,6 +165,12 @@ protected:
     // task|pool
     std::vector<wTask*> mTaskPool[kClientNumShard];
 
+    // 异步HTTP连接池 host:port -> pool
+    std::map<std::string, HttpPool_t*> mHttpPool;
+    int mHttpConns;
+    int mHttpPipeline;
+    int mHttpIdle;
+
     wConfig* mConfig;
     wServer* mServer;
 };
@@ -24,16 +24,22 @@
 #include "wUdpTask.h"
 #include "wUnixTask.h"
 #include "wChannelTask.h"
+#include "wChannelCmd.h"
+#include "wChannelRing.h"
 #include "wHttpTask.h"
 
 namespace hnet {
 
-wServer::wServer(wConfig* config): mExiting(false), mTick(0), mHeartbeatTurn(kHeartbeatTurn), mEpollFD(kFDUnknown), mTimeout(10), 
-mShm(NULL), mAcceptAtomic(NULL), mAcceptFL(NULL), mUseAcceptTurn(kAcceptTurn), mAcceptHeld(false), mAcceptDisabled(0), 
+wServer::wServer(wConfig* config): mExiting(false), mQuitTm(0), mDrainTm(0), mDrainConn(-1), mQuitTimeout(kQuitTimeout), mMigrateSlot(kMaxProcess), mMigrateNum(0), mTick(0), mHeartbeatTurn(kHeartbeatTurn), mEpollFD(kFDUnknown), mTimeout(10), 
+mShm(NULL), mAcceptAtomic(NULL), mAcceptFL(NULL), mUseAcceptTurn(kAcceptTurn), mAcceptHeld(false), mAcceptDisabled(0), mAcceptSlack(kAcceptSlack), mLoadScore(0), mLoopTm(0), mLoopLag(0), 
 mMaster(NULL), mConfig(config), mEnv(wEnv::Default()) {
 	assert(mConfig != NULL);
+	memset(mChannelTask, 0, sizeof(mChannelTask));
+	SetChannelQueue(kChannelBlock);
     mLatestTm = soft::TimeUsec();
     mHeartbeatTimer = wTimer(kKeepAliveTm);
+    mIdleTimer = wTimer(kKeepAliveTm);
+    mLoadTimer = wTimer(kLoadTurn);
 }
 
 wServer::~wServer() {
@@ -49,6 +55,12 @@ int wServer::PrepareStart(const std::string& ipaddr, uint16_t port, const std::s
 		return ret;
     }
 
+    // 优雅退出期限（master、worker共用）
+    int timeout = 0;
+    if (mConfig->GetConf("quit_timeout", &timeout) && timeout >= 0) {
+    	mQuitTimeout = static_cast<uint32_t>(timeout);
+    }
+
     ret = PrepareRun();
     if (ret == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::PrepareStart PrepareRun() failed", "");
@@ -77,7 +89,7 @@ int wServer::SingleStart(bool daemon) {
     while (daemon) {
     	soft::TimeUpdate();
 
-    	if (mExiting) {
+    	if (mExiting && Drained()) {
 		    ProcessExit();
 		    CleanListenSock();
 		    exit(0);
@@ -105,6 +117,30 @@ int wServer::WorkerStart(bool daemon) {
 		return ret;
     }
 
+    // channel socket发送队列配置
+    std::string policy;
+    int queue = kChannelQueue, wait = kChannelWait;
+    mConfig->GetConf("channel_queue", &queue);
+    mConfig->GetConf("channel_wait", &wait);
+    mConfig->GetConf("channel_policy", &policy);
+    if (queue <= 0) {
+    	queue = kChannelQueue;
+    }
+    if (wait < 0) {
+    	wait = 0;
+    }
+    int slack = kAcceptSlack;
+    if (mConfig->GetConf("accept_slack", &slack) && slack >= 0) {
+    	mAcceptSlack = static_cast<uint32_t>(slack);
+    }
+    if (policy == "drop") {
+    	SetChannelQueue(kChannelDrop, queue, wait);
+    } else if (policy == "fail") {
+    	SetChannelQueue(kChannelFail, queue, wait);
+    } else {
+    	SetChannelQueue(kChannelBlock, queue, wait);
+    }
+
     ret = Channel2Epoll(true);
     if (ret == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::WorkerStart Channel2Epoll() failed", "");
@@ -123,13 +159,13 @@ int wServer::WorkerStart(bool daemon) {
     while (daemon) {
     	soft::TimeUpdate();
     	
-    	if (mExiting) {
+    	if (mExiting && Drained()) {
     	    if (kAcceptStuff == 0 && mShm) {
     	    	mAcceptAtomic->CompareExchangeWeak(mMaster->mWorker->mPid, -1);
     	    	mShm->Remove();
     	    }
     	   	ProcessExit();
-			CleanListenSock();
+			CleanListenSock(false);
 		    exit(0);
     	}
     
@@ -241,9 +277,17 @@ int wServer::ReleaseAcceptMutex(int pid) {
 }
 
 int wServer::Recv() {
-	// 争抢accept锁
+	// 上一轮事件处理时长
+	uint64_t now = soft::TimeUsec();
+	if (mLoopTm > 0 && now > mLoopTm) {
+		mLoopLag = std::max(mLoopLag, now - mLoopTm);
+	}
+
+	// 争抢accept锁（负载高于平均时跳过 mAcceptDisabled 轮）
 	if (mUseAcceptTurn == true && mAcceptHeld == false) {
-		if ((kAcceptStuff == 0 && mAcceptAtomic->CompareExchangeWeak(-1, mMaster->mWorker->mPid)) ||
+		if (mAcceptDisabled > 0) {
+			mAcceptDisabled--;
+		} else if ((kAcceptStuff == 0 && mAcceptAtomic->CompareExchangeWeak(-1, mMaster->mWorker->mPid)) ||
 			(kAcceptStuff == 1 && mEnv->LockFile(soft::GetAcceptPath(), &mAcceptFL) == 0)) {
 			Listener2Epoll(false);
 			mAcceptHeld = true;
@@ -256,6 +300,7 @@ int wServer::Recv() {
 	if (ret == -1) {
 		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Recv epoll_wait() failed", error::Strerror(errno).c_str());
 	}
+	mLoopTm = misc::GetTimeofday();
 
 	for (int i = 0; i < ret && evt[i].data.ptr; i++) {
 		wTask* task = reinterpret_cast<wTask*>(evt[i].data.ptr);
@@ -280,15 +325,21 @@ int wServer::Recv() {
 					if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpChannel) {	// udp无需删除task
 						task->DisConnect();
 						RemoveTask(task);
+						continue;
 					}
 				}
-			} else if (evt[i].events & EPOLLOUT) {
-				if (task->SendLen() <= 0) {	// 清除写事件
+			}
+			// 读写事件同时就绪时一并处理，避免持续输入时写事件饥饿（流水线请求）
+			if (evt[i].events & EPOLLOUT) {
+				if (!task->SendPending()) {	// 清除写事件
 					AddTask(task, EPOLLIN, EPOLL_CTL_MOD, false);
 				} else {
 					// 套接口准备好了写入操作
 					// 写入失败，半连接，对端读关闭（udp无需删除task）
 					ssize_t size;
+					if (task->Socket()->SP() == kSpChannel) {
+						mChannelStat.mRetried++;
+					}
 					if (task->TaskSend(&size) == -1) {
 						if (task->Socket()->SP() != kSpUdp && task->Socket()->SP() != kSpChannel) {
 							task->DisConnect();
@@ -508,93 +559,200 @@ int wServer::FindTaskBySocket(wTask** task, const wSocket* sock) {
 	return -1;
 }
 
-int wServer::AsyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uint32_t>* blackslot) {
-	if (Master()->WorkerNum() <= 1) {
-		return 0;
+int wServer::DeliverWorker(uint32_t solt, const std::vector<uint32_t>* blackslot, const char head[], size_t headlen, const char body[], size_t bodylen, bool sync) {
+	// 广播消息仅遍历存活slot
+	const uint32_t* slots = &solt;
+	size_t num = 1;
+	if (solt == kMaxProcess) {
+		slots = mChannelSlot.data();
+		num = mChannelSlot.size();
 	}
-	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
-			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
-				continue;
-			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
-				continue;
-			}
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(i)->Channel()) == 0) {
-				Send(task, cmd, len);
-			}
-	    }
-	} else {
-		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
+	int ret = 0;
+	ChannelFrame_t* frame = NULL;	// channel socket共享帧，首个经socket发送的目标时编码
+	for (size_t n = 0; n < num; n++) {
+		uint32_t i = slots[n];
+		if (!LiveWorker(i, blackslot)) {
+			continue;
+		}
+
+		int r = RingWorker(i, head, headlen, body, bodylen, sync);
+		if (r == -1) {
+			mChannelStat.mDropped++;
+			ret = -1;
+			continue;
+		} else if (r == 0) {
+			continue;
+		}
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(solt)->Channel()) == 0) {
-				Send(task, cmd, len);
+		if (frame == NULL) {
+			HNET_NEW(ChannelFrame_t(), frame);
+			if (frame == NULL) {
+				HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::DeliverWorker new() failed", error::Strerror(errno).c_str());
+				return -1;
 			}
+			frame->mData.reserve(headlen + bodylen);
+			frame->mData.append(head, headlen);
+			frame->mData.append(body, bodylen);
+		}
+		if (QueueWorker(i, frame) == -1) {
+			ret = -1;
 		}
 	}
-    return 0;
+	if (frame != NULL) {
+		ReleaseFrame(frame);
+	}
+    return ret;
 }
 
-#ifdef _USE_PROTOBUF_
-int wServer::AsyncWorker(const google::protobuf::Message* msg, uint32_t solt, const std::vector<uint32_t>* blackslot) {
-	if (Master()->WorkerNum() <= 1) {
-		return 0;
+int wServer::RingWorker(uint32_t solt, const char head[], size_t headlen, const char body[], size_t bodylen, bool sync) {
+	wChannelRing* ring = mMaster->Ring();
+	if (ring == NULL || !ring->Usable(solt, headlen + bodylen)) {
+		return 1;
+	} else if (sync && mChannelPolicy == kChannelBlock) {
+		return ring->SyncPush(solt, head, headlen, body, bodylen, mChannelWait);
+	} else if (ring->Push(solt, head, headlen, body, bodylen) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d]", "wServer::RingWorker Push() failed", "ring full", solt);
+		return -1;
 	}
-	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
-			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
-				continue;
-			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
-				continue;
-			}
+	return 0;
+}
 
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(i)->Channel()) == 0) {
-				Send(task, msg);
-			}
-	    }
-	} else {
-		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
-			
-			wTask *task = NULL;
-			if (FindTaskBySocket(&task, mMaster->Worker(solt)->Channel()) == 0) {
-				Send(task, msg);
+int wServer::QueueWorker(uint32_t solt, ChannelFrame_t* frame) {
+	// 帧须整体写入一条记录
+	if (frame->mData.size() > mMaster->Worker(solt)->Channel()->FrameMax()) {
+		mChannelStat.mDropped++;
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d, len=%d]", "wServer::QueueWorker () failed", "frame too large", solt, static_cast<int>(frame->mData.size()));
+		return -1;
+	}
+
+	wTask* task = mChannelTask[solt];
+	if (task == NULL) {
+		return FlushWorker(solt, frame->mData.data(), frame->mData.size());
+	}
+
+	// 队列为空时立即写入：整帧写入，或发送缓冲不足时整帧入队
+	if (!task->SendPending()) {
+		ssize_t size = 0;
+		if (task->Socket()->SendBytes(const_cast<char*>(frame->mData.data()), frame->mData.size(), &size) == -1) {
+			mChannelStat.mDropped++;
+			return -1;
+		} else if (size > 0) {
+			return 0;
+		}
+	}
+
+	// 队列满
+	if (task->SendFileNum() >= mChannelQueue) {
+		if (mChannelPolicy == kChannelDrop && task->DropSendData() == 0) {
+			mChannelStat.mDropped++;
+		} else if (mChannelPolicy == kChannelBlock) {
+			int64_t start = misc::GetTimeofday();
+			while (task->SendFileNum() >= mChannelQueue) {
+				int64_t left = static_cast<int64_t>(mChannelWait) - (misc::GetTimeofday() - start) / 1000;
+				if (left <= 0 || WaitWorker(solt, left) == -1) {
+					break;
+				}
+				ssize_t size;
+				mChannelStat.mRetried++;
+				if (task->TaskSend(&size) == -1) {
+					break;
+				}
 			}
 		}
+
+		if (task->SendFileNum() >= mChannelQueue) {
+			mChannelStat.mDropped++;
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d]", "wServer::QueueWorker () failed", "queue full", solt);
+			return -1;
+		}
 	}
-    return 0;
+
+	frame->mRef++;
+	task->SendData2Buf(frame->mData.data(), frame->mData.size(), &wServer::ReleaseFrame, frame);
+	mChannelStat.mQueued++;
+	return AddTask(task, EPOLLIN | EPOLLOUT, EPOLL_CTL_MOD, false);
 }
-#endif
 
-int wServer::SyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uint32_t>* blackslot) {
+int wServer::FlushWorker(uint32_t solt, const char buf[], size_t len) {
+	wChannelSocket* socket = mMaster->Worker(solt)->Channel();
+	int64_t start = misc::GetTimeofday();
+	while (true) {
+		ssize_t size = 0;
+		if (socket->SendBytes(const_cast<char*>(buf), len, &size) == -1) {
+			mChannelStat.mDropped++;
+			return -1;
+		} else if (size > 0) {
+			return 0;
+		}
+
+		// 整帧未写入，超时丢弃不影响后续帧
+		int64_t left = static_cast<int64_t>(mChannelWait) - (misc::GetTimeofday() - start) / 1000;
+		if (left <= 0 || WaitWorker(solt, left) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d]", "wServer::FlushWorker () failed", "timeout", solt);
+			mChannelStat.mDropped++;
+			return -1;
+		}
+		mChannelStat.mRetried++;
+	}
+}
+
+int wServer::WaitWorker(uint32_t solt, int64_t timeout) {
+	struct pollfd pfd;
+	pfd.fd = (*mMaster->Worker(solt)->Channel())[0];
+	pfd.events = POLLOUT;
+	pfd.revents = 0;
+	int ret = poll(&pfd, 1, static_cast<int>(timeout));
+	if (ret == -1 && errno != EINTR) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::WaitWorker poll() failed", error::Strerror(errno).c_str());
+		return -1;
+	} else if (ret > 0 && (pfd.revents & (POLLERR | POLLHUP | POLLNVAL))) {
+		return -1;
+	}
+	return 0;
+}
+
+bool wServer::LiveWorker(uint32_t solt, const std::vector<uint32_t>* blackslot) {
+	if (mMaster->Worker(solt)->mPid == -1 || mMaster->Worker(solt)->ChannelFD(0) == kFDUnknown) {
+		return false;
+	} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), solt) != blackslot->end()) {
+		return false;
+	}
+	return true;
+}
+
+int wServer::AsyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uint32_t>* blackslot) {
 	if (Master()->WorkerNum() <= 1) {
 		return 0;
 	}
-	ssize_t ret;
-	char buf[kPackageSize];
-	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
-			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
-				continue;
-			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
-				continue;
-			}
+	// 帧头，消息体直接写入环（或共享帧）
+	char head[sizeof(uint32_t) + sizeof(uint8_t)];
+	coding::EncodeFixed32(head, static_cast<uint32_t>(len + sizeof(uint8_t)));
+	coding::EncodeFixed8(head + sizeof(uint32_t), static_cast<uint8_t>(kMpCommand));
+	return DeliverWorker(solt, blackslot, head, sizeof(head), cmd, len, false);
+}
 
-			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, cmd, len);
-			mMaster->Worker(i)->Channel()->SendBytes(buf, sizeof(uint32_t) + sizeof(uint8_t) + len, &ret);
-	    }
-	} else {
-		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
+#ifdef _USE_PROTOBUF_
+int wServer::AsyncWorker(const google::protobuf::Message* msg, uint32_t solt, const std::vector<uint32_t>* blackslot) {
+	if (Master()->WorkerNum() <= 1) {
+		return 0;
+	}
+	// 整帧只序列化一次
+	std::string frame;
+	frame.resize(sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize());
+	wTask::Assertbuf(&frame[0], msg);
+	return DeliverWorker(solt, blackslot, frame.data(), frame.size(), NULL, 0, false);
+}
+#endif
 
-			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, cmd, len);
-			mMaster->Worker(solt)->Channel()->SendBytes(buf, sizeof(uint32_t) + sizeof(uint8_t) + len, &ret);
-		}
+int wServer::SyncWorker(char *cmd, int len, uint32_t solt, const std::vector<uint32_t>* blackslot) {
+	if (Master()->WorkerNum() <= 1) {
+		return 0;
 	}
-    return 0;
+	char head[sizeof(uint32_t) + sizeof(uint8_t)];
+	coding::EncodeFixed32(head, static_cast<uint32_t>(len + sizeof(uint8_t)));
+	coding::EncodeFixed8(head + sizeof(uint32_t), static_cast<uint8_t>(kMpCommand));
+	return DeliverWorker(solt, blackslot, head, sizeof(head), cmd, len, true);
 }
 
 #ifdef _USE_PROTOBUF_
@@ -602,32 +760,47 @@ int wServer::SyncWorker(const google::protobuf::Message* msg, uint32_t solt, con
 	if (Master()->WorkerNum() <= 1) {
 		return 0;
 	}
-	ssize_t ret;
-	char buf[kPackageSize];
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
-	if (solt == kMaxProcess) {	// 广播消息
-		for (uint32_t i = 0; i < kMaxProcess; i++) {
-			if (mMaster->Worker(i)->mPid == -1 || mMaster->Worker(i)->ChannelFD(0) == kFDUnknown) {
-				continue;
-			} else if (blackslot && std::find(blackslot->begin(), blackslot->end(), i) != blackslot->end()) {
-				continue;
-			}
+	std::string frame;
+	frame.resize(sizeof(uint32_t) + sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize());
+	wTask::Assertbuf(&frame[0], msg);
+	return DeliverWorker(solt, blackslot, frame.data(), frame.size(), NULL, 0, true);
+}
+#endif
 
-			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, msg);
-			mMaster->Worker(i)->Channel()->SendBytes(buf, sizeof(uint32_t) + len, &ret);
-	    }
-	} else {
-		if (mMaster->Worker(solt)->mPid != -1 && mMaster->Worker(solt)->ChannelFD(0) != kFDUnknown) {
+void wServer::SetChannelQueue(int policy, uint32_t queue, uint32_t wait) {
+	mChannelPolicy = policy;
+	mChannelQueue = queue > 0 ? queue : 1;
+	mChannelWait = wait;
+}
 
-			/* TODO: EAGAIN */
-			wTask::Assertbuf(buf, msg);
-			mMaster->Worker(solt)->Channel()->SendBytes(buf, sizeof(uint32_t) + len, &ret);
-		}
+void wServer::ReleaseFrame(void* arg) {
+	ChannelFrame_t* frame = reinterpret_cast<ChannelFrame_t*>(arg);
+	if (--frame->mRef == 0) {
+		HNET_DELETE(frame);
 	}
-    return 0;
 }
-#endif
+
+void wServer::AddChannelSlot(uint32_t slot, wTask* task) {
+	if (slot >= kMaxProcess) {
+		return;
+	}
+	std::vector<uint32_t>::iterator it = std::lower_bound(mChannelSlot.begin(), mChannelSlot.end(), slot);
+	if (it == mChannelSlot.end() || *it != slot) {
+		mChannelSlot.insert(it, slot);
+	}
+	mChannelTask[slot] = task;
+}
+
+void wServer::RemoveChannelSlot(uint32_t slot) {
+	if (slot >= kMaxProcess) {
+		return;
+	}
+	std::vector<uint32_t>::iterator it = std::lower_bound(mChannelSlot.begin(), mChannelSlot.end(), slot);
+	if (it != mChannelSlot.end() && *it == slot) {
+		mChannelSlot.erase(it);
+	}
+	mChannelTask[slot] = NULL;
+}
 
 int wServer::AddListener(const std::string& ipaddr, uint16_t port, const std::string& protocol) {
     wSocket *socket = NULL;
@@ -646,17 +819,25 @@ int wServer::AddListener(const std::string& ipaddr, uint16_t port, const std::st
 		return -1;
     }
 
-    int ret = socket->Open();
-	if (ret == -1) {
-	    HNET_DELETE(socket);
-	    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AddListener Open() failed", "");
-	    return ret;
-	}
+    // 热升级新master直接沿用旧master的listen socket，期间不拒绝任何连接
+    int ret = InheritListener(socket, ipaddr, port);
+    if (ret == 1) {
+	    ret = socket->Open();
+		if (ret == -1) {
+		    HNET_DELETE(socket);
+		    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AddListener Open() failed", "");
+		    return ret;
+		}
 
-	ret = socket->Listen(ipaddr, port);
-	if (ret == -1) {
+		ret = socket->Listen(ipaddr, port);
+		if (ret == -1) {
+		    HNET_DELETE(socket);
+		    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AddListener Listen() failed", "");
+		    return ret;
+		}
+	} else if (ret == -1) {
 	    HNET_DELETE(socket);
-	    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AddListener Listen() failed", "");
+	    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AddListener InheritListener() failed", "");
 	    return ret;
 	}
 
@@ -669,6 +850,355 @@ int wServer::AddListener(const std::string& ipaddr, uint16_t port, const std::st
     return 0;
 }
 
+int wServer::InheritListener(wSocket* socket, const std::string& ipaddr, uint16_t port) {
+	const char* env = mConfig->Getenv(kListenFdsEnv);
+	if (env == NULL) {
+		return 1;
+	}
+
+	int want = socket->SP() == kSpUdp? SOCK_DGRAM: SOCK_STREAM;
+	std::vector<std::string> fds = misc::SplitString(env, ";");
+	for (std::vector<std::string>::iterator it = fds.begin(); it != fds.end(); it++) {
+		uint64_t fd = 0;
+		if (!logging::DecimalStringToNumber(*it, &fd)) {
+			continue;
+		}
+
+		int type = 0;
+		socklen_t typelen = sizeof(type);
+		if (getsockopt(fd, SOL_SOCKET, SO_TYPE, &type, &typelen) == -1 || type != want) {
+			continue;
+		}
+
+		struct sockaddr_storage addr;
+		socklen_t addrlen = sizeof(addr);
+		memset(&addr, 0, sizeof(addr));
+		if (getsockname(fd, reinterpret_cast<struct sockaddr*>(&addr), &addrlen) == -1) {
+			continue;
+		}
+
+		bool match = false;
+		if (addr.ss_family == AF_INET && socket->SP() != kSpUnix) {
+			struct sockaddr_in* in = reinterpret_cast<struct sockaddr_in*>(&addr);
+			match = ntohs(in->sin_port) == port && in->sin_addr.s_addr == misc::Text2IP(ipaddr.c_str());
+		} else if (addr.ss_family == AF_UNIX && socket->SP() == kSpUnix) {
+			struct sockaddr_un* un = reinterpret_cast<struct sockaddr_un*>(&addr);
+			match = ipaddr == un->sun_path;
+		}
+		if (!match) {
+			continue;
+		}
+
+		socket->FD() = static_cast<int64_t>(fd);
+		socket->Host() = ipaddr;
+		socket->Port() = port;
+		if (socket->SetNonblock() == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::InheritListener SetNonblock() failed", "");
+			return -1;
+		}
+		return 0;
+	}
+	return 1;
+}
+
+bool wServer::Drained() {
+	uint64_t now = soft::TimeUsec();
+	if (mQuitTm == 0) {
+		mQuitTm = now;
+
+		// listen socket仅在持有惊群锁（或未启用）时处于epoll中
+		if (mUseAcceptTurn == false || mAcceptHeld == true) {
+			RemoveListener(false);
+		}
+		if (mAcceptHeld == true) {
+			if (kAcceptStuff == 0) {
+				mAcceptAtomic->CompareExchangeWeak(mMaster->mWorker->mPid, -1);
+			} else if (kAcceptStuff == 1) {
+				mEnv->UnlockFile(mAcceptFL);
+			}
+			mAcceptHeld = false;
+		}
+		mUseAcceptTurn = false;
+
+		// 通知各连接（HTTP/2 GOAWAY、WebSocket关闭帧等）
+		for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
+			wSocket* socket = (*it)->Socket();
+			if (socket->ST() == kStConnect && socket->SP() != kSpChannel && socket->SP() != kSpUdp) {
+				(*it)->Draining() = true;
+				if ((*it)->Drain() == -1) {
+					(*it)->DisConnect();
+					RemoveTask(*it, &it);
+					continue;
+				}
+			}
+			it++;
+		}
+	}
+
+	// 优先关闭空闲连接，进行中的请求处理完毕（发送缓冲清空）后由 Idle 判定关闭
+	if (now - mDrainTm >= static_cast<uint64_t>(kDrainTurn)*1000) {
+		mDrainTm = now;
+		for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
+			wSocket* socket = (*it)->Socket();
+			if (socket->ST() == kStConnect && socket->SP() != kSpChannel && socket->SP() != kSpUdp && (*it)->Idle(now)) {
+				(*it)->DisConnect();
+				RemoveTask(*it, &it);
+				continue;
+			}
+			it++;
+		}
+
+		int32_t conn = static_cast<int32_t>(ConnectNum());
+		if (conn != mDrainConn) {
+			mDrainConn = conn;
+			ReportDrain(conn);
+		}
+	}
+
+	// 待发往其他worker的channel消息
+	bool pending = false;
+	for (std::vector<uint32_t>::iterator it = mChannelSlot.begin(); it != mChannelSlot.end(); it++) {
+		if (mChannelTask[*it] != NULL && mChannelTask[*it]->SendPending()) {
+			pending = true;
+			break;
+		}
+	}
+	if (mDrainConn == 0 && !pending) {
+		return true;
+	} else if (now - mQuitTm < static_cast<uint64_t>(mQuitTimeout)*1000) {
+		return false;
+	}
+
+	// 期限已到：尽力写出发送缓冲后退出
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end(); it++) {
+		if ((*it)->Socket()->ST() == kStConnect && (*it)->SendPending()) {
+			ssize_t size;
+			(*it)->TaskSend(&size);
+		}
+	}
+	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Drained () timeout", (logging::NumberToString(ConnectNum()) + " connections left").c_str());
+	return true;
+}
+
+int wServer::ReportDrain(int32_t conn) {
+	if (mMaster == NULL || mMaster->mWorker == NULL || mMaster->mReport[0] == kFDUnknown) {
+		return -1;
+	}
+
+	wChannelReqDrain_t drain;
+	drain.set_pid(mMaster->mWorker->mPid);
+	drain.set_slot(mMaster->mSlot);
+	drain.set_conn(conn);
+	if (send(mMaster->mReport[0], reinterpret_cast<char*>(&drain), sizeof(drain), MSG_DONTWAIT) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::ReportDrain send() failed", error::Strerror(errno).c_str());
+		return -1;
+	}
+	return 0;
+}
+
+uint32_t wServer::ConnectNum() {
+	uint32_t num = 0;
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end(); it++) {
+		wSocket* socket = (*it)->Socket();
+		if (socket->ST() == kStConnect && socket->SP() != kSpChannel && socket->SP() != kSpUdp) {
+			num++;
+		}
+	}
+	return num;
+}
+
+void wServer::UpdateLoad() {
+	WorkerLoad_t* load = mMaster != NULL && mMaster->mWorker != NULL ? mMaster->Load(mMaster->mSlot) : NULL;
+	if (load == NULL) {
+		return;
+	}
+
+	uint32_t conn = 0, backlog = 0;
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end(); it++) {
+		wSocket* socket = (*it)->Socket();
+		if (socket->ST() == kStConnect && socket->SP() != kSpChannel && socket->SP() != kSpUdp) {
+			conn++;
+			if ((*it)->SendPending()) {
+				backlog++;
+			}
+		}
+	}
+	mLoadScore = conn + backlog*kAcceptBacklogWeight + static_cast<uint32_t>(mLoopLag/1000);
+	mLoopLag = 0;
+
+	load->mConn.Store(conn);
+	load->mScore.Store(mLoadScore);
+	load->mPid.Store(mMaster->mWorker->mPid);
+	load->mTm.Store(soft::TimeUsec());
+
+	if (mUseAcceptTurn == false) {
+		return;
+	}
+
+	// 存活worker（负载表项有效）平均评分
+	uint64_t now = soft::TimeUsec(), total = 0, num = 0;
+	for (uint32_t i = 0; i < kMaxProcess; i++) {
+		WorkerLoad_t* peer = mMaster->Load(i);
+		if (i != mMaster->mSlot && !LiveWorker(i, NULL)) {
+			continue;
+		} else if (peer->mPid.Load() == -1 || peer->mTm.Load() + static_cast<uint64_t>(kLoadExpire)*1000 < now) {
+			continue;
+		}
+		total += peer->mScore.Load();
+		num++;
+	}
+	if (num > 1 && mLoadScore*num > total + mAcceptSlack*num) {
+		mAcceptDisabled = static_cast<int64_t>(mLoadScore - total/num - mAcceptSlack);
+	} else {
+		mAcceptDisabled = 0;
+	}
+}
+
+void wServer::MigrateTask(uint32_t slot, uint32_t num) {
+	mMigrateSlot = slot;
+	mMigrateNum = num;
+}
+
+int wServer::HandleMigrate() {
+	uint32_t slot = mMigrateSlot, num = mMigrateNum;
+	mMigrateSlot = kMaxProcess;
+	mMigrateNum = 0;
+	if (mExiting || slot == mMaster->mSlot || !LiveWorker(slot, NULL)) {
+		return 0;
+	}
+	wTask* channel = mChannelTask[slot];
+	if (channel == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[slot=%d]", "wServer::HandleMigrate () failed", "channel task not found", slot);
+		return -1;
+	}
+
+	uint32_t n = 0;
+	std::string frame;
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end() && n < num;) {
+		wTask* task = *it;
+		wSocket* socket = task->Socket();
+		if (socket->ST() != kStConnect || socket->SS() != kSsConnected || (socket->SP() != kSpTcp && socket->SP() != kSpHttp && socket->SP() != kSpUnix)) {
+			it++;
+			continue;
+		} else if (channel->SendPending()) {
+			break;
+		}
+
+		// 帧头 + 迁移消息 + 收发缓冲未处理数据 + 业务状态
+		wChannelReqMigrate_t migrate;
+		size_t headlen = sizeof(uint32_t) + sizeof(uint8_t);
+		frame.assign(headlen + sizeof(migrate), 0);
+		uint32_t recvlen = 0, sendlen = 0, statelen = 0;
+		if (task->MigrateOut(&frame, &recvlen, &sendlen, &statelen) == -1 || frame.size() > kMigrateMaxLen || frame.size() > mMaster->Worker(slot)->Channel()->FrameMax()) {
+			it++;
+			continue;
+		}
+		migrate.set_pid(mMaster->mWorker->mPid);
+		migrate.set_slot(mMaster->mSlot);
+		migrate.set_fd(socket->FD());
+		migrate.set_proto(static_cast<uint8_t>(socket->SP()));
+		migrate.set_recv_len(recvlen);
+		migrate.set_send_len(sendlen);
+		migrate.set_state_len(statelen);
+		coding::EncodeFixed32(&frame[0], static_cast<uint32_t>(frame.size() - sizeof(uint32_t)));
+		coding::EncodeFixed8(&frame[sizeof(uint32_t)], static_cast<uint8_t>(kMpCommand));
+		memcpy(&frame[headlen], &migrate, sizeof(migrate));
+
+		// 整帧（含描述符）一条记录写入，发送缓冲不足时停止本轮迁移（连接保留在本进程）
+		ssize_t size = 0;
+		if (channel->Socket()->SendBytes(&frame[0], frame.size(), &size) == -1 || size <= 0) {
+			break;
+		}
+
+		// 连接已由目标worker接管，本进程仅关闭描述符（保留unix socket对端文件）
+		if (socket->SP() == kSpUnix) {
+			socket->Host().clear();
+		}
+		RemoveTask(task, &it);
+		n++;
+	}
+
+	if (n > 0) {
+		UpdateLoad();
+		std::string str = "wServer::HandleMigrate, migrate to slot(" + logging::NumberToString(slot) + ")";
+		HNET_DEBUG(soft::GetLogPath(), "%s : %s", str.c_str(), (logging::NumberToString(n) + " connections").c_str());
+	}
+	return static_cast<int>(n);
+}
+
+int wServer::AdoptTask(int fd, uint8_t proto, const char recv[], size_t recvlen, const char send[], size_t sendlen, const char state[], size_t statelen) {
+	struct sockaddr_storage sockAddr;
+	socklen_t sockAddrSize = sizeof(sockAddr);
+	memset(&sockAddr, 0, sizeof(sockAddr));
+	if (getpeername(fd, reinterpret_cast<struct sockaddr*>(&sockAddr), &sockAddrSize) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask getpeername() failed", error::Strerror(errno).c_str());
+		close(fd);
+		return -1;
+	}
+
+	wSocket* socket = NULL;
+	if ((proto == kSpTcp || proto == kSpHttp) && sockAddr.ss_family == AF_INET) {
+		struct sockaddr_in* addr = reinterpret_cast<struct sockaddr_in*>(&sockAddr);
+		HNET_NEW(wTcpSocket(kStConnect, static_cast<SockProto>(proto)), socket);
+		if (socket) {
+			socket->Host() = inet_ntoa(addr->sin_addr);
+			socket->Port() = addr->sin_port;
+		}
+	} else if (proto == kSpUnix && sockAddr.ss_family == AF_UNIX) {
+		struct sockaddr_un* addr = reinterpret_cast<struct sockaddr_un*>(&sockAddr);
+		HNET_NEW(wUnixSocket(kStConnect), socket);
+		if (socket) {
+			socket->Host() = addr->sun_path;
+			socket->Port() = 0;
+		}
+	} else {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask () failed", "protocol mismatch");
+		close(fd);
+		return -1;
+	}
+	if (socket == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask new() failed", error::Strerror(errno).c_str());
+		close(fd);
+		return -1;
+	}
+	socket->FD() = fd;
+	socket->SS() = kSsConnected;
+	socket->RecvTm() = socket->SendTm() = soft::TimeUsec();
+
+	wTask* task = NULL;
+	int ret = -1;
+	if (proto == kSpTcp) {
+		ret = NewTcpTask(socket, &task);
+	} else if (proto == kSpHttp) {
+		ret = NewHttpTask(socket, &task);
+	} else {
+		ret = NewUnixTask(socket, &task);
+	}
+	if (ret == -1) {
+		HNET_DELETE(socket);
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask NewTask() failed", "");
+		return -1;
+	}
+
+	if (AddTask(task) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask AddTask() failed", "");
+		RemoveTask(task);
+		return -1;
+	}
+
+	// 本worker已开始优雅退出（迁移指令发出后）时，随即通知该连接
+	if (mExiting) {
+		task->Draining() = true;
+	}
+	if (task->MigrateIn(recv, recvlen, send, sendlen, state, statelen) == -1 || (mExiting && task->Drain() == -1)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::AdoptTask MigrateIn() failed", "");
+		task->DisConnect();
+		RemoveTask(task);
+		return -1;
+	}
+	return 0;
+}
+
 int wServer::InitEpoll() {
     int ret = epoll_create(kListenBacklog);
     if (ret == -1) {
@@ -750,6 +1280,10 @@ int wServer::RemoveListener(bool delpool) {
 }
 
 int wServer::Channel2Epoll(bool addpool) {
+	// 重建channel slot表（fork时继承自master）
+	mChannelSlot.clear();
+	memset(mChannelTask, 0, sizeof(mChannelTask));
+
 	for (uint32_t i = 0; i < kMaxProcess; i++) {
 		if (mMaster != NULL && mMaster->Worker(i)->mPid == -1) {
 			continue;
@@ -772,7 +1306,34 @@ int wServer::Channel2Epoll(bool addpool) {
 
 			if (AddTask(ctask) == -1) {
 				RemoveTask(ctask);
+				ctask = NULL;
 			}
+			AddChannelSlot(i, ctask);
+		}
+	}
+
+	// 共享内存通道：本worker eventfd可读时自各环取出其他worker发来的消息，由channel task解析
+	wChannelRing* ring = mMaster->Ring();
+	if (ring != NULL && mMaster->mSlot < ring->Slots()) {
+		ring->Attach(mMaster->mSlot);
+
+		wChannelSocket *socket;
+		HNET_NEW(wChannelSocket(kStConnect), socket);
+		if (socket == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Channel2Epoll new() failed", error::Strerror(errno).c_str());
+			return -1;
+		}
+		socket->SetRing(ring, ring->EventFD(mMaster->mSlot));
+		socket->SS() = kSsConnected;
+
+		wTask *ctask;
+		if (NewChannelTask(socket, &ctask) == -1) {
+			HNET_DELETE(socket);
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wServer::Channel2Epoll NewChannelTask() failed", "");
+			return -1;
+		}
+		if (AddTask(ctask) == -1) {
+			RemoveTask(ctask);
 		}
 	}
     return 0;
@@ -835,6 +1396,13 @@ int wServer::AddToTaskPool(wTask* task) {
 std::vector<wTask*>::iterator wServer::RemoveTaskPool(wTask* task) {
     std::vector<wTask*>::iterator it = std::find(mTaskPool.begin(), mTaskPool.end(), task);
     if (it != mTaskPool.end()) {
+    	if (task->Socket()->SP() == kSpChannel) {
+    		for (std::vector<uint32_t>::iterator is = mChannelSlot.begin(); is != mChannelSlot.end(); is++) {
+    			if (mChannelTask[*is] == task) {
+    				mChannelTask[*is] = NULL;
+    			}
+    		}
+    	}
     	HNET_DELETE(task);
         it = mTaskPool.erase(it);
     }
@@ -849,10 +1417,14 @@ int wServer::CleanTaskPool(std::vector<wTask*> pool) {
     return 0;
 }
 
-int wServer::CleanListenSock() {
+int wServer::CleanListenSock(bool unlink) {
 	for (std::vector<wSocket*>::iterator it = mListenSock.begin(); it != mListenSock.end(); it++) {
+		if (!unlink && (*it)->SP() == kSpUnix) {
+			(*it)->Host().clear();	// ~wUnixSocket不再删除sock文件
+		}
 		HNET_DELETE(*it);
 	}
+	mListenSock.clear();
 	return 0;
 }
 
@@ -865,6 +1437,10 @@ int wServer::DeleteAcceptFile() {
 }
 
 void wServer::CheckTick() {
+	if (mMigrateNum > 0) {
+		HandleMigrate();
+	}
+
 	mTick = soft::TimeUsec() - mLatestTm;
 	if (mTick < 10*1000) {
 		return;
@@ -874,11 +1450,29 @@ void wServer::CheckTick() {
 	if (mHeartbeatTurn && mHeartbeatTimer.CheckTimer(mTick/1000)) {
 		CheckHeartBeat();
 	}
+	if (mIdleTimer.CheckTimer(mTick/1000)) {
+		CheckIdle();
+	}
+	if (mLoadTimer.CheckTimer(mTick/1000)) {
+		UpdateLoad();
+	}
+}
+
+void wServer::CheckIdle() {
+	uint64_t now = soft::TimeUsec();
+	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
+		if ((*it)->Socket()->ST() == kStConnect && (*it)->IdleOut(now)) {
+			(*it)->DisConnect();
+			RemoveTask(*it, &it);
+			continue;
+		}
+		it++;
+	}
 }
 
 void wServer::CheckHeartBeat() {
 	for (std::vector<wTask*>::iterator it = mTaskPool.begin(); it != mTaskPool.end();) {
-		if ((*it)->Socket()->ST() == kStConnect && ((*it)->Socket()->SP() == kSpTcp || (*it)->Socket()->SP() == kSpUnix)) {
+		if ((*it)->Socket()->ST() == kStConnect && (*it)->HeartbeatTurn()) {
 			if ((*it)->Socket()->SS() == kSsUnconnect) {	// 断线连接
 				(*it)->DisConnect();
 				RemoveTask(*it, &it);
@@ -34,6 +34,40 @@ class wWorker;
 class wFileLock;
 class wShm;
 
+// worker间channel socket投递：每目标slot一个有界发送队列（目标channel task发送队列，EPOLLOUT时续发）
+// 队列满时溢出策略（配置项 channel_policy："block"、"drop"、"fail"）
+enum ChannelPolicy {
+    kChannelBlock = 0,	// 阻塞等待队列可用，至多 channel_wait 毫秒，超时丢弃当前消息
+    kChannelDrop,		// 丢弃队列中最早一条消息
+    kChannelFail		// 当前消息发送失败
+};
+
+// 每目标slot发送队列最大消息数（配置项 channel_queue）
+const uint32_t	kChannelQueue = 256;
+
+// 阻塞等待最长时间（毫秒，配置项 channel_wait）
+const uint32_t	kChannelWait = 100;
+
+// worker向共享内存负载表更新自身负载间隔（毫秒）
+const uint32_t	kLoadTurn = 100;
+
+// 负载感知accept：负载评分 = 连接数 + 待发送连接数*kAcceptBacklogWeight + 事件循环最大延迟（毫秒）
+// 评分超出存活worker平均评分 kAcceptSlack（配置项 accept_slack）以上时，按超出值跳过相应轮次惊群锁争抢
+const uint32_t	kAcceptBacklogWeight = 4;
+const uint32_t	kAcceptSlack = 8;
+
+// 可迁移连接的收发缓冲未处理数据及业务状态总长上限（迁移消息经channel socket整帧发送）
+const uint32_t	kMigrateMaxLen = 65536;
+
+// channel消息投递统计（本进程）
+struct ChannelStat_t {
+    uint64_t mQueued;	// socket暂不可写而写入发送队列的消息数
+    uint64_t mDropped;	// 溢出丢弃、发送失败的消息数
+    uint64_t mRetried;	// EAGAIN后续发（EPOLLOUT、阻塞等待）次数
+
+    ChannelStat_t() : mQueued(0), mDropped(0), mRetried(0) { }
+};
+
 // 服务基础类
 class wServer : private wNoncopyable {
 public:
@@ -102,6 +136,16 @@ public:
 
     // 连接检测（心跳）
     virtual void CheckHeartBeat();
+
+    // 空闲连接检测（wTask::IdleOut）
+    virtual void CheckIdle();
+
+    // 连接迁移：向slot迁出至多num个连接（描述符、收发缓冲未处理数据及业务状态经channel socket发送）
+    // 于本轮事件处理结束后（CheckTick）执行，避免释放本轮尚待处理事件的task
+    void MigrateTask(uint32_t slot, uint32_t num);
+
+    // 接管其他worker迁入的连接fd（出错时关闭fd）
+    int AdoptTask(int fd, uint8_t proto, const char recv[], size_t recvlen, const char send[], size_t sendlen, const char state[], size_t statelen);
     
     // single|worker进程退出函数
     virtual void ProcessExit() { }
@@ -120,6 +164,31 @@ public:
     int AddTask(wTask* task, int ev = EPOLLIN, int op = EPOLL_CTL_ADD, bool addpool = true);
     int RemoveTask(wTask* task, std::vector<wTask*>::iterator* iter = NULL, bool delpool = true);
     int FindTaskBySocket(wTask** task, const wSocket* sock);
+
+    // channel slot表：存活worker slot（有序）及各slot写入channel task，AsyncWorker|SyncWorker仅遍历存活slot
+    // master进程于fork、回收worker时维护（无task），worker进程于Channel2Epoll、ChannelOpen、ChannelClose时维护
+    void AddChannelSlot(uint32_t slot, wTask* task = NULL);
+    void RemoveChannelSlot(uint32_t slot);
+    inline wTask* ChannelTask(uint32_t slot) { return slot < kMaxProcess ? mChannelTask[slot] : NULL;}
+
+    // channel socket发送队列：每目标slot至多queue条消息，溢出按policy处理，阻塞等待至多wait毫秒
+    // master进程无事件循环，总是阻塞写入
+    void SetChannelQueue(int policy, uint32_t queue = kChannelQueue, uint32_t wait = kChannelWait);
+    inline const ChannelStat_t& ChannelStat() { return mChannelStat;}
+
+    // 本worker最近一次计算的负载评分、当前剩余跳过争抢惊群锁轮次
+    inline uint32_t LoadScore() { return mLoadScore;}
+    inline int64_t AcceptDisabled() { return mAcceptDisabled;}
+
+    // channel socket共享帧：一次编码，各目标发送队列以引用计数共享
+    struct ChannelFrame_t {
+        int32_t mRef;
+        std::string mData;
+        ChannelFrame_t() : mRef(1) { }
+    };
+
+    // wTask::SendData2Buf 释放回调
+    static void ReleaseFrame(void* arg);
     
 protected:
     friend class wMaster;
@@ -133,6 +202,47 @@ protected:
     int InitEpoll();
     int AddListener(const std::string& ipaddr, uint16_t port, const std::string& protocol = "TCP");
 
+    // 热升级：自环境变量kListenFdsEnv中继承与ipaddr、port及协议匹配的listen socket（由旧master传递）
+    // 返回 0 已继承，1 无匹配描述符
+    int InheritListener(wSocket* socket, const std::string& ipaddr, uint16_t port);
+
+    // 优雅退出：首次调用时停止accept、释放惊群锁，并通知各连接（wTask::Drain）
+    // 此后每 kDrainTurn 毫秒关闭空闲连接（wTask::Idle）、向master汇报剩余连接数
+    // 连接全部关闭且channel发送队列清空，或超出 quit_timeout 毫秒返回true
+    bool Drained();
+
+    // 经master channel汇报剩余连接数
+    int ReportDrain(int32_t conn);
+
+    // 已建立连接数（不含listen、channel、udp socket）
+    uint32_t ConnectNum();
+
+    // 更新共享内存负载表中本worker负载评分（master据此迁移连接），并据存活worker平均评分计算 mAcceptDisabled
+    void UpdateLoad();
+
+    // 执行 MigrateTask 请求，返回迁出连接数
+    // 目标channel发送队列非空（描述符须随迁移消息首个字节送达）时停止本轮迁移
+    int HandleMigrate();
+
+    // 投递一帧（head、body两段）至solt（kMaxProcess为全部存活slot）：优先共享内存通道，否则经channel socket发送队列
+    int DeliverWorker(uint32_t solt, const std::vector<uint32_t>* blackslot, const char head[], size_t headlen, const char body[], size_t bodylen, bool sync);
+
+    // 经共享内存通道发送一帧（head、body两段）至worker。通道不可用返回1（由调用者经channel socket发送）
+    // sync为true且策略为阻塞时环满有限等待，否则环满即返回-1
+    int RingWorker(uint32_t solt, const char head[], size_t headlen, const char body[], size_t bodylen, bool sync);
+
+    // 经channel socket发送一帧：队列为空时立即整帧写入，发送缓冲不足（EAGAIN）时整帧入队，队列满时按溢出策略处理
+    int QueueWorker(uint32_t solt, ChannelFrame_t* frame);
+
+    // 阻塞写入一帧（master进程、无channel task时），至多等待mChannelWait毫秒
+    int FlushWorker(uint32_t solt, const char buf[], size_t len);
+
+    // 等待channel socket可写，至多timeout毫秒
+    int WaitWorker(uint32_t solt, int64_t timeout);
+
+    // solt为存活worker且不在黑名单
+    bool LiveWorker(uint32_t solt, const std::vector<uint32_t>* blackslot);
+
     // 添加本进程channel socket到epoll侦听读事件队列
     int Channel2Epoll(bool addpool = true);
 
@@ -141,7 +251,8 @@ protected:
     int RemoveListener(bool delpool = true);
 
     int CleanTask();
-    int CleanListenSock();
+    // unlink为false时保留unix socket文件（worker进程，或listen socket已移交新master）
+    int CleanListenSock(bool unlink = true);
     int DeleteAcceptFile();
 
     int AddToTaskPool(wTask *task);
@@ -149,6 +260,14 @@ protected:
     int CleanTaskPool(std::vector<wTask*> pool);
 
     bool mExiting;
+    uint64_t mQuitTm;	// 开始优雅退出时间 微妙
+    uint64_t mDrainTm;	// 最近一次检查空闲连接时间 微妙
+    int32_t mDrainConn;	// 最近一次汇报的剩余连接数
+    uint32_t mQuitTimeout;	// 优雅退出期限 毫秒
+
+    // 待执行的连接迁移请求（目标slot、连接数）
+    uint32_t mMigrateSlot;
+    uint32_t mMigrateNum;
 
     // 服务器当前时间 微妙
     uint64_t mLatestTm;
@@ -158,6 +277,10 @@ protected:
     bool mHeartbeatTurn;
     // 心跳定时器
     wTimer mHeartbeatTimer;
+    // 空闲连接定时器
+    wTimer mIdleTimer;
+    // 负载更新定时器
+    wTimer mLoadTimer;
 
     // 多listen socket监听服务描述符
     std::vector<wSocket*> mListenSock;
@@ -167,6 +290,16 @@ protected:
 
     // task|pool
     std::vector<wTask*> mTaskPool;
+
+    // channel slot表
+    std::vector<uint32_t> mChannelSlot;
+    wTask* mChannelTask[kMaxProcess];
+
+    // channel socket发送队列
+    int mChannelPolicy;
+    uint32_t mChannelQueue;
+    uint32_t mChannelWait;
+    ChannelStat_t mChannelStat;
     
     // 惊群锁
     wShm *mShm;
@@ -175,7 +308,13 @@ protected:
 
     bool mUseAcceptTurn;
     bool mAcceptHeld;
-    int64_t mAcceptDisabled;
+    int64_t mAcceptDisabled;	// 大于0时跳过该轮次数惊群锁争抢
+    uint32_t mAcceptSlack;
+
+    // 负载评分
+    uint32_t mLoadScore;
+    uint64_t mLoopTm;	// 最近一次epoll_wait返回时间 微妙
+    uint64_t mLoopLag;	// 本周期事件循环最大处理时长 微妙
 
     wMaster* mMaster;	// 引用进程表
     wConfig* mConfig;
@@ -4,10 +4,19 @@
  * Copyright (C) Hupu, Inc.
  */
  
+#include <sys/mman.h>
+#include <sys/syscall.h>
 #include "wShm.h"
 #include "wMisc.h"
 #include "wLogger.h"
 
+#ifndef MFD_CLOEXEC
+#	define MFD_CLOEXEC	0x0001U
+#endif
+#ifndef MFD_HUGETLB
+#	define MFD_HUGETLB	0x0004U
+#endif
+
 namespace hnet {
 
 wPosixShm::wPosixShm(const std::string& filename, size_t size) : mShmId(-1), mShmhead(NULL), mFilename(filename) {
@@ -128,6 +137,120 @@ void wPosixShm::Remove() {
     if (mShmhead && shmdt(reinterpret_cast<void*>(mShmhead->mStart)) == -1) {
     	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wPosixShm::Destroy shmdt() failed", error::Strerror(errno).c_str());
     }
+    // 映射已解除，避免析构时再次访问
+    mShmhead = NULL;
+}
+
+wMemfdShm::wMemfdShm(const std::string& filename, size_t size, int8_t hugepage, bool prefault) : mMapLen(0), mHugePage(hugepage), mPrefault(prefault),
+mShmhead(NULL), mFilename(filename) {
+	mSize = misc::Align(size + sizeof(struct Shmhead_t), kPageSize);
+}
+
+wMemfdShm::~wMemfdShm() {
+	Remove();
+}
+
+int wMemfdShm::OpenFD(const std::string& name, bool huge) {
+	int fd = -1;
+#ifdef SYS_memfd_create
+	fd = static_cast<int>(syscall(SYS_memfd_create, name.c_str(), MFD_CLOEXEC | (huge ? MFD_HUGETLB : 0)));
+	if (fd >= 0 || huge) {
+		return fd;
+	}
+#endif
+	if (huge) {
+		errno = ENOSYS;
+		return -1;
+	}
+
+	// 内核不支持memfd：/dev/shm下创建后即刻unlink
+	std::string path = "/dev/shm/" + name + "." + logging::NumberToString(getpid());
+	fd = open(path.c_str(), O_RDWR | O_CREAT | O_EXCL | O_CLOEXEC, 0600);
+	if (fd >= 0) {
+		unlink(path.c_str());
+	}
+	return fd;
+}
+
+void* wMemfdShm::Map(const std::string& name, size_t len, bool huge) {
+	int fd = OpenFD(name, huge);
+	if (fd == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::Map memfd_create() failed", error::Strerror(errno).c_str());
+		return NULL;
+	} else if (ftruncate(fd, static_cast<off_t>(len)) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::Map ftruncate() failed", error::Strerror(errno).c_str());
+		close(fd);
+		return NULL;
+	}
+
+	// hugetlb大页总是预先分配：大页不足时于此失败，而非访问时SIGBUS
+	int flags = MAP_SHARED;
+	if (mPrefault || huge) {
+		flags |= MAP_POPULATE;
+	}
+	void* addr = mmap(NULL, len, PROT_READ | PROT_WRITE, flags, fd, 0);
+	close(fd);
+	if (addr == MAP_FAILED) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::Map mmap() failed", error::Strerror(errno).c_str());
+		return NULL;
+	}
+	return addr;
+}
+
+int wMemfdShm::CreateShm(int pipeid) {
+	std::string name = mFilename.substr(mFilename.find_last_of('/') + 1) + "." + static_cast<char>(pipeid);
+
+	void* addr = NULL;
+	if (mHugePage == kShmHugeExplicit) {
+		mMapLen = (mSize + kHugePageSize - 1) & ~(kHugePageSize - 1);
+		addr = Map(name, mMapLen, true);
+		if (addr == NULL) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::CreateShm () failed", "hugetlb unavailable, fallback to normal pages");
+		}
+	}
+	if (addr == NULL) {
+		mMapLen = mSize;
+		addr = Map(name, mMapLen, false);
+		if (addr == NULL) {
+			return -1;
+		}
+		if (mHugePage == kShmHugeTransparent && madvise(addr, mMapLen, MADV_HUGEPAGE) == -1) {
+			HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::CreateShm madvise() failed", error::Strerror(errno).c_str());
+		}
+	}
+
+    // 存储头信息
+	mShmhead = reinterpret_cast<struct Shmhead_t*>(addr);
+	mShmhead->mStart = reinterpret_cast<uintptr_t>(addr);
+	mShmhead->mUsedOff = mShmhead->mStart + static_cast<uintptr_t>(sizeof(struct Shmhead_t));
+	mShmhead->mEnd = mShmhead->mStart + static_cast<uintptr_t>(mMapLen);
+	return 0;
+}
+
+int wMemfdShm::AttachShm(int pipeid) {
+	if (mShmhead == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::AttachShm () failed", "not created or inherited");
+		return -1;
+	}
+	return 0;
+}
+
+void* wMemfdShm::AllocShm(size_t size) {
+	if (mShmhead->mUsedOff + static_cast<uintptr_t>(size) < mShmhead->mEnd) {
+		void* ptr = reinterpret_cast<void*>(mShmhead->mUsedOff);
+		mShmhead->mUsedOff += static_cast<uintptr_t>(size);
+		return ptr;
+	}
+	HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::AllocShm failed, shm space not enough", "");
+	return NULL;
+}
+
+void wMemfdShm::Remove() {
+	// 解除当前进程映射
+	if (mShmhead && munmap(reinterpret_cast<void*>(mShmhead), mMapLen) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wMemfdShm::Remove munmap() failed", error::Strerror(errno).c_str());
+	}
+	mShmhead = NULL;
 }
 
 }	// namespace hnet
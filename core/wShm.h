@@ -69,6 +69,36 @@ protected:
 	std::string mFilename;
 };
 
+// 共享内存实现类：memfd_create（或/dev/shm下即刻unlink的文件）+ mmap
+// 映射后即关闭描述符，无名、不残留：全部进程（含fork的子进程）解除映射或退出后由系统回收，Destroy 无需调用
+// 仅可由创建进程及其fork的子进程使用（AttachShm 仅确认已继承映射）
+class wMemfdShm : public wShm {
+public:
+	wMemfdShm(const std::string& filename, size_t size = kMsgQueueLen, int8_t hugepage = kShmHugeOff, bool prefault = false);
+	virtual ~wMemfdShm();
+
+	virtual int CreateShm(int pipeid = 'i');
+	virtual int AttachShm(int pipeid = 'i');
+	virtual void* AllocShm(size_t size = 0);
+	virtual void Remove();
+	virtual void Destroy() { }
+	virtual struct Shmhead_t* ShmHead() { return mShmhead;}
+
+protected:
+	// 创建共享内存描述符，huge为true时使用hugetlb大页
+	int OpenFD(const std::string& name, bool huge);
+
+	// 创建并映射len字节，失败返回NULL
+	void* Map(const std::string& name, size_t len, bool huge);
+
+	size_t mSize;
+	size_t mMapLen;
+	int8_t mHugePage;
+	bool mPrefault;
+	struct Shmhead_t* mShmhead;
+	std::string mFilename;
+};
+
 }	// namespace hnet
 
 #endif
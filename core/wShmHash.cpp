@@ -0,0 +1,262 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <sched.h>
+#include "wShmHash.h"
+#include "wEnv.h"
+#include "wShm.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+wShmHash::wShmHash(wEnv* env, uint32_t entries, uint32_t vallen) : mEnv(env), mShm(NULL), mBase(NULL), mMask(kShmHashProbe - 1), mValLen(vallen) {
+	while (mMask + 1 < entries && mMask < 0x7fffffff) {
+		mMask = (mMask << 1) | 1;
+	}
+	mSlotLen = (sizeof(SlotHead_t) + kShmHashKey + mValLen + kCacheLine - 1) & ~(kCacheLine - 1);
+}
+
+wShmHash::~wShmHash() {
+	if (mShm) {
+		mShm->Remove();
+		HNET_DELETE(mShm);
+	}
+}
+
+int wShmHash::Create() {
+	size_t size = static_cast<size_t>(mMask + 1) * mSlotLen;
+	if (mEnv->NewShm(soft::GetAcceptPath(), &mShm, size + kCacheLine) == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmHash::Create NewShm() failed", "");
+		return -1;
+	} else if (mShm->CreateShm('h') == -1) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmHash::Create CreateShm() failed", "");
+		return -1;
+	}
+
+	char* ptr = reinterpret_cast<char*>(mShm->AllocShm(size + kCacheLine));
+	if (ptr == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmHash::Create AllocShm() failed", "");
+		return -1;
+	}
+	mBase = reinterpret_cast<char*>((reinterpret_cast<uintptr_t>(ptr) + kCacheLine - 1) & ~(kCacheLine - 1));
+
+	// 即刻标记删除，全部进程退出后由系统回收
+	mShm->Destroy();
+
+	for (uint32_t i = 0; i <= mMask; i++) {
+		new (Slot(i)) SlotHead_t();
+	}
+	return 0;
+}
+
+uint32_t wShmHash::Tag(const wSlice& key) {
+	uint32_t tag = misc::Hash(key.data(), key.size(), 0x9747b28c);
+	return tag != 0 ? tag : 1;
+}
+
+int64_t wShmHash::Find(uint32_t tag, const wSlice& key, uint64_t now, uint32_t* seq, int64_t* spare, uint32_t* spareseq, bool* busy) {
+	*spare = -1;
+	*busy = false;
+	for (uint32_t i = 0; i < kShmHashProbe; i++) {
+		uint32_t pos = (tag + i) & mMask;
+		SlotHead_t* slot = Slot(pos);
+		uint32_t s = slot->mSeq.AcquireLoad();
+		if (s & 1) {
+			*busy = true;
+			continue;
+		}
+
+		// 槽内容可能正被改写，长度校验后再比较，最后以序号确认读取有效
+		uint32_t t = slot->mTag, keylen = slot->mKeyLen;
+		uint64_t expire = slot->mExpire;
+		bool match = t == tag && keylen == key.size() && keylen <= kShmHashKey && memcmp(Key(slot), key.data(), key.size()) == 0;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (slot->mSeq.NoBarrierLoad() != s) {
+			*busy = true;
+			continue;
+		}
+
+		if (match) {
+			*seq = s;
+			return pos;
+		} else if (*spare == -1 && (t == 0 || (expire != 0 && expire <= now))) {
+			*spare = pos;
+			*spareseq = s;
+		}
+	}
+	return -1;
+}
+
+int wShmHash::Put(const wSlice& key, const wSlice& val, uint32_t ttl) {
+	if (mBase == NULL || key.size() == 0 || key.size() > kShmHashKey || val.size() > mValLen) {
+		return -1;
+	}
+
+	uint32_t tag = Tag(key);
+	uint64_t now = soft::TimeUsec();
+	for (uint32_t retry = 0; retry < kShmHashRetry; retry++) {
+		uint32_t seq = 0, spareseq = 0;
+		int64_t spare;
+		bool busy;
+		int64_t pos = Find(tag, key, now, &seq, &spare, &spareseq, &busy);
+		if (pos == -1) {
+			// 正在写入的槽可能即为该键，稍后重试，避免同一键写入两个槽
+			if (busy && (spare == -1 || retry < kShmHashRetry/2)) {
+				sched_yield();
+				continue;
+			} else if (spare == -1) {
+				return -1;
+			}
+			pos = spare;
+			seq = spareseq;
+		}
+
+		// 抢占槽：其他写者已修改该槽时重新查找
+		SlotHead_t* slot = Slot(static_cast<uint32_t>(pos));
+		if (!slot->mSeq.CompareExchangeStrong(seq, seq + 1)) {
+			continue;
+		}
+		slot->mTag = tag;
+		slot->mExpire = ttl > 0 ? now + static_cast<uint64_t>(ttl)*1000 : 0;
+		slot->mKeyLen = static_cast<uint32_t>(key.size());
+		slot->mValLen = static_cast<uint32_t>(val.size());
+		memcpy(Key(slot), key.data(), key.size());
+		memcpy(Value(slot), val.data(), val.size());
+		slot->mSeq.ReleaseStore(seq + 2);
+
+		// 写入空槽时其他写者可能同时将该键写入另一空槽
+		if (pos == spare) {
+			Dedup(tag, key);
+		}
+		return 0;
+	}
+	return -1;
+}
+
+void wShmHash::Dedup(uint32_t tag, const wSlice& key) {
+	// 每个写者发布后复查，最后发布者必见全部副本：仅保留探测顺序最靠前的一个
+	bool keep = false;
+	for (uint32_t i = 0; i < kShmHashProbe; i++) {
+		SlotHead_t* slot = Slot(tag + i);
+		uint32_t s = slot->mSeq.AcquireLoad();
+		if ((s & 1) || slot->mTag != tag) {
+			continue;
+		}
+
+		uint32_t keylen = slot->mKeyLen;
+		bool match = keylen == key.size() && keylen <= kShmHashKey && memcmp(Key(slot), key.data(), key.size()) == 0;
+		std::atomic_thread_fence(std::memory_order_acquire);
+		if (!match || slot->mSeq.NoBarrierLoad() != s) {
+			continue;
+		} else if (!keep) {
+			keep = true;
+			continue;
+		}
+
+		if (slot->mSeq.CompareExchangeStrong(s, s + 1)) {
+			slot->mTag = 0;
+			slot->mKeyLen = 0;
+			slot->mValLen = 0;
+			slot->mExpire = 0;
+			slot->mSeq.ReleaseStore(s + 2);
+		}
+	}
+}
+
+int wShmHash::Del(const wSlice& key) {
+	if (mBase == NULL || key.size() == 0 || key.size() > kShmHashKey) {
+		return -1;
+	}
+
+	uint32_t tag = Tag(key);
+	uint64_t now = soft::TimeUsec();
+	for (uint32_t retry = 0; retry < kShmHashRetry; retry++) {
+		uint32_t seq = 0, spareseq = 0;
+		int64_t spare;
+		bool busy;
+		int64_t pos = Find(tag, key, now, &seq, &spare, &spareseq, &busy);
+		if (pos == -1) {
+			if (!busy) {
+				return -1;
+			}
+			sched_yield();
+			continue;
+		}
+
+		SlotHead_t* slot = Slot(static_cast<uint32_t>(pos));
+		if (!slot->mSeq.CompareExchangeStrong(seq, seq + 1)) {
+			continue;
+		}
+		slot->mTag = 0;
+		slot->mKeyLen = 0;
+		slot->mValLen = 0;
+		slot->mExpire = 0;
+		slot->mSeq.ReleaseStore(seq + 2);
+		return 0;
+	}
+	return -1;
+}
+
+int wShmHash::Get(const wSlice& key, std::string* val) {
+	val->resize(mValLen);
+	uint32_t len = 0;
+	if (Read(key, &(*val)[0], mValLen, &len) == -1) {
+		val->clear();
+		return -1;
+	}
+	val->resize(len);
+	return 0;
+}
+
+int wShmHash::Read(const wSlice& key, char buf[], size_t len, uint32_t* vallen) {
+	if (mBase == NULL || key.size() == 0 || key.size() > kShmHashKey) {
+		return -1;
+	}
+
+	uint32_t tag = Tag(key);
+	uint64_t now = soft::TimeUsec();
+	for (uint32_t retry = 0; retry < kShmHashRetry; retry++) {
+		bool busy = false;
+		for (uint32_t i = 0; i < kShmHashProbe; i++) {
+			SlotHead_t* slot = Slot(tag + i);
+			uint32_t s = slot->mSeq.AcquireLoad();
+			if (s & 1) {
+				busy = true;
+				continue;
+			} else if (slot->mTag != tag) {
+				continue;
+			}
+
+			uint32_t keylen = slot->mKeyLen, l = slot->mValLen;
+			uint64_t expire = slot->mExpire;
+			bool match = keylen == key.size() && keylen <= kShmHashKey && l <= mValLen && memcmp(Key(slot), key.data(), key.size()) == 0;
+			if (match && l <= len) {
+				memcpy(buf, Value(slot), l);
+			}
+			std::atomic_thread_fence(std::memory_order_acquire);
+			if (slot->mSeq.NoBarrierLoad() != s) {
+				busy = true;
+				continue;
+			} else if (!match) {
+				continue;
+			}
+
+			if ((expire != 0 && expire <= now) || l > len) {
+				return -1;
+			}
+			*vallen = l;
+			return 0;
+		}
+		if (!busy) {
+			break;
+		}
+		sched_yield();
+	}
+	return -1;
+}
+
+}	// namespace hnet
@@ -0,0 +1,121 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_SHM_HASH_H_
+#define _W_SHM_HASH_H_
+
+#include <type_traits>
+#include "wCore.h"
+#include "wNoncopyable.h"
+#include "wAtomic.h"
+#include "wSlice.h"
+
+namespace hnet {
+
+// 键最大长度
+const uint32_t	kShmHashKey = 64;
+
+// 值默认最大长度（配置项 shm_hash_value）
+const uint32_t	kShmHashValue = 256;
+
+// 开放寻址探测窗口（槽数）。键只存放于其哈希位置起的窗口内，窗口满时写入失败
+const uint32_t	kShmHashProbe = 16;
+
+// 窗口内有槽正在写入时重试次数
+const uint32_t	kShmHashRetry = 64;
+
+class wEnv;
+class wShm;
+
+// worker进程间共享哈希表（会话、令牌等跨worker缓存）：固定容量，开放寻址（线性探测），无锁
+// 每槽一个顺序锁：序号偶数为稳定，写者CAS将序号加1（奇数）独占该槽，写完加1发布；读者复制后校验序号未变，否则重试
+// 槽中记录过期时间，过期槽读取视为不存在，写入时可复用
+// 并发写入同一不存在的键可能各占一个空槽，写者发布后复查窗口，仅保留探测顺序最靠前的副本
+// master进程在fork前创建（共享内存即刻标记删除，全部进程退出后由系统回收），worker继承映射
+// 写者进程在持有槽期间崩溃时，该槽不再可用
+class wShmHash : private wNoncopyable {
+public:
+    // 槽头，其后依次为键（kShmHashKey字节）、值（mValLen字节），槽长度按缓存行对齐
+    struct SlotHead_t {
+        wAtomic<uint32_t> mSeq;	// 顺序锁序号
+        uint32_t mTag;		// 键哈希值（0为空槽）
+        uint64_t mExpire;	// 过期时间 微妙，0永不过期
+        uint32_t mKeyLen;
+        uint32_t mValLen;
+
+        SlotHead_t() : mSeq(0), mTag(0), mExpire(0), mKeyLen(0), mValLen(0) { }
+    };
+
+    // entries为槽数（向上取2的幂），vallen为值最大长度
+    wShmHash(wEnv* env, uint32_t entries, uint32_t vallen = kShmHashValue);
+    ~wShmHash();
+
+    // master进程创建共享内存
+    int Create();
+
+    // 写入（已存在则覆盖），ttl为有效期（毫秒，0永不过期）。键、值超长或探测窗口已满返回-1
+    int Put(const wSlice& key, const wSlice& val, uint32_t ttl = 0);
+
+    // 读取，不存在或已过期返回-1
+    int Get(const wSlice& key, std::string* val);
+
+    // 删除，不存在返回-1
+    int Del(const wSlice& key);
+
+    // 按类型写入、读取定长值（POD类型）。读取时值长度须与类型长度一致
+    template<typename T>
+    inline int Store(const wSlice& key, const T& val, uint32_t ttl = 0) {
+        static_assert(std::is_pod<T>::value, "wShmHash::Store requires POD type");
+        return Put(key, wSlice(reinterpret_cast<const char*>(&val), sizeof(T)), ttl);
+    }
+
+    template<typename T>
+    inline int Load(const wSlice& key, T* val) {
+        static_assert(std::is_pod<T>::value, "wShmHash::Load requires POD type");
+        uint32_t len = 0;
+        if (Read(key, reinterpret_cast<char*>(val), sizeof(T), &len) == -1 || len != sizeof(T)) {
+            return -1;
+        }
+        return 0;
+    }
+
+    inline uint32_t Capacity() { return mMask + 1;}
+    inline uint32_t ValueLen() { return mValLen;}
+
+protected:
+    inline SlotHead_t* Slot(uint32_t i) {
+        return reinterpret_cast<SlotHead_t*>(mBase + static_cast<size_t>(i & mMask) * mSlotLen);
+    }
+    inline char* Key(SlotHead_t* slot) {
+        return reinterpret_cast<char*>(slot + 1);
+    }
+    inline char* Value(SlotHead_t* slot) {
+        return Key(slot) + kShmHashKey;
+    }
+
+    static uint32_t Tag(const wSlice& key);
+
+    // 读取值至buf（至多len字节），值长度写入vallen
+    int Read(const wSlice& key, char buf[], size_t len, uint32_t* vallen);
+
+    // 在探测窗口中查找键：返回匹配槽（-1无匹配），spare为首个可复用槽（空槽或已过期）
+    // 窗口内有槽正在写入或读取期间被修改时busy为true（调用者可重试）
+    int64_t Find(uint32_t tag, const wSlice& key, uint64_t now, uint32_t* seq, int64_t* spare, uint32_t* spareseq, bool* busy);
+
+    // 删除探测窗口中该键除首个以外的副本（并发写入同一不存在的键时各自占用了不同空槽）
+    void Dedup(uint32_t tag, const wSlice& key);
+
+    wEnv* mEnv;
+    wShm* mShm;
+    char* mBase;
+    uint32_t mMask;
+    uint32_t mValLen;
+    size_t mSlotLen;
+};
+
+}	// namespace hnet
+
+#endif
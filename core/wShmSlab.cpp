@@ -0,0 +1,129 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wShmSlab.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+int wShmSlab::Init(void* base, size_t size) {
+	uint64_t pageoff = (sizeof(SlabHead_t) + size / kShmSlabPage + kShmSlabPage - 1) & ~static_cast<uint64_t>(kShmSlabPage - 1);
+	if (base == NULL || size > 0xffffffffULL || size < pageoff + kShmSlabPage) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmSlab::Init () failed", "size invalid");
+		return -1;
+	}
+
+	mBase = reinterpret_cast<char*>(base);
+	mHead = new (base) SlabHead_t();
+	mHead->mPages = static_cast<uint32_t>((size - pageoff) / kShmSlabPage);
+	mHead->mSize = size;
+	mHead->mPageOff = pageoff;
+	memset(ClassMap(), 0, mHead->mPages);
+	mHead->mMagic = kShmSlabMagic;
+	return 0;
+}
+
+int wShmSlab::Attach(void* base) {
+	SlabHead_t* head = reinterpret_cast<SlabHead_t*>(base);
+	if (head == NULL || head->mMagic != kShmSlabMagic) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmSlab::Attach () failed", "magic invalid");
+		return -1;
+	}
+	mBase = reinterpret_cast<char*>(base);
+	mHead = head;
+	return 0;
+}
+
+uint32_t wShmSlab::SizeClass(size_t size) {
+	uint32_t cls = 0;
+	while (cls < kShmSlabClass && (static_cast<size_t>(kShmSlabMin) << cls) < size) {
+		cls++;
+	}
+	return cls;
+}
+
+void* wShmSlab::Alloc(size_t size) {
+	uint32_t cls = SizeClass(size);
+	if (mHead == NULL || size == 0 || cls >= kShmSlabClass) {
+		return NULL;
+	}
+
+	wAtomic<uint64_t>* list = &mHead->mFree[cls];
+	while (true) {
+		uint64_t head = list->AcquireLoad();
+		uint32_t off = static_cast<uint32_t>(head);
+		if (off == 0) {
+			if (Grow(cls) == -1) {
+				return NULL;
+			}
+			continue;
+		}
+
+		// 该对象可能已被其他进程取走并改写，此时表头标签已变，CAS失败重试
+		uint32_t next = Next(off)->NoBarrierLoad();
+		if (list->CompareExchangeWeak(head, (((head >> 32) + 1) << 32) | next)) {
+			mHead->mUsed.FetchAdd(static_cast<uint64_t>(kShmSlabMin) << cls);
+			return mBase + off;
+		}
+	}
+}
+
+void wShmSlab::Free(void* ptr) {
+	if (mHead == NULL || ptr == NULL) {
+		return;
+	}
+
+	// 校验对象位于已切分页中，且与所属规格对齐
+	uint64_t off = Offset(ptr);
+	uint64_t page = (off - mHead->mPageOff) / kShmSlabPage;
+	if (off < mHead->mPageOff || page >= mHead->mPageTop.AcquireLoad()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmSlab::Free () failed", "pointer invalid");
+		return;
+	}
+	uint32_t cls = ClassMap()[page];
+	if (((off - mHead->mPageOff) & ((static_cast<uint64_t>(kShmSlabMin) << cls) - 1)) != 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wShmSlab::Free () failed", "pointer unaligned");
+		return;
+	}
+
+	mHead->mUsed.FetchSub(static_cast<uint64_t>(kShmSlabMin) << cls);
+	Push(cls, static_cast<uint32_t>(off), static_cast<uint32_t>(off));
+}
+
+void wShmSlab::Push(uint32_t cls, uint32_t first, uint32_t last) {
+	wAtomic<uint64_t>* list = &mHead->mFree[cls];
+	while (true) {
+		uint64_t head = list->AcquireLoad();
+		Next(last)->NoBarrierStore(static_cast<uint32_t>(head));
+		if (list->CompareExchangeWeak(head, (((head >> 32) + 1) << 32) | first)) {
+			return;
+		}
+	}
+}
+
+int wShmSlab::Grow(uint32_t cls) {
+	uint32_t page;
+	do {
+		page = mHead->mPageTop.AcquireLoad();
+		if (page >= mHead->mPages) {
+			return -1;
+		}
+	} while (!mHead->mPageTop.CompareExchangeWeak(page, page + 1));
+
+	// 新页仅本进程可见，链接完成后整体压入（CAS发布，其他进程随之可见页规格及链接）
+	ClassMap()[page] = static_cast<uint8_t>(cls);
+	uint32_t size = kShmSlabMin << cls;
+	uint32_t first = static_cast<uint32_t>(mHead->mPageOff + static_cast<uint64_t>(page) * kShmSlabPage);
+	uint32_t last = first + kShmSlabPage - size;
+	for (uint32_t off = first; off < last; off += size) {
+		Next(off)->NoBarrierStore(off + size);
+	}
+	Push(cls, first, last);
+	return 0;
+}
+
+}	// namespace hnet
@@ -0,0 +1,97 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_SHM_SLAB_H_
+#define _W_SHM_SLAB_H_
+
+#include "wCore.h"
+#include "wNoncopyable.h"
+#include "wAtomic.h"
+
+namespace hnet {
+
+// slab页长度。每页只切分为一种规格的对象
+const uint32_t	kShmSlabPage = 65536;
+
+// 对象规格：kShmSlabMin << i（i < kShmSlabClass），即16字节至32KB
+const uint32_t	kShmSlabMin = 16;
+const uint32_t	kShmSlabClass = 12;
+
+// 共享内存区域标识
+const uint32_t	kShmSlabMagic = 0x68736c62;
+
+// 共享内存slab分配器：在一段共享内存（如 wShm::AllocShm 所得）上按规格分配、释放对象
+// 区域内一律以相对区域起始的偏移（Offset）记录位置，各进程映射地址不同亦可共用
+// 每规格一条空闲链表（无锁栈，表头为 标签<<32|偏移，标签每次修改加1防ABA），空闲对象首4字节存放下一对象偏移
+// 空闲链表为空时自区域切分新页（页一经分配归属该规格，不再归还）。进程在分配、释放中途崩溃至多遗失该对象，链表不被破坏
+class wShmSlab : private wNoncopyable {
+public:
+    // 区域头，其后为页规格表（每页1字节）、页
+    struct SlabHead_t {
+        uint32_t mMagic;
+        uint32_t mPages;	// 页总数
+        uint64_t mSize;		// 区域长度
+        uint64_t mPageOff;	// 首页偏移
+        wAtomic<uint32_t> mPageTop;	// 已切分页数
+        wAtomic<uint64_t> mUsed;	// 已分配字节数（按规格计）
+        wAtomic<uint64_t> mFree[kShmSlabClass];	// 各规格空闲链表表头
+
+        SlabHead_t() : mMagic(0), mPages(0), mSize(0), mPageOff(0), mPageTop(0), mUsed(0) {
+            for (uint32_t i = 0; i < kShmSlabClass; i++) {
+                mFree[i].NoBarrierStore(0);
+            }
+        }
+    };
+
+    wShmSlab() : mBase(NULL), mHead(NULL) { }
+
+    // 创建进程在base起size字节（不超过4GB）区域上初始化
+    int Init(void* base, size_t size);
+
+    // 其他进程以自身映射地址挂接已初始化的区域
+    int Attach(void* base);
+
+    // 分配size字节（不超过最大规格），区域已满返回NULL
+    void* Alloc(size_t size);
+
+    // 释放 Alloc 所得对象（可由其他进程分配）
+    void Free(void* ptr);
+
+    // 指针与区域内偏移转换（0为NULL），供存放于共享内存的数据结构记录位置
+    inline uint64_t Offset(const void* ptr) {
+        return ptr != NULL ? static_cast<uint64_t>(reinterpret_cast<const char*>(ptr) - mBase) : 0;
+    }
+    inline void* Ptr(uint64_t off) {
+        return off != 0 ? mBase + off : NULL;
+    }
+
+    inline uint64_t Used() { return mHead != NULL ? mHead->mUsed.NoBarrierLoad() : 0;}
+    inline uint64_t Size() { return mHead != NULL ? mHead->mSize : 0;}
+
+protected:
+    // 空闲对象首4字节：下一空闲对象偏移
+    inline wAtomic<uint32_t>* Next(uint32_t off) {
+        return reinterpret_cast<wAtomic<uint32_t>*>(mBase + off);
+    }
+    inline uint8_t* ClassMap() {
+        return reinterpret_cast<uint8_t*>(mHead + 1);
+    }
+
+    static uint32_t SizeClass(size_t size);
+
+    // 压入对象链（first至last已链接）
+    void Push(uint32_t cls, uint32_t first, uint32_t last);
+
+    // 为规格cls切分一页并压入空闲链表，区域已满返回-1
+    int Grow(uint32_t cls);
+
+    char* mBase;
+    SlabHead_t* mHead;
+};
+
+}	// namespace hnet
+
+#endif
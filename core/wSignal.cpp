@@ -17,11 +17,13 @@ volatile int hnet_quit = 0;
 volatile int hnet_reconfigure = 0;
 volatile int hnet_reap = 0;
 volatile int hnet_reopen = 0;
+volatile int hnet_changebinary = 0;
 
 // 信号集
 wSignal::Signal_t hnet_signals[] = {
     {SIGHUP,    "SIGHUP",   "restart",  &wSignal::SignalHandler},   // 重启
     {SIGUSR1,   "SIGUSR1",  "reopen",   &wSignal::SignalHandler},   // 清除日志
+    {SIGUSR2,   "SIGUSR2",  "upgrade",  &wSignal::SignalHandler},   // 热升级（执行新二进制文件）
     {SIGQUIT,   "SIGQUIT",  "quit",     &wSignal::SignalHandler},   // 优雅退出
     {SIGTERM,   "SIGTERM",  "stop",     &wSignal::SignalHandler},   // 立即退出
     {SIGINT,    "SIGINT",   "",         &wSignal::SignalHandler},   // 立即退出
@@ -114,6 +116,11 @@ void wSignal::SignalHandler(int signo) {
         action = ", reopen";
         break;
 
+    case SIGUSR2:
+        hnet_changebinary = 1;
+        action = ", changing binary";
+        break;
+
     case SIGALRM:
         hnet_sigalrm = 1;
         break;
@@ -59,6 +59,7 @@ extern volatile int hnet_quit;          // SIGQUIT
 extern volatile int hnet_reconfigure;   // SIGHUP
 extern volatile int hnet_reap;          // SIGCHLD
 extern volatile int hnet_reopen;        // SIGUSR1
+extern volatile int hnet_changebinary;  // SIGUSR2
 
 }   // namespace hnet
 
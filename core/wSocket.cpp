@@ -4,12 +4,15 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <sys/sendfile.h>
 #include "wSocket.h"
 
 namespace hnet {
 
 wSocket::wSocket(SockType type, SockProto proto, SockFlag flag) : mFD(kFDUnknown), mPort(0), mRecvTm(0), mSendTm(0), 
-mMakeTm(soft::TimeUsec()), mSockType(type), mSockProto(proto), mSockFlag(flag) { }
+mMakeTm(soft::TimeUsec()), mSockType(type), mSockProto(proto), mSockFlag(flag), mSplice(false), mPipeLen(0) {
+    mPipe[0] = mPipe[1] = kFDUnknown;
+}
 
 wSocket::~wSocket() {
     Close();
@@ -58,6 +61,9 @@ int wSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
                 break;
             }
         } else if (errno == EAGAIN || errno == EWOULDBLOCK) {   // Resource temporarily unavailable // 资源暂时不够(可能写缓冲区满)
+            if (sendedlen > 0) {	// 已发送部分须告知调用者，否则缓冲游标错乱
+                *size = sendedlen;
+            }
             ret = 0;
             break;
         } else if (errno == EINTR) {    // Interrupted system call
@@ -76,12 +82,88 @@ int wSocket::SendBytes(char buf[], size_t len, ssize_t *size) {
     return ret;
 }
 
+int wSocket::SendFile(int fd, off_t* offset, size_t len, ssize_t *size) {
+    mSendTm = soft::TimeUsec();
+
+    int ret = 0;
+    ssize_t sendedlen = 0;
+    size_t leftlen = len;
+    while (leftlen > 0) {
+        if (!mSplice) {
+            *size = sendfile(mFD, fd, offset, leftlen);
+        } else {
+            // 管道为空时自文件填充，再由管道发送至socket
+            if (mPipeLen == 0) {
+                ssize_t n = splice(fd, offset, mPipe[1], NULL, leftlen, SPLICE_F_MOVE | SPLICE_F_NONBLOCK);
+                if (n == 0) {   // 文件被截断
+                    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile splice() failed", "unexpected end of file");
+                    ret = -1;
+                    break;
+                } else if (n > 0) {
+                    mPipeLen = n;
+                } else if (errno != EAGAIN && errno != EINTR) {
+                    HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile splice() failed", error::Strerror(errno).c_str());
+                    ret = -1;
+                    break;
+                }
+            }
+            *size = mPipeLen > 0 ? splice(mPipe[0], NULL, mFD, NULL, mPipeLen, SPLICE_F_MOVE | SPLICE_F_NONBLOCK) : -1;
+            if (*size > 0) {
+                mPipeLen -= *size;
+            }
+        }
+
+        if (*size > 0) {
+            sendedlen += *size;
+            if ((leftlen -= *size) == 0) {
+                *size = sendedlen;
+                break;
+            }
+        } else if (*size == 0) {    // 文件被截断
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile sendfile() failed", "unexpected end of file");
+            ret = -1;
+            break;
+        } else if (errno == EAGAIN || errno == EWOULDBLOCK) {
+            if (sendedlen > 0) {
+                *size = sendedlen;
+            }
+            ret = 0;
+            break;
+        } else if (errno == EINTR) {
+            continue;
+        } else if (!mSplice && sendedlen == 0 && (errno == EINVAL || errno == ENOSYS)) {
+            // 文件不支持sendfile，改用splice
+            if (pipe2(mPipe, O_NONBLOCK | O_CLOEXEC) == -1) {
+                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile pipe2() failed", error::Strerror(errno).c_str());
+                ret = -1;
+                break;
+            }
+            mSplice = true;
+        } else if (errno == EPIPE) {
+            ret = -1;
+            break;
+        } else {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::SendFile sendfile() failed", error::Strerror(errno).c_str());
+            ret = -1;
+            break;
+        }
+    }
+    return ret;
+}
+
 int wSocket::Close() {
     int ret = close(mFD);
     if (ret == -1) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s", "wSocket::Close close() failed", error::Strerror(errno).c_str());
     }
     mFD = kFDUnknown;
+
+    if (mPipe[0] != kFDUnknown) {
+        close(mPipe[0]);
+        close(mPipe[1]);
+        mPipe[0] = mPipe[1] = kFDUnknown;
+        mPipeLen = 0;
+    }
     return ret;
 }
 
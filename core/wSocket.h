@@ -63,6 +63,12 @@ public:
     // size>= 0 发送字符
     // 返回 =-1 表示需要关闭该连接，并清理内存
     virtual int SendBytes(char buf[], size_t len, ssize_t *size);
+
+    // 零拷贝发送文件fd自*offset起len字节（sendfile，不支持时以splice经管道发送）
+    // size =-1 稍后重试
+    // size>= 0 已发送至socket字节数（*offset可能超前size，超出部分暂存管道，下次调用先行发送）
+    // 返回 =-1 表示需要关闭该连接，并清理内存
+    virtual int SendFile(int fd, off_t* offset, size_t len, ssize_t *size);
     
     // 从客户端接收连接
     // fd   =-1 发生错误|稍后重试
@@ -154,6 +160,11 @@ protected:
     SockStatus  mSockStatus;
     SockProto   mSockProto;
     SockFlag    mSockFlag;
+
+    // splice发送文件
+    bool        mSplice;
+    int         mPipe[2];
+    size_t      mPipeLen;   // 管道中待发送字节数
 };
 
 }   // namespace hnet
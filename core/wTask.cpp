@@ -14,7 +14,8 @@
 
 namespace hnet {
 
-wTask::wTask(wSocket* socket, int32_t type) : mType(type), mSocket(socket), mHeartbeat(0), mServer(NULL), mClient(NULL), mSCType(-1) {
+wTask::wTask(wSocket* socket, int32_t type) : mType(type), mSocket(socket), mDrain(false), mHeartbeat(0), mCodec(NULL), mServer(NULL), mClient(NULL), mSCType(-1) {
+	HNET_NEW(wFixed32Codec(), mCodec);
 	ResetBuffer();
 }
 
@@ -22,12 +23,73 @@ void wTask::ResetBuffer() {
 	mRecvLen = mSendLen = 0;
 	mRecvRead = mRecvWrite = mRecvBuff;
 	mSendRead = mSendWrite = mSendBuff;
+	mSendMark = mSendedMark = 0;
+	mStreamSeq.clear();
+	ClearSendFile();
+}
+
+void wTask::ClearSendFile() {
+	for (std::deque<SendFile_t>::iterator it = mSendFiles.begin(); it != mSendFiles.end(); it++) {
+		if (it->mRelease) {
+			it->mRelease(it->mArg);
+		}
+	}
+	mSendFiles.clear();
 }
 
 wTask::~wTask() {
+    ClearSendFile();
+    HNET_DELETE(mCodec);
     HNET_DELETE(mSocket);
 }
 
+bool wTask::Idle(uint64_t now) {
+    if (SendPending() || mRecvLen > 0) {
+        return false;
+    }
+    uint64_t last = std::max(mSocket->RecvTm(), mSocket->SendTm());
+    return now > last && now - last >= static_cast<uint64_t>(kDrainIdleTm)*1000;
+}
+
+int wTask::MigrateOut(std::string* buf, uint32_t* recvlen, uint32_t* sendlen, uint32_t* statelen) {
+    if (mDrain || !mSendFiles.empty() || !mStreamSeq.empty()) {
+        return -1;
+    }
+
+    size_t off = buf->size();
+    buf->append(mRecvRead, mRecvLen);
+    buf->append(mSendRead, mSendLen);
+    if (SaveState(buf) == -1) {
+        buf->resize(off);
+        return -1;
+    }
+    *recvlen = static_cast<uint32_t>(mRecvLen);
+    *sendlen = static_cast<uint32_t>(mSendLen);
+    *statelen = static_cast<uint32_t>(buf->size() - off - mRecvLen - mSendLen);
+    return 0;
+}
+
+int wTask::MigrateIn(const char recv[], size_t recvlen, const char send[], size_t sendlen, const char state[], size_t statelen) {
+    if (recvlen > kPackageSize || (sendlen > 0 && Append2Buf(send, sendlen) == -1)) {
+        return -1;
+    }
+    memcpy(mRecvBuff, recv, recvlen);
+    mRecvRead = mRecvBuff;
+    mRecvWrite = mRecvBuff + recvlen;
+    mRecvLen = recvlen;
+
+    if (LoadState(state, statelen) == -1) {
+        return -1;
+    } else if (SendPending() && Output() == -1) {
+        return -1;
+    }
+    return HandleRecv();
+}
+
+bool wTask::HeartbeatTurn() {
+    return mSocket->SP() == kSpTcp || mSocket->SP() == kSpUnix;
+}
+
 int wTask::HeartbeatSend() {
     mHeartbeat++;
     struct wCommand cmd;
@@ -53,160 +115,111 @@ int wTask::Output() {
 }
 
 int wTask::TaskRecv(ssize_t *size) {
-	const char *buffend = mRecvBuff + kPackageSize;
+	*size = 0;
 
-	// 循环队列
-	if (mRecvLen < kPackageSize && mRecvLen == 0) {
+	// 线性缓冲：未处理数据始终连续存放，Decode、Handlemsg直接引用缓冲（零拷贝）
+	if (mRecvLen == 0) {
 		mRecvRead = mRecvWrite = mRecvBuff;
-	} else if (mRecvLen < kPackageSize && mRecvRead != mRecvBuff && mRecvWrite == buffend) {
-		mRecvWrite = mRecvBuff;
+	} else if (mRecvRead != mRecvBuff && static_cast<size_t>(mRecvBuff + kPackageSize - mRecvWrite) < kPackageSize/2) {
+		// 队列太过靠后，剩余部分消息移至缓冲头部
+		memmove(mRecvBuff, mRecvRead, mRecvLen);
+		mRecvRead = mRecvBuff;
+		mRecvWrite = mRecvBuff + mRecvLen;
 	}
-	*size = 0;
-
-    // len >= 0 正向剩余
-    // len < 0 分段，中间剩余
-    ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-    size_t leftlen = len >= 0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-
-    if (mRecvLen < kPackageSize) {
-    	if (len >= 0 && leftlen <= 4*sizeof(uint32_t)) {
-    		// 队列太过靠后，重新调整
-    		memmove(mRecvBuff, mRecvRead, len);
-    		mRecvRead = mRecvBuff;
-    		mRecvWrite= mRecvBuff + len;
-    		len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-    		leftlen = len>=0? static_cast<size_t>(buffend - mRecvWrite): static_cast<size_t>(abs(len));
-    	}
-
-    	if (leftlen > 0) {
-        	// socket接受数据
-        	int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
-            if (ret == -1 || *size < 0) {
-                return ret;
-            }
-
-            mRecvLen += *size;
-            mRecvWrite += *size;
-    	}
-    }
-
-    // 消息解析
-    auto handleFunc = [this] (char* buf, uint32_t len, char* nextbuf) -> int {
-        int ret = this->Handlemsg(buf, len);
 
-        this->mRecvRead = nextbuf;
-        this->mRecvLen -= len + sizeof(uint32_t);
-        return ret;
-    };
+	size_t leftlen = static_cast<size_t>(mRecvBuff + kPackageSize - mRecvWrite);
+	if (leftlen > 0) {
+		// socket接受数据
+		int ret = mSocket->RecvBytes(mRecvWrite, leftlen, size);
+		if (ret == -1 || *size < 0) {
+			return ret;
+		}
 
-    int ret = 0;
-    while (mRecvLen > sizeof(uint32_t)) {
-    	// 循环队列
-    	if (mRecvRead == buffend && mRecvWrite != mRecvBuff) {
-            mRecvRead = mRecvBuff;
-        }
-    	ssize_t len =  static_cast<ssize_t>(mRecvWrite - mRecvRead);
-        
-        uint32_t reallen = 0;
-        if (len > 0) {
-            // 消息字符在正向缓冲中
-            reallen = coding::DecodeFixed32(mRecvRead);
-            if (reallen < kMinPackageSize || reallen > kMaxPackageSize) {
-                ret = -1;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", ">0 message length error");
-                break;
+		mRecvLen += *size;
+		mRecvWrite += *size;
+	}
 
-            } else if (reallen > static_cast<uint32_t>(len - sizeof(uint32_t))) {
-                ret = 0;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", ">0 recv a part of message");
-                break;
-            }
+	return HandleRecv();
+}
 
-            ret = handleFunc(mRecvRead + sizeof(uint32_t), reallen, mRecvRead + sizeof(uint32_t) + reallen);
-            if (ret == -1) {
-                break;
-            }
-        } else {
-            leftlen = buffend - mRecvRead;
-            // 消息字符分段存储
-            if (leftlen >= sizeof(uint32_t)) {
-                reallen = coding::DecodeFixed32(mRecvRead);
-            } else {
-                // 长度分段
-                [=, &reallen]() {
-                    for (size_t pos = 0; pos < leftlen; pos++) {
-                        reallen |= (static_cast<uint32_t>(static_cast<unsigned char>(mRecvRead[pos])) << (8 * pos));
-                    }
-                    for (size_t pos = 0; pos < sizeof(uint32_t) - leftlen; pos++) {
-                        reallen |= (static_cast<uint32_t>(static_cast<unsigned char>(mRecvBuff[pos])) << (8 * pos));
-                    }
-                } ();
-            }
+int wTask::HandleRecv() {
+	// 消息解析
+	int ret = 0;
+	while (mRecvLen > 0 && !HoldRecv()) {
+		size_t off = 0;
+		uint32_t len = 0;
+		int32_t framelen = mCodec->Decode(mRecvRead, mRecvLen, &off, &len);
+		if (framelen == -1) {
+			ret = -1;
+			HNET_ERROR(soft::GetLogPath(), "%s : %s[codec=%s]", "wTask::HandleRecv () failed", "message length error", mCodec->Name());
+			break;
+		} else if (framelen == 0) {
+			if (mRecvLen >= kPackageSize) {
+				ret = -1;
+				HNET_ERROR(soft::GetLogPath(), "%s : %s[codec=%s]", "wTask::HandleRecv () failed", "message too large", mCodec->Name());
+			}
+			break;
+		}
 
-            if (reallen < kMinPackageSize || reallen > kMaxPackageSize) {
-                ret = -1;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", "<=0 message length error");
-                break;
+		char* buf = mRecvRead + off;
+		mRecvRead += framelen;
+		mRecvLen -= framelen;
 
-            } else if (reallen > static_cast<uint32_t>(kPackageSize - abs(len) - sizeof(uint32_t))) {
-                ret = 0;
-                HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::TaskRecv () failed", "<=0 recv a part of message");
-                break;
-            }
-            
-            if (reallen <= static_cast<uint32_t>(leftlen - sizeof(uint32_t))) { // 正向剩余
-                ret = handleFunc(mRecvRead + sizeof(uint32_t), reallen, mRecvRead + sizeof(uint32_t) + reallen);
-                if (ret == -1) {
-                    break;
-                }
-            } else {
-                memcpy(mTempBuff, mRecvRead, leftlen);
-                memcpy(mTempBuff + leftlen, mRecvBuff, reallen - leftlen + sizeof(uint32_t));
-                
-                ret = handleFunc(mTempBuff + sizeof(uint32_t), reallen, mRecvBuff + (reallen - leftlen + sizeof(uint32_t)));
-                if (ret == -1) {
-                    break;
-                }
-            }
-        }
-    }
-    return ret;
+		ret = Handlemsg(buf, len);
+		if (ret == -1) {
+			break;
+		}
+	}
+	return ret;
 }
 
 int wTask::TaskSend(ssize_t *size) {
-    ssize_t len;
-    const char *buffend = mSendBuff + kPackageSize;
-    int ret = 0;
-    while (true) {
-        len = mSendWrite - mSendRead;
-        if (len == 0 && mSendLen == 0) {
-            break;
-        } else if (len > 0) {
-            ret = mSocket->SendBytes(mSendRead, mSendLen, size);
-            if (ret == -1 || *size < 0) {
-                break;
-            }
+	int ret = 0;
+	while (mSendLen > 0 || !mSendFiles.empty()) {
+		if (!mSendFiles.empty() && mSendFiles.front().mMark == mSendedMark) {
+			// 其前缓冲数据已发送，发送文件（内存）片段
+			SendFile_t& file = mSendFiles.front();
+			if (file.mData != NULL) {
+				ret = mSocket->SendBytes(const_cast<char*>(file.mData) + file.mOff, file.mLen, size);
+			} else {
+				ret = mSocket->SendFile(file.mFD, &file.mOff, file.mLen, size);
+			}
+			if (ret == -1 || *size < 0) {
+				break;
+			} else if (file.mData != NULL) {
+				file.mOff += *size;
+			}
+			file.mLen -= *size;
+			if (file.mLen == 0) {
+				if (file.mRelease) {
+					file.mRelease(file.mArg);
+				}
+				mSendFiles.pop_front();
+			}
+			continue;
+		}
 
-            mSendLen -= *size;
-            mSendRead += *size;
-        } else if (len <= 0) {
-            ssize_t leftlen = buffend - mSendRead;
-            memcpy(mTempBuff, mSendRead, leftlen);
-            memcpy(mTempBuff + leftlen, mSendBuff, mSendLen - leftlen);
-            ret = mSocket->SendBytes(mTempBuff, mSendLen, size);
-            if (ret == -1 || *size < 0) {
-                break;
-            }
+		// 发送至下一文件片段位置
+		size_t len = mSendLen;
+		if (!mSendFiles.empty()) {
+			len = static_cast<size_t>(mSendFiles.front().mMark - mSendedMark);
+		}
+		ret = mSocket->SendBytes(mSendRead, len, size);
+		if (ret == -1 || *size < 0) {
+			break;
+		}
 
-            if (*size <= leftlen) {
-            	mSendRead += *size;
-            } else {
-            	mSendRead = mSendBuff + mSendLen - leftlen;
-            }
-            mSendLen -= *size;
-        }
-    }
-    return ret;
+		mSendLen -= *size;
+		mSendRead += *size;
+		mSendedMark += *size;
+	}
+
+	// 发送缓冲已清空，续写流分片
+	if (ret == 0 && mSendLen == 0 && mSendFiles.empty()) {
+		mSendRead = mSendWrite = mSendBuff;
+		ret = TaskWritable();
+	}
+	return ret;
 }
 
 #ifdef _USE_PROTOBUF_
@@ -241,76 +254,230 @@ void wTask::Assertbuf(char buf[], const char cmd[], size_t len) {
 	memcpy(buf + sizeof(uint32_t) + sizeof(uint8_t), cmd, len);
 }
 
+void wTask::SetCodec(wCodec* codec) {
+	if (codec != NULL && codec != mCodec) {
+		HNET_DELETE(mCodec);
+		mCodec = codec;
+	}
+}
+
+void wTask::SetCrc32c(bool on) {
+	wCrc32cCodec* crc = dynamic_cast<wCrc32cCodec*>(mCodec);
+	if (on && crc == NULL) {
+		wCodec* codec;
+		HNET_NEW(wCrc32cCodec(mCodec), codec);
+		if (codec != NULL) {
+			mCodec = codec;
+		}
+	} else if (!on && crc != NULL) {
+		mCodec = crc->Release();
+		HNET_DELETE(crc);
+	}
+}
+
+char* wTask::PrepareBuf(size_t len) {
+	if (len > kPackageSize - mSendLen) {
+		return NULL;
+	}
+
+	if (mSendLen == 0) {
+		mSendRead = mSendWrite = mSendBuff;
+	} else if (len > static_cast<size_t>(mSendBuff + kPackageSize - mSendWrite)) {
+		// 尾部剩余不足，待发送数据移至缓冲头部
+		memmove(mSendBuff, mSendRead, mSendLen);
+		mSendRead = mSendBuff;
+		mSendWrite = mSendBuff + mSendLen;
+	}
+	return mSendWrite;
+}
+
+int wTask::SendFile2Buf(int fd, off_t offset, size_t len, void (*release)(void* arg), void* arg) {
+	if (len == 0) {
+		if (release) {
+			release(arg);
+		}
+		return 0;
+	}
+
+	SendFile_t file;
+	file.mFD = fd;
+	file.mData = NULL;
+	file.mOff = offset;
+	file.mLen = len;
+	file.mMark = mSendMark;
+	file.mRelease = release;
+	file.mArg = arg;
+	mSendFiles.push_back(file);
+	return 0;
+}
+
+int wTask::SendData2Buf(const char data[], size_t len, void (*release)(void* arg), void* arg) {
+	if (len == 0) {
+		if (release) {
+			release(arg);
+		}
+		return 0;
+	}
+
+	SendFile_t file;
+	file.mFD = kFDUnknown;
+	file.mData = data;
+	file.mOff = 0;
+	file.mLen = len;
+	file.mMark = mSendMark;
+	file.mRelease = release;
+	file.mArg = arg;
+	mSendFiles.push_back(file);
+	return 0;
+}
+
+int wTask::DropSendData() {
+	for (std::deque<SendFile_t>::iterator it = mSendFiles.begin(); it != mSendFiles.end(); it++) {
+		if (it->mData != NULL && it->mOff == 0) {
+			if (it->mRelease) {
+				it->mRelease(it->mArg);
+			}
+			mSendFiles.erase(it);
+			return 0;
+		}
+	}
+	return -1;
+}
+
+int wTask::Append2Buf(const char buf[], size_t len) {
+	char* dst = PrepareBuf(len);
+	if (dst == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Append2Buf () failed", "left buffer not enough");
+		return -1;
+	}
+	memcpy(dst, buf, len);
+	CommitBuf(len);
+	return 0;
+}
+
+char* wTask::PrepareFrame(size_t len, size_t* headlen) {
+	if (len < mCodec->MinLen() || len > mCodec->MaxLen()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::PrepareFrame () failed", "message too large");
+		return NULL;
+	}
+
+	*headlen = mCodec->HeadLen(len);
+	char* buf = PrepareBuf(*headlen + len + mCodec->TailLen());
+	if (buf == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::PrepareFrame () failed", "left buffer not enough");
+		return NULL;
+	}
+	mCodec->EncodeHead(buf, len);
+	return buf;
+}
+
+void wTask::CommitFrame(char buf[], size_t headlen, size_t len) {
+	mCodec->EncodeTail(buf + headlen, len);
+	CommitBuf(headlen + len + mCodec->TailLen());
+}
+
+int wTask::Write2Buf(const char buf[], size_t len) {
+	size_t headlen;
+	char* dst = PrepareFrame(len, &headlen);
+	if (dst == NULL) {
+		return -1;
+	}
+	memcpy(dst + headlen, buf, len);
+	CommitFrame(dst, headlen, len);
+	return 0;
+}
+
 int wTask::Send2Buf(char cmd[], size_t len) {
 	// 消息体总长度
-	len += sizeof(uint8_t);
-    if (len < kMinPackageSize || len > kMaxPackageSize) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "message too large");
-        return -1;
-
-    } else if (len > static_cast<size_t>(kPackageSize - mSendLen - sizeof(uint32_t))) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
-    }
+	size_t headlen;
+	char* buf = PrepareFrame(len + sizeof(uint8_t), &headlen);
+	if (buf == NULL) {
+		return -1;
+	}
 
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len + sizeof(uint32_t))) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len + sizeof(uint32_t)))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	Assertbuf(mSendWrite, cmd, len - sizeof(uint8_t));
-    	mSendWrite += sizeof(uint32_t) + len;
-
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	Assertbuf(mTempBuff, cmd, len - sizeof(uint8_t));
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	mSendWrite = mSendBuff;
-    	memcpy(mSendWrite, mTempBuff + leftlen, sizeof(uint32_t) + len - leftlen);
-    	mSendWrite += sizeof(uint32_t)+ len - leftlen;
+	// wCommand消息类型
+	coding::EncodeFixed8(buf + headlen, static_cast<uint8_t>(kMpCommand));
+	// 消息体
+	memcpy(buf + headlen + sizeof(uint8_t), cmd, len);
 
-    } else {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
-    }
-    mSendLen += sizeof(uint32_t) + len;
-    return 0;
+	CommitFrame(buf, headlen, len + sizeof(uint8_t));
+	return 0;
 }
 
 #ifdef _USE_PROTOBUF_
 int wTask::Send2Buf(const google::protobuf::Message* msg) {
+	// 类名 && 长度
+	const std::string& pbName = msg->GetTypeName();
+	uint16_t nameLen = static_cast<uint16_t>(pbName.size());
 	// 消息体总长度
-	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
-    if (len < kMinPackageSize || len > kMaxPackageSize) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "message too large");
-        return -1;
-    } else if (len > static_cast<uint32_t>(kPackageSize - mSendLen - sizeof(uint32_t))) {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
-    }
+	size_t len = sizeof(uint8_t) + sizeof(uint16_t) + nameLen + msg->ByteSize();
+	size_t headlen;
+	char* buf = PrepareFrame(len, &headlen);
+	if (buf == NULL) {
+		return -1;
+	}
 
-    const char *buffend = mSendBuff + kPackageSize;
-    ssize_t writelen =  mSendWrite - mSendRead;
-    ssize_t leftlen = buffend - mSendWrite;
-    if ((writelen >= 0 && leftlen >= static_cast<ssize_t>(len + sizeof(uint32_t))) || (writelen < 0 && abs(writelen) >= static_cast<ssize_t>(len + sizeof(uint32_t)))) {
-    	// 单向剩余足够（右边剩余 || 中间剩余）
-    	Assertbuf(mSendWrite, msg);
-    	mSendWrite += sizeof(uint32_t) + len;
-    } else if (writelen >= 0 && leftlen < static_cast<ssize_t>(len + sizeof(uint32_t))) {
-    	// 分段剩余足够（两边剩余）
-    	Assertbuf(mTempBuff, msg);
-    	memcpy(mSendWrite, mTempBuff, leftlen);
-    	memcpy(mSendWrite = mSendBuff, mTempBuff + leftlen, sizeof(uint32_t) + len - leftlen);
-    	mSendWrite += sizeof(uint32_t)+ len - leftlen;
-    } else {
-        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Send2Buf () failed", "left buffer not enough");
-        return -1;
-    }
-    mSendLen += sizeof(uint32_t) + len;
-    return 0;
+	char* p = buf + headlen;
+	// protobuf消息类型
+	coding::EncodeFixed8(p, static_cast<uint8_t>(kMpProtobuf));
+	// 类名长度
+	coding::EncodeFixed16(p + sizeof(uint8_t), nameLen);
+	// 类名
+	memcpy(p + sizeof(uint8_t) + sizeof(uint16_t), pbName.data(), nameLen);
+	// 消息体
+	msg->SerializeToArray(reinterpret_cast<void*>(p + sizeof(uint8_t) + sizeof(uint16_t) + nameLen), msg->ByteSize());
+
+	CommitFrame(buf, headlen, len);
+	return 0;
 }
 #endif
 
+size_t wTask::StreamLeft() {
+	// 数据协议 + 流id + 分片序号 + 标志
+	const size_t streamlen = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+	const size_t framelen = mCodec->HeadLen(mCodec->MaxLen()) + mCodec->TailLen() + streamlen;
+	size_t left = kPackageSize - mSendLen;
+	if (left <= framelen) {
+		return 0;
+	}
+	return std::min(left - framelen, mCodec->MaxLen() - streamlen);
+}
+
+int wTask::Stream2Buf(uint32_t id, uint32_t seq, const char buf[], size_t len, bool fin) {
+	// 数据协议 + 流id + 分片序号 + 标志
+	const size_t streamlen = sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+	if (len > StreamLeft()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Stream2Buf () failed", "left buffer not enough");
+		return -1;
+	}
+
+	size_t headlen;
+	char* dst = PrepareFrame(streamlen + len, &headlen);
+	if (dst == NULL) {
+		return -1;
+	}
+
+	char* p = dst + headlen;
+	coding::EncodeFixed8(p, static_cast<uint8_t>(kMpStream));
+	coding::EncodeFixed32(p + sizeof(uint8_t), id);
+	coding::EncodeFixed32(p + sizeof(uint8_t) + sizeof(uint32_t), seq);
+	coding::EncodeFixed8(p + sizeof(uint8_t) + sizeof(uint32_t) + sizeof(uint32_t), fin? kStreamFin: 0);
+	if (len > 0) {
+		memcpy(p + streamlen, buf, len);
+	}
+
+	CommitFrame(dst, headlen, streamlen + len);
+	return 0;
+}
+
+int wTask::AsyncStream(uint32_t id, uint32_t seq, const char buf[], size_t len, bool fin) {
+	if (Stream2Buf(id, seq, buf, len, fin) == -1) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::AsyncStream Stream2Buf() failed", "");
+        return -1;
+	}
+	return Output();
+}
+
 int wTask::SyncWorker(char cmd[], size_t len) {
     if (mServer && mServer->Worker()) {
         std::vector<uint32_t> blackslot(1, mServer->Worker()->Slot());
@@ -409,7 +576,23 @@ int wTask::AsyncSend(const google::protobuf::Message* msg) {
 }
 #endif
 
+bool wTask::SyncFramed() {
+	if (dynamic_cast<wCrc32cCodec*>(mCodec) != NULL) {
+		// 同步帧不带crc，对端校验失败；接收亦无法校验
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[codec=%s]", "wTask::SyncFramed () failed", "sync io does not support crc32c", mCodec->Name());
+		return false;
+	} else if (dynamic_cast<wFixed32Codec*>(mCodec) == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s[codec=%s]", "wTask::SyncFramed () failed", "sync io requires fixed32 codec", mCodec->Name());
+		return false;
+	}
+	return true;
+}
+
 int wTask::SyncSend(char cmd[], size_t len, ssize_t *size) {
+	if (!SyncFramed()) {
+		return -1;
+	}
+
 	// 消息体总长度
 	len += sizeof(uint8_t);
     if (len < kMinPackageSize || len > kMaxPackageSize) {
@@ -423,6 +606,10 @@ int wTask::SyncSend(char cmd[], size_t len, ssize_t *size) {
 
 #ifdef _USE_PROTOBUF_
 int wTask::SyncSend(const google::protobuf::Message* msg, ssize_t *size) {
+	if (!SyncFramed()) {
+		return -1;
+	}
+
 	// 消息体总长度
 	uint32_t len = sizeof(uint8_t) + sizeof(uint16_t) + msg->GetTypeName().size() + msg->ByteSize();
 	if (len < kMinPackageSize || len > kMaxPackageSize) {
@@ -436,6 +623,10 @@ int wTask::SyncSend(const google::protobuf::Message* msg, ssize_t *size) {
 #endif
 
 int wTask::SyncRecv(char cmd[], ssize_t *size, size_t msglen, uint32_t timeout) {
+	if (!SyncFramed()) {
+		return -1;
+	}
+
     static const size_t kCmdHeadLen = sizeof(uint32_t) + sizeof(uint8_t); // 包长度 + 数据协议
 
 	size_t recvheadlen = 0, recvbodylen = 0, headlen = 0;
@@ -520,6 +711,10 @@ int wTask::SyncRecv(char cmd[], ssize_t *size, size_t msglen, uint32_t timeout)
 
 #ifdef _USE_PROTOBUF_
 int wTask::SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen, uint32_t timeout) {
+	if (!SyncFramed()) {
+		return -1;
+	}
+
     static const size_t kCmdHeadLen = sizeof(uint32_t) + sizeof(uint8_t); // 包长度 + 数据协议
 
     size_t recvheadlen = 0, recvbodylen = 0, headlen = 0;
@@ -603,7 +798,16 @@ int wTask::SyncRecv(google::protobuf::Message* msg, ssize_t *size, size_t msglen
 #endif
 
 int wTask::Handlemsg(char cmd[], uint32_t len) {
+	// 原始业务数据，无数据协议字节
+	if (mCodec->Raw()) {
+		return HandleRaw(cmd, len);
+	}
+
 	// 数据协议
+	if (len < sizeof(uint8_t)) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::Handlemsg () failed", "message empty");
+        return -1;
+	}
 	uint8_t sp = static_cast<uint8_t>(coding::DecodeFixed8(cmd));
 	cmd += sizeof(uint8_t);
 	len -= sizeof(uint8_t);
@@ -640,6 +844,8 @@ int wTask::Handlemsg(char cmd[], uint32_t len) {
         HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::Handlemsg () failed", "protobuf invalid", sp);
         ret = -1;
 #endif
+	} else if (sp == kMpStream) {
+		ret = HandleStream(cmd, len);
 	} else {
         HNET_ERROR(soft::GetLogPath(), "%s : %s[sp=%d]", "wTask::Handlemsg () failed", "request invalid", sp);
         ret = -1;
@@ -648,4 +854,54 @@ int wTask::Handlemsg(char cmd[], uint32_t len) {
 	return ret;
 }
 
+int wTask::HandleRaw(char buf[], uint32_t len) {
+    HNET_ERROR(soft::GetLogPath(), "%s : %s[codec=%s]", "wTask::HandleRaw () failed", "raw message handler not implemented", mCodec->Name());
+    return -1;
+}
+
+int wTask::HandleStream(char cmd[], uint32_t len) {
+	// 流id + 分片序号 + 标志
+	const uint32_t headlen = sizeof(uint32_t) + sizeof(uint32_t) + sizeof(uint8_t);
+	if (len < headlen) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::HandleStream () failed", "stream head error");
+        return -1;
+	} else if (!mEventStream) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s", "wTask::HandleStream () failed", "stream handler not found");
+        return -1;
+	}
+
+	uint32_t id = coding::DecodeFixed32(cmd);
+	uint32_t seq = coding::DecodeFixed32(cmd + sizeof(uint32_t));
+	uint8_t flag = static_cast<uint8_t>(coding::DecodeFixed8(cmd + sizeof(uint32_t) + sizeof(uint32_t)));
+
+	// 分片序号校验（乱序、重复、未知流均为非法）
+	std::map<uint32_t, uint32_t>::iterator it = mStreamSeq.find(id);
+	if (seq == 0) {
+		if (it != mStreamSeq.end()) {
+	        HNET_ERROR(soft::GetLogPath(), "%s : %s[id=%u]", "wTask::HandleStream () failed", "stream already open", id);
+	        return -1;
+		} else if (mStreamSeq.size() >= kMaxStreamNum) {
+	        HNET_ERROR(soft::GetLogPath(), "%s : %s[id=%u]", "wTask::HandleStream () failed", "too many streams", id);
+	        return -1;
+		}
+		it = mStreamSeq.insert(std::make_pair(id, 0)).first;
+	} else if (it == mStreamSeq.end() || it->second != seq) {
+        HNET_ERROR(soft::GetLogPath(), "%s : %s[id=%u, seq=%u]", "wTask::HandleStream () failed", "stream sequence error", id, seq);
+        return -1;
+	}
+
+	if (flag & kStreamFin) {
+		mStreamSeq.erase(it);
+	} else {
+		it->second = seq + 1;
+	}
+
+	struct Stream_t stream(id, seq, flag, cmd + headlen, len - headlen);
+	if (mEventStream(&stream) == -1) {
+		mStreamSeq.erase(id);
+		return -1;
+	}
+	return 0;
+}
+
 }   // namespace hnet
@@ -7,9 +7,11 @@
 #ifndef _W_TASK_H_
 #define _W_TASK_H_
 
+#include <deque>
 #include "wCore.h"
 #include "wNoncopyable.h"
 #include "wEvent.h"
+#include "wCodec.h"
 #include "wServer.h"
 #include "wMultiClient.h"
 #include "wLogger.h"
@@ -27,6 +29,28 @@ struct Request_t {
 	Request_t(char buf[], uint32_t len) : mBuf(buf), mLen(len) { }
 };
 
+// 流式消息绑定函数参数类型
+struct Stream_t {
+	uint32_t mId;	// 流id
+	uint32_t mSeq;	// 分片序号（从0开始连续递增）
+	uint8_t mFlag;	// kStreamFin
+	char* mBuf;
+	uint32_t mLen;
+	Stream_t(uint32_t id, uint32_t seq, uint8_t flag, char buf[], uint32_t len) : mId(id), mSeq(seq), mFlag(flag), mBuf(buf), mLen(len) { }
+	inline bool Fin() { return (mFlag & kStreamFin) != 0;}
+};
+
+// 发送队列中的文件片段或共享内存片段（零拷贝发送）
+struct SendFile_t {
+	int mFD;
+	const char* mData;	// 内存片段起始（文件片段为NULL）
+	off_t mOff;
+	size_t mLen;	// 剩余待发送长度
+	uint64_t mMark;	// 须先行发送的缓冲字节（累计）位置
+	void (*mRelease)(void* arg);	// 发送完毕或连接销毁时回调，可为NULL
+	void* mArg;
+};
+
 class wSocket;
 
 class wTask : private wNoncopyable {
@@ -47,7 +71,14 @@ public:
         return 0;
     }
 
-    // 处理接受到数据，转发给业务处理函数 Handlemsg 处理。每条消息大小[1b,512k]
+    // 设置分帧编解码器（接管codec内存），默认 wFixed32Codec
+    void SetCodec(wCodec* codec);
+    inline wCodec* Codec() { return mCodec;}
+
+    // 开启|关闭帧crc32c校验（在当前codec基础上包装 wCrc32cCodec，收发两端须一致）。开启期间 SyncSend/SyncRecv 返回-1
+    void SetCrc32c(bool on = true);
+
+    // 处理接受到数据，按 Codec 分帧后转发给业务处理函数 Handlemsg 处理。每条消息大小[1b,512k]
     // size = -1 对端发生错误|稍后重试
     // size = 0  对端关闭
     // size > 0  接受字符
@@ -58,16 +89,86 @@ public:
     // size >= 0 发送字符
     virtual int TaskSend(ssize_t *size);
 
-    // 解析消息
+    // 解析消息：首字节为数据协议（kMpCommand、kMpProtobuf、kMpStream），按协议分发至注册的处理函数
+    // Codec()->Raw() 为true（wLineCodec、wUserCodec）时消息体无数据协议字节，整体转交 HandleRaw
     virtual int Handlemsg(char cmd[], uint32_t len);
 
+    // 处理原始消息体（非长度前缀类codec，不经命令分发）。使用此类codec的task须重载，默认返回-1
+    virtual int HandleRaw(char buf[], uint32_t len);
+
     // 异步发送：将待发送客户端消息写入buf，等待TaskSend发送
     int Send2Buf(char cmd[], size_t len);
+
+    // 按 Codec 分帧将消息体原样写入buf（不附加数据协议，适用自定义协议）
+    int Write2Buf(const char buf[], size_t len);
+
+    // 原始字节写入buf（不分帧）
+    int Append2Buf(const char buf[], size_t len);
 #ifdef _USE_PROTOBUF_
     int Send2Buf(const google::protobuf::Message* msg);
 #endif
 
-    // 同步发送确切长度消息
+    // 流式发送：将一个分片写入buf，等待TaskSend发送。单个分片不超过 StreamLeft()
+    // 大数据按序切分（seq从0递增），最后一个分片fin=true。buf不足时返回-1，可于 TaskWritable 中续写
+    int Stream2Buf(uint32_t id, uint32_t seq, const char buf[], size_t len, bool fin = false);
+
+    // Stream2Buf的异步发送版本
+    int AsyncStream(uint32_t id, uint32_t seq, const char buf[], size_t len, bool fin = false);
+
+    // 文件片段排在当前发送缓冲数据之后，由TaskSend以sendfile直接自页缓存发送（不经发送缓冲）
+    // fd须在release回调前保持打开
+    int SendFile2Buf(int fd, off_t offset, size_t len, void (*release)(void* arg) = NULL, void* arg = NULL);
+
+    // 内存片段排在当前发送缓冲数据之后，由TaskSend直接自data发送（不拷贝至发送缓冲，如多连接共享的广播帧）
+    // data须在release回调前保持有效
+    int SendData2Buf(const char data[], size_t len, void (*release)(void* arg) = NULL, void* arg = NULL);
+
+    // 丢弃最早一个尚未开始发送的内存片段（发送队列溢出时），并回调release。无可丢弃片段返回-1
+    int DropSendData();
+
+    // 发送缓冲（含文件片段）全部写入socket后回调，可在此续写后续流分片（有界内存发送大数据）
+    // 返回-1关闭连接
+    virtual int TaskWritable() {
+        return 0;
+    }
+
+    // 为true时暂停解析后续消息（如响应积压），已接收数据保留在接收缓冲中
+    virtual bool HoldRecv() {
+        return false;
+    }
+
+    // 连接空闲超时（服务端定时检测，返回true关闭连接）。now为微秒时间戳
+    virtual bool IdleOut(uint64_t now) {
+        return false;
+    }
+
+    // worker优雅退出开始时回调（Draining()已置位），可发送协议层goaway。返回-1立即关闭连接
+    virtual int Drain() {
+        return 0;
+    }
+
+    // 优雅退出时连接可立即关闭（无进行中的请求）。默认收发缓冲为空且静默 kDrainIdleTm
+    virtual bool Idle(uint64_t now);
+
+    // 连接迁移（worker间负载均衡）：接收缓冲未解析数据、发送缓冲未发送数据、业务状态依次追加至buf
+    // 发送队列含文件（内存）片段、流接收中、正在优雅退出或 SaveState 返回-1时不可迁移，返回-1
+    int MigrateOut(std::string* buf, uint32_t* recvlen, uint32_t* sendlen, uint32_t* statelen);
+
+    // 目标worker（task已加入事件循环）写回收发缓冲、恢复业务状态，并解析已接收的完整消息。返回-1关闭连接
+    int MigrateIn(const char recv[], size_t recvlen, const char send[], size_t sendlen, const char state[], size_t statelen);
+
+    // 业务状态序列化：迁出时追加至state，返回-1本轮不迁移该连接；迁入时于目标worker新建的task上恢复
+    // 迁移的连接于源worker不回调 DisConnect，于目标worker不回调 Connect
+    // 默认返回-1（task可能持有无法迁移的业务状态），确可迁移的task重载（如 wHttpTask）
+    virtual int SaveState(std::string* state) {
+        return -1;
+    }
+
+    virtual int LoadState(const char state[], size_t len) {
+        return 0;
+    }
+
+    // 同步发送确切长度消息（同步接口固定使用4字节长度前缀分帧，codec非 wFixed32Codec 时返回-1）
     // size = -1 对端发生错误|稍后重试|对端关闭
     // size >= 0 发送字符
     int SyncSend(char cmd[], size_t len, ssize_t *size);
@@ -81,7 +182,7 @@ public:
     int AsyncSend(const google::protobuf::Message* msg);
 #endif
 
-    // 同步接受一条合法的、非心跳消息 或 接受一条指定长度合法的、非心跳消息（该消息必须为一条即将接受的消息）
+    // 同步接受一条合法的、非心跳消息（codec非 wFixed32Codec 时返回-1） 或 接受一条指定长度合法的、非心跳消息（该消息必须为一条即将接受的消息）
     // 调用者：保证此sock未加入epoll中，否则出现事件竞争；且该sock需为阻塞的fd；另外也要确保buf有足够长的空间接受自此同步消息
     // size = -1 对端发生错误|稍后重试
     // size = 0  对端关闭
@@ -118,7 +219,11 @@ public:
     static void Assertbuf(char buf[], const google::protobuf::Message* msg);
 #endif
 
-    int HeartbeatSend();
+    // 是否参与服务端心跳检测（默认TCP、UNIX连接）
+    virtual bool HeartbeatTurn();
+
+    // 发送心跳（默认空wCommand消息）
+    virtual int HeartbeatSend();
 
     inline bool HeartbeatOut() {
         return mHeartbeat > kHeartbeat;
@@ -159,8 +264,15 @@ public:
     }
 
     inline size_t SendLen() { return mSendLen;}
+    // 发送缓冲或文件片段待发送
+    inline bool SendPending() { return mSendLen > 0 || !mSendFiles.empty();}
+    inline size_t SendFileNum() { return mSendFiles.size();}
+    // 当前发送缓冲可写入的最大流分片长度
+    size_t StreamLeft();
     inline int32_t Type() { return mType;}
     inline wSocket* Socket() { return mSocket;}
+    // 所在worker正在优雅退出
+    inline bool& Draining() { return mDrain;}
     
 protected:
     // command消息路由器
@@ -177,15 +289,52 @@ protected:
     }
     wEvent<std::string, std::function<int(struct Request_t *argv)>, struct Request_t*> mEventPb;
 
+    // 流式消息路由器：各流分片按序回调，fin分片后该流结束
+    template<typename T = wTask>
+    void OnStream(int (T::*func)(struct Stream_t *argv), T* target) {
+    	mEventStream = std::bind(func, target, std::placeholders::_1);
+    }
+    std::function<int(struct Stream_t *argv)> mEventStream;
+
+    // 解析接收缓冲中已到达的完整消息
+    int HandleRecv();
+
+    // 解析流分片
+    int HandleStream(char cmd[], uint32_t len);
+
+    // 预留发送缓冲中len字节连续空间，不足返回NULL。写入后须 CommitBuf
+    char* PrepareBuf(size_t len);
+    inline void CommitBuf(size_t len) {
+    	mSendWrite += len;
+    	mSendLen += len;
+    	mSendMark += len;
+    }
+
+    // 释放全部待发送文件片段
+    void ClearSendFile();
+
+    // 同步收发自行按4字节长度前缀分帧，仅当前codec为 wFixed32Codec（未开启crc32c）时可用，否则记录错误返回false
+    bool SyncFramed();
+
+    // 预留消息体长度为len的帧空间并写入帧头，消息体写入 buf + *headlen 后须 CommitFrame
+    char* PrepareFrame(size_t len, size_t* headlen);
+    void CommitFrame(char buf[], size_t headlen, size_t len);
+
+    // 接收中的流：流id -> 期望的下一分片序号
+    std::map<uint32_t, uint32_t> mStreamSeq;
+
     int32_t mType;
     wSocket *mSocket;
+    bool mDrain;
 
     uint8_t mHeartbeat;
+    wCodec* mCodec;
 
     char mTempBuff[kPackageSize];    // 同步发送、接受消息缓冲
     char mRecvBuff[kPackageSize];    // 异步接受消息缓冲
     char mSendBuff[kPackageSize];    // 异步发送消息缓冲
     
+    // 收发缓冲均为线性缓冲（未处理数据连续存放，空间不足时移至缓冲头部）
     char *mRecvRead;
     char *mRecvWrite;
     size_t mRecvLen;  // 已接受数据长度
@@ -193,6 +342,9 @@ protected:
     char *mSendRead;
     char *mSendWrite;
     size_t mSendLen;  // 可发送数据长度
+    uint64_t mSendMark;	// 累计写入发送缓冲字节数
+    uint64_t mSendedMark;	// 累计自发送缓冲发出字节数
+    std::deque<SendFile_t> mSendFiles;
 
     wServer* mServer;
     wMultiClient* mClient;
@@ -13,7 +13,9 @@
 namespace hnet {
 
 wUnixSocket::~wUnixSocket() {
-	wEnv::Default()->DeleteFile(mHost);
+	if (!mHost.empty()) {
+		wEnv::Default()->DeleteFile(mHost);
+	}
 }
 
 int wUnixSocket::Open() {
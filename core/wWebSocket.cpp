@@ -0,0 +1,337 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include "wWebSocket.h"
+#include "wHttpTask.h"
+#include "wMisc.h"
+#include "wLogger.h"
+
+namespace hnet {
+
+namespace {
+
+const char kBase64[] = "ABCDEFGHIJKLMNOPQRSTUVWXYZabcdefghijklmnopqrstuvwxyz0123456789+/";
+
+inline uint32_t Rotl32(uint32_t x, int n) {
+	return (x << n) | (x >> (32 - n));
+}
+
+// SHA-1（RFC 3174），仅用于握手（输入为短串）
+void Sha1(const std::string& src, uint8_t digest[20]) {
+	uint32_t h[5] = {0x67452301, 0xefcdab89, 0x98badcfe, 0x10325476, 0xc3d2e1f0};
+
+	// 填充：0x80、0至56字节（模64），8字节大端位长度
+	std::string msg(src);
+	uint64_t bits = static_cast<uint64_t>(src.size()) * 8;
+	msg.push_back(static_cast<char>(0x80));
+	while (msg.size() % 64 != 56) {
+		msg.push_back(0);
+	}
+	for (int i = 7; i >= 0; i--) {
+		msg.push_back(static_cast<char>((bits >> (i * 8)) & 0xff));
+	}
+
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(msg.data());
+	for (size_t off = 0; off < msg.size(); off += 64) {
+		uint32_t w[80];
+		for (int i = 0; i < 16; i++) {
+			const uint8_t* q = p + off + i * 4;
+			w[i] = (static_cast<uint32_t>(q[0]) << 24) | (static_cast<uint32_t>(q[1]) << 16) | (static_cast<uint32_t>(q[2]) << 8) | q[3];
+		}
+		for (int i = 16; i < 80; i++) {
+			w[i] = Rotl32(w[i-3] ^ w[i-8] ^ w[i-14] ^ w[i-16], 1);
+		}
+
+		uint32_t a = h[0], b = h[1], c = h[2], d = h[3], e = h[4];
+		for (int i = 0; i < 80; i++) {
+			uint32_t f, k;
+			if (i < 20) {
+				f = (b & c) | (~b & d);
+				k = 0x5a827999;
+			} else if (i < 40) {
+				f = b ^ c ^ d;
+				k = 0x6ed9eba1;
+			} else if (i < 60) {
+				f = (b & c) | (b & d) | (c & d);
+				k = 0x8f1bbcdc;
+			} else {
+				f = b ^ c ^ d;
+				k = 0xca62c1d6;
+			}
+			uint32_t t = Rotl32(a, 5) + f + e + k + w[i];
+			e = d;
+			d = c;
+			c = Rotl32(b, 30);
+			b = a;
+			a = t;
+		}
+		h[0] += a; h[1] += b; h[2] += c; h[3] += d; h[4] += e;
+	}
+
+	for (int i = 0; i < 5; i++) {
+		digest[i*4] = static_cast<uint8_t>(h[i] >> 24);
+		digest[i*4 + 1] = static_cast<uint8_t>(h[i] >> 16);
+		digest[i*4 + 2] = static_cast<uint8_t>(h[i] >> 8);
+		digest[i*4 + 3] = static_cast<uint8_t>(h[i]);
+	}
+}
+
+}	// namespace anonymous
+
+int32_t wWsCodec::Decode(const char buf[], size_t len, size_t* off, uint32_t* size) {
+	if (len < 2) {
+		return 0;
+	}
+
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	bool fin = (p[0] & 0x80) != 0;
+	uint8_t opcode = p[0] & 0x0f;
+	if ((p[0] & 0x70) != 0 || (p[1] & 0x80) == 0) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWsCodec::Decode () failed", "reserved bits set or frame unmasked");
+		return -1;
+	} else if ((opcode > kWsBinary && opcode < kWsClose) || opcode > kWsPong) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWsCodec::Decode () failed", "unknown opcode");
+		return -1;
+	}
+
+	uint64_t paylen = p[1] & 0x7f;
+	size_t headlen = 2;
+	if (opcode >= kWsClose && (!fin || paylen > kWsMaxControl)) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWsCodec::Decode () failed", "control frame fragmented or too large");
+		return -1;
+	} else if (paylen == 126) {
+		if (len < 4) {
+			return 0;
+		}
+		paylen = (static_cast<uint64_t>(p[2]) << 8) | p[3];
+		headlen = 4;
+	} else if (paylen == 127) {
+		if (len < 10) {
+			return 0;
+		}
+		paylen = 0;
+		for (int i = 2; i < 10; i++) {
+			paylen = (paylen << 8) | p[i];
+		}
+		headlen = 10;
+	}
+	if (paylen > MaxLen()) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWsCodec::Decode () failed", "frame too large");
+		return -1;
+	}
+
+	headlen += sizeof(uint32_t);
+	if (len < headlen + paylen) {
+		return 0;
+	}
+	mFin = fin;
+	mOpcode = opcode;
+	memcpy(&mKey, buf + headlen - sizeof(uint32_t), sizeof(uint32_t));
+	*off = headlen;
+	*size = static_cast<uint32_t>(paylen);
+	return static_cast<int32_t>(headlen + paylen);
+}
+
+size_t wWsCodec::HeadLen(size_t len) {
+	return ws::HeadLen(len);
+}
+
+void wWsCodec::EncodeHead(char buf[], size_t len) {
+	// 按Codec分帧写出的消息为二进制帧
+	ws::EncodeHead(buf, kWsBinary, true, len);
+}
+
+void wWsHub::Subscribe(const std::string& topic, wHttpTask* task) {
+	mTopics[topic].insert(task);
+}
+
+void wWsHub::Unsubscribe(const std::string& topic, wHttpTask* task) {
+	std::unordered_map<std::string, std::unordered_set<wHttpTask*> >::iterator it = mTopics.find(topic);
+	if (it != mTopics.end()) {
+		it->second.erase(task);
+		if (it->second.empty()) {
+			mTopics.erase(it);
+		}
+	}
+}
+
+size_t wWsHub::Broadcast(const std::string& topic, const wSlice& data, uint8_t opcode) {
+	std::unordered_map<std::string, std::unordered_set<wHttpTask*> >::iterator it = mTopics.find(topic);
+	if (it == mTopics.end()) {
+		return 0;
+	}
+
+	size_t num = 0;
+	char head[kWsMaxHead];
+	size_t headlen = ws::EncodeHead(head, opcode, true, data.size());
+	if (headlen + data.size() <= kWsShareLen) {
+		// 小帧：拷贝至各连接发送缓冲，与其他响应合并发送
+		char frame[kWsShareLen];
+		memcpy(frame, head, headlen);
+		memcpy(frame + headlen, data.data(), data.size());
+		for (std::unordered_set<wHttpTask*>::iterator t = it->second.begin(); t != it->second.end(); t++) {
+			if ((*t)->WsPush(frame, headlen + data.size(), NULL) == 0) {
+				num++;
+			}
+		}
+		return num;
+	}
+
+	// 大帧：全部连接引用同一份帧数据，最后一个连接发送完毕后释放
+	Frame_t* frame;
+	HNET_NEW(Frame_t(), frame);
+	if (frame == NULL) {
+		HNET_ERROR(soft::GetLogPath(), "%s : %s", "wWsHub::Broadcast new() failed", error::Strerror(errno).c_str());
+		return 0;
+	}
+	frame->mData.reserve(headlen + data.size());
+	frame->mData.append(head, headlen);
+	frame->mData.append(data.data(), data.size());
+	for (std::unordered_set<wHttpTask*>::iterator t = it->second.begin(); t != it->second.end(); t++) {
+		if ((*t)->WsPush(frame->mData.data(), frame->mData.size(), frame) == 0) {
+			num++;
+		}
+	}
+	ReleaseFrame(frame);
+	return num;
+}
+
+void wWsHub::ReleaseFrame(void* arg) {
+	Frame_t* frame = reinterpret_cast<Frame_t*>(arg);
+	if (--frame->mRef == 0) {
+		HNET_DELETE(frame);
+	}
+}
+
+static pthread_once_t hnet_wshub_once = PTHREAD_ONCE_INIT;
+static wWsHub* hnet_defaultWsHub;
+static void InitDefaultWsHub() {
+    HNET_NEW(wWsHub(), hnet_defaultWsHub);
+}
+
+wWsHub* wWsHub::Default() {
+	pthread_once(&hnet_wshub_once, InitDefaultWsHub);
+	return hnet_defaultWsHub;
+}
+
+namespace ws {
+
+void Mask(char buf[], size_t len, uint32_t key) {
+	// 掩码键按字节序复制为8字节字，8字节对齐的位置上掩码相位不变
+	uint64_t key8;
+	memcpy(&key8, &key, sizeof(key));
+	memcpy(reinterpret_cast<char*>(&key8) + sizeof(key), &key, sizeof(key));
+
+	size_t i = 0;
+	for (; i + sizeof(key8) <= len; i += sizeof(key8)) {
+		uint64_t v;
+		memcpy(&v, buf + i, sizeof(v));
+		v ^= key8;
+		memcpy(buf + i, &v, sizeof(v));
+	}
+	const char* k = reinterpret_cast<const char*>(&key);
+	for (; i < len; i++) {
+		buf[i] ^= k[i & 3];
+	}
+}
+
+size_t HeadLen(size_t len) {
+	return len < 126 ? 2 : (len <= 0xffff ? 4 : 10);
+}
+
+size_t EncodeHead(char buf[], uint8_t opcode, bool fin, size_t len) {
+	buf[0] = static_cast<char>((fin ? 0x80 : 0) | (opcode & 0x0f));
+	if (len < 126) {
+		buf[1] = static_cast<char>(len);
+		return 2;
+	} else if (len <= 0xffff) {
+		buf[1] = 126;
+		buf[2] = static_cast<char>((len >> 8) & 0xff);
+		buf[3] = static_cast<char>(len & 0xff);
+		return 4;
+	}
+	buf[1] = 127;
+	uint64_t v = static_cast<uint64_t>(len);
+	for (int i = 9; i >= 2; i--, v >>= 8) {
+		buf[i] = static_cast<char>(v & 0xff);
+	}
+	return 10;
+}
+
+bool ValidUtf8(const char buf[], size_t len) {
+	const uint8_t* p = reinterpret_cast<const uint8_t*>(buf);
+	const uint8_t* e = p + len;
+	while (p < e) {
+		uint64_t v;
+		if (e - p >= static_cast<ptrdiff_t>(sizeof(v))) {
+			memcpy(&v, p, sizeof(v));
+			if ((v & 0x8080808080808080ULL) == 0) {
+				p += sizeof(v);
+				continue;
+			}
+		}
+		if (*p < 0x80) {
+			p++;
+			continue;
+		}
+
+		// 多字节序列：首字节确定续字节数及最小码点
+		size_t n;
+		uint32_t cp, min;
+		if ((*p & 0xe0) == 0xc0) {
+			n = 1; cp = *p & 0x1f; min = 0x80;
+		} else if ((*p & 0xf0) == 0xe0) {
+			n = 2; cp = *p & 0x0f; min = 0x800;
+		} else if ((*p & 0xf8) == 0xf0) {
+			n = 3; cp = *p & 0x07; min = 0x10000;
+		} else {
+			return false;
+		}
+		if (static_cast<size_t>(e - p) <= n) {
+			return false;
+		}
+		for (size_t i = 1; i <= n; i++) {
+			if ((p[i] & 0xc0) != 0x80) {
+				return false;
+			}
+			cp = (cp << 6) | (p[i] & 0x3f);
+		}
+		if (cp < min || cp > 0x10ffff || (cp >= 0xd800 && cp <= 0xdfff)) {
+			return false;
+		}
+		p += n + 1;
+	}
+	return true;
+}
+
+bool ValidCloseCode(uint16_t code) {
+	return (code >= 1000 && code <= 1003) || (code >= 1007 && code <= 1014) || (code >= 3000 && code <= 4999);
+}
+
+std::string AcceptKey(const wSlice& key) {
+	uint8_t digest[20];
+	Sha1(key.ToString() + kWsGuid, digest);
+
+	std::string dst;
+	for (size_t i = 0; i < sizeof(digest); i += 3) {
+		uint32_t v = static_cast<uint32_t>(digest[i]) << 16;
+		if (i + 1 < sizeof(digest)) {
+			v |= static_cast<uint32_t>(digest[i + 1]) << 8;
+		}
+		if (i + 2 < sizeof(digest)) {
+			v |= digest[i + 2];
+		}
+		dst.push_back(kBase64[(v >> 18) & 0x3f]);
+		dst.push_back(kBase64[(v >> 12) & 0x3f]);
+		dst.push_back(i + 1 < sizeof(digest) ? kBase64[(v >> 6) & 0x3f] : '=');
+		dst.push_back(i + 2 < sizeof(digest) ? kBase64[v & 0x3f] : '=');
+	}
+	return dst;
+}
+
+}	// namespace ws
+
+}	// namespace hnet
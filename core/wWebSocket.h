@@ -0,0 +1,147 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#ifndef _W_WEB_SOCKET_H_
+#define _W_WEB_SOCKET_H_
+
+#include <vector>
+#include <unordered_map>
+#include <unordered_set>
+#include "wCore.h"
+#include "wSlice.h"
+#include "wNoncopyable.h"
+#include "wCodec.h"
+
+namespace hnet {
+
+// 握手Sec-WebSocket-Accept计算用GUID
+const char		kWsGuid[]		= "258EAFA5-E914-47DA-95CA-C5AB0DC85B11";
+
+const size_t	kWsMaxHead		= 14;		// 最大帧头长度（含掩码键）
+const size_t	kWsMaxControl	= 125;		// 控制帧最大载荷
+const size_t	kWsShareLen		= 4096;		// 广播帧超过此长度时各连接共享同一份帧数据，否则拷贝至各连接发送缓冲
+const size_t	kWsMaxQueue		= 64;		// 单连接待发送共享帧上限（超出视为积压，广播跳过该连接）
+
+// 帧类型
+enum {
+	kWsCont = 0, kWsText = 1, kWsBinary = 2, kWsClose = 8, kWsPing = 9, kWsPong = 10
+};
+
+// 关闭状态码
+enum {
+	kWsCloseNormal = 1000, kWsCloseGoingAway = 1001, kWsCloseProtocol = 1002, kWsCloseUnsupported = 1003,
+	kWsCloseInvalid = 1007, kWsClosePolicy = 1008, kWsCloseTooBig = 1009
+};
+
+// WebSocket帧分帧（RFC 6455，服务端：客户端帧须带掩码）
+// 消息体为帧载荷（帧头由 Decode 剥离），帧头字段保存至最近一次Decode结果，供Handlemsg读取
+// 保留位非0、未掩码、控制帧分片或载荷超过125字节、载荷超过MaxLen均为非法帧
+class wWsCodec : public wCodec {
+public:
+    wWsCodec() : mFin(false), mOpcode(0), mKey(0) { }
+
+    virtual int32_t Decode(const char buf[], size_t len, size_t* off, uint32_t* size);
+
+    // 服务端发送帧不掩码
+    virtual size_t HeadLen(size_t len);
+
+    virtual void EncodeHead(char buf[], size_t len);
+
+    virtual size_t MinLen() {
+        return 0;
+    }
+    virtual size_t MaxLen() {
+        return kPackageSize - kWsMaxHead;
+    }
+
+    virtual const char* Name() {
+        return "websocket";
+    }
+
+    inline bool Fin() { return mFin;}
+    inline uint8_t Opcode() { return mOpcode;}
+    // 掩码键（按接收字节序存放）
+    inline uint32_t Key() { return mKey;}
+
+protected:
+    bool mFin;
+    uint8_t mOpcode;
+    uint32_t mKey;
+};
+
+// 连接状态
+struct WsConn_t {
+    bool mOpen;	// 已发送101响应（握手完成前为false）
+    std::string mAccept;	// Sec-WebSocket-Accept
+    uint8_t mOpcode;	// 分片消息类型（无分片消息为kWsCont）
+    std::string mMsg;	// 分片消息重组缓冲
+    bool mClosing;	// 已发送关闭帧
+    std::vector<std::string> mTopics;	// 已订阅主题
+
+    WsConn_t() : mOpen(false), mOpcode(kWsCont), mClosing(false) { }
+};
+
+class wHttpTask;
+
+// 主题广播：帧只编码一次，由全部订阅连接共享
+// 小帧（不超过kWsShareLen）拷贝至各连接发送缓冲；大帧以引用计数共享，经 wTask::SendData2Buf 零拷贝发送
+// 发送积压的连接跳过本条消息（慢连接不拖累广播、不无限占用内存）
+// 非线程安全，每进程一个实例（Default），仅广播本进程（worker）内连接
+class wWsHub : private wNoncopyable {
+public:
+    // 共享帧
+    struct Frame_t {
+        int32_t mRef;
+        std::string mData;
+        Frame_t() : mRef(1) { }
+    };
+
+    // 订阅、退订由 wHttpTask::WsSubscribe、WsUnsubscribe 调用
+    void Subscribe(const std::string& topic, wHttpTask* task);
+    void Unsubscribe(const std::string& topic, wHttpTask* task);
+
+    // 向topic全部订阅连接发送一条消息，返回送达（写入发送队列）的连接数
+    size_t Broadcast(const std::string& topic, const wSlice& data, uint8_t opcode = kWsText);
+
+    inline size_t Subscribers(const std::string& topic) {
+        std::unordered_map<std::string, std::unordered_set<wHttpTask*> >::iterator it = mTopics.find(topic);
+        return it != mTopics.end() ? it->second.size() : 0;
+    }
+
+    // wTask::SendData2Buf 释放回调
+    static void ReleaseFrame(void* arg);
+
+    static wWsHub* Default();
+
+protected:
+    std::unordered_map<std::string, std::unordered_set<wHttpTask*> > mTopics;
+};
+
+namespace ws {
+
+// 以4字节掩码键（按接收字节序）掩码|去掩码buf（原地）。按8字节字宽异或，尾部逐字节
+void Mask(char buf[], size_t len, uint32_t key);
+
+// 服务端帧头长度（不掩码）
+size_t HeadLen(size_t len);
+
+// 写入帧头，返回帧头长度
+size_t EncodeHead(char buf[], uint8_t opcode, bool fin, size_t len);
+
+// 是否为合法UTF-8（RFC 3629：拒绝超长编码、代理码点及超出U+10FFFF）。ASCII段按8字节字宽跳过
+bool ValidUtf8(const char buf[], size_t len);
+
+// 关闭帧中对端可发送的状态码（1005、1006、1015及1000以下等保留值非法）
+bool ValidCloseCode(uint16_t code);
+
+// Sec-WebSocket-Key对应的Sec-WebSocket-Accept（base64(sha1(key + GUID))）
+std::string AcceptKey(const wSlice& key);
+
+}	// namespace ws
+
+}	// namespace hnet
+
+#endif
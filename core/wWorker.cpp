@@ -4,6 +4,7 @@
  * Copyright (C) Hupu, Inc.
  */
 
+#include <sys/syscall.h>
 #include "wWorker.h"
 #include "wMisc.h"
 #include "wLogger.h"
@@ -15,8 +16,11 @@
 
 namespace hnet {
 
+// set_mempolicy(2) 策略（linux/mempolicy.h），无需依赖libnuma
+const int kMpolPreferred = 1;
+
 wWorker::wWorker(std::string title, uint32_t slot, wMaster* master) : mMaster(master), mTitle(title), mPid(-1), mPriority(0), mRlimitCore(kRlimitCore), 
-mDetached(0), mExited(0), mExiting(0), mStat(0), mRespawn(1), mJustSpawn(0), mTimeline(soft::TimeUnix()), mSlot(slot), mChannel(NULL) { }
+mCpu(-1), mNode(-1), mDetached(0), mExited(0), mExiting(0), mStat(0), mRespawn(1), mJustSpawn(0), mTimeline(soft::TimeUnix()), mQuitTm(0), mDrainConn(-1), mSlot(slot), mChannel(NULL) { }
 
 wWorker::~wWorker() { }
 
@@ -41,6 +45,24 @@ int wWorker::PrepareStart() {
         }
     }
 	
+    // 绑定CPU：避免进程迁移导致缓存失效。失败（如CPU已下线）不影响启动
+    if (mCpu >= 0) {
+        cpu_set_t set;
+        CPU_ZERO(&set);
+        CPU_SET(mCpu, &set);
+        if (sched_setaffinity(0, sizeof(set), &set) == -1) {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s[cpu=%d]", "wWorker::PrepareStart sched_setaffinity() failed", error::Strerror(errno).c_str(), mCpu);
+        }
+    }
+
+    // NUMA节点本地内存：优先自所在节点分配，节点内存不足时退回其他节点
+    if (mNode >= 0 && mNode < static_cast<int>(sizeof(unsigned long) * 8)) {
+        unsigned long mask = 1UL << mNode;
+        if (syscall(SYS_set_mempolicy, kMpolPreferred, &mask, sizeof(mask) * 8) == -1) {
+            HNET_ERROR(soft::GetLogPath(), "%s : %s[node=%d]", "wWorker::PrepareStart set_mempolicy() failed", error::Strerror(errno).c_str(), mNode);
+        }
+    }
+
     // 每个worker进程，只保留自身worker进程的channel[1]与其他所有worker进程的channel[0]描述符
     for (uint32_t n = 0; n < kMaxProcess; n++) {
     	// 将其他进程的channel[1]关闭，自己的除外
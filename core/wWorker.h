@@ -42,12 +42,15 @@ public:
 	inline std::string& Title() { return mTitle;}
 	inline pid_t& Pid() { return mPid;}
 	inline int& Priority() { return mPriority;}
+	inline int& Cpu() { return mCpu;}
+	inline int& Node() { return mNode;}
 	inline int& Respawn() { return mRespawn;}
 	inline int& Detached() { return mDetached;}
 	inline int& Exited() { return mExited;}
 	inline int& Exiting() { return mExiting;}
 	inline int& Stat() { return mStat;}
 	inline uint32_t& Timeline() { return mTimeline;}
+	inline int32_t& DrainConn() { return mDrainConn;}
 	inline uint32_t& Slot() { return mSlot;}
 
 	inline wChannelSocket* Channel() { return mChannel;}
@@ -71,6 +74,8 @@ protected:
 	pid_t mPid;
 	int mPriority;	// 进程优先级
 	int mRlimitCore;// 连接限制
+	int mCpu;		// 绑定CPU（-1不绑定）
+	int mNode;		// NUMA节点，优先自该节点分配内存（-1不设置）
 
 	int mDetached;	// 是否已分离
 	int mExited;	// 已退出 进程表mWorkerPool已回收
@@ -80,6 +85,9 @@ protected:
 	int mJustSpawn;
 	uint32_t mTimeline;
 
+	uint64_t mQuitTm;	// master发送优雅退出信号时间 微妙（0未退出）
+	int32_t mDrainConn;	// 汇报的剩余连接数（-1未汇报）
+
 	uint32_t mSlot;	// 进程表中索引
 	wChannelSocket* mChannel;	// worker进程channel
 };
@@ -75,8 +75,12 @@ int main(int argc, char *argv[]) {
 	// 开始微妙时间
 	int64_t start_usec = misc::GetTimeofday();
 
-	const int worker = 10;
+	// 并发进程数（-n），对比服务端不同worker绑定策略（-a）下吞吐
+	int worker = 10;
 	const int request = 5000;
+	if (config->GetConf("worker", &worker) == false || worker <= 0) {
+		worker = 10;
+	}
 
 	// 创建进程
 	std::vector<pid_t> process(worker);
@@ -109,12 +113,12 @@ int main(int argc, char *argv[]) {
 		}
 	}
 
-	int64_t total_usec = (misc::GetTimeofday() - start_usec)/1000000;
+	int64_t total_usec = misc::GetTimeofday() - start_usec;
 
 	std::cout << "[error]	:	" << error << std::endl;
 	std::cout << "[success]	:	" << request*worker - error << std::endl;
-	std::cout << "[second]	:	" << total_usec << "s" << std::endl;
-	std::cout << "[qps]		:	" << request*worker/total_usec << "req/s" << std::endl;
+	std::cout << "[second]	:	" << total_usec/1000000.0 << "s" << std::endl;
+	std::cout << "[qps]		:	" << static_cast<int64_t>(request*worker*1000000.0/(total_usec > 0 ? total_usec : 1)) << "req/s" << std::endl;
 	return 0;
 }
 
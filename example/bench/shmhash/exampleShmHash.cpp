@@ -0,0 +1,182 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <vector>
+#include <algorithm>
+#include <sys/wait.h>
+#include "wCore.h"
+#include "wConfig.h"
+#include "wMisc.h"
+#include "wEnv.h"
+#include "wShmHash.h"
+
+using namespace hnet;
+
+// wShmHash多进程争用压测：fork出的进程在同一共享哈希表上随机读写同一组键
+// 值自带校验和，读到撕裂（读写交错）的值计为错误
+
+// 值（POD），sum为其余字段校验和
+struct SessionVal_t {
+	uint64_t mId;
+	uint64_t mVer;
+	uint64_t mData[20];
+	uint64_t mSum;
+};
+
+// 键数、每进程操作数、写操作百分比
+const uint32_t	kBenchKeys = 10000;
+const int		kBenchOps = 200000;
+const int		kBenchWrite = 20;
+
+pid_t SpawnProcess(wShmHash* hash, int i);
+void Handle(wShmHash* hash, int i);
+
+int main(int argc, char *argv[]) {
+	// 设置运行目录
+	if (misc::SetBinPath() == -1) {
+		std::cout << "set bin path failed" << std::endl;
+		return -1;
+	}
+
+	// 创建配置对象
+	wConfig* config;
+	HNET_NEW(wConfig, config);
+	if (!config) {
+		std::cout << "config new failed" << std::endl;
+		return -1;
+	}
+
+	// 解析命令行
+	if (config->GetOption(argc, argv) == -1) {
+		std::cout << "get configure failed" << std::endl;
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 并发进程数（-n）
+	int worker = 32;
+	if (config->GetConf("worker", &worker) == false || worker <= 0) {
+		worker = 32;
+	}
+
+	// fork前创建共享哈希表，子进程继承映射
+	soft::TimeUpdate();
+	wShmHash* hash;
+	HNET_NEW(wShmHash(wEnv::Default(), kBenchKeys * 2, sizeof(SessionVal_t)), hash);
+	if (!hash || hash->Create() == -1) {
+		std::cout << "shm hash create failed" << std::endl;
+		HNET_DELETE(hash);
+		HNET_DELETE(config);
+		return -1;
+	}
+
+	// 开始微妙时间
+	int64_t start_usec = misc::GetTimeofday();
+
+	// 创建进程
+	std::vector<pid_t> process(worker);
+	for (int i = 0; i < worker; i++) {
+		pid_t pid = SpawnProcess(hash, i);
+		if (pid > 0) {
+			process[i] = pid;
+		}
+	}
+
+	int error = 0;
+
+	// 回收进程
+	int status;
+	while (!process.empty()) {
+		pid_t pid = wait(&status);
+		if (pid == -1) {
+			break;
+		}
+
+		// 是否有撕裂读
+		if (WIFEXITED(status) != 0) {
+			if (WEXITSTATUS(status) > 0) {
+				error += WEXITSTATUS(status);
+			}
+		}
+
+		std::vector<pid_t>::iterator it = std::find(process.begin(), process.end(), pid);
+		if (it != process.end()) {
+			process.erase(it);
+		}
+	}
+
+	int64_t total_usec = misc::GetTimeofday() - start_usec;
+
+	std::cout << "[process]	:	" << worker << std::endl;
+	std::cout << "[error]	:	" << error << std::endl;
+	std::cout << "[second]	:	" << total_usec/1000000.0 << "s" << std::endl;
+	std::cout << "[ops]		:	" << static_cast<int64_t>(static_cast<double>(kBenchOps)*worker*1000000.0/(total_usec > 0 ? total_usec : 1)) << "op/s" << std::endl;
+
+	HNET_DELETE(hash);
+	HNET_DELETE(config);
+	return 0;
+}
+
+pid_t SpawnProcess(wShmHash* hash, int i) {
+	pid_t pid = fork();
+
+	switch (pid) {
+	case -1:
+		exit(0);
+		break;
+
+	case 0:
+		Handle(hash, i);
+		break;
+	}
+	return pid;
+}
+
+void Handle(wShmHash* hash, int i) {
+	int64_t start_usec = misc::GetTimeofday();
+
+	uint64_t seed = static_cast<uint64_t>(i) * 7919 + 1;
+	int64_t hit = 0, miss = 0, fail = 0, bad = 0;
+	for (int n = 0; n < kBenchOps; n++) {
+		seed = seed * 6364136223846793005ULL + 1442695040888963407ULL;
+		uint64_t id = (seed >> 33) % kBenchKeys;
+
+		char key[32];
+		int len = snprintf(key, sizeof(key), "sess:%u", static_cast<uint32_t>(id));
+		if (static_cast<int>((seed >> 20) % 100) < kBenchWrite) {
+			SessionVal_t val;
+			val.mId = id;
+			val.mVer = n;
+			val.mSum = id ^ val.mVer;
+			for (int j = 0; j < 20; j++) {
+				val.mData[j] = id * j + val.mVer;
+				val.mSum += val.mData[j];
+			}
+			if (hash->Store(wSlice(key, len), val) == -1) {
+				fail++;
+			}
+		} else {
+			SessionVal_t val;
+			if (hash->Load(wSlice(key, len), &val) == -1) {
+				miss++;
+				continue;
+			}
+			hit++;
+			uint64_t sum = val.mId ^ val.mVer;
+			for (int j = 0; j < 20; j++) {
+				sum += val.mData[j];
+			}
+			if (sum != val.mSum || val.mId != id) {
+				bad++;
+			}
+		}
+	}
+
+	int64_t total_usec = misc::GetTimeofday() - start_usec;
+	std::cout << getpid() << "|" << "[hit]	: " << hit << " [miss]	: " << miss << " [putfail]	: " << fail << " [error]	: " << bad << " [second]	: " << total_usec << "us" << std::endl;
+
+	exit(bad > 0 ? 1 : 0);
+}
@@ -0,0 +1,126 @@
+
+/**
+ * Copyright (C) Anny Wang.
+ * Copyright (C) Hupu, Inc.
+ */
+
+#include <map>
+#include <vector>
+#include <new>
+#include "wCore.h"
+#include "wMisc.h"
+#include "wHttpParser.h"
+
+using namespace hnet;
+
+// HTTP请求解析微基准：wHttpParser 对比 原 Strpos + SplitString + map 解析方式
+// 每轮请求分 kPieces 次到达（模拟部分读），统计耗时及堆内存分配次数
+
+static uint64_t hnet_alloc = 0;
+
+void* operator new(size_t n) {
+	hnet_alloc++;
+	void* p = malloc(n);
+	if (!p) {
+		throw std::bad_alloc();
+	}
+	return p;
+}
+
+void operator delete(void* p) noexcept {
+	free(p);
+}
+
+static const char kRequest[] = "GET /index?cmd=50&para=0&uid=10086&token=abcdefg HTTP/1.1\r\n"
+	"Host: 127.0.0.1:10025\r\n"
+	"User-Agent: Mozilla/5.0 (X11; Linux x86_64) AppleWebKit/537.36 (KHTML, like Gecko) Chrome/60.0 Safari/537.36\r\n"
+	"Accept: text/html,application/xhtml+xml,application/xml;q=0.9,*/*;q=0.8\r\n"
+	"Accept-Encoding: gzip, deflate\r\n"
+	"Accept-Language: zh-CN,zh;q=0.8\r\n"
+	"Cookie: session=0123456789abcdef; lang=zh\r\n"
+	"Connection: keep-alive\r\n"
+	"\r\n";
+
+static const int kPieces = 3;
+
+// 原实现：每次读取后从头查找请求结束，完整后切分为map
+int OldFrame(const char* buf, size_t len) {
+	if (misc::Strcmp(std::string(buf, 0, 3), "GET", 3) != 0) {
+		return -1;
+	}
+	int32_t pos = misc::Strpos(std::string(buf, 0, len), "\r\n\r\n");
+	return pos == -1 ? 0 : pos + 4;
+}
+
+void OldParse(const char* buf, size_t len, std::map<std::string, std::string>& req, std::map<std::string, std::string>& get) {
+	std::vector<std::string> lines = misc::SplitString(std::string(buf, 0, len), "\r\n");
+	if (lines.empty()) {
+		return;
+	}
+	std::vector<std::string> line = misc::SplitString(lines.front(), " ");
+	if (line.size() == 3) {
+		req.insert(std::make_pair("Method", line[0]));
+		req.insert(std::make_pair("Url", line[1]));
+		req.insert(std::make_pair("Schema", line[2]));
+		std::vector<std::string> line1 = misc::SplitString(line[1], "?");
+		req.insert(std::make_pair("PathInfo", line1[0]));
+		if (line1.size() > 1) {
+			req.insert(std::make_pair("QueryString", "?" + line1.back()));
+			std::vector<std::string> kv = misc::SplitString(line1.back(), "&");
+			for (size_t i = 0; i < kv.size(); i++) {
+				std::vector<std::string> v = misc::SplitString(kv[i], "=");
+				get[v[0]] = v.size() > 1 ? v[1] : "";
+			}
+		}
+	}
+	for (size_t i = 1; i < lines.size(); i++) {
+		std::vector<std::string> header = misc::SplitString(lines[i], ": ");
+		if (header.size() == 2) {
+			req.insert(std::make_pair(header[0], header[1]));
+		}
+	}
+}
+
+int main(int argc, char *argv[]) {
+	const size_t len = sizeof(kRequest) - 1;
+	const int n = argc > 1 ? atoi(argv[1]) : 200000;
+	size_t cut[kPieces + 1] = {0, len/3, len*2/3, len};
+	uint64_t sum = 0;
+
+	// 原实现
+	uint64_t alloc = hnet_alloc;
+	int64_t tm = soft::TimeUpdate();
+	for (int i = 0; i < n; i++) {
+		int ret = 0;
+		for (int p = 1; p <= kPieces && ret == 0; p++) {
+			ret = OldFrame(kRequest, cut[p]);
+		}
+		std::map<std::string, std::string> req, get;
+		OldParse(kRequest, ret, req, get);
+		sum += atoi(get["cmd"].c_str()) + req["Host"].size();
+	}
+	int64_t oldtm = soft::TimeUpdate() - tm;
+	uint64_t oldalloc = hnet_alloc - alloc;
+
+	// wHttpParser
+	wHttpParser parser;
+	alloc = hnet_alloc;
+	tm = soft::TimeUpdate();
+	for (int i = 0; i < n; i++) {
+		int32_t ret = 0;
+		for (int p = 1; p <= kPieces && ret == 0; p++) {
+			ret = parser.Parse(kRequest, cut[p]);
+		}
+		wSlice cmd, host;
+		wHttpParser::FindParam(parser.Query(), "cmd", &cmd);
+		parser.Header("Host", &host);
+		sum += atoi(cmd.data()) + host.size();
+	}
+	int64_t newtm = soft::TimeUpdate() - tm;
+	uint64_t newalloc = hnet_alloc - alloc;
+
+	std::cout << "requests: " << n << ", pieces: " << kPieces << ", bytes: " << len << " (" << sum << ")" << std::endl;
+	std::cout << "split+map:   " << oldtm*1000/n << " ns/req, " << static_cast<double>(oldalloc)/n << " allocs/req" << std::endl;
+	std::cout << "wHttpParser: " << newtm*1000/n << " ns/req, " << static_cast<double>(newalloc)/n << " allocs/req" << std::endl;
+	return 0;
+}